@@ -0,0 +1,21 @@
+#ifndef ADV_TIERS_H__
+#define ADV_TIERS_H__
+
+/**
+ * @brief Advertising tiers of the light
+ *
+ * @details High duty directed advertising to the central that disconnected last, then fast and
+ *          slow undirected advertising. advertising_init() configures ble_advertising with these
+ *          values and the host reconnect latency bench models the same tiers, so both follow a
+ *          change here. Plain constants, the header is included without the SDK.
+ */
+
+#define ADV_DIRECTED_DURATION_MS 1280 // High duty directed advertising, BLE_GAP_ADV_TIMEOUT_HIGH_DUTY_MAX of the SoftDevice
+#define ADV_DIRECTED_PERIOD_US 3750   // Longest high duty advertising interval of the Core specification
+
+#define APP_ADV_INTERVAL 300       // Fast advertising interval in units of 0.625 ms (187.5 ms)
+#define APP_ADV_DURATION 18000     // Fast advertising duration in units of 10 ms (180 s)
+#define APP_ADV_SLOW_INTERVAL 1636 // Slow advertising interval once fast advertising timed out (1022.5 ms)
+#define APP_ADV_SLOW_DURATION 0    // Slow advertising does not time out, the light stays lit and reachable
+
+#endif // ADV_TIERS_H__
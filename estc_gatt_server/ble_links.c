@@ -0,0 +1,176 @@
+#include "ble_links.h"
+
+#include <stddef.h>
+#include "nrf_log.h"
+#include "estc_log.h"
+#include "estc_perf.h"
+#include "flash_storage.h"
+#include "conn_activity.h"
+#include "hal_ble.h"
+#include "hal_timer.h"
+
+static ble_link_ctx_t m_links[BLE_LINKS_COUNT];
+
+static ble_links_state_handler_t m_state_handler;
+
+void ble_links_init(ble_links_state_handler_t state_handler)
+{
+    m_state_handler = state_handler;
+
+    for (uint8_t i = 0; i < BLE_LINKS_COUNT; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+}
+
+/**
+ * @brief Find a context, BLE_CONN_HANDLE_INVALID finds a free one
+ */
+static ble_link_ctx_t *link_find(uint16_t conn_handle)
+{
+    for (uint8_t i = 0; i < BLE_LINKS_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+ble_link_ctx_t *ble_links_get(uint16_t conn_handle)
+{
+    // Group commands reach the batch handler without a link, with BLE_CONN_HANDLE_INVALID
+    return conn_handle != BLE_CONN_HANDLE_INVALID ? link_find(conn_handle) : NULL;
+}
+
+ble_link_ctx_t *ble_links_at(uint8_t index)
+{
+    return &m_links[index];
+}
+
+uint8_t ble_links_index(ble_link_ctx_t const *p_link)
+{
+    return (uint8_t)(p_link - m_links);
+}
+
+ble_link_ctx_t *ble_links_connected(uint16_t conn_handle, ble_gap_addr_t const *p_peer_addr)
+{
+    ble_link_ctx_t *p_link = link_find(BLE_CONN_HANDLE_INVALID);
+    if (p_link == NULL || conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return NULL;
+    }
+
+    p_link->conn_handle = conn_handle;
+    p_link->tx_phy = BLE_GAP_PHY_1MBPS;
+    p_link->rx_phy = BLE_GAP_PHY_1MBPS;
+    p_link->peer_addr = *p_peer_addr;
+    p_link->peer_id = PM_PEER_ID_INVALID;
+    p_link->connected_at = hal_timer_stamp_get();
+    p_link->event_length = NRF_SDH_BLE_GAP_EVENT_LENGTH;
+    p_link->first_write_pending = true;
+
+    conn_activity_connected(conn_handle);
+
+    return p_link;
+}
+
+void ble_links_disconnected(uint16_t conn_handle)
+{
+    ble_link_ctx_t *p_link = ble_links_get(conn_handle);
+    if (p_link != NULL)
+    {
+        p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+        conn_activity_disconnected(conn_handle);
+    }
+}
+
+/**
+ * @brief Record a write on a link and switch it to the fast connection parameters
+ */
+static void link_activity(uint16_t conn_handle)
+{
+    ble_link_ctx_t *p_link = ble_links_get(conn_handle);
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    if (p_link->first_write_pending)
+    {
+        // A bonded client with a cached attribute table writes without service discovery
+        p_link->first_write_pending = false;
+        NRF_LOG_INFO("First control write on conn_handle %d, %d ms after connecting (%s)", p_link->conn_handle,
+                     hal_timer_elapsed_ms(p_link->connected_at),
+                     p_link->peer_id != PM_PEER_ID_INVALID ? "bonded" : "not bonded");
+    }
+
+    conn_activity_write(conn_handle);
+}
+
+static void estc_notify(ble_estc_service_t *p_lbs, estc_char_id_t char_id, uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    if (hal_ble_notify(conn_handle, p_lbs->char_handles[char_id].value_handle, p_data, len) == NRF_SUCCESS)
+    {
+        ESTC_PERF_COUNT(ESTC_PERF_CNT_NOTIFICATIONS);
+    }
+}
+
+void ble_links_notify_all(ble_estc_service_t *p_lbs, estc_char_id_t char_id, uint8_t const *p_data, uint16_t len)
+{
+    for (uint8_t i = 0; i < BLE_LINKS_COUNT; i++)
+    {
+        uint16_t conn_handle = m_links[i].conn_handle;
+
+        if (conn_handle != BLE_CONN_HANDLE_INVALID &&
+            hal_ble_notification_enabled(conn_handle, p_lbs->char_handles[char_id].cccd_handle))
+        {
+            estc_notify(p_lbs, char_id, conn_handle, p_data, len);
+        }
+    }
+}
+
+void ble_links_batch_handler(uint16_t conn_handle, ble_estc_service_t *p_lbs, estc_cmd_batch_t const *p_batch)
+{
+    ESTC_PERF_START(start);
+
+    link_activity(conn_handle);
+
+    ESTC_LOG(ESTC_LOG_WRITE, p_batch->flags, p_batch->state,
+             p_batch->color.red, p_batch->color.green, p_batch->color.blue);
+
+    // The batch was pushed to the render ring when it was written, the PWM output may still lag behind
+    if (p_batch->flags & ESTC_CMD_FLAG_STATE)
+    {
+        ble_links_notify_all(p_lbs, ESTC_CHAR_RGB_STATE, &p_batch->state, CHARACTERISTIC_RGB_STATE_SIZE);
+    }
+
+    if (p_batch->flags & ESTC_CMD_FLAG_COLOR)
+    {
+        uint8_t data[3] = {p_batch->color.red, p_batch->color.green, p_batch->color.blue};
+        ble_links_notify_all(p_lbs, ESTC_CHAR_RGB_VALUE, data, CHARACTERISTIC_RGB_VALUE_SIZE);
+    }
+
+    // Writes of several links may be folded into one batch, so every subscribed link gets the answer.
+    if (p_batch->flags & ESTC_CMD_FLAG_QUERY)
+    {
+        uint8_t response[ESTC_CMD_QUERY_RESPONSE_SIZE];
+        uint16_t len = estc_cmd_query_response_encode(p_batch, response);
+        ble_links_notify_all(p_lbs, ESTC_CHAR_COMMAND, response, len);
+    }
+
+    if (m_state_handler != NULL &&
+        (p_batch->flags & (ESTC_CMD_FLAG_STATE | ESTC_CMD_FLAG_COLOR | ESTC_CMD_FLAG_BRIGHTNESS)))
+    {
+        m_state_handler(p_batch);
+    }
+
+    // One persist for the whole batch
+    flash_storage_update_values(p_batch->flags & ESTC_CMD_FLAG_STATE, p_batch->state,
+                                p_batch->flags & ESTC_CMD_FLAG_COLOR,
+                                p_batch->color.red, p_batch->color.green, p_batch->color.blue);
+
+    ESTC_PERF_STOP(ESTC_PERF_BATCH_HANDLER, start);
+}
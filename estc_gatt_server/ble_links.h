@@ -0,0 +1,93 @@
+#ifndef BLE_LINKS_H__
+#define BLE_LINKS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "peer_manager_types.h"
+#include "sdk_config.h"
+#include "estc_service.h"
+#include "estc_command.h"
+
+/**
+ * @brief Contexts of the connected centrals and the handling of their write batches
+ *
+ * @details Keeps one context per link, applies the batches of the ESTC service and notifies the
+ *          new values to every link that enabled notifications. Only hal_ble and hal_timer are
+ *          used, so the host replay runs this code unchanged. ble_module.c feeds it the GAP events
+ *          and adds advertising, bonding and PHY handling around it.
+ */
+
+#define BLE_LINKS_COUNT NRF_SDH_BLE_PERIPHERAL_LINK_COUNT // Centrals connected at the same time
+
+/**
+ * @brief Per-link context
+ *
+ * @details The application side cost of a link is sizeof(ble_link_ctx_t) plus one nrf_ble_qwr_t,
+ *          the SoftDevice side cost is reported by ble_stack_init() at boot.
+ */
+typedef struct
+{
+    uint16_t conn_handle;     // BLE_CONN_HANDLE_INVALID while the context is free
+    uint8_t tx_phy;           // PHY in use for transmission, BLE_GAP_PHY_1MBPS until the 2M update completes
+    uint8_t rx_phy;           // PHY in use for reception
+    ble_gap_addr_t peer_addr; // Address of the central, the target of directed advertising after it disconnects
+    pm_peer_id_t peer_id;     // Bond of the central, PM_PEER_ID_INVALID until the link is secured with a bond
+    uint32_t connected_at;    // Time of the connection, see hal_timer_stamp_get()
+    uint16_t event_length;    // Radio time reserved per connection event in 1.25 ms units, see ble_stack_init()
+    bool first_write_pending; // No control write arrived on this link yet
+} ble_link_ctx_t;
+
+/**
+ * @brief Handler of a batch that changed the light state, color or brightness
+ */
+typedef void (*ble_links_state_handler_t)(estc_cmd_batch_t const *p_batch);
+
+/**
+ * @brief Free every link context
+ * @param state_handler Called from ble_links_batch_handler() after the notifications, may be NULL
+ */
+void ble_links_init(ble_links_state_handler_t state_handler);
+
+/**
+ * @brief Take a free context for a new link and start tracking its write activity
+ * @param conn_handle Handle of the new connection
+ * @param p_peer_addr Address of the central
+ * @return NULL if every context is in use
+ */
+ble_link_ctx_t *ble_links_connected(uint16_t conn_handle, ble_gap_addr_t const *p_peer_addr);
+
+/**
+ * @brief Free the context of a link
+ */
+void ble_links_disconnected(uint16_t conn_handle);
+
+/**
+ * @brief Get the context of a link
+ * @return NULL if the link is not connected or conn_handle is BLE_CONN_HANDLE_INVALID
+ */
+ble_link_ctx_t *ble_links_get(uint16_t conn_handle);
+
+/**
+ * @brief Get a context by index, connected or not
+ * @param index Below BLE_LINKS_COUNT
+ */
+ble_link_ctx_t *ble_links_at(uint8_t index);
+
+/**
+ * @brief Index of a context, the same for the whole connection
+ */
+uint8_t ble_links_index(ble_link_ctx_t const *p_link);
+
+/**
+ * @brief Notify an ESTC characteristic value to every link that enabled notifications
+ * @details A link with a full notification queue misses the value.
+ */
+void ble_links_notify_all(ble_estc_service_t *p_lbs, estc_char_id_t char_id, uint8_t const *p_data, uint16_t len);
+
+/**
+ * @brief Batch write handler of the ESTC service, see ble_lbs_init_t
+ */
+void ble_links_batch_handler(uint16_t conn_handle, ble_estc_service_t *p_lbs, estc_cmd_batch_t const *p_batch);
+
+#endif // BLE_LINKS_H__
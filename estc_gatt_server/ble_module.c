@@ -1,41 +1,162 @@
 #include "ble_module.h"
+#include "ble_links.h"
+#include "adv_tiers.h"
 #include "pwm_control.h"
-#include "flash_storage.h"
+#include "estc_command.h"
+#include "estc_group.h"
 #include "nrf_log.h"
+#include "estc_perf.h"
+#include "hal_timer.h"
+#include "hal_ble.h"
+#include "conn_activity.h"
 #include "app_error.h"
+#include "app_scheduler.h"
 #include "nrf_pwr_mgmt.h"
+#include "fds.h"
 
 #define DEVICE_NAME "Artem"                     /**< Name of device. Will be included in the advertising data. */
 #define MANUFACTURER_NAME "NordicSemiconductor" /**< Manufacturer. Will be passed to Device Information Service. */
-#define APP_ADV_INTERVAL 300                    /**< The advertising interval (in units of 0.625 ms. This value corresponds to 187.5 ms). */
 
-#define APP_ADV_DURATION 18000  /**< The advertising duration (180 seconds) in units of 10 milliseconds. */
+// ble_advertising runs the directed tier of adv_tiers.h for the SoftDevice maximum
+STATIC_ASSERT(ADV_DIRECTED_DURATION_MS == BLE_GAP_ADV_TIMEOUT_HIGH_DUTY_MAX * 10);
+
+/* Airtime of one connectable advertising event at 0 dBm, the charge estimates below follow it:
+ *   legacy, 1M:          3 x ADV_IND (26 B, 208 us) plus scan responses on request      ~0.7 ms
+ *   extended, 1M:        3 x ADV_EXT_IND (17 B, 136 us) + AUX_ADV_IND (60 B, 480 us)    ~0.9 ms
+ *   extended, Coded S8:  3 x ADV_EXT_IND (~1.2 ms) + AUX_ADV_IND (~3.9 ms)              ~7.4 ms
+ */
+#define ADV_EVENT_CHARGE_NC 18000   /**< Estimated charge of one connectable advertising event (3 channels, 0 dBm, LDO), used for reporting. */
+#if ESTC_ADV_EXTENDED_PHY == BLE_GAP_PHY_CODED
+#define ADV_EXT_EVENT_CHARGE_NC 80000 /**< Estimated charge of one extended advertising event on the Coded PHY, used for reporting. */
+#else
+#define ADV_EXT_EVENT_CHARGE_NC 22000 /**< Estimated charge of one extended advertising event on the 1M PHY, used for reporting. */
+#endif
+#define SYSTEM_IDLE_CURRENT_UA 3    /**< Estimated System ON idle current with the RTC running, used for reporting. */
+#define PWM_ACTIVE_CURRENT_UA 400   /**< Estimated HFCLK and PWM current while the light is lit (LED current excluded), used for reporting. */
+
+#define ADV_COMPANY_ID ESTC_GROUP_COMPANY_ID /**< Company identifier of the manufacturer specific data, shared with the group commands. */
+#define ADV_STATE_DATA_SIZE 6      /**< Light state broadcast in the scan response: state, R, G, B, change counter (uint16, little-endian, wraps, see adv_state_encode()). */
+#define ADV_SNAPSHOT_SIZE 8        /**< Light state broadcast in extended advertising: the scan response state, brightness, group. */
+#define ADV_FORMAT_SWITCH_MS 2000  /**< Period of the switch between extended and legacy advertising. */
+
+#define SCAN_INTERVAL MSEC_TO_UNITS(500, UNIT_0_625_MS) /**< Group command scan interval (500 ms), bounds the group command latency. */
+#define SCAN_WINDOW MSEC_TO_UNITS(25, UNIT_0_625_MS)    /**< Group command scan window (25 ms), catches a controller advertising every 20 ms. */
+#define SCAN_RX_CURRENT_UA 6000                         /**< Estimated radio current while the scan window is open, used for reporting. */
+
 #define APP_BLE_OBSERVER_PRIO 3 /**< Application's BLE observer priority. You shouldn't need to modify this value. */
 #define APP_BLE_CONN_CFG_TAG 1  /**< A tag identifying the SoftDevice BLE configuration. */
+#define APP_BLE_CONN_CFG_TAG_STREAM 2 /**< Configuration of the one link reserving ESTC_STREAM_CONN_EVENT_LENGTH. */
 
-#define MIN_CONN_INTERVAL MSEC_TO_UNITS(100, UNIT_1_25_MS) /**< Minimum acceptable connection interval (0.1 seconds). */
-#define MAX_CONN_INTERVAL MSEC_TO_UNITS(200, UNIT_1_25_MS) /**< Maximum acceptable connection interval (0.2 second). */
-#define SLAVE_LATENCY 0                                    /**< Slave latency. */
+#define MIN_CONN_INTERVAL MSEC_TO_UNITS(100, UNIT_1_25_MS) /**< Minimum idle connection interval (0.1 seconds). */
+#define MAX_CONN_INTERVAL MSEC_TO_UNITS(200, UNIT_1_25_MS) /**< Maximum idle connection interval (0.2 second). */
+#define SLAVE_LATENCY 6                                    /**< Idle slave latency, the radio wakes up at most every 1.4 seconds. */
 #define CONN_SUP_TIMEOUT MSEC_TO_UNITS(4000, UNIT_10_MS)   /**< Connection supervisory timeout (4 seconds). */
 
+#define FAST_MIN_CONN_INTERVAL MSEC_TO_UNITS(7.5, UNIT_1_25_MS) /**< Minimum connection interval while writes are arriving (7.5 ms). */
+#define FAST_MAX_CONN_INTERVAL MSEC_TO_UNITS(15, UNIT_1_25_MS)  /**< Maximum connection interval while writes are arriving (15 ms). */
+#define FAST_SLAVE_LATENCY 0                                    /**< Slave latency while writes are arriving. */
+
+#define RADIO_EVENT_US 400                          /**< Estimated radio on-time of an empty connection event, used for reporting. */
+
 #define FIRST_CONN_PARAMS_UPDATE_DELAY APP_TIMER_TICKS(5000) /**< Time from initiating event (connect or start of notification) to first time sd_ble_gap_conn_param_update is called (5 seconds). */
 #define NEXT_CONN_PARAMS_UPDATE_DELAY APP_TIMER_TICKS(30000) /**< Time between each call to sd_ble_gap_conn_param_update after the first call (30 seconds). */
 #define MAX_CONN_PARAMS_UPDATE_COUNT 3                       /**< Number of attempts before giving up the connection parameter negotiation. */
 
+#define SEC_PARAM_BOND 1                               /**< Perform bonding. */
+#define SEC_PARAM_MITM 0                               /**< Man In The Middle protection not required, the dongle has no display or keyboard. */
+#define SEC_PARAM_LESC 0                               /**< LE Secure Connections not enabled. */
+#define SEC_PARAM_KEYPRESS 0                           /**< Keypress notifications not enabled. */
+#define SEC_PARAM_IO_CAPABILITIES BLE_GAP_IO_CAPS_NONE /**< No I/O capabilities. */
+#define SEC_PARAM_OOB 0                                /**< Out Of Band data not available. */
+#define SEC_PARAM_MIN_KEY_SIZE 7                       /**< Minimum encryption key size. */
+#define SEC_PARAM_MAX_KEY_SIZE 16                      /**< Maximum encryption key size. */
+
+#define DB_HASH_FILE_ID 0x1000    /**< FDS file of the attribute table hash and the group sequence number, below the range used by the Peer Manager. */
+#define DB_HASH_RECORD_KEY 0x0001 /**< FDS record key of the attribute table hash. */
+#define GROUP_SEQ_RECORD_KEY 0x0002 /**< FDS record key of the last group command sequence number, in DB_HASH_FILE_ID. */
+
 #define DEAD_BEEF 0xDEADBEEF /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
+#define LINK_COUNT NRF_SDH_BLE_PERIPHERAL_LINK_COUNT /**< Number of centrals that can be connected at the same time. */
+
 BLE_LBS_DEF(m_estc_service);
 NRF_BLE_GATT_DEF(m_gatt);
-NRF_BLE_QWR_DEF(m_qwr);
+NRF_BLE_QWRS_DEF(m_qwr, LINK_COUNT);
 BLE_ADVERTISING_DEF(m_advertising);
 
-static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID; /**< Handle of the current connection. */
+static ble_gap_addr_t m_reconnect_addr; /**< Address of the central that disconnected last. */
+static pm_peer_id_t m_reconnect_peer_id = PM_PEER_ID_INVALID; /**< Bond of the central that disconnected last. */
+static bool m_reconnect_pending;        /**< The last central has not reconnected yet. */
+static uint32_t m_reconnect_start;      /**< Time of the last disconnection, see hal_timer_stamp_get(). */
+
+static uint32_t m_db_hash; /**< Hash of the ESTC attribute table, written to flash by db_hash_check(). */
+static uint32_t volatile m_group_seq; /**< Group command sequence number to store, see group_seq_store(). */
+static uint32_t m_group_seq_record;   /**< Group command sequence number written to flash by group_seq_write(). */
+
+static uint8_t m_adv_conn_cfg_tag = APP_BLE_CONN_CFG_TAG;            /**< Configuration of the link advertising connects next. */
+static uint16_t m_stream_cfg_conn_handle = BLE_CONN_HANDLE_INVALID; /**< Link connected with APP_BLE_CONN_CFG_TAG_STREAM. */
+
+static ble_gap_conn_params_t const m_fast_conn_params =
+    {
+        .min_conn_interval = FAST_MIN_CONN_INTERVAL,
+        .max_conn_interval = FAST_MAX_CONN_INTERVAL,
+        .slave_latency = FAST_SLAVE_LATENCY,
+        .conn_sup_timeout = CONN_SUP_TIMEOUT,
+};
+
+static ble_gap_conn_params_t const m_idle_conn_params =
+    {
+        .min_conn_interval = MIN_CONN_INTERVAL,
+        .max_conn_interval = MAX_CONN_INTERVAL,
+        .slave_latency = SLAVE_LATENCY,
+        .conn_sup_timeout = CONN_SUP_TIMEOUT,
+};
 
 static ble_uuid_t m_adv_uuids[] = /**< Universally unique service identifiers. */
     {
         {RANDOM_SERVICE_UUID, BLE_UUID_TYPE_VENDOR_BEGIN},
 };
 
+static uint8_t m_adv_state_data[ADV_SNAPSHOT_SIZE]; /**< Encoded light state, see adv_state_encode(). */
+static uint16_t m_adv_change_count;                 /**< Number of light state changes since boot modulo 2^16, lets scanners spot missed updates. */
+static bool m_adv_state_encoded;                    /**< adv_state_encode() ran since boot. */
+
+static ble_advdata_manuf_data_t m_adv_manuf_data =
+    {
+        .company_identifier = ADV_COMPANY_ID,
+        .data = {.size = ADV_STATE_DATA_SIZE, .p_data = m_adv_state_data},
+};
+
+static ble_advdata_t m_advdata; /**< Advertising data, kept for ble_advertising_advdata_update(). */
+static ble_advdata_t m_srdata;  /**< Scan response data, carries the light state. */
+
+#if ESTC_ADV_EXTENDED_ENABLED
+static ble_advdata_manuf_data_t m_adv_ext_manuf_data =
+    {
+        .company_identifier = ADV_COMPANY_ID,
+        .data = {.size = ADV_SNAPSHOT_SIZE, .p_data = m_adv_state_data},
+};
+
+static ble_advdata_t m_ext_advdata;        /**< Extended advertising data: name, service UUID and the state snapshot in one packet. */
+static bool m_adv_extended;                /**< The extended format is in use. */
+static bool m_adv_switching;               /**< Advertising is restarted for a format switch, not for a new fast period. */
+static uint32_t m_adv_fast_start;          /**< Start of the current fast advertising period, see hal_timer_stamp_get(). */
+static hal_timer_id_t m_adv_format_timer;  /**< Timer switching between extended and legacy advertising. */
+#endif
+
+static uint8_t m_scan_buffer_data[BLE_GAP_SCAN_BUFFER_MIN]; /**< Buffer the SoftDevice stores advertising reports in. */
+static ble_data_t m_scan_buffer = {m_scan_buffer_data, sizeof(m_scan_buffer_data)};
+
+static ble_gap_scan_params_t const m_scan_params =
+    {
+        .active = 0,
+        .interval = SCAN_INTERVAL,
+        .window = SCAN_WINDOW,
+        .timeout = BLE_GAP_SCAN_TIMEOUT_UNLIMITED,
+        .scan_phys = BLE_GAP_PHY_1MBPS,
+        .filter_policy = BLE_GAP_SCAN_FP_ACCEPT_ALL,
+};
+
 /**@brief Callback function for asserts in the SoftDevice.
  */
 void assert_nrf_callback(uint16_t line_num, const uint8_t *p_file_name)
@@ -43,53 +164,205 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t *p_file_name)
     app_error_handler(DEAD_BEEF, line_num, p_file_name);
 }
 
-void rgb_state_write_handler(uint16_t conn_handle, ble_estc_service_t *p_lbs, uint8_t new_state)
+/**@brief Function for reporting the cost of the connection parameters in use.
+ *
+ * @details The radio wakes up once every (slave latency + 1) connection intervals,
+ *          which is also the worst-case delay between a central write and the light update.
+ */
+static void conn_params_report(uint16_t conn_handle, ble_gap_conn_params_t const *p_params)
 {
-    if (new_state)
+    uint32_t interval_us = (uint32_t)p_params->max_conn_interval * 1250;
+    uint32_t wakeup_us = interval_us * (p_params->slave_latency + 1);
+
+    NRF_LOG_INFO("Conn params (conn_handle: %d): interval %d us, latency %d", conn_handle,
+                 interval_us, p_params->slave_latency);
+    NRF_LOG_INFO("  %d radio wakeups/s, ~%d us radio on-time/s, write-to-light <= %d us",
+                 1000000 / wakeup_us, RADIO_EVENT_US * (1000000 / wakeup_us), wakeup_us);
+}
+
+/**@brief Function for requesting the 2M PHY on a new link.
+ *
+ * @details The link keeps the 1M PHY if the peer does not support 2M or rejects the update,
+ *          the outcome is recorded by the BLE_GAP_EVT_PHY_UPDATE handler.
+ */
+static void link_phy_2m_request(ble_link_ctx_t *p_link)
+{
+    ble_gap_phys_t const phys =
+        {
+            .rx_phys = BLE_GAP_PHY_2MBPS,
+            .tx_phys = BLE_GAP_PHY_2MBPS,
+        };
+
+    ret_code_t err_code = sd_ble_gap_phy_update(p_link->conn_handle, &phys);
+    if (err_code != NRF_SUCCESS)
     {
-        pwm_on_rgb();
+        // E.g. a peer initiated procedure is already running, its result is recorded the same way.
+        NRF_LOG_INFO("PHY: 2M request not sent (conn_handle: %d, error %d)", p_link->conn_handle, err_code);
     }
-    else
+}
+
+/**@brief Function for encoding a light state into the manufacturer specific data.
+ *
+ * @details The state is the applied batch, not the PWM output, which lags behind it while the
+ *          render ring is drained and while a fade is playing.
+ *
+ * @param[in] p_state  Light state to encode.
+ *
+ *          The change counter is 16 bits wide, little-endian. The state encoded at boot carries 1,
+ *          every change adds 1 and 65535 wraps to 0, so 0 is an ordinary value. Scanners compare
+ *          two counters as serial numbers (RFC 1982): (uint16_t)(new - last) is the number of
+ *          changes in between, 1 if none was missed. A scanner that misses 32768 changes or more
+ *          cannot tell, at a few changes per second that takes hours of not listening.
+ *
+ * @return True if the state differs from the encoded one; the change counter is then incremented.
+ */
+static bool adv_state_encode(estc_cmd_batch_t const *p_state)
+{
+    uint8_t snapshot[ADV_SNAPSHOT_SIZE] = {p_state->state ? 1 : 0,
+                                           p_state->color.red, p_state->color.green, p_state->color.blue,
+                                           (uint8_t)m_adv_change_count, (uint8_t)(m_adv_change_count >> 8),
+                                           p_state->brightness, ESTC_GROUP_ID};
+
+    // The first call always encodes
+    if (m_adv_state_encoded && memcmp(m_adv_state_data, snapshot, sizeof(snapshot)) == 0)
     {
-        pwm_off_rgb();
+        return false;
     }
 
-    ble_gatts_hvx_params_t hvx_params;
-    memset(&hvx_params, 0, sizeof(hvx_params));
+    m_adv_state_encoded = true;
+    m_adv_change_count++;
+    snapshot[4] = (uint8_t)m_adv_change_count;
+    snapshot[5] = (uint8_t)(m_adv_change_count >> 8);
+    memcpy(m_adv_state_data, snapshot, sizeof(snapshot));
 
-    hvx_params.handle = p_lbs->rgb_state_characteristic_handles.value_handle;
-    hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
-    hvx_params.offset = 0;
-    uint16_t len = CHARACTERISTIC_RGB_STATE_SIZE;
-    hvx_params.p_len = &len;
-    hvx_params.p_data = (uint8_t *)&new_state;
+    return true;
+}
+
+/**@brief Function for choosing the SoftDevice configuration of the next connection.
+ *
+ * @details The event length is fixed when a link connects. The next central gets the streaming
+ *          reservation while no link holds it, the SoftDevice connects only one link with it.
+ */
+static void adv_conn_cfg_select(void)
+{
+#if ESTC_STREAM_CONN_EVENT_LENGTH
+    m_adv_conn_cfg_tag = m_stream_cfg_conn_handle == BLE_CONN_HANDLE_INVALID ? APP_BLE_CONN_CFG_TAG_STREAM
+                                                                              : APP_BLE_CONN_CFG_TAG;
+    ble_advertising_conn_cfg_tag_set(&m_advertising, m_adv_conn_cfg_tag);
+#endif
+}
+
+/**@brief Function for handing the advertising data of the format in use to the advertising module.
+ *
+ * @details Only undirected advertising carries data. In any other mode the encoded state is kept
+ *          and on_adv_evt() hands it over once fast or slow advertising starts.
+ */
+static void adv_data_update(void)
+{
+    ret_code_t err_code;
+    ble_adv_mode_t mode = m_advertising.adv_mode_current;
+
+    if (mode != BLE_ADV_MODE_FAST && mode != BLE_ADV_MODE_SLOW)
+    {
+        return;
+    }
 
-    sd_ble_gatts_hvx(p_lbs->connection_handle, &hvx_params);
-    NRF_LOG_INFO("NOTIFY: RGB STATE characteristic value(%d)", new_state);
+#if ESTC_ADV_EXTENDED_ENABLED
+    if (m_adv_extended)
+    {
+        // Extended connectable advertising is not scannable
+        err_code = ble_advertising_advdata_update(&m_advertising, &m_ext_advdata, NULL);
+        APP_ERROR_CHECK(err_code);
+        return;
+    }
+#endif
 
-    flash_storage_update_state(new_state);
+    err_code = ble_advertising_advdata_update(&m_advertising, &m_advdata, &m_srdata);
+    APP_ERROR_CHECK(err_code);
 }
 
-void rgb_value_write_handler(uint16_t conn_handle, ble_estc_service_t *p_lbs, uint8_t r, uint8_t g, uint8_t b)
+/**@brief Function for broadcasting a changed light state without stopping advertising.
+ *
+ * @param[in] p_state  Light state to broadcast.
+ */
+static void adv_state_update(estc_cmd_batch_t const *p_state)
 {
-    ble_gatts_hvx_params_t hvx_params;
-    memset(&hvx_params, 0, sizeof(hvx_params));
+    if (adv_state_encode(p_state))
+    {
+        adv_data_update();
+    }
+}
 
-    hvx_params.handle = p_lbs->rgb_value_characteristic_handles.value_handle;
-    hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
-    hvx_params.offset = 0;
-    uint16_t len = CHARACTERISTIC_RGB_VALUE_SIZE;
-    hvx_params.p_len = &len;
-    uint8_t data[3] = {r, g, b};
-    hvx_params.p_data = data;
+#if ESTC_ADV_EXTENDED_ENABLED
+/**@brief Function for selecting the advertising format in the advertising modes configuration.
+ */
+static void adv_format_config(ble_adv_modes_config_t *p_config, bool extended)
+{
+    p_config->ble_adv_extended_enabled = extended;
+    p_config->ble_adv_primary_phy = extended ? ESTC_ADV_EXTENDED_PHY : BLE_GAP_PHY_1MBPS;
+    p_config->ble_adv_secondary_phy = extended ? ESTC_ADV_EXTENDED_PHY : BLE_GAP_PHY_1MBPS;
+}
+
+/**@brief Function for selecting the advertising format used by the next start, advertising must be stopped.
+ */
+static void adv_format_set(bool extended)
+{
+    m_adv_extended = extended;
+
+    ble_adv_modes_config_t config = m_advertising.adv_modes_config;
+    adv_format_config(&config, extended);
+    ble_advertising_modes_config_set(&m_advertising, &config);
+
+    ret_code_t err_code = ble_advertising_advdata_update(&m_advertising, &m_advdata, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for switching between extended and legacy advertising, runs from the main loop.
+ *
+ * @details The SoftDevice has a single advertising set, so the formats take turns. Data that is
+ *          invalid for the parameters configured in the set is rejected, so the set is restarted
+ *          with the legacy advertising data, which is valid for both formats, and the data of the
+ *          new format is applied afterwards.
+ */
+static void adv_format_switch(void *p_event_data, uint16_t event_size)
+{
+    ble_adv_mode_t mode = m_advertising.adv_mode_current;
+
+    // Directed advertising is legacy only; with every link in use the format is switched in a later period
+    if (mode != BLE_ADV_MODE_FAST && mode != BLE_ADV_MODE_SLOW)
+    {
+        return;
+    }
+
+    // Fails if a central connected in the meantime, ble_evt_handler() then restarts advertising
+    if (sd_ble_gap_adv_stop(m_advertising.adv_handle) != NRF_SUCCESS)
+    {
+        return;
+    }
+
+    adv_format_set(!m_adv_extended);
+
+    // A restart begins a new fast period, so the fast timeout is tracked here
+    if (mode == BLE_ADV_MODE_FAST && hal_timer_elapsed_ms(m_adv_fast_start) >= APP_ADV_DURATION * 10)
+    {
+        mode = BLE_ADV_MODE_SLOW;
+    }
 
-    sd_ble_gatts_hvx(p_lbs->connection_handle, &hvx_params);
-    NRF_LOG_INFO("NOTIFY: RGB VALUE characteristic value(%d; %d; %d)", r, g, b);
+    adv_conn_cfg_select();
+    m_adv_switching = true;
+    ret_code_t err_code = ble_advertising_start(&m_advertising, mode);
+    APP_ERROR_CHECK(err_code);
+    m_adv_switching = false;
 
-    pwm_set_rgb_color(r, g, b);
+    adv_data_update();
+}
 
-    flash_storage_update_rgb(r, g, b);
+static void adv_format_timer_handler(void *p_context)
+{
+    ret_code_t err_code = app_sched_event_put(NULL, 0, adv_format_switch);
+    APP_ERROR_CHECK(err_code);
 }
+#endif // ESTC_ADV_EXTENDED_ENABLED
 
 /**@brief Function for the GAP initialization.
  */
@@ -111,10 +384,8 @@ void gap_params_init(void)
 
     memset(&gap_conn_params, 0, sizeof(gap_conn_params));
 
-    gap_conn_params.min_conn_interval = MIN_CONN_INTERVAL;
-    gap_conn_params.max_conn_interval = MAX_CONN_INTERVAL;
-    gap_conn_params.slave_latency = SLAVE_LATENCY;
-    gap_conn_params.conn_sup_timeout = CONN_SUP_TIMEOUT;
+    // Links start with the idle parameters and are switched to the fast ones on demand.
+    gap_conn_params = m_idle_conn_params;
 
     err_code = sd_ble_gap_ppcp_set(&gap_conn_params);
     APP_ERROR_CHECK(err_code);
@@ -135,6 +406,78 @@ static void nrf_qwr_error_handler(uint32_t nrf_error)
     APP_ERROR_HANDLER(nrf_error);
 }
 
+/**@brief Function for writing the last group command sequence number to flash, runs from the main loop.
+ */
+static void group_seq_write(void *p_event_data, uint16_t event_size)
+{
+    fds_record_desc_t desc;
+    fds_find_token_t token = {0};
+    fds_record_t const record =
+        {
+            .file_id = DB_HASH_FILE_ID,
+            .key = GROUP_SEQ_RECORD_KEY,
+            .data.p_data = &m_group_seq_record,
+            .data.length_words = 1,
+        };
+    ret_code_t err_code;
+
+    m_group_seq_record = m_group_seq;
+
+    if (fds_record_find(DB_HASH_FILE_ID, GROUP_SEQ_RECORD_KEY, &desc, &token) == NRF_SUCCESS)
+    {
+        err_code = fds_record_update(&desc, &record);
+    }
+    else
+    {
+        err_code = fds_record_write(NULL, &record);
+    }
+
+    // Without space the older number stays, the Peer Manager triggers garbage collection
+    if (err_code != FDS_ERR_NO_SPACE_IN_FLASH)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**@brief Function for keeping the sequence number of the last group command, see estc_group.h.
+ *
+ * @details Called from the SoftDevice event or timer context at most once per
+ *          ESTC_GROUP_SEQ_STORE_INTERVAL_MS, FDS is used from the main loop.
+ */
+static void group_seq_store(uint32_t seq)
+{
+    m_group_seq = seq;
+
+    ret_code_t err_code = app_sched_event_put(NULL, 0, group_seq_write);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for restoring the group command sequence number of the last boot, runs from the main loop once FDS is initialized.
+ */
+static void group_seq_restore(void *p_event_data, uint16_t event_size)
+{
+    fds_record_desc_t desc;
+    fds_find_token_t token = {0};
+
+    if (fds_record_find(DB_HASH_FILE_ID, GROUP_SEQ_RECORD_KEY, &desc, &token) != NRF_SUCCESS)
+    {
+        // Nothing stored yet, the next command heard is accepted
+        estc_group_seq_restore(NULL);
+        return;
+    }
+
+    fds_flash_record_t flash_record;
+
+    ret_code_t err_code = fds_record_open(&desc, &flash_record);
+    APP_ERROR_CHECK(err_code);
+    uint32_t seq = *(uint32_t const *)flash_record.p_data;
+    err_code = fds_record_close(&desc);
+    APP_ERROR_CHECK(err_code);
+
+    NRF_LOG_INFO("Group commands: sequence number %d restored", seq);
+    estc_group_seq_restore(&seq);
+}
+
 /**@brief Function for initializing services that will be used by the application.
  */
 void services_init(void)
@@ -143,17 +486,168 @@ void services_init(void)
     ble_lbs_init_t lbs_init = {0};
     nrf_ble_qwr_init_t qwr_init = {0};
 
-    // Initialize Queued Write Module.
+    // Initialize Queued Write Module instances, one per link.
     qwr_init.error_handler = nrf_qwr_error_handler;
 
-    err_code = nrf_ble_qwr_init(&m_qwr, &qwr_init);
-    APP_ERROR_CHECK(err_code);
+    for (uint8_t i = 0; i < LINK_COUNT; i++)
+    {
+        err_code = nrf_ble_qwr_init(&m_qwr[i], &qwr_init);
+        APP_ERROR_CHECK(err_code);
+    }
 
-    lbs_init.rgb_state_write_handler = rgb_state_write_handler;
-    lbs_init.rgb_value_write_handler = rgb_value_write_handler;
+    ble_links_init(adv_state_update);
+    lbs_init.batch_write_handler = ble_links_batch_handler;
 
     err_code = estc_ble_service_init(&m_estc_service, &lbs_init);
     APP_ERROR_CHECK(err_code);
+
+    err_code = estc_group_init(group_seq_store);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for comparing the ESTC attribute table with the one bonded clients may have cached.
+ *
+ * @details The SoftDevice offers no GATT database hash, so the contents of the ESTC attribute
+ *          table are hashed (see estc_service_db_hash()) and kept in flash instead. A different
+ *          table (e.g. a build with another characteristic set, or the same handles with changed
+ *          properties) makes the Peer Manager indicate Service Changed to every bonded client on
+ *          its next connection, clients can cache the table until then.
+ *          Runs from the main loop once FDS is initialized.
+ */
+static void db_hash_check(void *p_event_data, uint16_t event_size)
+{
+    uint32_t hash = estc_service_db_hash(&m_estc_service);
+
+    fds_record_desc_t desc;
+    fds_find_token_t token = {0};
+    fds_record_t const record =
+        {
+            .file_id = DB_HASH_FILE_ID,
+            .key = DB_HASH_RECORD_KEY,
+            .data.p_data = &m_db_hash,
+            .data.length_words = 1,
+        };
+    ret_code_t err_code;
+
+    m_db_hash = hash;
+
+    if (fds_record_find(DB_HASH_FILE_ID, DB_HASH_RECORD_KEY, &desc, &token) == NRF_SUCCESS)
+    {
+        fds_flash_record_t flash_record;
+
+        err_code = fds_record_open(&desc, &flash_record);
+        APP_ERROR_CHECK(err_code);
+        uint32_t stored = *(uint32_t const *)flash_record.p_data;
+        err_code = fds_record_close(&desc);
+        APP_ERROR_CHECK(err_code);
+
+        if (stored == hash)
+        {
+            NRF_LOG_INFO("GATT: attribute table unchanged (hash 0x%x), bonded clients keep their cache", hash);
+            return;
+        }
+
+        NRF_LOG_INFO("GATT: attribute table changed (hash 0x%x -> 0x%x), indicating Service Changed", stored, hash);
+        pm_local_database_has_changed();
+
+        err_code = fds_record_update(&desc, &record);
+    }
+    else
+    {
+        err_code = fds_record_write(NULL, &record);
+    }
+
+    // Without space the check repeats on the next boot, the Peer Manager triggers garbage collection
+    if (err_code != FDS_ERR_NO_SPACE_IN_FLASH)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**@brief Function for handling FDS events.
+ */
+static void fds_evt_handler(fds_evt_t const *p_evt)
+{
+    // FDS may report its initialization from inside pm_init()
+    if (p_evt->id == FDS_EVT_INIT && p_evt->result == NRF_SUCCESS)
+    {
+        ret_code_t err_code = app_sched_event_put(NULL, 0, db_hash_check);
+        APP_ERROR_CHECK(err_code);
+        err_code = app_sched_event_put(NULL, 0, group_seq_restore);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**@brief Function for handling Peer Manager events.
+ */
+static void pm_evt_handler(pm_evt_t const *p_evt)
+{
+    pm_handler_on_pm_evt(p_evt);
+    pm_handler_disconnect_on_sec_failure(p_evt);
+    pm_handler_flash_clean(p_evt);
+
+    switch (p_evt->evt_id)
+    {
+    case PM_EVT_CONN_SEC_SUCCEEDED:
+    {
+        ble_link_ctx_t *p_link = ble_links_get(p_evt->conn_handle);
+        if (p_link != NULL)
+        {
+            p_link->peer_id = p_evt->peer_id;
+        }
+    }
+    break;
+
+    case PM_EVT_CONN_SEC_CONFIG_REQ:
+    {
+        // A central that lost its keys is allowed to bond again
+        pm_conn_sec_config_t config = {.allow_repairing = true};
+        pm_conn_sec_config_reply(p_evt->conn_handle, &config);
+    }
+    break;
+
+    default:
+        break;
+    }
+}
+
+/**@brief Function for the Peer Manager initialization.
+ *
+ * @details Bonds keep the keys and the CCCD values of a central, so a reconnecting client is
+ *          encrypted and notified without rewriting its CCCDs.
+ */
+void peer_manager_init(void)
+{
+    ble_gap_sec_params_t sec_param;
+    ret_code_t err_code;
+
+    // Registered first to see the initialization of FDS by the Peer Manager
+    err_code = fds_register(fds_evt_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = pm_init();
+    APP_ERROR_CHECK(err_code);
+
+    memset(&sec_param, 0, sizeof(ble_gap_sec_params_t));
+
+    sec_param.bond = SEC_PARAM_BOND;
+    sec_param.mitm = SEC_PARAM_MITM;
+    sec_param.lesc = SEC_PARAM_LESC;
+    sec_param.keypress = SEC_PARAM_KEYPRESS;
+    sec_param.io_caps = SEC_PARAM_IO_CAPABILITIES;
+    sec_param.oob = SEC_PARAM_OOB;
+    sec_param.min_key_size = SEC_PARAM_MIN_KEY_SIZE;
+    sec_param.max_key_size = SEC_PARAM_MAX_KEY_SIZE;
+    sec_param.kdist_own.enc = 1;
+    sec_param.kdist_own.id = 1;
+    sec_param.kdist_peer.enc = 1;
+    sec_param.kdist_peer.id = 1;
+
+    err_code = pm_sec_params_set(&sec_param);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = pm_register(pm_evt_handler);
+    APP_ERROR_CHECK(err_code);
 }
 
 /**@brief Function for handling the Connection Parameters Module.
@@ -164,7 +658,7 @@ static void on_conn_params_evt(ble_conn_params_evt_t *p_evt)
 
     if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
     {
-        err_code = sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
+        err_code = sd_ble_gap_disconnect(p_evt->conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
         APP_ERROR_CHECK(err_code);
     }
 }
@@ -183,9 +677,22 @@ void conn_params_init(void)
     ret_code_t err_code;
     ble_conn_params_init_t cp_init;
 
+    // The negotiation module accepts the whole range between the fast and the idle parameters,
+    // so it does not fight the per-link requests of conn_activity.
+    static ble_gap_conn_params_t accepted_conn_params =
+        {
+            .min_conn_interval = FAST_MIN_CONN_INTERVAL,
+            .max_conn_interval = MAX_CONN_INTERVAL,
+            .slave_latency = SLAVE_LATENCY,
+            .conn_sup_timeout = CONN_SUP_TIMEOUT,
+        };
+
+    err_code = conn_activity_init(&m_fast_conn_params, &m_idle_conn_params);
+    APP_ERROR_CHECK(err_code);
+
     memset(&cp_init, 0, sizeof(cp_init));
 
-    cp_init.p_conn_params = NULL;
+    cp_init.p_conn_params = &accepted_conn_params;
     cp_init.first_conn_params_update_delay = FIRST_CONN_PARAMS_UPDATE_DELAY;
     cp_init.next_conn_params_update_delay = NEXT_CONN_PARAMS_UPDATE_DELAY;
     cp_init.max_conn_params_update_count = MAX_CONN_PARAMS_UPDATE_COUNT;
@@ -216,8 +723,68 @@ static void sleep_mode_enter(void)
     APP_ERROR_CHECK(err_code);
 }
 
-/**@brief Function for handling advertising events.
+/**@brief Function for starting advertising with the directed tier to the central that disconnected last.
+ *
+ * @details ble_advertising falls through to fast advertising if no central is known.
+ */
+static void advertising_reconnect_start(void)
+{
+#if ESTC_ADV_EXTENDED_ENABLED
+    // High duty directed advertising is legacy only
+    adv_format_set(false);
+#endif
+
+    if (m_reconnect_peer_id != PM_PEER_ID_INVALID)
+    {
+        // Lets the SoftDevice resolve the private address of the bond; without it only
+        // an unchanged address is reached
+        (void)pm_device_identities_list_set(&m_reconnect_peer_id, 1);
+    }
+
+    adv_conn_cfg_select();
+    ret_code_t err_code = ble_advertising_start(&m_advertising, BLE_ADV_MODE_DIRECTED_HIGH_DUTY);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for replacing running undirected advertising with the directed tier, runs from the main loop.
+ */
+static void advertising_reconnect_restart(void *p_event_data, uint16_t event_size)
+{
+    // Fails if a central connected in the meantime, ble_evt_handler() then restarts advertising
+    if (sd_ble_gap_adv_stop(m_advertising.adv_handle) != NRF_SUCCESS)
+    {
+        return;
+    }
+
+    advertising_reconnect_start();
+}
+
+/**@brief Function for the estimated average current of an advertising tier, in uA.
+ *
+ * @param[in] interval   Advertising interval in units of 0.625 ms.
+ * @param[in] charge_nc  Charge of one advertising event.
+ */
+static uint32_t adv_current_estimate(uint32_t interval, uint32_t charge_nc)
+{
+    return SYSTEM_IDLE_CURRENT_UA + charge_nc * 1000 / (interval * 625);
+}
+
+/**@brief Function for reporting the estimated current of the advertising tiers.
  */
+static void adv_current_report(void)
+{
+    NRF_LOG_INFO("ADV tiers: fast %d ms for %d s ~%d uA, then slow %d ms ~%d uA",
+                 APP_ADV_INTERVAL * 625 / 1000, APP_ADV_DURATION / 100, adv_current_estimate(APP_ADV_INTERVAL, ADV_EVENT_CHARGE_NC),
+                 APP_ADV_SLOW_INTERVAL * 625 / 1000, adv_current_estimate(APP_ADV_SLOW_INTERVAL, ADV_EVENT_CHARGE_NC));
+#if ESTC_ADV_EXTENDED_ENABLED
+    uint32_t charge_nc = (ADV_EVENT_CHARGE_NC + ADV_EXT_EVENT_CHARGE_NC) / 2;
+    NRF_LOG_INFO("  alternating with extended advertising (PHY 0x%x) every %d ms: fast ~%d uA, slow ~%d uA",
+                 ESTC_ADV_EXTENDED_PHY, ADV_FORMAT_SWITCH_MS, adv_current_estimate(APP_ADV_INTERVAL, charge_nc),
+                 adv_current_estimate(APP_ADV_SLOW_INTERVAL, charge_nc));
+#endif
+    NRF_LOG_INFO("  PWM adds ~%d uA while the light is lit, nothing while it is dark", PWM_ACTIVE_CURRENT_UA);
+}
+
 static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 {
     ret_code_t err_code;
@@ -225,14 +792,72 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
     switch (ble_adv_evt)
     {
     case BLE_ADV_EVT_FAST:
+#if ESTC_ADV_EXTENDED_ENABLED
+        if (m_adv_switching)
+        {
+            break;
+        }
+        m_adv_fast_start = hal_timer_stamp_get();
+#endif
+        // The light state may have changed while directed advertising ran, which carries no data
+        adv_data_update();
         NRF_LOG_INFO("ADV Event: Start fast advertising");
-        err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING);
-        APP_ERROR_CHECK(err_code);
+        // Keep the connected indication while other centrals are connected.
+        if (ble_conn_state_peripheral_conn_count() == 0)
+        {
+            err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING);
+            APP_ERROR_CHECK(err_code);
+        }
+        break;
+
+    case BLE_ADV_EVT_DIRECTED_HIGH_DUTY:
+        NRF_LOG_INFO("ADV Event: Start directed advertising to the last central");
+        if (ble_conn_state_peripheral_conn_count() == 0)
+        {
+            err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_DIRECTED);
+            APP_ERROR_CHECK(err_code);
+        }
+        break;
+
+    case BLE_ADV_EVT_PEER_ADDR_REQUEST:
+        // Without a reply the directed tier is skipped
+        if (m_reconnect_pending)
+        {
+            // A bonded central is addressed by its identity, so it is found again after changing its private address
+            pm_peer_data_bonding_t bonding_data;
+            ble_gap_addr_t *p_addr = &m_reconnect_addr;
+
+            if (m_reconnect_peer_id != PM_PEER_ID_INVALID &&
+                pm_peer_data_bonding_load(m_reconnect_peer_id, &bonding_data) == NRF_SUCCESS)
+            {
+                p_addr = &bonding_data.peer_ble_id.id_addr_info;
+            }
+
+            err_code = ble_advertising_peer_addr_reply(&m_advertising, p_addr);
+            APP_ERROR_CHECK(err_code);
+        }
+        break;
+
+    case BLE_ADV_EVT_SLOW:
+#if ESTC_ADV_EXTENDED_ENABLED
+        if (m_adv_switching)
+        {
+            break;
+        }
+#endif
+        adv_data_update();
+        NRF_LOG_INFO("ADV Event: Start slow advertising");
+        // The light keeps running, the LED indication timer is stopped to avoid extra wakeups.
+        if (ble_conn_state_peripheral_conn_count() == 0)
+        {
+            err_code = bsp_indication_set(BSP_INDICATE_IDLE);
+            APP_ERROR_CHECK(err_code);
+        }
         break;
 
     case BLE_ADV_EVT_IDLE:
+        // Slow advertising does not time out, system-off is only entered on request (BSP_EVENT_SLEEP).
         NRF_LOG_INFO("ADV Event: idle, no connectable advertising is ongoing");
-        sleep_mode_enter();
         break;
 
     default:
@@ -240,6 +865,20 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
     }
 }
 
+/**@brief Function for applying a group command advertisement.
+ *
+ * @details Runs in the SoftDevice event context for every advertisement heard, anything that is not
+ *          a group command for this light is dropped after a few byte compares. Scanning pauses on
+ *          every report and is resumed here.
+ */
+static void on_adv_report(ble_gap_evt_adv_report_t const *p_report)
+{
+    (void)estc_group_adv_report(&m_estc_service, p_report->data.p_data, p_report->data.len);
+
+    ret_code_t err_code = sd_ble_gap_scan_start(NULL, &m_scan_buffer);
+    APP_ERROR_CHECK(err_code);
+}
+
 /**@brief Function for handling BLE events.
  */
 static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
@@ -249,19 +888,114 @@ static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
     switch (p_ble_evt->header.evt_id)
     {
     case BLE_GAP_EVT_DISCONNECTED:
-        NRF_LOG_INFO("Disconnected (conn_handle: %d)", p_ble_evt->evt.gap_evt.conn_handle);
-        // LED indication will be changed when advertising starts.
-        break;
+    {
+        uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+        uint32_t links = ble_conn_state_peripheral_conn_count();
+
+        NRF_LOG_INFO("Disconnected (conn_handle: %d), %d link(s) left", conn_handle, links);
+
+        ble_link_ctx_t const *p_link = ble_links_get(conn_handle);
+        if (p_link != NULL)
+        {
+            m_reconnect_addr = p_link->peer_addr;
+            m_reconnect_peer_id = p_link->peer_id;
+            m_reconnect_pending = true;
+            m_reconnect_start = hal_timer_stamp_get();
+
+            ble_links_disconnected(conn_handle);
+        }
+
+        if (conn_handle == m_stream_cfg_conn_handle)
+        {
+            m_stream_cfg_conn_handle = BLE_CONN_HANDLE_INVALID;
+        }
+
+        // Advertising was stopped while all links were in use, otherwise undirected advertising
+        // is replaced from the main loop. LED indication will be changed when advertising starts.
+        if (links == LINK_COUNT - 1)
+        {
+            advertising_reconnect_start();
+        }
+        else
+        {
+            err_code = app_sched_event_put(NULL, 0, advertising_reconnect_restart);
+            APP_ERROR_CHECK(err_code);
+
+            if (links != 0)
+            {
+                err_code = bsp_indication_set(BSP_INDICATE_CONNECTED);
+                APP_ERROR_CHECK(err_code);
+            }
+        }
+    }
+    break;
 
     case BLE_GAP_EVT_CONNECTED:
-        NRF_LOG_INFO("Connected (conn_handle: %d)", p_ble_evt->evt.gap_evt.conn_handle);
+    {
+        uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+        uint32_t links = ble_conn_state_peripheral_conn_count();
+
+        NRF_LOG_INFO("Connected (conn_handle: %d), %d link(s) in use", conn_handle, links);
+
+        ble_gap_addr_t const *p_peer_addr = &p_ble_evt->evt.gap_evt.params.connected.peer_addr;
+        if (m_reconnect_pending && p_peer_addr->addr_type == m_reconnect_addr.addr_type &&
+            memcmp(p_peer_addr->addr, m_reconnect_addr.addr, BLE_GAP_ADDR_LEN) == 0)
+        {
+            // A central using a new resolvable address is not recognized and not reported
+            m_reconnect_pending = false;
+            NRF_LOG_INFO("Reconnect of the last central after %d ms (%s advertising)",
+                         hal_timer_elapsed_ms(m_reconnect_start),
+                         m_advertising.adv_mode_current == BLE_ADV_MODE_DIRECTED_HIGH_DUTY ? "directed" : "undirected");
+        }
 
         err_code = bsp_indication_set(BSP_INDICATE_CONNECTED);
         APP_ERROR_CHECK(err_code);
 
-        m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-        err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle);
+        ble_link_ctx_t *p_link = ble_links_connected(conn_handle, p_peer_addr);
+        APP_ERROR_CHECK_BOOL(p_link != NULL);
+
+        if (m_adv_conn_cfg_tag == APP_BLE_CONN_CFG_TAG_STREAM)
+        {
+            m_stream_cfg_conn_handle = conn_handle;
+            p_link->event_length = ESTC_STREAM_CONN_EVENT_LENGTH;
+        }
+        NRF_LOG_INFO("%d us reserved per connection event (conn_handle: %d)", p_link->event_length * 1250, conn_handle);
+
+        // Bonded centrals re-encrypt with the stored keys, which restores their CCCDs. Asking every
+        // new central to bond would put a pairing in front of its first write, so that is opt-in;
+        // otherwise a central that wants to cache the attribute table starts pairing itself.
+        pm_peer_id_t peer_id;
+        if (ESTC_BOND_REQUEST_ENABLED ||
+            (pm_peer_id_get(conn_handle, &peer_id) == NRF_SUCCESS && peer_id != PM_PEER_ID_INVALID))
+        {
+            err_code = pm_conn_secure(conn_handle, false);
+            if (err_code != NRF_ERROR_BUSY)
+            {
+                APP_ERROR_CHECK(err_code);
+            }
+        }
+        err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr[ble_links_index(p_link)], conn_handle);
         APP_ERROR_CHECK(err_code);
+
+        link_phy_2m_request(p_link);
+
+        conn_params_report(conn_handle, &p_ble_evt->evt.gap_evt.params.connected.conn_params);
+
+        // Keep accepting centrals until every link is in use.
+        if (links < LINK_COUNT)
+        {
+            advertising_start();
+        }
+    }
+    break;
+
+    case BLE_GAP_EVT_ADV_REPORT:
+        on_adv_report(&p_ble_evt->evt.gap_evt.params.adv_report);
+        break;
+
+    case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+        conn_params_report(p_ble_evt->evt.gap_evt.conn_handle,
+                           &p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params);
         break;
 
     case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
@@ -277,6 +1011,31 @@ static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
     }
     break;
 
+    case BLE_GAP_EVT_PHY_UPDATE:
+    {
+        ble_gap_evt_phy_update_t const *p_phy = &p_ble_evt->evt.gap_evt.params.phy_update;
+        ble_link_ctx_t *p_link = ble_links_get(p_ble_evt->evt.gap_evt.conn_handle);
+
+        if (p_phy->status != BLE_HCI_STATUS_CODE_SUCCESS)
+        {
+            // Peer refused or does not support the update, the previous PHY stays in use.
+            NRF_LOG_INFO("PHY: update failed (conn_handle: %d, status 0x%x)",
+                         p_ble_evt->evt.gap_evt.conn_handle, p_phy->status);
+        }
+        else if (p_link != NULL)
+        {
+            p_link->tx_phy = p_phy->tx_phy;
+            p_link->rx_phy = p_phy->rx_phy;
+        }
+
+        if (p_link != NULL)
+        {
+            NRF_LOG_INFO("PHY: conn_handle %d uses TX 0x%x, RX 0x%x", p_ble_evt->evt.gap_evt.conn_handle,
+                         p_link->tx_phy, p_link->rx_phy);
+        }
+    }
+    break;
+
     case BLE_GATTC_EVT_TIMEOUT:
         // Disconnect on GATT Client timeout event.
         NRF_LOG_DEBUG("GATT Client Timeout (conn_handle: %d)", p_ble_evt->evt.gattc_evt.conn_handle);
@@ -299,6 +1058,33 @@ static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
     }
 }
 
+#if ESTC_STREAM_CONN_EVENT_LENGTH
+/**@brief Function for adding the connection configuration of the streaming link.
+ *
+ * @details The configuration nrf_sdh_ble_default_cfg_set() sets for APP_BLE_CONN_CFG_TAG, for one
+ *          link and with ESTC_STREAM_CONN_EVENT_LENGTH. The SoftDevice keeps the RAM of that link
+ *          on top of the others, ble_stack_init() logs the start of application RAM it needs.
+ */
+static void stream_conn_cfg_set(uint32_t ram_start)
+{
+    ret_code_t err_code;
+    ble_cfg_t ble_cfg;
+
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag = APP_BLE_CONN_CFG_TAG_STREAM;
+    ble_cfg.conn_cfg.params.gap_conn_cfg.conn_count = 1;
+    ble_cfg.conn_cfg.params.gap_conn_cfg.event_length = ESTC_STREAM_CONN_EVENT_LENGTH;
+    err_code = sd_ble_cfg_set(BLE_CONN_CFG_GAP, &ble_cfg, ram_start);
+    APP_ERROR_CHECK(err_code);
+
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag = APP_BLE_CONN_CFG_TAG_STREAM;
+    ble_cfg.conn_cfg.params.gatt_conn_cfg.att_mtu = NRF_SDH_BLE_GATT_MAX_MTU_SIZE;
+    err_code = sd_ble_cfg_set(BLE_CONN_CFG_GATT, &ble_cfg, ram_start);
+    APP_ERROR_CHECK(err_code);
+}
+#endif
+
 /**@brief Function for initializing the BLE stack.
  */
 void ble_stack_init(void)
@@ -314,10 +1100,30 @@ void ble_stack_init(void)
     err_code = nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start);
     APP_ERROR_CHECK(err_code);
 
+#if ESTC_STREAM_CONN_EVENT_LENGTH
+    stream_conn_cfg_set(ram_start);
+#endif
+
+    uint32_t ram_start_linked = ram_start;
+
     // Enable BLE stack.
     err_code = nrf_sdh_ble_enable(&ram_start);
     APP_ERROR_CHECK(err_code);
 
+    // The SoftDevice returns the exact start of application RAM it needs for this configuration,
+    // the RAM origin of the linker script can be moved down to it
+    NRF_LOG_INFO("BLE stack: %d peripheral link(s), %d byte attribute table, RAM from 0x%x, minimum 0x%x (%d bytes spare)",
+                 LINK_COUNT, NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE, ram_start_linked, ram_start,
+                 ram_start_linked - ram_start);
+
+    // A burst of writes or notifications then completes in one connection event instead of being
+    // spread over several intervals, the extension only uses radio time no other role needs
+    err_code = hal_ble_conn_evt_ext_set(true);
+    APP_ERROR_CHECK(err_code);
+
+    NRF_LOG_INFO("BLE stack: %d us reserved per connection event, %d us on the streaming link, event length extension enabled",
+                 NRF_SDH_BLE_GAP_EVENT_LENGTH * 1250, ESTC_STREAM_CONN_EVENT_LENGTH * 1250);
+
     // Register a handler for BLE events.
     NRF_SDH_BLE_OBSERVER(m_ble_observer, APP_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
 }
@@ -335,11 +1141,20 @@ static void bsp_event_handler(bsp_event_t event)
         break; // BSP_EVENT_SLEEP
 
     case BSP_EVENT_DISCONNECT:
-        err_code = sd_ble_gap_disconnect(m_conn_handle,
-                                         BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
-        if (err_code != NRF_ERROR_INVALID_STATE)
+        for (uint8_t i = 0; i < LINK_COUNT; i++)
         {
-            APP_ERROR_CHECK(err_code);
+            uint16_t conn_handle = ble_links_at(i)->conn_handle;
+            if (conn_handle == BLE_CONN_HANDLE_INVALID)
+            {
+                continue;
+            }
+
+            err_code = sd_ble_gap_disconnect(conn_handle,
+                                             BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+            if (err_code != NRF_ERROR_INVALID_STATE)
+            {
+                APP_ERROR_CHECK(err_code);
+            }
         }
         break; // BSP_EVENT_DISCONNECT
     default:
@@ -366,18 +1181,38 @@ void advertising_init(void)
 {
     ret_code_t err_code;
     ble_advertising_init_t init;
+    estc_cmd_batch_t state;
 
     memset(&init, 0, sizeof(init));
 
     init.advdata.name_type = BLE_ADVDATA_FULL_NAME;
     init.advdata.flags = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
 
+    // The 128-bit service UUID and the light state fill 28 of the 31 scan response bytes.
     init.srdata.uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
     init.srdata.uuids_complete.p_uuids = m_adv_uuids;
+    init.srdata.p_manuf_specific_data = &m_adv_manuf_data;
+
+    // The light state was restored from flash before advertising is set up
+    estc_service_light_state_get(&state);
+    adv_state_encode(&state);
+    m_advdata = init.advdata;
+    m_srdata = init.srdata;
 
+    // Tiers of adv_tiers.h: directed to the last central (1.28 s), fast (180 s), slow (no timeout).
+    init.config.ble_adv_directed_high_duty_enabled = true;
     init.config.ble_adv_fast_enabled = true;
     init.config.ble_adv_fast_interval = APP_ADV_INTERVAL;
     init.config.ble_adv_fast_timeout = APP_ADV_DURATION;
+    init.config.ble_adv_slow_enabled = true;
+    init.config.ble_adv_slow_interval = APP_ADV_SLOW_INTERVAL;
+    init.config.ble_adv_slow_timeout = APP_ADV_SLOW_DURATION;
+#if ESTC_ADV_EXTENDED_ENABLED
+    // Advertising starts in the legacy format
+    adv_format_config(&init.config, false);
+#endif
+    // Advertising is restarted by ble_evt_handler() depending on the number of free links.
+    init.config.ble_adv_on_disconnect_disabled = true;
 
     init.evt_handler = on_adv_evt;
 
@@ -385,12 +1220,38 @@ void advertising_init(void)
     APP_ERROR_CHECK(err_code);
 
     ble_advertising_conn_cfg_tag_set(&m_advertising, APP_BLE_CONN_CFG_TAG);
+
+#if ESTC_ADV_EXTENDED_ENABLED
+    // Without a scan response, the name, the service UUID and the full snapshot share one packet
+    m_ext_advdata = m_advdata;
+    m_ext_advdata.uuids_complete = m_srdata.uuids_complete;
+    m_ext_advdata.p_manuf_specific_data = &m_adv_ext_manuf_data;
+
+    err_code = hal_timer_create(&m_adv_format_timer, true, adv_format_timer_handler);
+    APP_ERROR_CHECK(err_code);
+    err_code = hal_timer_start(m_adv_format_timer, ADV_FORMAT_SWITCH_MS, NULL);
+    APP_ERROR_CHECK(err_code);
+#endif
+
+    adv_current_report();
 }
 
 /**@brief Function for starting advertising.
  */
 void advertising_start(void)
 {
+    adv_conn_cfg_select();
     ret_code_t err_code = ble_advertising_start(&m_advertising, BLE_ADV_MODE_FAST);
     APP_ERROR_CHECK(err_code);
-}
\ No newline at end of file
+}
+
+/**@brief Function for starting the low duty cycle scan for group command advertisements.
+ */
+void observer_start(void)
+{
+    ret_code_t err_code = sd_ble_gap_scan_start(&m_scan_params, &m_scan_buffer);
+    APP_ERROR_CHECK(err_code);
+
+    NRF_LOG_INFO("Observer: %d ms window every %d ms, ~%d uA", SCAN_WINDOW * 625 / 1000, SCAN_INTERVAL * 625 / 1000,
+                 SCAN_RX_CURRENT_UA * SCAN_WINDOW / SCAN_INTERVAL);
+}
@@ -19,6 +19,7 @@
 #include "nrf_ble_gatt.h"
 #include "nrf_ble_qwr.h"
 #include "estc_service.h"
+#include "estc_command.h"
 
 ble_estc_service_t *get_estc_service(void);
 nrf_ble_gatt_t *get_gatt(void);
@@ -29,12 +30,11 @@ void ble_stack_init(void);
 void gap_params_init(void);
 void gatt_init(void);
 void services_init(void);
+void peer_manager_init(void);
 void conn_params_init(void);
 void advertising_init(void);
 void advertising_start(void);
+void observer_start(void);
 void buttons_leds_init(void);
 
-void rgb_state_write_handler(uint16_t conn_handle, ble_estc_service_t *p_lbs, uint8_t new_state);
-void rgb_value_write_handler(uint16_t conn_handle, ble_estc_service_t *p_lbs, uint8_t r, uint8_t g, uint8_t b);
-
 #endif // BLE_MODULE_H
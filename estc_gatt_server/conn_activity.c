@@ -0,0 +1,144 @@
+#include "conn_activity.h"
+
+#include <stddef.h>
+#include "sdk_config.h"
+#include "app_error.h"
+#include "hal_ble.h"
+#include "hal_timer.h"
+
+#define LINK_COUNT NRF_SDH_BLE_PERIPHERAL_LINK_COUNT
+
+typedef struct
+{
+    uint16_t conn_handle;
+    bool fast;              // The fast connection parameters were requested
+    uint32_t last_activity; // Timestamp of the last write, see hal_timer_stamp_get()
+} conn_activity_link_t;
+
+static conn_activity_link_t m_links[LINK_COUNT];
+
+static ble_gap_conn_params_t const *m_p_fast;
+static ble_gap_conn_params_t const *m_p_idle;
+
+static hal_timer_id_t m_idle_timer;
+
+// BLE_CONN_HANDLE_INVALID finds a free context
+static conn_activity_link_t *link_find(uint16_t conn_handle)
+{
+    for (uint8_t i = 0; i < LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Group commands are applied without a link, with BLE_CONN_HANDLE_INVALID
+static conn_activity_link_t *link_get(uint16_t conn_handle)
+{
+    return conn_handle != BLE_CONN_HANDLE_INVALID ? link_find(conn_handle) : NULL;
+}
+
+static bool params_request(conn_activity_link_t *p_link, ble_gap_conn_params_t const *p_params)
+{
+    ret_code_t err_code = hal_ble_conn_params_update(p_link->conn_handle, p_params);
+
+    // A pending procedure is not an error, the request is retried on the next write or check
+    if (err_code == NRF_ERROR_BUSY || err_code == NRF_ERROR_INVALID_STATE)
+    {
+        return false;
+    }
+    APP_ERROR_CHECK(err_code);
+
+    return true;
+}
+
+static void idle_timer_handler(void *p_context)
+{
+    bool any_fast = false;
+
+    for (uint8_t i = 0; i < LINK_COUNT; i++)
+    {
+        conn_activity_link_t *p_link = &m_links[i];
+        if (p_link->conn_handle == BLE_CONN_HANDLE_INVALID || !p_link->fast)
+        {
+            continue;
+        }
+
+        if (hal_timer_elapsed_ms(p_link->last_activity) >= CONN_ACTIVITY_IDLE_TIMEOUT_MS &&
+            params_request(p_link, m_p_idle))
+        {
+            p_link->fast = false;
+        }
+
+        any_fast |= p_link->fast;
+    }
+
+    if (!any_fast)
+    {
+        hal_timer_stop(m_idle_timer);
+    }
+}
+
+ret_code_t conn_activity_init(ble_gap_conn_params_t const *p_fast, ble_gap_conn_params_t const *p_idle)
+{
+    m_p_fast = p_fast;
+    m_p_idle = p_idle;
+
+    for (uint8_t i = 0; i < LINK_COUNT; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+
+    return hal_timer_create(&m_idle_timer, true, idle_timer_handler);
+}
+
+void conn_activity_connected(uint16_t conn_handle)
+{
+    conn_activity_link_t *p_link = link_find(BLE_CONN_HANDLE_INVALID);
+    if (p_link == NULL || conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return;
+    }
+
+    p_link->conn_handle = conn_handle;
+    p_link->fast = false;
+}
+
+void conn_activity_disconnected(uint16_t conn_handle)
+{
+    conn_activity_link_t *p_link = link_get(conn_handle);
+    if (p_link != NULL)
+    {
+        p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+}
+
+void conn_activity_write(uint16_t conn_handle)
+{
+    conn_activity_link_t *p_link = link_get(conn_handle);
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    p_link->last_activity = hal_timer_stamp_get();
+
+    if (!p_link->fast && params_request(p_link, m_p_fast))
+    {
+        p_link->fast = true;
+
+        ret_code_t err_code = hal_timer_start(m_idle_timer, CONN_ACTIVITY_CHECK_INTERVAL_MS, NULL);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+bool conn_activity_is_fast(uint16_t conn_handle)
+{
+    conn_activity_link_t const *p_link = link_get(conn_handle);
+
+    return p_link != NULL && p_link->fast;
+}
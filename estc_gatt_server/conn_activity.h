@@ -0,0 +1,48 @@
+#ifndef CONN_ACTIVITY_H__
+#define CONN_ACTIVITY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "sdk_errors.h"
+
+/**
+ * @brief Connection parameters that follow the write activity of each link
+ *
+ * @details Links start with the idle connection parameters. A control write requests the fast
+ *          ones, a link without writes for CONN_ACTIVITY_IDLE_TIMEOUT_MS returns to the idle ones.
+ *          The check runs every CONN_ACTIVITY_CHECK_INTERVAL_MS while any link is fast. A request
+ *          refused because a procedure is pending is retried on the next write or check.
+ */
+
+#define CONN_ACTIVITY_IDLE_TIMEOUT_MS 5000    // Inactivity time after which a link returns to the idle parameters
+#define CONN_ACTIVITY_CHECK_INTERVAL_MS 1000  // Period of the inactivity check while any link is fast
+
+/**
+ * @brief Create the inactivity check timer
+ * @param p_fast Parameters requested on a write, must stay valid
+ * @param p_idle Parameters requested after the idle timeout, must stay valid
+ */
+ret_code_t conn_activity_init(ble_gap_conn_params_t const *p_fast, ble_gap_conn_params_t const *p_idle);
+
+/**
+ * @brief Start tracking a link, it uses the idle parameters
+ */
+void conn_activity_connected(uint16_t conn_handle);
+
+/**
+ * @brief Stop tracking a link
+ */
+void conn_activity_disconnected(uint16_t conn_handle);
+
+/**
+ * @brief Record a control write on a link and request the fast parameters if it is idle
+ */
+void conn_activity_write(uint16_t conn_handle);
+
+/**
+ * @brief Tell whether the fast parameters were requested for a link
+ */
+bool conn_activity_is_fast(uint16_t conn_handle);
+
+#endif // CONN_ACTIVITY_H__
@@ -0,0 +1,512 @@
+#include "estc_anim.h"
+
+#include <string.h>
+#include "nrf_log.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+
+#define ANIM_WINDOW_MASK (ESTC_ANIM_WINDOW_SIZE - 1)
+// A varint of 3 bytes carries 21 bits, enough for every step and loop count
+#define ANIM_VARINT_SIZE_MAX 3
+// Runs decoded per pass, a hold takes one and a ramp one per step
+#define ANIM_OUT_RUNS 32
+
+STATIC_ASSERT((ESTC_ANIM_WINDOW_SIZE & ANIM_WINDOW_MASK) == 0);
+STATIC_ASSERT(ESTC_ANIM_LOOP_BODY_MAX < ESTC_ANIM_WINDOW_SIZE);
+STATIC_ASSERT(ESTC_ANIM_INSN_SIZE_MAX == 1 + 3 + ANIM_VARINT_SIZE_MAX);
+
+// Parsed instruction
+typedef struct
+{
+    uint8_t opcode;
+    uint8_t index;
+    uint8_t rgb[3];
+    uint32_t arg[2];
+} anim_insn_t;
+
+// Steps of one color decoded outside the critical region
+typedef struct
+{
+    rgb_color_t color;
+    uint16_t steps;
+} anim_run_t;
+
+// Decoder state, owned by the main loop
+typedef struct
+{
+    bool running;
+    uint8_t const *p_program; // Program read in place, NULL when decoding from the window
+    uint32_t program_len;
+    uint32_t start; // Position of the first byte of the animation
+    uint32_t read;  // Position of the next instruction
+    rgb_color_t color;
+    rgb_color_t palette[ESTC_ANIM_PALETTE_SIZE];
+
+    // Instruction being played
+    bool ramp;
+    rgb_color_t from;
+    uint16_t steps;
+    uint16_t done;
+
+    // Loop being replayed
+    bool looping;
+    uint32_t loop_start;
+    uint32_t loop_end;
+    uint32_t loop_resume;
+    uint16_t loop_left;
+} anim_decoder_t;
+
+// The window positions are free running. The decoder runs on a copy outside the critical region
+// and publishes it with its steps inside, so the BLE event context never sees it half way.
+// Bytes from m_keep on are not overwritten in the meantime.
+static uint8_t m_window[ESTC_ANIM_WINDOW_SIZE];
+static uint32_t m_write; // BLE event context
+static uint32_t m_keep;  // Main loop, oldest byte the decoder may still read
+static uint32_t m_restart_at;
+static bool m_restart;
+static bool m_stop;
+
+static anim_decoder_t m_dec;  // Published state
+static anim_decoder_t m_work; // Main loop copy being decoded
+
+// Output of the pass being decoded
+static anim_run_t m_out[ANIM_OUT_RUNS];
+static uint8_t m_out_count;
+static uint32_t m_out_space; // Stream buffer steps left
+static bool m_out_flush;     // Commit a partly filled buffer if the stream starves
+static bool m_out_end;       // The animation ended
+
+pwm_stream_result_t estc_anim_feed(uint8_t const *p_data, uint16_t len, bool restart)
+{
+    if (len > ESTC_ANIM_CHUNK_MAX)
+    {
+        return PWM_STREAM_INVALID;
+    }
+
+    if (restart)
+    {
+        m_restart_at = m_write;
+        m_restart = true;
+    }
+
+    // A restart frees the window once the decoder took it over
+    if (m_write + len - m_keep > ESTC_ANIM_WINDOW_SIZE)
+    {
+        return PWM_STREAM_NO_SPACE;
+    }
+
+    for (uint16_t i = 0; i < len; i++)
+    {
+        m_window[(m_write + i) & ANIM_WINDOW_MASK] = p_data[i];
+    }
+    m_write += len;
+
+    return PWM_STREAM_OK;
+}
+
+bool estc_anim_program_stop(uint8_t const *p_program)
+{
+    // The published decoder is seen between two decode passes. A pending restart replaces the
+    // program anyway.
+    if (!m_dec.running || m_dec.p_program != p_program || m_restart)
+    {
+        return false;
+    }
+
+    m_stop = true;
+    return true;
+}
+
+static uint8_t anim_byte(uint32_t pos)
+{
+    if (m_work.p_program != NULL)
+    {
+        return m_work.p_program[pos];
+    }
+    return m_window[pos & ANIM_WINDOW_MASK];
+}
+
+/**
+ * @brief Parse a varint
+ * @return Number of bytes, 0 if more bytes are needed, -1 if it is too long
+ */
+static int8_t anim_varint_parse(uint32_t pos, uint32_t avail, uint32_t *p_value)
+{
+    uint32_t value = 0;
+
+    for (uint8_t i = 0; i < ANIM_VARINT_SIZE_MAX; i++)
+    {
+        if (i == avail)
+        {
+            return 0;
+        }
+
+        uint8_t byte = anim_byte(pos + i);
+        value |= (uint32_t)(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0)
+        {
+            *p_value = value;
+            return i + 1;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Parse the instruction at a window position
+ * @return Number of bytes, 0 if more bytes are needed, -1 for unknown opcodes and overlong varints
+ */
+static int8_t anim_insn_parse(uint32_t pos, uint32_t avail, anim_insn_t *p_insn)
+{
+    uint8_t rgb_len = 0;
+    uint8_t varints = 1;
+
+    if (avail == 0)
+    {
+        return 0;
+    }
+
+    uint8_t opcode = anim_byte(pos);
+    p_insn->opcode = opcode < ESTC_ANIM_OP_RAMP_DELTA ? opcode & 0xF0 : opcode;
+    p_insn->index = opcode & 0x0F;
+
+    switch (p_insn->opcode)
+    {
+    case ESTC_ANIM_OP_HOLD_PALETTE:
+    case ESTC_ANIM_OP_RAMP_PALETTE:
+    case ESTC_ANIM_OP_HOLD:
+        break;
+    case ESTC_ANIM_OP_HOLD_RGB:
+    case ESTC_ANIM_OP_RAMP_RGB:
+    case ESTC_ANIM_OP_RAMP_DELTA:
+        rgb_len = 3;
+        break;
+    case ESTC_ANIM_OP_LOOP:
+        varints = 2;
+        break;
+    case ESTC_ANIM_OP_END:
+        return 1;
+    default:
+        return -1;
+    }
+
+    uint8_t len = 1 + rgb_len;
+    if (avail < len)
+    {
+        return 0;
+    }
+    for (uint8_t i = 0; i < rgb_len; i++)
+    {
+        p_insn->rgb[i] = anim_byte(pos + 1 + i);
+    }
+
+    for (uint8_t i = 0; i < varints; i++)
+    {
+        int8_t varint_len = anim_varint_parse(pos + len, avail - len, &p_insn->arg[i]);
+        if (varint_len <= 0)
+        {
+            return varint_len;
+        }
+        len += varint_len;
+    }
+
+    return len;
+}
+
+static uint8_t anim_clamp(int16_t value)
+{
+    return value < 0 ? 0 : (value > UINT8_MAX ? UINT8_MAX : value);
+}
+
+// Rounded to the nearest, as the float math of show generators does. The sum is never negative.
+static uint8_t anim_interpolate(uint8_t from, uint8_t to, uint16_t step, uint16_t steps)
+{
+    int32_t twice = 2 * (int32_t)steps * from + 2 * (int32_t)step * ((int32_t)to - from) + steps;
+    return (uint8_t)(twice / (2 * (int32_t)steps));
+}
+
+/**
+ * @brief Execute the instruction at the read position
+ * @return false if the instruction is malformed
+ */
+static bool anim_insn_execute(anim_insn_t const *p_insn, uint8_t len)
+{
+    rgb_color_t const rgb = {p_insn->rgb[0], p_insn->rgb[1], p_insn->rgb[2]};
+    rgb_color_t target = m_work.color;
+    bool ramp = false;
+
+    switch (p_insn->opcode)
+    {
+    case ESTC_ANIM_OP_HOLD_PALETTE:
+        target = m_work.palette[p_insn->index];
+        break;
+    case ESTC_ANIM_OP_HOLD_RGB:
+        m_work.palette[p_insn->index] = rgb;
+        target = rgb;
+        break;
+    case ESTC_ANIM_OP_RAMP_PALETTE:
+        target = m_work.palette[p_insn->index];
+        ramp = true;
+        break;
+    case ESTC_ANIM_OP_RAMP_RGB:
+        m_work.palette[p_insn->index] = rgb;
+        target = rgb;
+        ramp = true;
+        break;
+    case ESTC_ANIM_OP_RAMP_DELTA:
+        target.red = anim_clamp(m_work.color.red + (int8_t)p_insn->rgb[0]);
+        target.green = anim_clamp(m_work.color.green + (int8_t)p_insn->rgb[1]);
+        target.blue = anim_clamp(m_work.color.blue + (int8_t)p_insn->rgb[2]);
+        ramp = true;
+        break;
+    case ESTC_ANIM_OP_HOLD:
+        break;
+
+    case ESTC_ANIM_OP_LOOP:
+    {
+        uint32_t body_len = p_insn->arg[0];
+        uint32_t count = p_insn->arg[1];
+
+        if (m_work.looping || body_len == 0 || body_len > ESTC_ANIM_LOOP_BODY_MAX ||
+            body_len > m_work.read - m_work.start || count == 0 || count > ESTC_ANIM_LOOP_COUNT_MAX)
+        {
+            return false;
+        }
+
+        m_work.looping = true;
+        m_work.loop_end = m_work.read;
+        m_work.loop_start = m_work.read - body_len;
+        m_work.loop_resume = m_work.read + len;
+        m_work.loop_left = count;
+        m_work.read = m_work.loop_start;
+        return true;
+    }
+
+    case ESTC_ANIM_OP_END:
+        m_work.running = false;
+        m_work.read += len;
+        return true;
+
+    default:
+        return false;
+    }
+
+    if (p_insn->arg[0] == 0 || p_insn->arg[0] > ESTC_ANIM_STEPS_MAX)
+    {
+        return false;
+    }
+
+    m_work.ramp = ramp;
+    m_work.from = m_work.color;
+    m_work.color = target;
+    m_work.steps = p_insn->arg[0];
+    m_work.done = 0;
+    m_work.read += len;
+
+    return true;
+}
+
+static void anim_out_put(rgb_color_t color, uint16_t steps)
+{
+    m_out[m_out_count].color = color;
+    m_out[m_out_count].steps = steps;
+    m_out_count++;
+    m_out_space -= steps;
+}
+
+/**
+ * @brief Decode the steps of the current instruction the stream buffers and the output have room for
+ */
+static void anim_steps_play(void)
+{
+    uint16_t count = MIN(m_out_space, (uint32_t)(m_work.steps - m_work.done));
+
+    if (!m_work.ramp)
+    {
+        anim_out_put(m_work.color, count);
+        m_work.done += count;
+        return;
+    }
+
+    for (count = MIN(count, ANIM_OUT_RUNS - m_out_count); count != 0; count--)
+    {
+        m_work.done++;
+
+        rgb_color_t const step = {
+            anim_interpolate(m_work.from.red, m_work.color.red, m_work.done, m_work.steps),
+            anim_interpolate(m_work.from.green, m_work.color.green, m_work.done, m_work.steps),
+            anim_interpolate(m_work.from.blue, m_work.color.blue, m_work.done, m_work.steps),
+        };
+        anim_out_put(step, 1);
+    }
+}
+
+/**
+ * @brief Decode m_work into m_out, runs outside the critical region
+ * @param write Fed bytes end, m_write when the pass started
+ * @return true if the output is full and decoding can go on
+ */
+static bool anim_run(uint32_t write)
+{
+    while (m_work.running)
+    {
+        if (m_work.done != m_work.steps)
+        {
+            if (m_out_space == 0)
+            {
+                return false;
+            }
+            if (m_out_count == ANIM_OUT_RUNS)
+            {
+                return true;
+            }
+            anim_steps_play();
+            continue;
+        }
+
+        if (m_work.looping && m_work.read == m_work.loop_end)
+        {
+            if (--m_work.loop_left != 0)
+            {
+                m_work.read = m_work.loop_start;
+            }
+            else
+            {
+                m_work.read = m_work.loop_resume;
+                m_work.looping = false;
+            }
+            continue;
+        }
+
+        anim_insn_t insn;
+        uint32_t end = m_work.p_program != NULL ? m_work.program_len : write;
+        uint32_t avail = (m_work.looping ? m_work.loop_end : end) - m_work.read;
+        int8_t len = anim_insn_parse(m_work.read, avail, &insn);
+
+        if (len == 0 && !m_work.looping && m_work.p_program == NULL)
+        {
+            // Wait for the next chunk, the steps decoded so far must not stall the playback
+            m_out_flush = true;
+            return false;
+        }
+
+        if (len <= 0 || !anim_insn_execute(&insn, len))
+        {
+            NRF_LOG_WARNING("Animation: malformed instruction at byte %u", m_work.read - m_work.start);
+            m_work.running = false;
+        }
+    }
+
+    m_out_end = true;
+    return false;
+}
+
+/**
+ * @brief Start decoding from the window or from a program, call in a critical region
+ */
+static void anim_start(uint8_t const *p_program, uint32_t program_len, uint32_t start)
+{
+    memset(&m_dec, 0, sizeof(m_dec));
+    m_dec.running = true;
+    m_dec.p_program = p_program;
+    m_dec.program_len = program_len;
+    m_dec.start = start;
+    m_dec.read = start;
+}
+
+void estc_anim_play(uint8_t const *p_program, uint16_t len)
+{
+    CRITICAL_REGION_ENTER();
+    m_restart = false;
+    m_stop = false;
+    anim_start(p_program, len, 0);
+    CRITICAL_REGION_EXIT();
+}
+
+/**
+ * @brief Put the decoded steps into the stream buffers, call in a critical region
+ */
+static void anim_out_publish(void)
+{
+    uint8_t brightness = pwm_get_brightness();
+
+    for (uint8_t i = 0; i < m_out_count; i++)
+    {
+        pwm_stream_steps_put(m_out[i].color, m_out[i].steps, brightness);
+    }
+
+    if (m_out_flush || m_out_end)
+    {
+        pwm_stream_flush(m_out_end);
+    }
+}
+
+void estc_anim_decode(void)
+{
+    bool more = true;
+
+    while (more)
+    {
+        uint32_t write;
+
+        CRITICAL_REGION_ENTER();
+
+        if (m_stop)
+        {
+            m_stop = false;
+            if (m_dec.running)
+            {
+                m_dec.running = false;
+                pwm_stream_flush(true);
+            }
+        }
+
+        if (m_restart)
+        {
+            m_restart = false;
+            anim_start(NULL, 0, m_restart_at);
+        }
+
+        m_work = m_dec;
+        write = m_write;
+        m_out_count = 0;
+        m_out_space = pwm_stream_space_get();
+        m_out_flush = false;
+        m_out_end = false;
+
+        CRITICAL_REGION_EXIT();
+
+        more = m_work.running && anim_run(write);
+
+        CRITICAL_REGION_ENTER();
+
+        if (!m_stop && !m_restart)
+        {
+            m_dec = m_work;
+            anim_out_publish();
+        }
+        else
+        {
+            // Fed while decoding: the steps of the old animation are dropped, the next pass takes over
+            more = true;
+        }
+
+        // A loop body may start up to ESTC_ANIM_LOOP_BODY_MAX bytes before the next instruction,
+        // the bytes following the end of the animation are dropped
+        if (!m_dec.running || m_dec.p_program != NULL)
+        {
+            m_keep = m_write;
+        }
+        else if (m_dec.looping)
+        {
+            m_keep = m_dec.loop_start;
+        }
+        else
+        {
+            m_keep = m_dec.read - MIN(m_dec.read - m_dec.start, (uint32_t)ESTC_ANIM_LOOP_BODY_MAX);
+        }
+
+        CRITICAL_REGION_EXIT();
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef ESTC_ANIM_H__
+#define ESTC_ANIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pwm_control.h"
+
+/**
+ * @brief Compressed animations
+ *
+ * @details An animation is a byte code played in steps of HAL_PWM_STREAM_STEP_US. The decoder
+ *          keeps a current color and a palette of ESTC_ANIM_PALETTE_SIZE colors. Every
+ *          instruction starts with an opcode byte, the low nibble of the palette opcodes is a
+ *          palette index. Step counts are LEB128 varints (7 bits per byte, low bits first),
+ *          1 to ESTC_ANIM_STEPS_MAX.
+ *
+ *          Chunks are copied into a window of ESTC_ANIM_WINDOW_SIZE bytes and decoded in the main
+ *          loop into the PWM stream buffers, as far as those have room. An instruction may be
+ *          split across chunks. The last ESTC_ANIM_LOOP_BODY_MAX decoded bytes stay in the
+ *          window, so a loop replays its body from there.
+ *
+ *          Programs stored in flash are decoded the same way, read in place through the memory
+ *          mapped flash. Only the PWM stream buffers hold their steps in RAM.
+ *
+ *          tools/estc_anim.py encodes frame lists and checks the round trip.
+ */
+
+// Hold palette[i] for steps: 0x0i, steps
+#define ESTC_ANIM_OP_HOLD_PALETTE 0x00
+// Store r, g, b in palette[i] and hold it for steps: 0x1i, r, g, b, steps
+#define ESTC_ANIM_OP_HOLD_RGB 0x10
+// Ramp linearly to palette[i], the last step reaches it: 0x2i, steps
+#define ESTC_ANIM_OP_RAMP_PALETTE 0x20
+// Store r, g, b in palette[i] and ramp to it: 0x3i, r, g, b, steps
+#define ESTC_ANIM_OP_RAMP_RGB 0x30
+// Ramp to the current color plus signed deltas, clamped to 0..255: 0x40, dr, dg, db, steps
+#define ESTC_ANIM_OP_RAMP_DELTA 0x40
+// Hold the current color for steps: 0x41, steps
+#define ESTC_ANIM_OP_HOLD 0x41
+// Replay the body_len bytes in front of this opcode count more times: 0x50, body_len, count.
+// Both are varints, the body holds whole instructions and no loop.
+#define ESTC_ANIM_OP_LOOP 0x50
+// End of the animation, the light returns to its state once the steps before were played
+#define ESTC_ANIM_OP_END 0xFF
+
+#define ESTC_ANIM_PALETTE_SIZE 16
+#define ESTC_ANIM_STEPS_MAX 0xFFFF
+#define ESTC_ANIM_LOOP_COUNT_MAX 0xFFFF
+#define ESTC_ANIM_LOOP_BODY_MAX 128
+// Power of two
+#define ESTC_ANIM_WINDOW_SIZE 512
+// Longest instruction: opcode, r, g, b and a varint of 3 bytes, or a loop with two such varints
+#define ESTC_ANIM_INSN_SIZE_MAX 7
+// Largest chunk. The window keeps the loop body and the start of a split instruction besides it,
+// so a chunk always fits once the decoder caught up.
+#define ESTC_ANIM_CHUNK_MAX (ESTC_ANIM_WINDOW_SIZE - ESTC_ANIM_LOOP_BODY_MAX - (ESTC_ANIM_INSN_SIZE_MAX - 1))
+
+/**
+ * @brief Copy a chunk of an animation into the window, call from the BLE event context
+ * @param p_data Chunk
+ * @param len Length of the chunk
+ * @param restart Discard the animation not decoded yet, the chunk starts a new one
+ * @return PWM_STREAM_OK, PWM_STREAM_NO_SPACE until the decoder freed enough of the window,
+ *         PWM_STREAM_INVALID if the chunk is larger than ESTC_ANIM_CHUNK_MAX
+ */
+pwm_stream_result_t estc_anim_feed(uint8_t const *p_data, uint16_t len, bool restart);
+
+/**
+ * @brief Stop the animation after the steps decoded so far if it plays a program, call from the
+ *        BLE event context before the program is erased
+ * @details The next estc_anim_decode() ends the stream. An animation fed to the window or
+ *          another program plays on.
+ * @param p_program Program as given to estc_anim_play()
+ * @return true if the animation stops
+ */
+bool estc_anim_program_stop(uint8_t const *p_program);
+
+/**
+ * @brief Play a program in place instead of the fed bytes, call from the main loop
+ * @details Decoding starts with the next estc_anim_decode(). The caller takes the stream from the
+ *          upload feeding it, the call may be nested in the caller's critical region for that.
+ * @param p_program Program, stays readable until it ended or was replaced
+ * @param len Length of the program
+ */
+void estc_anim_play(uint8_t const *p_program, uint16_t len);
+
+/**
+ * @brief Decode the fed bytes into the PWM stream buffers, call from the main loop
+ * @details Stops when the stream buffers are full, the fed bytes run out or the animation
+ *          ended. A malformed animation is dropped, the steps decoded before still play.
+ *          Decoding runs outside the critical region, the lock is held to take the fed bytes
+ *          and to put the decoded steps into the stream buffers.
+ */
+void estc_anim_decode(void);
+
+#endif // ESTC_ANIM_H__
@@ -0,0 +1,458 @@
+#include "estc_bench.h"
+
+#if ESTC_BENCH_ENABLED
+
+#include <string.h>
+#include "app_util.h"
+#include "nrf_log.h"
+#include "hal_ble.h"
+#include "hal_timer.h"
+#include "ble_links.h"
+
+#define ESTC_BENCH_LINK_COUNT NRF_SDH_BLE_PERIPHERAL_LINK_COUNT
+#define ESTC_BENCH_RESULT_COUNT 8 // Link configurations kept, the last entry is reused when full
+
+// Longer pauses between packets do not count as active time
+#define ESTC_BENCH_IDLE_US 500000
+// Active time is folded into the result well before timestamps get too old to compare
+#define ESTC_BENCH_SEGMENT_MAX_US 60000000
+
+// Link configuration a result belongs to
+typedef struct
+{
+    uint16_t mtu;          // Effective ATT MTU
+    uint16_t interval;     // Connection interval in 1.25 ms units
+    uint8_t tx_phy;
+    uint8_t rx_phy;
+    uint16_t event_length; // Radio time reserved per connection event in 1.25 ms units
+    bool evt_ext;          // Connection event extension enabled
+} estc_bench_config_t;
+
+typedef struct
+{
+    uint32_t bytes;
+    uint32_t packets;
+    uint32_t drops;
+} estc_bench_dir_t;
+
+typedef struct
+{
+    estc_bench_config_t config;
+    estc_bench_dir_t sink;
+    estc_bench_dir_t source;
+    uint64_t active_us;
+} estc_bench_result_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    estc_bench_config_t config;
+} estc_bench_link_t;
+
+// Everything below is only accessed from the SoftDevice event context
+
+static uint16_t m_source_handle;
+
+// Enabled by ble_stack_init(), toggled by the benchmark commands for comparison
+static bool m_evt_ext = true;
+
+static estc_bench_link_t m_links[ESTC_BENCH_LINK_COUNT];
+
+static estc_bench_result_t m_results[ESTC_BENCH_RESULT_COUNT];
+static uint8_t m_result_count;
+
+// Link under test and the result of its current configuration
+static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;
+static estc_bench_result_t *m_p_result;
+
+// Active period not yet added to the result
+static bool m_segment_open;
+static uint32_t m_segment_start;
+static uint32_t m_segment_last;
+
+static bool m_sink_synced;
+static uint16_t m_sink_expected;
+
+static bool m_streaming;
+static uint16_t m_source_len;
+static uint16_t m_source_seq;
+static uint16_t m_source_in_flight;
+static uint8_t m_source_data[ESTC_BENCH_PAYLOAD_MAX];
+
+void estc_bench_init(uint16_t source_handle)
+{
+    m_source_handle = source_handle;
+
+    for (uint8_t i = 0; i < ESTC_BENCH_LINK_COUNT; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+
+    // Recognizable filler after the sequence number
+    for (uint16_t i = 0; i < sizeof(m_source_data); i++)
+    {
+        m_source_data[i] = (uint8_t)i;
+    }
+}
+
+static estc_bench_link_t *bench_link_get(uint16_t conn_handle)
+{
+    for (uint8_t i = 0; i < ESTC_BENCH_LINK_COUNT; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+    return NULL;
+}
+
+static bool bench_config_equal(estc_bench_config_t const *p_a, estc_bench_config_t const *p_b)
+{
+    return p_a->mtu == p_b->mtu && p_a->interval == p_b->interval &&
+           p_a->tx_phy == p_b->tx_phy && p_a->rx_phy == p_b->rx_phy && p_a->event_length == p_b->event_length &&
+           p_a->evt_ext == p_b->evt_ext;
+}
+
+static void bench_segment_close(void)
+{
+    if (m_segment_open)
+    {
+        m_p_result->active_us += hal_timer_stamp_diff_us(m_segment_last, m_segment_start);
+        m_segment_open = false;
+    }
+}
+
+/**
+ * @brief Record activity on the link under test at the current time
+ */
+static void bench_activity(void)
+{
+    uint32_t now = hal_timer_stamp_get();
+
+    if (m_segment_open && hal_timer_stamp_diff_us(now, m_segment_last) >= ESTC_BENCH_IDLE_US)
+    {
+        bench_segment_close();
+    }
+    else if (m_segment_open && hal_timer_stamp_diff_us(now, m_segment_start) >= ESTC_BENCH_SEGMENT_MAX_US)
+    {
+        m_segment_last = now;
+        bench_segment_close();
+    }
+
+    if (!m_segment_open)
+    {
+        m_segment_open = true;
+        m_segment_start = now;
+    }
+    m_segment_last = now;
+}
+
+/**
+ * @brief Select the result matching the configuration of the link under test, adding it if needed
+ */
+static void bench_result_select(void)
+{
+    bench_segment_close();
+    m_p_result = NULL;
+
+    // Unused link slots hold BLE_CONN_HANDLE_INVALID
+    estc_bench_link_t const *p_link = (m_conn_handle != BLE_CONN_HANDLE_INVALID) ? bench_link_get(m_conn_handle) : NULL;
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    if (m_streaming)
+    {
+        m_source_len = p_link->config.mtu - 3;
+    }
+
+    estc_bench_config_t config = p_link->config;
+    config.evt_ext = m_evt_ext;
+
+    // Fixed when the link connected, see adv_conn_cfg_select() in ble_module.c
+    ble_link_ctx_t const *p_ctx = ble_links_get(p_link->conn_handle);
+    config.event_length = p_ctx != NULL ? p_ctx->event_length : NRF_SDH_BLE_GAP_EVENT_LENGTH;
+
+    for (uint8_t i = 0; i < m_result_count; i++)
+    {
+        if (bench_config_equal(&m_results[i].config, &config))
+        {
+            m_p_result = &m_results[i];
+            return;
+        }
+    }
+
+    if (m_result_count == ESTC_BENCH_RESULT_COUNT)
+    {
+        m_result_count--;
+    }
+
+    m_p_result = &m_results[m_result_count++];
+    memset(m_p_result, 0, sizeof(*m_p_result));
+    m_p_result->config = config;
+}
+
+/**
+ * @brief Make a link the link under test
+ * @return false if the link is unknown
+ */
+static bool bench_session(uint16_t conn_handle)
+{
+    if (conn_handle != m_conn_handle)
+    {
+        m_streaming = false;
+        m_source_in_flight = 0;
+        m_sink_synced = false;
+        m_conn_handle = conn_handle;
+        bench_result_select();
+    }
+
+    return m_p_result != NULL;
+}
+
+/**
+ * @brief Switch the link under test to the result of its new configuration
+ */
+static void bench_config_changed(uint16_t conn_handle)
+{
+    if (conn_handle == m_conn_handle)
+    {
+        bench_result_select();
+    }
+}
+
+static void bench_dir_log(char const *p_name, char const *p_drops, estc_bench_dir_t const *p_dir,
+                          estc_bench_result_t const *p_result)
+{
+    if (p_dir->packets == 0 || p_result->active_us == 0)
+    {
+        return;
+    }
+
+    uint32_t bytes_per_s = (uint32_t)((uint64_t)p_dir->bytes * 1000000 / p_result->active_us);
+    // Tenths of a packet per connection event
+    uint32_t per_event = (uint32_t)((uint64_t)p_dir->packets * 10 * p_result->config.interval * 1250 / p_result->active_us);
+
+    NRF_LOG_INFO("BENCH   %s: %d B/s, %d.%d packets/event, %d packets, %d %s", p_name, bytes_per_s,
+                 per_event / 10, per_event % 10, p_dir->packets, p_dir->drops, p_drops);
+}
+
+static void bench_log(void)
+{
+    bench_segment_close();
+
+    NRF_LOG_INFO("BENCH %d link configurations", m_result_count);
+
+    for (uint8_t i = 0; i < m_result_count; i++)
+    {
+        estc_bench_result_t const *p_result = &m_results[i];
+
+        NRF_LOG_INFO("BENCH MTU %d, PHY tx 0x%x rx 0x%x, interval %d us, event %d us, event extension %s, active %d ms",
+                     p_result->config.mtu, p_result->config.tx_phy, p_result->config.rx_phy,
+                     p_result->config.interval * 1250, p_result->config.event_length * 1250,
+                     p_result->config.evt_ext ? "on" : "off",
+                     (uint32_t)(p_result->active_us / 1000));
+        bench_dir_log("sink", "drops", &p_result->sink, p_result);
+        bench_dir_log("source", "refused", &p_result->source, p_result);
+    }
+}
+
+/**
+ * @brief Queue source notifications until the SoftDevice queue is full
+ */
+static void bench_source_fill(void)
+{
+    while (m_streaming)
+    {
+        uint16_encode(m_source_seq, m_source_data);
+
+        ret_code_t err_code = hal_ble_notify(m_conn_handle, m_source_handle, m_source_data, m_source_len);
+        if (err_code == NRF_ERROR_RESOURCES)
+        {
+            // Refilled on the next TX complete event
+            break;
+        }
+        if (err_code != NRF_SUCCESS)
+        {
+            // Notifications disabled or the link is going down
+            m_p_result->source.drops++;
+            m_streaming = false;
+            break;
+        }
+
+        m_source_seq++;
+        m_source_in_flight++;
+    }
+}
+
+void estc_bench_sink_write(uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    if (!bench_session(conn_handle))
+    {
+        return;
+    }
+
+    bench_activity();
+    m_p_result->sink.bytes += len;
+    m_p_result->sink.packets++;
+
+    if (len >= sizeof(uint16_t))
+    {
+        // The link layer delivers in order, a gap was dropped by the central
+        uint16_t seq = uint16_decode(p_data);
+        if (m_sink_synced && seq != m_sink_expected)
+        {
+            m_p_result->sink.drops += (uint16_t)(seq - m_sink_expected);
+        }
+        m_sink_expected = seq + 1;
+        m_sink_synced = true;
+    }
+}
+
+void estc_bench_control(uint16_t conn_handle, uint8_t command)
+{
+    switch (command)
+    {
+    case ESTC_BENCH_CMD_START:
+        if (bench_session(conn_handle) && !m_streaming)
+        {
+            m_streaming = true;
+            m_source_len = bench_link_get(conn_handle)->config.mtu - 3;
+            bench_activity();
+            bench_source_fill();
+        }
+        break;
+
+    case ESTC_BENCH_CMD_STOP:
+        m_streaming = false;
+        break;
+
+    case ESTC_BENCH_CMD_REPORT:
+        bench_log();
+        break;
+
+    case ESTC_BENCH_CMD_RESET:
+        bench_segment_close();
+        m_streaming = false;
+        m_result_count = 0;
+        m_p_result = NULL;
+        m_conn_handle = BLE_CONN_HANDLE_INVALID;
+        break;
+
+    case ESTC_BENCH_CMD_EVT_EXT_OFF:
+    case ESTC_BENCH_CMD_EVT_EXT_ON:
+    {
+        bool enable = command == ESTC_BENCH_CMD_EVT_EXT_ON;
+        if (hal_ble_conn_evt_ext_set(enable) == NRF_SUCCESS)
+        {
+            m_evt_ext = enable;
+            bench_config_changed(m_conn_handle);
+        }
+    }
+    break;
+
+    default:
+        break;
+    }
+}
+
+void estc_bench_on_ble_evt(ble_evt_t const *p_ble_evt)
+{
+    uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    estc_bench_link_t *p_link;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+    case BLE_GAP_EVT_CONNECTED:
+        p_link = bench_link_get(BLE_CONN_HANDLE_INVALID);
+        if (p_link != NULL)
+        {
+            p_link->conn_handle = conn_handle;
+            p_link->config.mtu = BLE_GATT_ATT_MTU_DEFAULT;
+            p_link->config.interval = p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval;
+            p_link->config.tx_phy = BLE_GAP_PHY_1MBPS;
+            p_link->config.rx_phy = BLE_GAP_PHY_1MBPS;
+        }
+        break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+        if (conn_handle == m_conn_handle)
+        {
+            m_streaming = false;
+            bench_log();
+            m_p_result = NULL;
+            m_conn_handle = BLE_CONN_HANDLE_INVALID;
+        }
+
+        p_link = bench_link_get(conn_handle);
+        if (p_link != NULL)
+        {
+            p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+        }
+        break;
+
+    case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+        p_link = bench_link_get(conn_handle);
+        if (p_link != NULL)
+        {
+            p_link->config.interval = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval;
+        }
+        bench_config_changed(conn_handle);
+        break;
+
+    case BLE_GAP_EVT_PHY_UPDATE:
+        p_link = bench_link_get(conn_handle);
+        if (p_link != NULL && p_ble_evt->evt.gap_evt.params.phy_update.status == BLE_HCI_STATUS_CODE_SUCCESS)
+        {
+            p_link->config.tx_phy = p_ble_evt->evt.gap_evt.params.phy_update.tx_phy;
+            p_link->config.rx_phy = p_ble_evt->evt.gap_evt.params.phy_update.rx_phy;
+            bench_config_changed(conn_handle);
+        }
+        break;
+
+    // The GATT module answers with NRF_SDH_BLE_GATT_MAX_MTU_SIZE, the smaller MTU applies
+    case BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST:
+        conn_handle = p_ble_evt->evt.gatts_evt.conn_handle;
+        p_link = bench_link_get(conn_handle);
+        if (p_link != NULL)
+        {
+            p_link->config.mtu = MAX(BLE_GATT_ATT_MTU_DEFAULT, MIN(NRF_SDH_BLE_GATT_MAX_MTU_SIZE,
+                                     p_ble_evt->evt.gatts_evt.params.exchange_mtu_request.client_rx_mtu));
+        }
+        bench_config_changed(conn_handle);
+        break;
+
+    case BLE_GATTC_EVT_EXCHANGE_MTU_RSP:
+        conn_handle = p_ble_evt->evt.gattc_evt.conn_handle;
+        p_link = bench_link_get(conn_handle);
+        if (p_link != NULL)
+        {
+            p_link->config.mtu = MAX(BLE_GATT_ATT_MTU_DEFAULT, MIN(NRF_SDH_BLE_GATT_MAX_MTU_SIZE,
+                                     p_ble_evt->evt.gattc_evt.params.exchange_mtu_rsp.server_rx_mtu));
+        }
+        bench_config_changed(conn_handle);
+        break;
+
+    case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+        // Light state notifications share the queue, only the ones known to be in flight are counted
+        if (p_ble_evt->evt.gatts_evt.conn_handle == m_conn_handle && m_source_in_flight != 0)
+        {
+            uint16_t count = MIN(p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count, m_source_in_flight);
+
+            m_source_in_flight -= count;
+            bench_activity();
+            m_p_result->source.bytes += count * m_source_len;
+            m_p_result->source.packets += count;
+
+            bench_source_fill();
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+#endif // ESTC_BENCH_ENABLED
@@ -0,0 +1,74 @@
+#ifndef ESTC_BENCH_H__
+#define ESTC_BENCH_H__
+
+#include <stdint.h>
+#include "ble.h"
+#include "sdk_config.h"
+
+/**
+ * @brief GATT throughput benchmark
+ *
+ * @details Two characteristics of the ESTC service measure what a central can move over a
+ *          given link configuration:
+ *          - sink: written without response, counts every byte. A write starts with a 16-bit
+ *            little-endian sequence number, gaps in the sequence are counted as drops.
+ *          - source: writing ESTC_BENCH_CMD_START streams ATT_MTU - 3 byte notifications,
+ *            each starting with a 16-bit sequence number. The SoftDevice queue is refilled on
+ *            every TX complete event. Notifications the SoftDevice refuses end the stream and
+ *            are counted as drops.
+ *
+ *          Results are kept per link configuration (ATT MTU, PHY, connection interval, reserved
+ *          event length, connection event extension) of the link under test, the last one that used a benchmark characteristic. Only active time
+ *          is counted, pauses of more than half a second between packets are left out.
+ *          ESTC_BENCH_CMD_REPORT and the end of the link log bytes per second, packets per
+ *          connection event and drops of every configuration seen.
+ *
+ *          With ESTC_BENCH_ENABLED cleared the characteristics are not registered.
+ */
+#ifndef ESTC_BENCH_ENABLED
+#define ESTC_BENCH_ENABLED 0
+#endif
+
+// Largest sink write and source notification
+#define ESTC_BENCH_PAYLOAD_MAX (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+
+// Source characteristic write commands
+#define ESTC_BENCH_CMD_STOP 0x00   // Stop streaming notifications
+#define ESTC_BENCH_CMD_START 0x01  // Stream notifications until stopped
+#define ESTC_BENCH_CMD_REPORT 0x02 // Log the results
+#define ESTC_BENCH_CMD_RESET 0x03  // Clear the results
+#define ESTC_BENCH_CMD_EVT_EXT_OFF 0x04 // Disable the connection event extension
+#define ESTC_BENCH_CMD_EVT_EXT_ON 0x05  // Enable the connection event extension, the default
+
+#if ESTC_BENCH_ENABLED
+
+/**
+ * @brief Initialize the benchmark
+ * @param source_handle Value handle of the source characteristic
+ */
+void estc_bench_init(uint16_t source_handle);
+
+/**
+ * @brief Track the link configurations and the notification queue, call for every BLE event
+ */
+void estc_bench_on_ble_evt(ble_evt_t const *p_ble_evt);
+
+/**
+ * @brief Count a write to the sink characteristic
+ */
+void estc_bench_sink_write(uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+
+/**
+ * @brief Handle a write to the source characteristic
+ * @param command One of ESTC_BENCH_CMD_*
+ */
+void estc_bench_control(uint16_t conn_handle, uint8_t command);
+
+#else
+
+#define estc_bench_init(_source_handle) do {} while (0)
+#define estc_bench_on_ble_evt(_p_ble_evt) do {} while (0)
+
+#endif // ESTC_BENCH_ENABLED
+
+#endif // ESTC_BENCH_H__
@@ -0,0 +1,165 @@
+#include "estc_command.h"
+
+#include <string.h>
+#include "nrf_log.h"
+#include "estc_log.h"
+
+// Scene slot
+typedef struct
+{
+    uint8_t state;
+    rgb_color_t color;
+    uint8_t brightness;
+} estc_scene_t;
+
+static estc_scene_t m_scenes[ESTC_CMD_SCENE_COUNT];
+
+/**
+ * @brief Number of operand bytes following an opcode
+ * @return Operand length or -1 for unknown opcodes
+ */
+static int8_t estc_cmd_operand_len(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case ESTC_CMD_OP_SET_COLOR:
+        return 3;
+    case ESTC_CMD_OP_SET_STATE:
+    case ESTC_CMD_OP_RECALL_SCENE:
+    case ESTC_CMD_OP_SET_BRIGHTNESS:
+    case ESTC_CMD_OP_STORE_SCENE:
+    case ESTC_CMD_OP_PLAY_PROGRAM:
+        return 1;
+    case ESTC_CMD_OP_FADE_TO:
+        return 5;
+    case ESTC_CMD_OP_QUERY:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static ret_code_t estc_cmd_validate(uint8_t const *p_data, uint16_t len)
+{
+    uint16_t pos = 0;
+
+    while (pos < len)
+    {
+        uint8_t opcode = p_data[pos++];
+        int8_t operand_len = estc_cmd_operand_len(opcode);
+
+        if (operand_len < 0)
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        if (len - pos < operand_len)
+        {
+            return NRF_ERROR_INVALID_LENGTH;
+        }
+        if ((opcode == ESTC_CMD_OP_RECALL_SCENE || opcode == ESTC_CMD_OP_STORE_SCENE) &&
+            p_data[pos] >= ESTC_CMD_SCENE_COUNT)
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        if (opcode == ESTC_CMD_OP_PLAY_PROGRAM && p_data[pos] >= ESTC_CMD_PROGRAM_COUNT)
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+
+        pos += operand_len;
+    }
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t estc_cmd_parse(uint8_t const *p_data, uint16_t len, estc_cmd_batch_t *p_batch)
+{
+    ret_code_t err_code = estc_cmd_validate(p_data, len);
+    if (err_code != NRF_SUCCESS)
+    {
+        ESTC_LOG(ESTC_LOG_CMD_REJECTED, len, err_code);
+        return err_code;
+    }
+
+    uint8_t const *p_end = p_data + len;
+
+    while (p_data < p_end)
+    {
+        uint8_t opcode = *p_data++;
+        estc_scene_t *p_scene;
+
+        switch (opcode)
+        {
+        case ESTC_CMD_OP_SET_COLOR:
+            p_batch->color.red = p_data[0];
+            p_batch->color.green = p_data[1];
+            p_batch->color.blue = p_data[2];
+            p_batch->flags |= ESTC_CMD_FLAG_COLOR;
+            p_batch->flags &= ~ESTC_CMD_FLAG_FADE;
+            break;
+
+        case ESTC_CMD_OP_SET_STATE:
+            p_batch->state = p_data[0] ? 1 : 0;
+            p_batch->flags |= ESTC_CMD_FLAG_STATE;
+            break;
+
+        case ESTC_CMD_OP_FADE_TO:
+            p_batch->color.red = p_data[0];
+            p_batch->color.green = p_data[1];
+            p_batch->color.blue = p_data[2];
+            p_batch->fade_ms = (uint16_t)(p_data[3] | (p_data[4] << 8));
+            p_batch->flags |= ESTC_CMD_FLAG_COLOR | ESTC_CMD_FLAG_FADE;
+            break;
+
+        case ESTC_CMD_OP_RECALL_SCENE:
+            p_scene = &m_scenes[p_data[0]];
+            p_batch->state = p_scene->state;
+            p_batch->color = p_scene->color;
+            p_batch->brightness = p_scene->brightness;
+            p_batch->flags |= ESTC_CMD_FLAG_STATE | ESTC_CMD_FLAG_COLOR | ESTC_CMD_FLAG_BRIGHTNESS;
+            p_batch->flags &= ~ESTC_CMD_FLAG_FADE;
+            break;
+
+        case ESTC_CMD_OP_SET_BRIGHTNESS:
+            p_batch->brightness = p_data[0];
+            p_batch->flags |= ESTC_CMD_FLAG_BRIGHTNESS;
+            break;
+
+        case ESTC_CMD_OP_QUERY:
+            p_batch->flags |= ESTC_CMD_FLAG_QUERY;
+            break;
+
+        case ESTC_CMD_OP_STORE_SCENE:
+            p_scene = &m_scenes[p_data[0]];
+            p_scene->state = p_batch->state;
+            p_scene->color = p_batch->color;
+            p_scene->brightness = p_batch->brightness;
+            break;
+
+        case ESTC_CMD_OP_PLAY_PROGRAM:
+            p_batch->program = p_data[0];
+            p_batch->flags |= ESTC_CMD_FLAG_PROGRAM;
+            break;
+
+        default:
+            // Rejected by estc_cmd_validate()
+            break;
+        }
+
+        p_data += estc_cmd_operand_len(opcode);
+    }
+
+    return NRF_SUCCESS;
+}
+
+uint16_t estc_cmd_query_response_encode(estc_cmd_batch_t const *p_batch, uint8_t *p_buf)
+{
+    p_buf[0] = ESTC_CMD_OP_QUERY;
+    p_buf[1] = p_batch->state;
+    p_buf[2] = p_batch->color.red;
+    p_buf[3] = p_batch->color.green;
+    p_buf[4] = p_batch->color.blue;
+    p_buf[5] = p_batch->brightness;
+
+    return ESTC_CMD_QUERY_RESPONSE_SIZE;
+}
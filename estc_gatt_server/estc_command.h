@@ -0,0 +1,68 @@
+#ifndef ESTC_COMMAND_H__
+#define ESTC_COMMAND_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+#include "pwm_control.h"
+#include "flash_storage.h"
+
+// Command opcodes, every opcode is followed by a fixed number of operand bytes
+#define ESTC_CMD_OP_SET_COLOR 0x01      // r, g, b
+#define ESTC_CMD_OP_SET_STATE 0x02      // state
+#define ESTC_CMD_OP_FADE_TO 0x03        // r, g, b, duration in ms (uint16, little endian)
+#define ESTC_CMD_OP_RECALL_SCENE 0x04   // scene index, a scene never stored recalls as off and black
+#define ESTC_CMD_OP_SET_BRIGHTNESS 0x05 // brightness
+#define ESTC_CMD_OP_QUERY 0x06          // no operands
+#define ESTC_CMD_OP_STORE_SCENE 0x07    // scene index, scenes are kept in RAM only and lost on reset
+#define ESTC_CMD_OP_PLAY_PROGRAM 0x08   // program slot
+
+#define ESTC_CMD_SCENE_COUNT 8
+#define ESTC_CMD_PROGRAM_COUNT FLASH_STORAGE_PROGRAM_COUNT
+#define ESTC_CMD_BRIGHTNESS_MAX 255
+
+// Flags describing which parts of the light state a batch changed
+#define ESTC_CMD_FLAG_STATE (1 << 0)
+#define ESTC_CMD_FLAG_COLOR (1 << 1)
+#define ESTC_CMD_FLAG_BRIGHTNESS (1 << 2)
+#define ESTC_CMD_FLAG_FADE (1 << 3)
+#define ESTC_CMD_FLAG_QUERY (1 << 4)
+#define ESTC_CMD_FLAG_PROGRAM (1 << 5)
+
+// Query response: opcode followed by state, r, g, b and brightness
+#define ESTC_CMD_QUERY_RESPONSE_SIZE 6
+
+/**
+ * @brief Light state accumulated over all commands of a single write
+ */
+typedef struct estc_cmd_batch_s
+{
+    uint8_t flags;
+    uint8_t state;
+    rgb_color_t color;
+    uint8_t brightness;
+    uint16_t fade_ms;
+    uint8_t program;
+} estc_cmd_batch_t;
+
+/**
+ * @brief Parse a command stream in place and fold it into a batch
+ * @details The whole stream is validated before any command is executed,
+ *          so a malformed write leaves both the batch and the scenes untouched.
+ * @param p_data Command stream
+ * @param len Length of the command stream
+ * @param p_batch Batch holding the light state the commands start from
+ * @return NRF_SUCCESS, NRF_ERROR_INVALID_PARAM on unknown opcode, scene index or program slot,
+ *         NRF_ERROR_INVALID_LENGTH on truncated operands
+ */
+ret_code_t estc_cmd_parse(uint8_t const *p_data, uint16_t len, estc_cmd_batch_t *p_batch);
+
+/**
+ * @brief Encode a query response for the light state held in a batch
+ * @param p_batch Executed batch
+ * @param p_buf Buffer of at least ESTC_CMD_QUERY_RESPONSE_SIZE bytes
+ * @return Number of encoded bytes
+ */
+uint16_t estc_cmd_query_response_encode(estc_cmd_batch_t const *p_batch, uint8_t *p_buf);
+
+#endif // ESTC_COMMAND_H__
@@ -0,0 +1,197 @@
+#include "estc_group.h"
+
+#include <string.h>
+#include "app_error.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "ble_advdata.h"
+#include "nrf_soc.h"
+#include "estc_perf.h"
+#include "hal_timer.h"
+
+static uint8_t const m_group_key[SOC_ECB_KEY_LENGTH] = ESTC_GROUP_KEY;
+
+// Sequence number of the last accepted command
+static uint32_t m_last_seq;
+static bool m_seq_valid;
+static bool m_seq_restored;
+
+static estc_group_seq_store_handler_t m_store_handler;
+static hal_timer_id_t m_store_timer;
+static bool m_store_held;    // Stored less than ESTC_GROUP_SEQ_STORE_INTERVAL_MS ago
+static bool m_store_pending; // Accepted a command while the store was held
+
+static uint32_t get_u32(uint8_t const *p_buf)
+{
+    return (uint32_t)p_buf[0] | ((uint32_t)p_buf[1] << 8) | ((uint32_t)p_buf[2] << 16) | ((uint32_t)p_buf[3] << 24);
+}
+
+/**
+ * @brief Hand the last sequence number to the store handler, or leave it to the store timer
+ */
+static void seq_store(void)
+{
+    bool store;
+
+    // The scan reports and the timer may run at different interrupt priorities
+    CRITICAL_REGION_ENTER();
+    store = !m_store_held;
+    m_store_held = true;
+    m_store_pending = !store;
+    CRITICAL_REGION_EXIT();
+
+    if (store)
+    {
+        m_store_handler(m_last_seq);
+
+        ret_code_t err_code = hal_timer_start(m_store_timer, ESTC_GROUP_SEQ_STORE_INTERVAL_MS, NULL);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+static void store_timer_handler(void *p_context)
+{
+    bool pending;
+
+    CRITICAL_REGION_ENTER();
+    pending = m_store_pending;
+    m_store_pending = false;
+    m_store_held = false;
+    CRITICAL_REGION_EXIT();
+
+    if (pending)
+    {
+        seq_store();
+    }
+}
+
+ret_code_t estc_group_init(estc_group_seq_store_handler_t store_handler)
+{
+    m_store_handler = store_handler;
+
+    return hal_timer_create(&m_store_timer, false, store_timer_handler);
+}
+
+void estc_group_seq_restore(uint32_t const *p_seq)
+{
+    if (p_seq != NULL)
+    {
+        m_last_seq = *p_seq;
+        m_seq_valid = true;
+    }
+    m_seq_restored = true;
+}
+
+/**
+ * @brief Compute the CBC-MAC of a group command
+ * @param p_header Group and sequence number, 5 bytes
+ * @param p_cmd Command stream
+ * @param cmd_len Length of the command stream
+ * @param p_mac Buffer of SOC_ECB_CIPHERTEXT_LENGTH bytes
+ */
+static void estc_group_mac(uint8_t const *p_header, uint8_t const *p_cmd, uint16_t cmd_len, uint8_t *p_mac)
+{
+    uint8_t message[2 * SOC_ECB_CLEARTEXT_LENGTH] = {0};
+    uint16_t message_len = 1 + (ESTC_GROUP_HEADER_SIZE - 1) + cmd_len;
+
+    message[0] = (uint8_t)cmd_len;
+    memcpy(&message[1], p_header, ESTC_GROUP_HEADER_SIZE - 1);
+    memcpy(&message[ESTC_GROUP_HEADER_SIZE], p_cmd, cmd_len);
+
+    nrf_ecb_hal_data_t ecb;
+    memcpy(ecb.key, m_group_key, sizeof(ecb.key));
+    memset(ecb.ciphertext, 0, sizeof(ecb.ciphertext));
+
+    for (uint16_t offset = 0; offset < message_len; offset += SOC_ECB_CLEARTEXT_LENGTH)
+    {
+        for (uint8_t i = 0; i < SOC_ECB_CLEARTEXT_LENGTH; i++)
+        {
+            ecb.cleartext[i] = message[offset + i] ^ ecb.ciphertext[i];
+        }
+
+        ret_code_t err_code = sd_ecb_block_encrypt(&ecb);
+        APP_ERROR_CHECK(err_code);
+    }
+
+    memcpy(p_mac, ecb.ciphertext, SOC_ECB_CIPHERTEXT_LENGTH);
+}
+
+ret_code_t estc_group_packet_check(uint8_t const *p_data, uint16_t len, uint8_t const **pp_cmd, uint16_t *p_cmd_len)
+{
+    // Cheap checks first, every advertisement in range passes through here
+    if (len < ESTC_GROUP_PAYLOAD_MIN_SIZE || len > ESTC_GROUP_PAYLOAD_MAX_SIZE || p_data[0] != ESTC_GROUP_MAGIC)
+    {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    if (p_data[1] != ESTC_GROUP_ID && p_data[1] != ESTC_GROUP_ALL)
+    {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    uint32_t seq = get_u32(&p_data[2]);
+    if (!m_seq_restored || (m_seq_valid && (int32_t)(seq - m_last_seq) <= 0))
+    {
+        // Repeats of the last command are the common case, they cost no encryption
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    uint8_t const *p_cmd = &p_data[ESTC_GROUP_HEADER_SIZE];
+    uint16_t cmd_len = len - ESTC_GROUP_HEADER_SIZE - ESTC_GROUP_MAC_SIZE;
+
+    uint8_t mac[SOC_ECB_CIPHERTEXT_LENGTH];
+    estc_group_mac(&p_data[1], p_cmd, cmd_len, mac);
+
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < ESTC_GROUP_MAC_SIZE; i++)
+    {
+        diff |= mac[i] ^ p_cmd[cmd_len + i];
+    }
+    if (diff != 0)
+    {
+        return NRF_ERROR_INVALID_DATA;
+    }
+
+    m_last_seq = seq;
+    m_seq_valid = true;
+    seq_store();
+
+    *pp_cmd = p_cmd;
+    *p_cmd_len = cmd_len;
+    return NRF_SUCCESS;
+}
+
+ret_code_t estc_group_adv_data_check(uint8_t const *p_adv_data, uint16_t len, uint8_t const **pp_cmd, uint16_t *p_cmd_len)
+{
+    uint16_t offset = 0;
+    uint16_t data_len = ble_advdata_search(p_adv_data, len, &offset, BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA);
+    uint8_t const *p_data = &p_adv_data[offset];
+
+    if (data_len <= sizeof(uint16_t) || uint16_decode(p_data) != ESTC_GROUP_COMPANY_ID)
+    {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    return estc_group_packet_check(p_data + sizeof(uint16_t), data_len - sizeof(uint16_t), pp_cmd, p_cmd_len);
+}
+
+ret_code_t estc_group_adv_report(ble_estc_service_t *p_service, uint8_t const *p_adv_data, uint16_t len)
+{
+    uint8_t const *p_cmd;
+    uint16_t cmd_len;
+
+    ESTC_PERF_COUNT(ESTC_PERF_CNT_SCAN_REPORTS);
+
+    ret_code_t err_code = estc_group_adv_data_check(p_adv_data, len, &p_cmd, &cmd_len);
+    if (err_code == NRF_SUCCESS)
+    {
+        ESTC_PERF_COUNT(ESTC_PERF_CNT_GROUP_COMMANDS);
+        estc_service_command_apply(p_service, p_cmd, cmd_len);
+    }
+    else if (err_code == NRF_ERROR_INVALID_DATA)
+    {
+        ESTC_PERF_COUNT(ESTC_PERF_CNT_GROUP_REJECTED);
+    }
+
+    return err_code;
+}
@@ -0,0 +1,111 @@
+#ifndef ESTC_GROUP_H__
+#define ESTC_GROUP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+#include "estc_service.h"
+
+/**
+ * @brief Connectionless group commands carried in advertising data
+ *
+ * @details A controller broadcasts a command stream (estc_command.h format) in the manufacturer
+ *          specific data of a non-connectable advertisement, every light of the addressed group
+ *          that hears it applies it. Layout after the company identifier:
+ *
+ *          magic (1), group (1), sequence number (4, little-endian), command stream (1..17), MAC (4)
+ *
+ *          The MAC is the first ESTC_GROUP_MAC_SIZE bytes of an AES-128 CBC-MAC over
+ *          length of the command stream (1), group (1), sequence number (4) and the command
+ *          stream, zero padded to whole blocks, keyed with ESTC_GROUP_KEY. The length prefix
+ *          keeps the MAC safe for variable length messages.
+ *
+ *          A command is applied once: its sequence number must be larger than the last accepted
+ *          one, so the controller repeats the same packet for as long as it advertises it. The
+ *          last sequence number is handed to a store handler that keeps it in flash, at most once
+ *          per ESTC_GROUP_SEQ_STORE_INTERVAL_MS, the later ones when the interval is over. After a
+ *          reboot commands are refused until estc_group_seq_restore() brings it back, so a recorded
+ *          packet cannot be replayed. Only the commands accepted in the last interval before a
+ *          reboot remain open to that.
+ *
+ *          tools/estc_group_packet.py builds packets for a controller or a simulated feed.
+ */
+
+#define ESTC_GROUP_COMPANY_ID 0x0059  // Company identifier of the manufacturer specific data (Nordic Semiconductor ASA)
+#define ESTC_GROUP_MAGIC 0xEC           // First byte of the payload, tells group commands from other data
+#define ESTC_GROUP_ALL 0xFF             // Group addressing every light
+#define ESTC_GROUP_HEADER_SIZE 6        // magic, group, sequence number
+#define ESTC_GROUP_MAC_SIZE 4
+#define ESTC_GROUP_CMD_MAX_SIZE 17      // What is left of a legacy advertisement without flags
+#define ESTC_GROUP_PAYLOAD_MIN_SIZE (ESTC_GROUP_HEADER_SIZE + 1 + ESTC_GROUP_MAC_SIZE)
+#define ESTC_GROUP_PAYLOAD_MAX_SIZE (ESTC_GROUP_HEADER_SIZE + ESTC_GROUP_CMD_MAX_SIZE + ESTC_GROUP_MAC_SIZE)
+
+// Shortest time between two stores of the sequence number, bounds the flash wear of a busy controller
+#ifndef ESTC_GROUP_SEQ_STORE_INTERVAL_MS
+#define ESTC_GROUP_SEQ_STORE_INTERVAL_MS 10000
+#endif
+
+// Group this light belongs to
+#ifndef ESTC_GROUP_ID
+#define ESTC_GROUP_ID 1
+#endif
+
+// Shared group key, override it per installation
+#ifndef ESTC_GROUP_KEY
+#define ESTC_GROUP_KEY {0x45, 0x53, 0x54, 0x43, 0x2D, 0x67, 0x72, 0x6F, \
+                        0x75, 0x70, 0x2D, 0x6B, 0x65, 0x79, 0x30, 0x31}
+#endif
+
+/**
+ * @brief Handler keeping the sequence number of the last accepted command, called from the context of
+ *        estc_group_packet_check() or of a timer
+ */
+typedef void (*estc_group_seq_store_handler_t)(uint32_t seq);
+
+/**
+ * @brief Create the store timer
+ * @param store_handler Handler keeping the sequence number
+ */
+ret_code_t estc_group_init(estc_group_seq_store_handler_t store_handler);
+
+/**
+ * @brief Restore the sequence number kept before the reboot, commands are refused until then
+ * @param p_seq Sequence number given to the store handler, NULL if it never stored one
+ */
+void estc_group_seq_restore(uint32_t const *p_seq);
+
+/**
+ * @brief Check a manufacturer specific data payload and extract its command stream
+ * @param p_data Payload following the company identifier
+ * @param len Length of the payload
+ * @param pp_cmd Set to the command stream inside p_data on success
+ * @param p_cmd_len Set to the length of the command stream on success
+ * @return NRF_SUCCESS, NRF_ERROR_NOT_FOUND if the payload is not a command for this light,
+ *         NRF_ERROR_INVALID_STATE if the command was already applied (old sequence number) or
+ *         the sequence number is not restored yet,
+ *         NRF_ERROR_INVALID_DATA on a bad MAC
+ */
+ret_code_t estc_group_packet_check(uint8_t const *p_data, uint16_t len, uint8_t const **pp_cmd, uint16_t *p_cmd_len);
+
+/**
+ * @brief Find the group command in the data of an advertising report and check it
+ * @param p_adv_data Advertising data, a sequence of AD structures
+ * @param len Length of the advertising data
+ * @param pp_cmd Set to the command stream inside p_adv_data on success
+ * @param p_cmd_len Set to the length of the command stream on success
+ * @return As estc_group_packet_check(), NRF_ERROR_NOT_FOUND also if the report carries no
+ *         manufacturer specific data with ESTC_GROUP_COMPANY_ID
+ */
+ret_code_t estc_group_adv_data_check(uint8_t const *p_adv_data, uint16_t len, uint8_t const **pp_cmd, uint16_t *p_cmd_len);
+
+/**
+ * @brief Handle the data of a scanned advertising report, apply the group command it carries
+ * @details The command goes through estc_service_command_apply() as a COMMAND write without a link.
+ * @param p_service ESTC service the command is applied to
+ * @param p_adv_data Advertising data, a sequence of AD structures
+ * @param len Length of the advertising data
+ * @return As estc_group_adv_data_check(), NRF_SUCCESS if the command was applied
+ */
+ret_code_t estc_group_adv_report(ble_estc_service_t *p_service, uint8_t const *p_adv_data, uint16_t len);
+
+#endif // ESTC_GROUP_H__
@@ -0,0 +1,106 @@
+#include "estc_log.h"
+
+#include <string.h>
+
+#if ESTC_LOG_BINARY_ENABLED
+
+#define ESTC_LOG_BUFFER_WORDS 256     // Ring size in words, power of two
+#define ESTC_LOG_HEADROOM_WORDS 32    // Space kept for writers preempting each other
+#define ESTC_LOG_FLUSH_CHUNK_BYTES 64 // Bytes handed to nrf_log per flush
+
+#define ESTC_LOG_HEADER_NARGS(_header) (((_header) >> 16) & 0xFF)
+
+_Static_assert((ESTC_LOG_BUFFER_WORDS & (ESTC_LOG_BUFFER_WORDS - 1)) == 0, "Buffer size must be a power of two");
+_Static_assert(ESTC_LOG_FLUSH_CHUNK_BYTES >= 6 * sizeof(uint32_t), "Chunk must hold the largest record");
+
+// A slot holding zero is free; the header word is written last, so a non-zero header
+// means the whole record is in place
+static uint32_t m_log_buffer[ESTC_LOG_BUFFER_WORDS];
+static uint32_t m_log_head;    // Reserved by writers with an atomic add
+static uint32_t m_log_tail;    // Written by estc_log_flush() only
+static uint32_t m_log_dropped; // Records lost because the ring was full
+
+void estc_log_write(uint32_t header, uint32_t const *p_args)
+{
+    uint32_t words = ESTC_LOG_HEADER_NARGS(header) + 1;
+    uint32_t used = __atomic_load_n(&m_log_head, __ATOMIC_RELAXED) - __atomic_load_n(&m_log_tail, __ATOMIC_ACQUIRE);
+
+    if (used + words > ESTC_LOG_BUFFER_WORDS - ESTC_LOG_HEADROOM_WORDS)
+    {
+        __atomic_fetch_add(&m_log_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint32_t index = __atomic_fetch_add(&m_log_head, words, __ATOMIC_RELAXED);
+
+    for (uint32_t i = 1; i < words; i++)
+    {
+        m_log_buffer[(index + i) & (ESTC_LOG_BUFFER_WORDS - 1)] = p_args[i - 1];
+    }
+
+    // Publish the record only after its arguments are written
+    __atomic_store_n(&m_log_buffer[index & (ESTC_LOG_BUFFER_WORDS - 1)], header, __ATOMIC_RELEASE);
+}
+
+bool estc_log_flush(void)
+{
+    uint8_t chunk[ESTC_LOG_FLUSH_CHUNK_BYTES];
+    uint32_t len = 0;
+    uint32_t tail = m_log_tail;
+
+    for (;;)
+    {
+        uint32_t header = __atomic_load_n(&m_log_buffer[tail & (ESTC_LOG_BUFFER_WORDS - 1)], __ATOMIC_ACQUIRE);
+        if (header == 0)
+        {
+            break;
+        }
+
+        uint32_t words = ESTC_LOG_HEADER_NARGS(header) + 1;
+        if (len + words * sizeof(uint32_t) > sizeof(chunk))
+        {
+            break;
+        }
+
+        for (uint32_t i = 0; i < words; i++)
+        {
+            uint32_t *p_slot = &m_log_buffer[(tail + i) & (ESTC_LOG_BUFFER_WORDS - 1)];
+            memcpy(&chunk[len], p_slot, sizeof(uint32_t));
+            len += sizeof(uint32_t);
+            *p_slot = 0;
+        }
+
+        tail += words;
+    }
+
+    // Hand the slots back to the writers only after they are cleared
+    __atomic_store_n(&m_log_tail, tail, __ATOMIC_RELEASE);
+
+    if (len > 0)
+    {
+        NRF_LOG_RAW_HEXDUMP_INFO(chunk, len);
+    }
+
+    uint32_t dropped = __atomic_exchange_n(&m_log_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0)
+    {
+        NRF_LOG_WARNING("ESTC LOG: %d binary records dropped", dropped);
+    }
+
+    return __atomic_load_n(&m_log_buffer[tail & (ESTC_LOG_BUFFER_WORDS - 1)], __ATOMIC_ACQUIRE) != 0;
+}
+
+#else
+
+#define ESTC_LOG_FORMAT(_id, _fmt) [_id] = _fmt,
+
+char const * const estc_log_formats[ESTC_LOG_MESSAGE_COUNT] = {
+    ESTC_LOG_MESSAGES(ESTC_LOG_FORMAT)
+};
+
+bool estc_log_flush(void)
+{
+    return false;
+}
+
+#endif // ESTC_LOG_BINARY_ENABLED
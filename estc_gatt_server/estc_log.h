@@ -0,0 +1,127 @@
+#ifndef ESTC_LOG_H__
+#define ESTC_LOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_util.h"
+#include "nrf_log.h"
+
+/**
+ * @brief Binary logging of hot path messages
+ *
+ * @details With ESTC_LOG_BINARY_ENABLED set, ESTC_LOG() stores a header word and the raw
+ *          32-bit arguments in a RAM ring instead of formatting them through nrf_log. The
+ *          format strings are not linked into the image; estc_log_flush() dumps the records
+ *          as hex from the main loop and tools/estc_log_decode.py turns them back into text
+ *          using the message table below. With the option cleared, ESTC_LOG() is a plain
+ *          NRF_LOG_INFO() call.
+ */
+#ifndef ESTC_LOG_BINARY_ENABLED
+#define ESTC_LOG_BINARY_ENABLED NRF_LOG_ENABLED // Text mode compiles to nothing without nrf_log
+#endif
+
+/**
+ * @brief Message table, X(id, format)
+ *
+ * The host decoder parses these lines, so keep one entry per line. IDs are assigned in
+ * table order.
+ */
+#define ESTC_LOG_MESSAGES(X)                                                                   \
+    X(ESTC_LOG_PWM_SET_COLOR,     "PWM CONTROL: Setting RGB color: R=%d, G=%d, B=%d")          \
+    X(ESTC_LOG_PWM_ON,            "PWM CONTROL: RGB ON: R=%d G=%d B=%d")                       \
+    X(ESTC_LOG_PWM_OFF,           "PWM CONTROL: RGB OFF (saved: R=%d G=%d B=%d)")              \
+    X(ESTC_LOG_PWM_BRIGHTNESS,    "PWM CONTROL: Setting brightness: %d")                       \
+    X(ESTC_LOG_PWM_FADE,          "PWM CONTROL: Fading to R=%d G=%d B=%d in %d ms")            \
+    X(ESTC_LOG_CMD_REJECTED,      "ESTC COMMAND: Rejected command stream of %d bytes (error %d)") \
+    X(ESTC_LOG_SERVICE_BATCH,     "ESTC SERVICE: Applying batch (flags 0x%x)") \
+    X(ESTC_LOG_SERVICE_AUTHORIZE, "ESTC SERVICE: RW AUTHORIZE REQUEST event received")         \
+    X(ESTC_LOG_SERVICE_TX_DONE,   "ESTC SERVICE: HVN TX COMPLETE event received")              \
+    X(ESTC_LOG_WRITE,             "WRITE: flags 0x%x, state %d, RGB (%d; %d; %d)")             \
+    X(ESTC_LOG_FLASH_UNCHANGED,   "FLASH STORAGE: No changes in RGB state and values, skipping flash update.") \
+    X(ESTC_LOG_FLASH_ERASE,       "FLASH STORAGE: Need to erase page before writing")          \
+    X(ESTC_LOG_FLASH_WRITE,       "FLASH STORAGE: Writing RGB state %u, values (%u,%u,%u) to address 0x%x")
+
+#define ESTC_LOG_ID(_id, _fmt) _id,
+
+typedef enum
+{
+    ESTC_LOG_MESSAGES(ESTC_LOG_ID)
+    ESTC_LOG_MESSAGE_COUNT
+} estc_log_id_t;
+
+#undef ESTC_LOG_ID
+
+/**
+ * @brief Log a message from the table
+ *
+ * Usage: ESTC_LOG(ESTC_LOG_PWM_SET_COLOR, r, g, b); up to five integer arguments.
+ */
+#if ESTC_LOG_BINARY_ENABLED
+
+#define ESTC_LOG_MAGIC 0xE5u // Top byte of every record header, lets the decoder resync
+
+#define ESTC_LOG_HEADER(_id, _nargs) (((uint32_t)ESTC_LOG_MAGIC << 24) | ((uint32_t)(_nargs) << 16) | (uint32_t)(_id))
+
+#define ESTC_LOG(...) CONCAT_2(ESTC_LOG_INTERNAL_, NUM_VA_ARGS_LESS_1(__VA_ARGS__))(__VA_ARGS__)
+
+#define ESTC_LOG_INTERNAL_0(_id) estc_log_write(ESTC_LOG_HEADER(_id, 0), NULL)
+
+#define ESTC_LOG_INTERNAL_1(_id, _a0)                                                          \
+    do                                                                                         \
+    {                                                                                          \
+        uint32_t const _args[] = {(uint32_t)(_a0)};                                            \
+        estc_log_write(ESTC_LOG_HEADER(_id, 1), _args);                                        \
+    } while (0)
+
+#define ESTC_LOG_INTERNAL_2(_id, _a0, _a1)                                                     \
+    do                                                                                         \
+    {                                                                                          \
+        uint32_t const _args[] = {(uint32_t)(_a0), (uint32_t)(_a1)};                           \
+        estc_log_write(ESTC_LOG_HEADER(_id, 2), _args);                                        \
+    } while (0)
+
+#define ESTC_LOG_INTERNAL_3(_id, _a0, _a1, _a2)                                                \
+    do                                                                                         \
+    {                                                                                          \
+        uint32_t const _args[] = {(uint32_t)(_a0), (uint32_t)(_a1), (uint32_t)(_a2)};          \
+        estc_log_write(ESTC_LOG_HEADER(_id, 3), _args);                                        \
+    } while (0)
+
+#define ESTC_LOG_INTERNAL_4(_id, _a0, _a1, _a2, _a3)                                           \
+    do                                                                                         \
+    {                                                                                          \
+        uint32_t const _args[] = {(uint32_t)(_a0), (uint32_t)(_a1), (uint32_t)(_a2),           \
+                                  (uint32_t)(_a3)};                                            \
+        estc_log_write(ESTC_LOG_HEADER(_id, 4), _args);                                        \
+    } while (0)
+
+#define ESTC_LOG_INTERNAL_5(_id, _a0, _a1, _a2, _a3, _a4)                                      \
+    do                                                                                         \
+    {                                                                                          \
+        uint32_t const _args[] = {(uint32_t)(_a0), (uint32_t)(_a1), (uint32_t)(_a2),           \
+                                  (uint32_t)(_a3), (uint32_t)(_a4)};                           \
+        estc_log_write(ESTC_LOG_HEADER(_id, 5), _args);                                        \
+    } while (0)
+
+/**
+ * @brief Store a binary record, safe to call from any interrupt priority
+ * @param header Record header built with ESTC_LOG_HEADER()
+ * @param p_args Arguments, as many as encoded in the header
+ */
+void estc_log_write(uint32_t header, uint32_t const *p_args);
+
+#else
+
+extern char const * const estc_log_formats[ESTC_LOG_MESSAGE_COUNT];
+
+#define ESTC_LOG(_id, ...) NRF_LOG_INFO(estc_log_formats[_id], ##__VA_ARGS__)
+
+#endif // ESTC_LOG_BINARY_ENABLED
+
+/**
+ * @brief Dump stored binary records to nrf_log, call from the main loop
+ * @return True if records are still pending
+ */
+bool estc_log_flush(void);
+
+#endif // ESTC_LOG_H__
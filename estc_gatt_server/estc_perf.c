@@ -0,0 +1,191 @@
+#include "estc_perf.h"
+
+#if ESTC_PERF_ENABLED
+
+#include <string.h>
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "nrf_log.h"
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint16_t hist[ESTC_PERF_HIST_BUCKETS];
+} estc_perf_stats_t;
+
+#define ESTC_PERF_SITE_NAME(_id, _name) [_id] = _name,
+
+static char const * const m_site_names[ESTC_PERF_SITE_COUNT] = {
+    ESTC_PERF_SITES(ESTC_PERF_SITE_NAME)
+};
+
+#define ESTC_PERF_COUNTER_NAME(_id, _name) [_id] = _name,
+
+static char const * const m_counter_names[ESTC_PERF_COUNTER_COUNT] = {
+    ESTC_PERF_COUNTERS(ESTC_PERF_COUNTER_NAME)
+};
+
+_Static_assert(ESTC_PERF_COUNTERS_SIZE <= ESTC_PERF_SNAPSHOT_SIZE, "Counters must fit the diagnostics characteristic");
+
+static uint32_t m_counters[ESTC_PERF_COUNTER_COUNT];
+
+// Statistics are updated from the context that owns the site; readers may see a sample
+// half applied, which is acceptable for diagnostics
+static estc_perf_stats_t m_stats[ESTC_PERF_SITE_COUNT];
+
+// Start of the BLE event being handled, in the SoftDevice event context
+static uint32_t m_event_start;
+
+// Pending span starts, bit 0 is forced on so that zero means "no span pending"
+static uint32_t m_span_start[ESTC_PERF_SITE_COUNT];
+
+void estc_perf_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    estc_perf_reset();
+}
+
+void estc_perf_record(estc_perf_site_t site, uint32_t cycles)
+{
+    estc_perf_stats_t *p_stats = &m_stats[site];
+
+    uint32_t bucket = (cycles == 0) ? 0 : 32 - __builtin_clz(cycles);
+    bucket = MIN(bucket, ESTC_PERF_HIST_BUCKETS - 1);
+
+    p_stats->count++;
+    p_stats->min = MIN(p_stats->min, cycles);
+    p_stats->max = MAX(p_stats->max, cycles);
+    p_stats->sum += cycles;
+    if (p_stats->hist[bucket] != UINT16_MAX)
+    {
+        p_stats->hist[bucket]++;
+    }
+}
+
+void estc_perf_event_begin(uint32_t now)
+{
+    m_event_start = now;
+}
+
+void estc_perf_span_start(estc_perf_site_t site)
+{
+    uint32_t expected = 0;
+    __atomic_compare_exchange_n(&m_span_start[site], &expected, m_event_start | 1, false,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+void estc_perf_span_end(estc_perf_site_t site, uint32_t now, bool record)
+{
+    uint32_t start = __atomic_exchange_n(&m_span_start[site], 0, __ATOMIC_RELAXED);
+
+    if (start != 0 && record)
+    {
+        estc_perf_record(site, now - start);
+    }
+}
+
+void estc_perf_counter_add(estc_perf_counter_t counter, uint32_t value)
+{
+    __atomic_fetch_add(&m_counters[counter], value, __ATOMIC_RELAXED);
+}
+
+void estc_perf_counter_max(estc_perf_counter_t counter, uint32_t value)
+{
+    uint32_t current = __atomic_load_n(&m_counters[counter], __ATOMIC_RELAXED);
+
+    while (value > current &&
+           !__atomic_compare_exchange_n(&m_counters[counter], &current, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+static uint8_t *put_u32(uint8_t *p_buf, uint32_t value)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    p_buf[2] = (uint8_t)(value >> 16);
+    p_buf[3] = (uint8_t)(value >> 24);
+    return p_buf + 4;
+}
+
+uint16_t estc_perf_counters_encode(uint8_t *p_buf)
+{
+    uint8_t *p_pos = p_buf;
+
+    *p_pos++ = ESTC_PERF_CMD_COUNTERS;
+    for (uint8_t i = 0; i < ESTC_PERF_COUNTER_COUNT; i++)
+    {
+        p_pos = put_u32(p_pos, __atomic_load_n(&m_counters[i], __ATOMIC_RELAXED));
+    }
+
+    return (uint16_t)(p_pos - p_buf);
+}
+
+uint16_t estc_perf_snapshot_encode(estc_perf_site_t site, uint8_t *p_buf)
+{
+    estc_perf_stats_t const *p_stats = &m_stats[site];
+    uint8_t *p_pos = p_buf;
+
+    *p_pos++ = (uint8_t)site;
+    p_pos = put_u32(p_pos, p_stats->count);
+    p_pos = put_u32(p_pos, p_stats->count ? p_stats->min : 0);
+    p_pos = put_u32(p_pos, p_stats->max);
+    p_pos = put_u32(p_pos, p_stats->count ? (uint32_t)(p_stats->sum / p_stats->count) : 0);
+
+    for (uint8_t i = 0; i < ESTC_PERF_HIST_BUCKETS; i++)
+    {
+        *p_pos++ = (uint8_t)p_stats->hist[i];
+        *p_pos++ = (uint8_t)(p_stats->hist[i] >> 8);
+    }
+
+    return (uint16_t)(p_pos - p_buf);
+}
+
+void estc_perf_log_all(void)
+{
+    for (uint8_t i = 0; i < ESTC_PERF_COUNTER_COUNT; i++)
+    {
+        NRF_LOG_INFO("PERF %s: %d", m_counter_names[i], m_counters[i]);
+    }
+
+    for (uint8_t site = 0; site < ESTC_PERF_SITE_COUNT; site++)
+    {
+        estc_perf_stats_t const *p_stats = &m_stats[site];
+        if (p_stats->count == 0)
+        {
+            continue;
+        }
+
+        NRF_LOG_INFO("PERF %s: n=%d min=%d avg=%d max=%d cycles", m_site_names[site], p_stats->count,
+                     p_stats->min, (uint32_t)(p_stats->sum / p_stats->count), p_stats->max);
+
+        for (uint8_t i = 0; i < ESTC_PERF_HIST_BUCKETS; i++)
+        {
+            if (p_stats->hist[i] != 0)
+            {
+                NRF_LOG_INFO("PERF   < 2^%d: %d", i, p_stats->hist[i]);
+            }
+        }
+    }
+}
+
+void estc_perf_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    memset(m_stats, 0, sizeof(m_stats));
+    memset(m_counters, 0, sizeof(m_counters));
+    for (uint8_t site = 0; site < ESTC_PERF_SITE_COUNT; site++)
+    {
+        m_stats[site].min = UINT32_MAX;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+#endif // ESTC_PERF_ENABLED
@@ -0,0 +1,186 @@
+#ifndef ESTC_PERF_H__
+#define ESTC_PERF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf.h"
+#include "sdk_config.h"
+
+/**
+ * @brief Hot path instrumentation based on the DWT cycle counter
+ *
+ * @details Every site keeps count, min, max and sum of its cycle counts plus a log2 histogram.
+ *          Bucket k counts samples in [2^(k-1), 2^k) cycles, the last bucket also holds
+ *          everything above. Span sites measure across contexts: ESTC_PERF_EVENT_BEGIN()
+ *          stamps the start of the BLE event being handled, ESTC_PERF_SPAN_START() opens a
+ *          span at that stamp unless one is already open and ESTC_PERF_SPAN_END() records
+ *          the time since, so coalesced writes report their worst-case latency.
+ *
+ *          With ESTC_PERF_ENABLED cleared (release builds) all macros compile to nothing and
+ *          the diagnostics characteristic is not registered.
+ */
+#ifndef ESTC_PERF_ENABLED
+#define ESTC_PERF_ENABLED 0
+#endif
+
+/**
+ * @brief Instrumented sites, X(id, name)
+ */
+#define ESTC_PERF_SITES(X)                                         \
+    X(ESTC_PERF_ON_WRITE,       "on_write")                        \
+    X(ESTC_PERF_CMD_PARSE,      "estc_cmd_parse")                  \
+    X(ESTC_PERF_DEFERRED_WRITE, "deferred write handler")          \
+    X(ESTC_PERF_BATCH_HANDLER,  "batch_write_handler")             \
+    X(ESTC_PERF_PWM_APPLY,      "pwm apply")                       \
+    X(ESTC_PERF_FLASH_UPDATE,   "flash_storage_update_values")     \
+    X(ESTC_PERF_WRITE_TO_LIGHT, "write event to PWM update")       \
+    X(ESTC_PERF_WRITE_TO_FLASH, "write event to flash job queued")
+
+#define ESTC_PERF_SITE_ID(_id, _name) _id,
+
+typedef enum
+{
+    ESTC_PERF_SITES(ESTC_PERF_SITE_ID)
+    ESTC_PERF_SITE_COUNT
+} estc_perf_site_t;
+
+#undef ESTC_PERF_SITE_ID
+
+/**
+ * @brief Session counters, X(id, name)
+ *
+ * Counters only grow, the "max" entries hold the largest value seen.
+ */
+#define ESTC_PERF_COUNTERS(X)                                       \
+    X(ESTC_PERF_CNT_BLE_EVENTS,       "BLE events")                 \
+    X(ESTC_PERF_CNT_WRITES,           "GATT writes")                \
+    X(ESTC_PERF_CNT_WRITES_REJECTED,  "GATT writes rejected")       \
+    X(ESTC_PERF_CNT_CMD_BYTES,        "command bytes parsed")       \
+    X(ESTC_PERF_CNT_BATCHES,          "batches applied")            \
+    X(ESTC_PERF_CNT_RENDER_OVERFLOWS, "render ring overflows")      \
+    X(ESTC_PERF_CNT_NOTIFICATIONS,    "notifications queued")       \
+    X(ESTC_PERF_CNT_TX_COMPLETE,      "notifications sent")         \
+    X(ESTC_PERF_CNT_FLASH_WRITES,     "flash writes")               \
+    X(ESTC_PERF_CNT_FLASH_ERASES,     "flash erases")               \
+    X(ESTC_PERF_MAX_RENDER_RING,      "max render ring depth")      \
+    X(ESTC_PERF_MAX_SCHED_QUEUE,      "max scheduler queue depth")  \
+    X(ESTC_PERF_CNT_SCAN_REPORTS,     "advertising reports scanned") \
+    X(ESTC_PERF_CNT_GROUP_COMMANDS,   "group commands applied")     \
+    X(ESTC_PERF_CNT_GROUP_REJECTED,   "group commands rejected")    \
+    X(ESTC_PERF_CNT_STREAM_UNDERRUNS, "animation stream underruns")
+
+#define ESTC_PERF_COUNTER_ID(_id, _name) _id,
+
+typedef enum
+{
+    ESTC_PERF_COUNTERS(ESTC_PERF_COUNTER_ID)
+    ESTC_PERF_COUNTER_COUNT
+} estc_perf_counter_t;
+
+#undef ESTC_PERF_COUNTER_ID
+
+#define ESTC_PERF_HIST_BUCKETS 24
+
+// Diagnostics characteristic write commands, any other value selects a site
+#define ESTC_PERF_CMD_LOG_ALL 0xFF // Dump every site to the log
+#define ESTC_PERF_CMD_RESET 0xFE   // Clear all counters
+#define ESTC_PERF_CMD_COUNTERS 0xFD // Select the session counters
+
+// Snapshot read from the diagnostics characteristic, little-endian:
+// site (1), count (4), min (4), max (4), avg (4), histogram (2 per bucket, saturated)
+#define ESTC_PERF_SNAPSHOT_SIZE (1 + 4 * sizeof(uint32_t) + ESTC_PERF_HIST_BUCKETS * sizeof(uint16_t))
+// Counters read from the diagnostics characteristic: ESTC_PERF_CMD_COUNTERS (1), then every
+// counter in table order (4 each, little-endian)
+#define ESTC_PERF_COUNTERS_SIZE (1 + ESTC_PERF_COUNTER_COUNT * sizeof(uint32_t))
+
+#if ESTC_PERF_ENABLED
+
+#define ESTC_PERF_START(_var) uint32_t const _var = DWT->CYCCNT
+#define ESTC_PERF_STOP(_site, _var) estc_perf_record((_site), DWT->CYCCNT - (_var))
+#define ESTC_PERF_EVENT_BEGIN() estc_perf_event_begin(DWT->CYCCNT)
+#define ESTC_PERF_SPAN_START(_site) estc_perf_span_start(_site)
+#define ESTC_PERF_SPAN_END(_site) estc_perf_span_end((_site), DWT->CYCCNT, true)
+#define ESTC_PERF_SPAN_CANCEL(_site) estc_perf_span_end((_site), 0, false)
+#define ESTC_PERF_COUNT(_counter) estc_perf_counter_add((_counter), 1)
+#define ESTC_PERF_ADD(_counter, _value) estc_perf_counter_add((_counter), (_value))
+#define ESTC_PERF_MAX(_counter, _value) estc_perf_counter_max((_counter), (_value))
+
+/**
+ * @brief Enable the DWT cycle counter
+ */
+void estc_perf_init(void);
+
+/**
+ * @brief Add a sample to a site
+ * @param site Site to update
+ * @param cycles Measured cycle count
+ */
+void estc_perf_record(estc_perf_site_t site, uint32_t cycles);
+
+/**
+ * @brief Remember the start of the BLE event being handled
+ */
+void estc_perf_event_begin(uint32_t now);
+
+/**
+ * @brief Open a span at the start of the current event unless one is still pending
+ */
+void estc_perf_span_start(estc_perf_site_t site);
+
+/**
+ * @brief Close a pending span, recording it if requested
+ */
+void estc_perf_span_end(estc_perf_site_t site, uint32_t now, bool record);
+
+/**
+ * @brief Add to a session counter, safe to call from any interrupt priority
+ */
+void estc_perf_counter_add(estc_perf_counter_t counter, uint32_t value);
+
+/**
+ * @brief Raise a "max" session counter to value if it is larger
+ */
+void estc_perf_counter_max(estc_perf_counter_t counter, uint32_t value);
+
+/**
+ * @brief Encode the session counters
+ * @param p_buf Buffer of ESTC_PERF_COUNTERS_SIZE bytes
+ * @return Number of bytes written
+ */
+uint16_t estc_perf_counters_encode(uint8_t *p_buf);
+
+/**
+ * @brief Encode the statistics of a site
+ * @param site Site to encode
+ * @param p_buf Buffer of ESTC_PERF_SNAPSHOT_SIZE bytes
+ * @return Number of bytes written
+ */
+uint16_t estc_perf_snapshot_encode(estc_perf_site_t site, uint8_t *p_buf);
+
+/**
+ * @brief Log the session counters and the statistics of every site that has samples
+ */
+void estc_perf_log_all(void);
+
+/**
+ * @brief Clear all statistics and counters
+ */
+void estc_perf_reset(void);
+
+#else
+
+#define ESTC_PERF_START(_var)
+#define ESTC_PERF_STOP(_site, _var) do {} while (0)
+#define ESTC_PERF_EVENT_BEGIN() do {} while (0)
+#define ESTC_PERF_SPAN_START(_site) do {} while (0)
+#define ESTC_PERF_SPAN_END(_site) do {} while (0)
+#define ESTC_PERF_SPAN_CANCEL(_site) do {} while (0)
+#define ESTC_PERF_COUNT(_counter) do {} while (0)
+#define ESTC_PERF_ADD(_counter, _value) do {} while (0)
+#define ESTC_PERF_MAX(_counter, _value) do {} while (0)
+
+#define estc_perf_init() do {} while (0)
+
+#endif // ESTC_PERF_ENABLED
+
+#endif // ESTC_PERF_H__
@@ -1,22 +1,192 @@
 #include "estc_service.h"
 
+#include <string.h>
 #include "app_error.h"
 #include "nrf_log.h"
+#include "estc_log.h"
+#include "estc_perf.h"
+#include "app_scheduler.h"
+#include "app_util.h"
+#include "app_util_platform.h"
 #include "pwm_control.h"
-
-#include "ble.h"
-#include "ble_gatts.h"
-#include "ble_srv_common.h"
+#include "estc_command.h"
+#include "estc_anim.h"
+#include "flash_storage.h"
+#include "hal_ble.h"
+#include "hal_timer.h"
+#include "crc32.h"
 
 #define CHARACTERISTIC_RGB_STATE_DESC "WRITE/READ/NOTIFY: RGB state characteristic 1 byte"
 #define CHARACTERISTIC_RGB_VALUE_DESC "WRITE/READ/NOTIFY: RGB value characteristic 3 bytes"
+#define CHARACTERISTIC_COMMAND_DESC "WRITE/NOTIFY: Batched command stream"
+#define CHARACTERISTIC_STREAM_DESC "WRITE/NOTIFY: Animation frame stream"
+#define CHARACTERISTIC_ANIM_DESC "WRITE/NOTIFY: Compressed animation stream"
+#define CHARACTERISTIC_PROGRAM_DESC "WRITE/NOTIFY: Animation program upload"
+#define CHARACTERISTIC_DIAG_DESC "WRITE/READ: Write a site index, read its cycle statistics"
+#define CHARACTERISTIC_BENCH_SINK_DESC "WRITE: Throughput benchmark sink"
+#define CHARACTERISTIC_BENCH_SOURCE_DESC "WRITE/NOTIFY: Throughput benchmark source, write 1 to stream"
 
 static uint8_t rgb_state_init_value = 0;
 static uint8_t rgb_value_init_values[3] = {0, 0, 0};
+static uint8_t command_value[CHARACTERISTIC_COMMAND_SIZE];
+static uint8_t stream_value[CHARACTERISTIC_STREAM_SIZE];
+static uint8_t anim_value[CHARACTERISTIC_STREAM_SIZE];
+static uint8_t program_value[CHARACTERISTIC_STREAM_SIZE];
+
+STATIC_ASSERT(CHARACTERISTIC_STREAM_SIZE - ESTC_STREAM_HEADER_SIZE <= FLASH_STORAGE_PROGRAM_CHUNK_MAX);
+#if ESTC_PERF_ENABLED
+static uint8_t diag_value[CHARACTERISTIC_DIAG_SIZE];
+#endif
+#if ESTC_BENCH_ENABLED
+static uint8_t bench_sink_value[CHARACTERISTIC_BENCH_SIZE];
+static uint8_t bench_source_value[CHARACTERISTIC_BENCH_SIZE];
+#endif
+
+// Light state as last handed to the render loop, owned by the SoftDevice event context
+static estc_cmd_batch_t m_light_state = {.brightness = ESTC_CMD_BRIGHTNESS_MAX};
+
+// Light state written in the SoftDevice event context and not yet applied by the main loop.
+// Further writes are folded into the same batch (latest wins), so at most one scheduler event is queued.
+static estc_cmd_batch_t m_pending_batch;
+static uint16_t m_pending_conn_handle;
+static volatile bool m_pending;
+// Set when the render ring was full, the main loop then renders the pending batch itself
+static bool m_render_overflow;
+
+// Animation stream, owned by the SoftDevice event context. The stream characteristics share it,
+// the link and characteristic of the upload in progress own it, see ESTC_STREAM_HEADER_SIZE.
+static uint16_t m_stream_value_handle;
+static uint16_t m_stream_conn_handle = BLE_CONN_HANDLE_INVALID;
+static uint16_t m_stream_expected_seq;
+// Time of the last accepted chunk or READY, for the idle timeout of the owner
+static uint32_t m_stream_stamp;
+// A status was sent for the last rejected chunk, the chunks following it get none
+static bool m_stream_rejected;
+// The client waits for READY, cleared by the main loop
+static volatile bool m_stream_waiting;
+// A compressed animation decode is queued, cleared by the main loop
+static volatile bool m_anim_decode_pending;
+// Flash write failures are reported to the PROGRAM upload owning the stream
+static uint16_t m_program_value_handle;
+
+// Stream chunk payload handler, restart is set for sequence number 0
+typedef pwm_stream_result_t (*stream_chunk_writer_t)(uint8_t const *p_data, uint16_t len, bool restart);
+
+// Characteristic write handler type, len is validated against the table entry before the call
+typedef void (*estc_char_write_handler_t)(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+
+// Compile-time description of a single characteristic
+typedef struct
+{
+    uint16_t uuid;
+    uint16_t size;
+    uint8_t props;
+    const char *desc;
+    uint8_t *p_init_value;
+    estc_char_write_handler_t write_handler;
+} estc_char_def_t;
+
+static void rgb_state_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+static void rgb_value_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+static void command_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+static void stream_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+static void anim_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+static void program_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+#if ESTC_PERF_ENABLED
+static void diag_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+#endif
+#if ESTC_BENCH_ENABLED
+static void bench_sink_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+static void bench_source_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len);
+#endif
+
+// Characteristic table, indexed by estc_char_id_t
+static const estc_char_def_t m_char_defs[ESTC_CHAR_COUNT] =
+    {
+        [ESTC_CHAR_RGB_STATE] = {
+            .uuid = RANDOM_CHARACTERISTIC_UUID_RGB_STATE,
+            .size = CHARACTERISTIC_RGB_STATE_SIZE,
+            .props = ESTC_CHAR_PROP_READ | ESTC_CHAR_PROP_WRITE | ESTC_CHAR_PROP_NOTIFY,
+            .desc = CHARACTERISTIC_RGB_STATE_DESC,
+            .p_init_value = &rgb_state_init_value,
+            .write_handler = rgb_state_char_write,
+        },
+        [ESTC_CHAR_RGB_VALUE] = {
+            .uuid = RANDOM_CHARACTERISTIC_UUID_RGB_VALUE,
+            .size = CHARACTERISTIC_RGB_VALUE_SIZE,
+            .props = ESTC_CHAR_PROP_READ | ESTC_CHAR_PROP_WRITE | ESTC_CHAR_PROP_NOTIFY,
+            .desc = CHARACTERISTIC_RGB_VALUE_DESC,
+            .p_init_value = rgb_value_init_values,
+            .write_handler = rgb_value_char_write,
+        },
+        [ESTC_CHAR_COMMAND] = {
+            .uuid = RANDOM_CHARACTERISTIC_UUID_COMMAND,
+            .size = CHARACTERISTIC_COMMAND_SIZE,
+            .props = ESTC_CHAR_PROP_WRITE | ESTC_CHAR_PROP_WRITE_WO_RESP | ESTC_CHAR_PROP_NOTIFY | ESTC_CHAR_PROP_VAR_LEN,
+            .desc = CHARACTERISTIC_COMMAND_DESC,
+            .p_init_value = command_value,
+            .write_handler = command_char_write,
+        },
+        [ESTC_CHAR_STREAM] = {
+            .uuid = RANDOM_CHARACTERISTIC_UUID_STREAM,
+            .size = CHARACTERISTIC_STREAM_SIZE,
+            .props = ESTC_CHAR_PROP_WRITE | ESTC_CHAR_PROP_WRITE_WO_RESP | ESTC_CHAR_PROP_NOTIFY | ESTC_CHAR_PROP_VAR_LEN,
+            .desc = CHARACTERISTIC_STREAM_DESC,
+            .p_init_value = stream_value,
+            .write_handler = stream_char_write,
+        },
+        [ESTC_CHAR_ANIM] = {
+            .uuid = RANDOM_CHARACTERISTIC_UUID_ANIM,
+            .size = CHARACTERISTIC_STREAM_SIZE,
+            .props = ESTC_CHAR_PROP_WRITE | ESTC_CHAR_PROP_WRITE_WO_RESP | ESTC_CHAR_PROP_NOTIFY | ESTC_CHAR_PROP_VAR_LEN,
+            .desc = CHARACTERISTIC_ANIM_DESC,
+            .p_init_value = anim_value,
+            .write_handler = anim_char_write,
+        },
+        [ESTC_CHAR_PROGRAM] = {
+            .uuid = RANDOM_CHARACTERISTIC_UUID_PROGRAM,
+            .size = CHARACTERISTIC_STREAM_SIZE,
+            .props = ESTC_CHAR_PROP_WRITE | ESTC_CHAR_PROP_WRITE_WO_RESP | ESTC_CHAR_PROP_NOTIFY | ESTC_CHAR_PROP_VAR_LEN,
+            .desc = CHARACTERISTIC_PROGRAM_DESC,
+            .p_init_value = program_value,
+            .write_handler = program_char_write,
+        },
+#if ESTC_PERF_ENABLED
+        [ESTC_CHAR_DIAG] = {
+            .uuid = RANDOM_CHARACTERISTIC_UUID_DIAG,
+            .size = CHARACTERISTIC_DIAG_SIZE,
+            .props = ESTC_CHAR_PROP_READ | ESTC_CHAR_PROP_WRITE | ESTC_CHAR_PROP_VAR_LEN,
+            .desc = CHARACTERISTIC_DIAG_DESC,
+            .p_init_value = diag_value,
+            .write_handler = diag_char_write,
+        },
+#endif
+#if ESTC_BENCH_ENABLED
+        [ESTC_CHAR_BENCH_SINK] = {
+            .uuid = RANDOM_CHARACTERISTIC_UUID_BENCH_SINK,
+            .size = CHARACTERISTIC_BENCH_SIZE,
+            .props = ESTC_CHAR_PROP_WRITE_WO_RESP | ESTC_CHAR_PROP_VAR_LEN,
+            .desc = CHARACTERISTIC_BENCH_SINK_DESC,
+            .p_init_value = bench_sink_value,
+            .write_handler = bench_sink_char_write,
+        },
+        [ESTC_CHAR_BENCH_SOURCE] = {
+            .uuid = RANDOM_CHARACTERISTIC_UUID_BENCH_SOURCE,
+            .size = CHARACTERISTIC_BENCH_SIZE,
+            .props = ESTC_CHAR_PROP_WRITE | ESTC_CHAR_PROP_NOTIFY | ESTC_CHAR_PROP_VAR_LEN,
+            .desc = CHARACTERISTIC_BENCH_SOURCE_DESC,
+            .p_init_value = bench_source_value,
+            .write_handler = bench_source_char_write,
+        },
+#endif
+};
 
 static ret_code_t estc_ble_add_characteristics(ble_estc_service_t *service);
+static void stream_space_handler(void);
+static void program_space_handler(ret_code_t result);
+static void estc_program_play(uint8_t slot);
 static ret_code_t estc_add_characteristic(ble_estc_service_t *service, ble_gatts_char_handles_t *handles,
-                                          uint16_t uuid, const char *desc, size_t size, uint8_t *p_init_value);
+                                          const estc_char_def_t *p_def);
 
 void estc_characteristic_init_values(uint8_t rgb_state, uint8_t r, uint8_t g, uint8_t b)
 {
@@ -25,26 +195,67 @@ void estc_characteristic_init_values(uint8_t rgb_state, uint8_t r, uint8_t g, ui
     rgb_value_init_values[1] = g;
     rgb_value_init_values[2] = b;
 
+    m_light_state.state = rgb_state ? 1 : 0;
+    m_light_state.color.red = r;
+    m_light_state.color.green = g;
+    m_light_state.color.blue = b;
+
     NRF_LOG_INFO("BLE init values set - RGB state: %d, RGB values: (%d, %d, %d)",
                  rgb_state, r, g, b);
 }
 
+uint32_t estc_service_db_hash(ble_estc_service_t const *service)
+{
+    static uint8_t const base_uuid[] = RANDOM_BASE_UUID;
+    uint8_t entry[2 * sizeof(uint16_t)];
+    uint32_t crc = crc32_compute(base_uuid, sizeof(base_uuid), NULL);
+
+    uint16_encode(RANDOM_SERVICE_UUID, &entry[0]);
+    uint16_encode(service->service_handle, &entry[2]);
+    crc = crc32_compute(entry, 4, &crc);
+
+    for (uint8_t id = 0; id < ESTC_CHAR_COUNT; id++)
+    {
+        const estc_char_def_t *p_def = &m_char_defs[id];
+        ble_gatts_char_handles_t const *p_handles = &service->char_handles[id];
+        uint8_t char_entry[13];
+
+        // Little-endian, so the hash does not depend on the struct layout
+        uint16_encode(p_def->uuid, &char_entry[0]);
+        uint16_encode(p_def->size, &char_entry[2]);
+        char_entry[4] = p_def->props;
+        uint16_encode(p_handles->value_handle, &char_entry[5]);
+        uint16_encode(p_handles->cccd_handle, &char_entry[7]);
+        uint16_encode(p_handles->user_desc_handle, &char_entry[9]);
+        uint16_encode(p_handles->sccd_handle, &char_entry[11]);
+        crc = crc32_compute(char_entry, sizeof(char_entry), &crc);
+        crc = crc32_compute((uint8_t const *)p_def->desc, strlen(p_def->desc), &crc);
+    }
+
+    return crc;
+}
+
+void estc_service_light_state_get(estc_cmd_batch_t *p_state)
+{
+    // Written from the SoftDevice event context
+    CRITICAL_REGION_ENTER();
+    *p_state = m_light_state;
+    CRITICAL_REGION_EXIT();
+}
+
 ret_code_t estc_ble_service_init(ble_estc_service_t *service, const ble_lbs_init_t *lbs_init)
 {
     ret_code_t error_code = NRF_SUCCESS;
 
-    service->rgb_state_write_handler = lbs_init->rgb_state_write_handler;
-    service->rgb_value_write_handler = lbs_init->rgb_value_write_handler;
+    service->batch_write_handler = lbs_init->batch_write_handler;
 
     ble_uuid128_t base_uuid_t = {RANDOM_BASE_UUID};
 
-    error_code = sd_ble_uuid_vs_add(&base_uuid_t, &service->uuid_type);
-    APP_ERROR_CHECK(error_code);
-
-    ble_uuid_t service_uuid = {RANDOM_SERVICE_UUID, service->uuid_type};
-
-    error_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &service_uuid, &service->service_handle);
-    APP_ERROR_CHECK(error_code);
+    error_code = hal_ble_service_add(&base_uuid_t, RANDOM_SERVICE_UUID, &service->uuid_type, &service->service_handle);
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
 
     return estc_ble_add_characteristics(service);
 }
@@ -53,101 +264,629 @@ static ret_code_t estc_ble_add_characteristics(ble_estc_service_t *service)
 {
     ret_code_t error_code = NRF_SUCCESS;
 
-    error_code = estc_add_characteristic(service, &service->rgb_state_characteristic_handles,
-                                         RANDOM_CHARACTERISTIC_UUID_RGB_STATE,
-                                         CHARACTERISTIC_RGB_STATE_DESC,
-                                         CHARACTERISTIC_RGB_STATE_SIZE,
-                                         &rgb_state_init_value);
-    APP_ERROR_CHECK(error_code);
+    memset(service->handle_map, 0, sizeof(service->handle_map));
 
-    error_code = estc_add_characteristic(service, &service->rgb_value_characteristic_handles,
-                                         RANDOM_CHARACTERISTIC_UUID_RGB_VALUE,
-                                         CHARACTERISTIC_RGB_VALUE_DESC,
-                                         CHARACTERISTIC_RGB_VALUE_SIZE,
-                                         rgb_value_init_values);
+    for (uint8_t id = 0; id < ESTC_CHAR_COUNT; id++)
+    {
+        error_code = estc_add_characteristic(service, &service->char_handles[id], &m_char_defs[id]);
+        if (error_code != NRF_SUCCESS)
+        {
+            return error_code;
+        }
+
+        // Attribute handles are allocated sequentially after the service declaration. A stack
+        // that adds more attributes per characteristic than the map has room for is caught here,
+        // on_write() would drop the writes of the characteristics past the map otherwise.
+        uint16_t offset = service->char_handles[id].value_handle - service->service_handle;
+        if (offset >= ESTC_HANDLE_MAP_SIZE)
+        {
+            return NRF_ERROR_NO_MEM;
+        }
+        service->handle_map[offset] = id + 1;
+    }
 
-    APP_ERROR_CHECK(error_code);
+    pwm_stream_space_handler_set(stream_space_handler);
+    m_program_value_handle = service->char_handles[ESTC_CHAR_PROGRAM].value_handle;
+    flash_storage_program_handler_set(program_space_handler);
+
+#if ESTC_BENCH_ENABLED
+    estc_bench_init(service->char_handles[ESTC_CHAR_BENCH_SOURCE].value_handle);
+#endif
 
     return NRF_SUCCESS;
 }
 
 static ret_code_t estc_add_characteristic(ble_estc_service_t *service, ble_gatts_char_handles_t *handles,
-                                          uint16_t uuid, const char *desc, size_t size, uint8_t *p_init_value)
+                                          const estc_char_def_t *p_def)
 {
-    ret_code_t error_code = NRF_SUCCESS;
-
     ble_add_char_params_t char_props;
     memset(&char_props, 0, sizeof(char_props));
 
-    char_props.uuid = uuid;
+    char_props.uuid = p_def->uuid;
     char_props.uuid_type = service->uuid_type;
-    char_props.max_len = size;
-    char_props.init_len = size;
-    char_props.p_init_value = p_init_value;
+    char_props.max_len = p_def->size;
+    char_props.init_len = (p_def->props & ESTC_CHAR_PROP_VAR_LEN) ? 0 : p_def->size;
+    char_props.is_var_len = (p_def->props & ESTC_CHAR_PROP_VAR_LEN) ? true : false;
+    char_props.p_init_value = p_def->p_init_value;
     char_props.is_value_user = true;
 
-    char_props.char_props.write = 1;
-    char_props.char_props.read = 1;
-    char_props.read_access = SEC_OPEN;
-    char_props.write_access = SEC_OPEN;
+    if (p_def->props & ESTC_CHAR_PROP_READ)
+    {
+        char_props.char_props.read = 1;
+        char_props.read_access = SEC_OPEN;
+    }
+
+    if (p_def->props & (ESTC_CHAR_PROP_WRITE | ESTC_CHAR_PROP_WRITE_WO_RESP))
+    {
+        char_props.char_props.write = (p_def->props & ESTC_CHAR_PROP_WRITE) ? 1 : 0;
+        char_props.char_props.write_wo_resp = (p_def->props & ESTC_CHAR_PROP_WRITE_WO_RESP) ? 1 : 0;
+        char_props.write_access = SEC_OPEN;
+    }
 
-    char_props.char_props.notify = 1;
-    char_props.cccd_write_access = SEC_OPEN;
+    if (p_def->props & ESTC_CHAR_PROP_NOTIFY)
+    {
+        char_props.char_props.notify = 1;
+        char_props.cccd_write_access = SEC_OPEN;
+    }
 
     ble_add_char_user_desc_t user_desc;
     memset(&user_desc, 0, sizeof(user_desc));
 
-    user_desc.p_char_user_desc = (uint8_t *)desc;
-    user_desc.size = strlen(desc);
-    user_desc.max_size = strlen(desc);
+    user_desc.p_char_user_desc = (uint8_t *)p_def->desc;
+    user_desc.size = strlen(p_def->desc);
+    user_desc.max_size = strlen(p_def->desc);
     user_desc.char_props.read = 1;
     user_desc.read_access = SEC_OPEN;
 
     char_props.p_user_descr = &user_desc;
 
-    error_code = characteristic_add(service->service_handle, &char_props, handles);
-    APP_ERROR_CHECK(error_code);
+    return hal_ble_characteristic_add(service->service_handle, &char_props, handles);
+}
+
+/**
+ * @brief Handle the pending batch from the main loop
+ */
+static void estc_deferred_write_handler(void *p_event_data, uint16_t event_size)
+{
+    ble_estc_service_t *service = *(ble_estc_service_t **)p_event_data;
+    estc_cmd_batch_t batch;
+    uint16_t conn_handle;
+    bool render;
+
+    ESTC_PERF_START(start);
+
+    CRITICAL_REGION_ENTER();
+    batch = m_pending_batch;
+    conn_handle = m_pending_conn_handle;
+    render = m_render_overflow;
+    m_render_overflow = false;
+    m_pending = false;
+    CRITICAL_REGION_EXIT();
+
+    if (render)
+    {
+        pwm_apply_light(batch.state, batch.color, batch.brightness,
+                        (batch.flags & ESTC_CMD_FLAG_FADE) ? batch.fade_ms : 0);
+    }
+
+    if (batch.flags & ESTC_CMD_FLAG_PROGRAM)
+    {
+        estc_program_play(batch.program);
+    }
+
+    ESTC_LOG(ESTC_LOG_SERVICE_BATCH, batch.flags);
+    ESTC_PERF_COUNT(ESTC_PERF_CNT_BATCHES);
+    ESTC_PERF_MAX(ESTC_PERF_MAX_SCHED_QUEUE, app_sched_queue_utilization_get());
+
+    service->batch_write_handler(conn_handle, service, &batch);
+
+    ESTC_PERF_STOP(ESTC_PERF_DEFERRED_WRITE, start);
+}
+
+/**
+ * @brief Get the batch the current write is folded into
+ */
+static estc_cmd_batch_t *estc_pending_batch_get(void)
+{
+    if (!m_pending)
+    {
+        m_pending_batch = m_light_state;
+    }
+    return &m_pending_batch;
+}
+
+/**
+ * @brief Hand the pending light state to the render loop and queue the batch
+ *        for the main loop unless it is already queued
+ */
+static void estc_pending_batch_commit(ble_estc_service_t *service, uint16_t conn_handle)
+{
+    pwm_command_t command = {
+        .state = m_pending_batch.state,
+        .color = m_pending_batch.color,
+        .brightness = m_pending_batch.brightness,
+        .fade_ms = (m_pending_batch.flags & ESTC_CMD_FLAG_FADE) ? m_pending_batch.fade_ms : 0,
+    };
+
+    m_light_state = m_pending_batch;
+    m_light_state.flags = 0;
+
+    ESTC_PERF_SPAN_START(ESTC_PERF_WRITE_TO_LIGHT);
+    ESTC_PERF_SPAN_START(ESTC_PERF_WRITE_TO_FLASH);
+
+    if (pwm_command_push(&command))
+    {
+        // The fade is running, later writes folded into this batch must not restart it
+        m_pending_batch.flags &= ~ESTC_CMD_FLAG_FADE;
+    }
+    else
+    {
+        m_render_overflow = true;
+        ESTC_PERF_COUNT(ESTC_PERF_CNT_RENDER_OVERFLOWS);
+    }
+
+    m_pending_conn_handle = conn_handle;
+
+    if (!m_pending)
+    {
+        m_pending = true;
+
+        ret_code_t err_code = app_sched_event_put(&service, sizeof(service), estc_deferred_write_handler);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+static void rgb_state_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    estc_cmd_batch_t *p_batch = estc_pending_batch_get();
+
+    p_batch->state = p_data[0] ? 1 : 0;
+    p_batch->flags |= ESTC_CMD_FLAG_STATE;
+
+    estc_pending_batch_commit(service, conn_handle);
+}
+
+static void rgb_value_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    estc_cmd_batch_t *p_batch = estc_pending_batch_get();
+
+    p_batch->color.red = p_data[0];
+    p_batch->color.green = p_data[1];
+    p_batch->color.blue = p_data[2];
+    p_batch->flags |= ESTC_CMD_FLAG_COLOR;
+    p_batch->flags &= ~ESTC_CMD_FLAG_FADE;
+
+    estc_pending_batch_commit(service, conn_handle);
+}
+
+static void command_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    // The command stream is parsed directly from the SoftDevice event buffer,
+    // a rejected stream leaves the pending batch untouched
+    ESTC_PERF_START(start);
+    ret_code_t err_code = estc_cmd_parse(p_data, len, estc_pending_batch_get());
+    ESTC_PERF_STOP(ESTC_PERF_CMD_PARSE, start);
+    ESTC_PERF_ADD(ESTC_PERF_CNT_CMD_BYTES, len);
+
+    if (err_code == NRF_SUCCESS)
+    {
+        estc_pending_batch_commit(service, conn_handle);
+    }
+    else
+    {
+        ESTC_PERF_COUNT(ESTC_PERF_CNT_WRITES_REJECTED);
+    }
+}
+
+void estc_service_command_apply(ble_estc_service_t *service, uint8_t const *p_data, uint16_t len)
+{
+    ESTC_PERF_EVENT_BEGIN();
+    command_char_write(service, BLE_CONN_HANDLE_INVALID, p_data, len);
+}
+
+static void stream_status_notify(uint16_t conn_handle, estc_stream_status_t status)
+{
+    uint8_t data[ESTC_STREAM_STATUS_SIZE];
+
+    data[0] = status;
+    uint16_encode(m_stream_expected_seq, &data[1]);
+    uint16_encode((uint16_t)MIN(pwm_stream_space_get(), UINT16_MAX), &data[3]);
+
+    // Without notifications enabled the client has to time out and resend from its last chunk
+    (void)hal_ble_notify(conn_handle, m_stream_value_handle, data, sizeof(data));
+}
 
-    return error_code;
+/**
+ * @brief Tell an upload that does not own the stream to start over later
+ */
+static void stream_busy_notify(uint16_t conn_handle, uint16_t value_handle)
+{
+    uint8_t data[ESTC_STREAM_STATUS_SIZE] = {ESTC_STREAM_STATUS_BUSY};
+
+    (void)hal_ble_notify(conn_handle, value_handle, data, sizeof(data));
 }
 
+/**
+ * @brief Check whether a chunk belongs to the upload owning the stream, chunk 0 of a new upload
+ *        takes the stream over if the owner is gone, idle or the same link
+ */
+static bool stream_owner_check(uint16_t conn_handle, uint16_t value_handle, uint8_t const *p_data, uint16_t len)
+{
+    if (conn_handle == m_stream_conn_handle && value_handle == m_stream_value_handle)
+    {
+        return true;
+    }
+
+    bool start = len >= ESTC_STREAM_HEADER_SIZE && uint16_decode(p_data) == 0;
+    bool free = m_stream_conn_handle == BLE_CONN_HANDLE_INVALID || conn_handle == m_stream_conn_handle ||
+                (!m_stream_waiting && hal_timer_elapsed_ms(m_stream_stamp) >= ESTC_STREAM_IDLE_TIMEOUT_MS);
+
+    if (!start || !free)
+    {
+        return false;
+    }
+
+    m_stream_conn_handle = conn_handle;
+    m_stream_value_handle = value_handle;
+    m_stream_rejected = false;
+    m_stream_waiting = false;
+    return true;
+}
+
+/**
+ * @brief Give up the stream of a link that disconnected
+ */
+static void stream_release(uint16_t conn_handle)
+{
+    if (conn_handle == m_stream_conn_handle)
+    {
+        m_stream_conn_handle = BLE_CONN_HANDLE_INVALID;
+        m_stream_waiting = false;
+    }
+}
+
+/**
+ * @brief Check the sequence number of a stream chunk and hand its payload to a writer
+ */
+static void stream_chunk_write(uint16_t conn_handle, uint16_t value_handle, uint8_t const *p_data, uint16_t len,
+                               uint16_t payload_min, stream_chunk_writer_t writer)
+{
+    estc_stream_status_t status = ESTC_STREAM_STATUS_INVALID;
+
+    if (!stream_owner_check(conn_handle, value_handle, p_data, len))
+    {
+        // Another upload is in progress, or this one lost the stream and has to start over
+        ESTC_PERF_COUNT(ESTC_PERF_CNT_WRITES_REJECTED);
+        stream_busy_notify(conn_handle, value_handle);
+        return;
+    }
+
+    if (len >= ESTC_STREAM_HEADER_SIZE + payload_min)
+    {
+        uint16_t seq = uint16_decode(p_data);
+        if (seq == 0)
+        {
+            m_stream_expected_seq = 0;
+        }
+
+        if (seq != m_stream_expected_seq)
+        {
+            status = ESTC_STREAM_STATUS_OUT_OF_ORDER;
+        }
+        else
+        {
+            switch (writer(&p_data[ESTC_STREAM_HEADER_SIZE], len - ESTC_STREAM_HEADER_SIZE, seq == 0))
+            {
+            case PWM_STREAM_OK:
+                m_stream_expected_seq++;
+                m_stream_rejected = false;
+                m_stream_stamp = hal_timer_stamp_get();
+                return;
+
+            case PWM_STREAM_NO_SPACE:
+                status = ESTC_STREAM_STATUS_NO_SPACE;
+                m_stream_waiting = true;
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    ESTC_PERF_COUNT(ESTC_PERF_CNT_WRITES_REJECTED);
+
+    if (!m_stream_rejected)
+    {
+        m_stream_rejected = true;
+        stream_status_notify(conn_handle, status);
+    }
+}
+
+static pwm_stream_result_t stream_frames_write(uint8_t const *p_data, uint16_t len, bool restart)
+{
+    // The frames are decoded from the SoftDevice event buffer into the PWM buffers
+    return pwm_stream_write(p_data, len, m_light_state.brightness);
+}
+
+static void stream_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    stream_chunk_write(conn_handle, service->char_handles[ESTC_CHAR_STREAM].value_handle, p_data, len,
+                       PWM_STREAM_FRAME_SIZE, stream_frames_write);
+}
+
+/**
+ * @brief Tell a waiting client that stream buffers were freed, runs in the main loop
+ */
+static void stream_space_handler(void)
+{
+    // Freed stream buffers let the decoder go on and free the animation window
+    estc_anim_decode();
+
+    if (m_stream_waiting)
+    {
+        m_stream_waiting = false;
+        m_stream_stamp = hal_timer_stamp_get();
+        stream_status_notify(m_stream_conn_handle, ESTC_STREAM_STATUS_READY);
+    }
+}
+
+static void anim_decode_handler(void *p_event_data, uint16_t event_size)
+{
+    m_anim_decode_pending = false;
+    stream_space_handler();
+}
+
+static void anim_decode_schedule(void)
+{
+    if (!m_anim_decode_pending)
+    {
+        m_anim_decode_pending = true;
+
+        ret_code_t err_code = app_sched_event_put(NULL, 0, anim_decode_handler);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+static pwm_stream_result_t stream_anim_write(uint8_t const *p_data, uint16_t len, bool restart)
+{
+    pwm_stream_result_t result = estc_anim_feed(p_data, len, restart);
+
+    // A restart is taken over by the decoder even if the chunk did not fit yet
+    if (result != PWM_STREAM_INVALID)
+    {
+        anim_decode_schedule();
+    }
+
+    return result;
+}
+
+static void anim_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    stream_chunk_write(conn_handle, service->char_handles[ESTC_CHAR_ANIM].value_handle, p_data, len,
+                       1, stream_anim_write);
+}
+
+static pwm_stream_result_t stream_program_write(uint8_t const *p_data, uint16_t len, bool restart)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+
+    if (restart)
+    {
+        if (len < ESTC_PROGRAM_HEADER_SIZE)
+        {
+            return PWM_STREAM_INVALID;
+        }
+
+        uint8_t const *p_program;
+        uint16_t program_len;
+        bool stored = flash_storage_program_get(p_data[0], &p_program, &program_len);
+
+        err_code = flash_storage_program_begin(p_data[0], uint16_decode(&p_data[1]));
+        // The slot is erased, the program stored in it must not be read anymore if it plays
+        if (err_code == NRF_SUCCESS && stored && estc_anim_program_stop(p_program))
+        {
+            anim_decode_schedule();
+        }
+
+        p_data += ESTC_PROGRAM_HEADER_SIZE;
+        len -= ESTC_PROGRAM_HEADER_SIZE;
+    }
+
+    // The bytes are staged and written to flash asynchronously, one chunk at a time
+    if (err_code == NRF_SUCCESS && len != 0)
+    {
+        err_code = flash_storage_program_append(p_data, len);
+    }
+
+    switch (err_code)
+    {
+    case NRF_SUCCESS:
+        return PWM_STREAM_OK;
+    case NRF_ERROR_BUSY:
+        return PWM_STREAM_NO_SPACE;
+    default:
+        return PWM_STREAM_INVALID;
+    }
+}
+
+static void program_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    stream_chunk_write(conn_handle, service->char_handles[ESTC_CHAR_PROGRAM].value_handle, p_data, len,
+                       1, stream_program_write);
+}
+
+/**
+ * @brief The previous program chunk is in flash or the program failed to store, runs in the
+ *        SoftDevice event context
+ */
+static void program_space_handler(ret_code_t result)
+{
+    if (result == NRF_SUCCESS)
+    {
+        // READY is sent from the main loop
+        anim_decode_schedule();
+        return;
+    }
+
+    // The program is dropped, the upload has to start over. The chunks in flight get no status.
+    if (m_stream_conn_handle != BLE_CONN_HANDLE_INVALID && m_stream_value_handle == m_program_value_handle)
+    {
+        m_stream_expected_seq = 0;
+        m_stream_rejected = true;
+        m_stream_waiting = false;
+        stream_status_notify(m_stream_conn_handle, ESTC_STREAM_STATUS_WRITE_FAILED);
+    }
+}
+
+/**
+ * @brief Play a stored program, runs in the main loop
+ *
+ * @details The program replaces what an ANIM or STREAM upload feeds to the PWM stream, so it takes
+ *          the stream: the owner gets BUSY and has to start over with chunk 0. A PROGRAM upload
+ *          only writes flash and keeps the stream. An upload started after the play takes the
+ *          stream as usual.
+ */
+static void estc_program_play(uint8_t slot)
+{
+    uint8_t const *p_program;
+    uint16_t len;
+    uint16_t owner = BLE_CONN_HANDLE_INVALID;
+    uint16_t owner_value_handle = 0;
+
+    if (!flash_storage_program_get(slot, &p_program, &len))
+    {
+        NRF_LOG_WARNING("Program %u is empty", slot);
+        return;
+    }
+
+    // The chunk handlers of the SoftDevice event context see either the upload or the program
+    CRITICAL_REGION_ENTER();
+    if (m_stream_conn_handle != BLE_CONN_HANDLE_INVALID && m_stream_value_handle != m_program_value_handle)
+    {
+        owner = m_stream_conn_handle;
+        owner_value_handle = m_stream_value_handle;
+        m_stream_conn_handle = BLE_CONN_HANDLE_INVALID;
+        m_stream_expected_seq = 0;
+        m_stream_rejected = false;
+        m_stream_waiting = false;
+    }
+    estc_anim_play(p_program, len);
+    CRITICAL_REGION_EXIT();
+
+    if (owner != BLE_CONN_HANDLE_INVALID)
+    {
+        stream_busy_notify(owner, owner_value_handle);
+    }
+
+    estc_anim_decode();
+}
+
+#if ESTC_PERF_ENABLED
+static void diag_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    if (p_data[0] == ESTC_PERF_CMD_LOG_ALL)
+    {
+        estc_perf_log_all();
+        return;
+    }
+
+    if (p_data[0] == ESTC_PERF_CMD_RESET)
+    {
+        estc_perf_reset();
+        return;
+    }
+
+    // The snapshot is taken now, the client reads it back with a (long) read
+    uint8_t snapshot[CHARACTERISTIC_DIAG_SIZE];
+    uint16_t snapshot_len;
+
+    if (p_data[0] == ESTC_PERF_CMD_COUNTERS)
+    {
+        snapshot_len = estc_perf_counters_encode(snapshot);
+    }
+    else if (p_data[0] < ESTC_PERF_SITE_COUNT)
+    {
+        snapshot_len = estc_perf_snapshot_encode((estc_perf_site_t)p_data[0], snapshot);
+    }
+    else
+    {
+        return;
+    }
+
+    ret_code_t err_code = hal_ble_value_set(service->char_handles[ESTC_CHAR_DIAG].value_handle, snapshot, snapshot_len);
+    APP_ERROR_CHECK(err_code);
+}
+#endif
+
+#if ESTC_BENCH_ENABLED
+static void bench_sink_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    estc_bench_sink_write(conn_handle, p_data, len);
+}
+
+static void bench_source_char_write(ble_estc_service_t *service, uint16_t conn_handle, uint8_t const *p_data, uint16_t len)
+{
+    estc_bench_control(conn_handle, p_data[0]);
+}
+#endif
+
 static void on_write(ble_estc_service_t *p_service, ble_evt_t const *p_ble_evt)
 {
     ble_gatts_evt_write_t const *p_evt_write = &p_ble_evt->evt.gatts_evt.params.write;
 
-    if (p_evt_write->handle == p_service->rgb_state_characteristic_handles.value_handle)
+    // Handles below the service declaration wrap around and are rejected by the bound check
+    uint16_t offset = p_evt_write->handle - p_service->service_handle;
+    if (offset >= ESTC_HANDLE_MAP_SIZE || p_service->handle_map[offset] == 0)
     {
-        NRF_LOG_INFO("ESTC SERVICE: RGB STATE characteristic write event received");
-        uint8_t led_value = p_evt_write->data[0];
-        p_service->rgb_state_write_handler(p_ble_evt->evt.gap_evt.conn_handle, p_service, led_value);
+        return;
     }
-    else if (p_evt_write->handle == p_service->rgb_value_characteristic_handles.value_handle)
+
+    const estc_char_def_t *p_def = &m_char_defs[p_service->handle_map[offset] - 1];
+    bool len_valid = (p_def->props & ESTC_CHAR_PROP_VAR_LEN) ? (p_evt_write->len != 0 && p_evt_write->len <= p_def->size)
+                                                             : (p_evt_write->len == p_def->size);
+    // Only plain writes carry the value in the event, prepared and signed writes are not supported
+    bool op_valid = p_evt_write->op == BLE_GATTS_OP_WRITE_REQ || p_evt_write->op == BLE_GATTS_OP_WRITE_CMD;
+    if (!op_valid || p_evt_write->offset != 0 || !len_valid)
     {
-        NRF_LOG_INFO("ESTC SERVICE: RGB VALUE characteristic write event received");
-        uint8_t r = p_evt_write->data[0];
-        uint8_t g = p_evt_write->data[1];
-        uint8_t b = p_evt_write->data[2];
-        p_service->rgb_value_write_handler(p_ble_evt->evt.gap_evt.conn_handle, p_service, r, g, b);
+        // Dropped silently, the SoftDevice event context is kept free of logging
+        ESTC_PERF_COUNT(ESTC_PERF_CNT_WRITES_REJECTED);
+        return;
     }
+
+    p_def->write_handler(p_service, p_ble_evt->evt.gatts_evt.conn_handle, p_evt_write->data, p_evt_write->len);
 }
 
 void ble_lbs_on_ble_evt(ble_evt_t const *p_ble_evt, void *p_context)
 {
     ble_estc_service_t *p_service = (ble_estc_service_t *)p_context;
 
+    ESTC_PERF_COUNT(ESTC_PERF_CNT_BLE_EVENTS);
+    estc_bench_on_ble_evt(p_ble_evt);
+
     switch (p_ble_evt->header.evt_id)
     {
     case BLE_GATTS_EVT_WRITE:
-        NRF_LOG_INFO("ESTC SERVICE: WRITE event received");
+    {
+        ESTC_PERF_COUNT(ESTC_PERF_CNT_WRITES);
+        ESTC_PERF_START(start);
+        ESTC_PERF_EVENT_BEGIN();
         on_write(p_service, p_ble_evt);
+        ESTC_PERF_STOP(ESTC_PERF_ON_WRITE, start);
+    }
+    break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+        stream_release(p_ble_evt->evt.gap_evt.conn_handle);
         break;
 
     case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
-        NRF_LOG_INFO("ESTC SERVICE: RW AUTHORIZE REQUEST event received");
+        ESTC_LOG(ESTC_LOG_SERVICE_AUTHORIZE);
         break;
 
     case BLE_GATTS_EVT_HVN_TX_COMPLETE:
-        NRF_LOG_INFO("ESTC SERVICE: HVN TX COMPLETE event received");
+        ESTC_LOG(ESTC_LOG_SERVICE_TX_DONE);
+        ESTC_PERF_ADD(ESTC_PERF_CNT_TX_COMPLETE, p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count);
         break;
 
     default:
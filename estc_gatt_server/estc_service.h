@@ -7,6 +7,8 @@
 #include "ble_srv_common.h"
 #include "nrf_sdh_ble.h"
 #include "sdk_errors.h"
+#include "estc_perf.h"
+#include "estc_bench.h"
 
 /**@brief   Macro for defining a ble_lbs instance.
  *
@@ -25,43 +27,130 @@
 
 #define RANDOM_CHARACTERISTIC_UUID_RGB_STATE 0x1525 // RGB STATE characteristic UUID
 #define RANDOM_CHARACTERISTIC_UUID_RGB_VALUE 0x1526 // RGB VALUE characteristic UUID
+#define RANDOM_CHARACTERISTIC_UUID_COMMAND 0x1527   // Batched COMMAND characteristic UUID
+#define RANDOM_CHARACTERISTIC_UUID_DIAG 0x1528      // Performance DIAGNOSTICS characteristic UUID
+#define RANDOM_CHARACTERISTIC_UUID_BENCH_SINK 0x1529   // Throughput benchmark SINK characteristic UUID
+#define RANDOM_CHARACTERISTIC_UUID_BENCH_SOURCE 0x152A // Throughput benchmark SOURCE characteristic UUID
+#define RANDOM_CHARACTERISTIC_UUID_STREAM 0x152B       // Animation STREAM characteristic UUID
+#define RANDOM_CHARACTERISTIC_UUID_ANIM 0x152C         // Compressed ANIMATION characteristic UUID
+#define RANDOM_CHARACTERISTIC_UUID_PROGRAM 0x152D      // Stored animation PROGRAM characteristic UUID
 
 #define CHARACTERISTIC_RGB_STATE_SIZE sizeof(uint8_t)
 #define CHARACTERISTIC_RGB_VALUE_SIZE (sizeof(uint8_t) * 3)
+// A single ATT write carries up to ATT_MTU - 3 bytes of command stream
+#define CHARACTERISTIC_COMMAND_SIZE (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+#define CHARACTERISTIC_STREAM_SIZE (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+#define CHARACTERISTIC_DIAG_SIZE ESTC_PERF_SNAPSHOT_SIZE
+#define CHARACTERISTIC_BENCH_SIZE ESTC_BENCH_PAYLOAD_MAX
+
+// Characteristic property flags used by the characteristic table
+#define ESTC_CHAR_PROP_READ (1 << 0)
+#define ESTC_CHAR_PROP_WRITE (1 << 1)
+#define ESTC_CHAR_PROP_WRITE_WO_RESP (1 << 2)
+#define ESTC_CHAR_PROP_NOTIFY (1 << 3)
+#define ESTC_CHAR_PROP_VAR_LEN (1 << 4)
+
+// Characteristic identifiers, also used as indexes into the characteristic table
+typedef enum
+{
+    ESTC_CHAR_RGB_STATE,
+    ESTC_CHAR_RGB_VALUE,
+    ESTC_CHAR_COMMAND,
+    ESTC_CHAR_STREAM,
+    ESTC_CHAR_ANIM,
+    ESTC_CHAR_PROGRAM,
+#if ESTC_PERF_ENABLED
+    ESTC_CHAR_DIAG,
+#endif
+#if ESTC_BENCH_ENABLED
+    ESTC_CHAR_BENCH_SINK,
+    ESTC_CHAR_BENCH_SOURCE,
+#endif
+    ESTC_CHAR_COUNT
+} estc_char_id_t;
+
+// Animation stream chunk: sequence number (2, little-endian), then pwm_control.h frames on the
+// STREAM characteristic or an estc_anim.h animation on the ANIMATION and PROGRAM characteristics.
+// Sequence number 0 starts over, any other chunk must follow the last accepted one.
+// Chunks are written without response, a rejected chunk is answered with a status notification
+// and the chunks in flight behind it are dropped silently.
+// The three stream characteristics share the light, so one upload runs at a time. Chunk 0 makes
+// its link and characteristic the owner until the link disconnects or leaves the upload idle for
+// ESTC_STREAM_IDLE_TIMEOUT_MS, chunks of other uploads are answered with BUSY until then.
+#define ESTC_STREAM_HEADER_SIZE 2
+// A PROGRAM upload starts with the program slot (1) and length (2, little-endian) in chunk 0.
+// The program is stored in flash and played with ESTC_CMD_OP_PLAY_PROGRAM, which ends a STREAM
+// or ANIMATION upload: its owner gets BUSY. A PROGRAM upload keeps the stream.
+#define ESTC_PROGRAM_HEADER_SIZE 3
+// Stream status notification: status (1), next expected sequence number (2), free steps (2)
+#define ESTC_STREAM_STATUS_SIZE 5
+
+// Time without an accepted chunk after which another upload may take the stream over
+#ifndef ESTC_STREAM_IDLE_TIMEOUT_MS
+#define ESTC_STREAM_IDLE_TIMEOUT_MS 2000
+#endif
+
+typedef enum
+{
+    ESTC_STREAM_STATUS_READY,        // Space was freed, continue with the expected chunk
+    ESTC_STREAM_STATUS_OUT_OF_ORDER, // Resend from the expected chunk
+    ESTC_STREAM_STATUS_NO_SPACE,     // Wait for READY, then resend from the expected chunk
+    ESTC_STREAM_STATUS_INVALID,      // Malformed chunk or more than the light can buffer
+    ESTC_STREAM_STATUS_BUSY,         // Another upload owns the stream, start over with chunk 0 later
+    ESTC_STREAM_STATUS_WRITE_FAILED, // PROGRAM only: storing the program in flash failed, start over with chunk 0
+} estc_stream_status_t;
+
+// Upper bound of attributes per characteristic: declaration, value, CCCD and user description
+#define ESTC_ATTRS_PER_CHARACTERISTIC 4
+// Number of attribute handles following the service declaration handle
+#define ESTC_HANDLE_MAP_SIZE (1 + ESTC_CHAR_COUNT * ESTC_ATTRS_PER_CHARACTERISTIC)
 
 struct ble_estc_service_s;
+struct estc_cmd_batch_s;
 
-// RGB state characteristic write event handler type
-typedef void (*ble_lbs_rgb_state_write_handler_t)(uint16_t conn_handle, struct ble_estc_service_s *p_lbs, uint8_t new_state);
+// Size of the app_scheduler events queued by the service
+#define ESTC_SCHED_EVENT_DATA_SIZE sizeof(struct ble_estc_service_s *)
 
-// RGB value characteristic write event handler type
-typedef void (*ble_lbs_rgb_value_write_handler_t)(uint16_t conn_handle, struct ble_estc_service_s *p_lbs, uint8_t r, uint8_t g, uint8_t b);
+// Light write event handler type.
+// Writes to the RGB state, RGB value and COMMAND characteristics are folded into a single batch
+// in the SoftDevice event context, the handler runs later from the main loop via app_scheduler.
+// conn_handle is the link that wrote last.
+typedef void (*ble_lbs_batch_write_handler_t)(uint16_t conn_handle, struct ble_estc_service_s *p_lbs, struct estc_cmd_batch_s const *p_batch);
 
 /** @brief LED Button Service init structure. This structure contains all options and data needed for
  *        initialization of the service.*/
 typedef struct
 {
-    ble_lbs_rgb_state_write_handler_t rgb_state_write_handler; // Event handler to be called when RGB state characteristic is written.
-    ble_lbs_rgb_value_write_handler_t rgb_value_write_handler; // Event handler to be called when RGB value characteristic is written.
+    ble_lbs_batch_write_handler_t batch_write_handler; // Event handler to be called from the main loop when the light characteristics were written.
 } ble_lbs_init_t;
 
 typedef struct ble_estc_service_s
 {
     uint16_t service_handle;
     uint8_t uuid_type;
-    uint16_t connection_handle;
-    ble_lbs_rgb_state_write_handler_t rgb_state_write_handler;
-    ble_lbs_rgb_value_write_handler_t rgb_value_write_handler;
+    ble_lbs_batch_write_handler_t batch_write_handler;
 
-    ble_gatts_char_handles_t rgb_state_characteristic_handles;
-    ble_gatts_char_handles_t rgb_value_characteristic_handles;
+    ble_gatts_char_handles_t char_handles[ESTC_CHAR_COUNT];
+
+    // Maps (attribute handle - service handle) to characteristic id + 1, 0 means "not a value handle"
+    uint8_t handle_map[ESTC_HANDLE_MAP_SIZE];
 } ble_estc_service_t;
 
+// Returns NRF_ERROR_NO_MEM if the stack assigned attribute handles beyond the handle map
 ret_code_t estc_ble_service_init(ble_estc_service_t *service, const ble_lbs_init_t *lbs_init);
 void estc_characteristic_init_values(uint8_t rgb_state, uint8_t r, uint8_t g, uint8_t b);
+// CRC-32 of the attribute table as a client caches it: the UUIDs, properties, maximum lengths, user
+// descriptions and attribute handles. Call after estc_ble_service_init().
+uint32_t estc_service_db_hash(ble_estc_service_t const *service);
+// Copy the light state of the last applied batch, or the state restored from flash before any write
+void estc_service_light_state_get(struct estc_cmd_batch_s *p_state);
 
 void ble_lbs_on_ble_evt(ble_evt_t const *p_ble_evt, void *p_context);
 
+// Apply a command stream received outside of a connection (group command advertisement) through the
+// same batch as the characteristic writes. Call from the SoftDevice event context.
+void estc_service_command_apply(ble_estc_service_t *service, uint8_t const *p_data, uint16_t len);
+
 void estc_update_characteristic_1_value(ble_estc_service_t *service, int32_t *value);
 
 #endif /* ESTC_SERVICE_H__ */
\ No newline at end of file
@@ -1,9 +1,15 @@
 #include "flash_storage.h"
 #include "app_error.h"
+#include "hal_flash.h"
 #include "nrf_log.h"
+#include "estc_log.h"
+#include "estc_perf.h"
 #include "estc_service.h"
 #include "pwm_control.h"
 #include <stdint.h>
+#include <string.h>
+#include "app_util.h"
+#include "sdk_config.h"
 #include "nrf_bootloader_info.h"
 #include "nrf_dfu_types.h"
 
@@ -13,7 +19,25 @@
 #define FLASH_PAGE_START (FLASH_BOOTLOADER_START_ADDR - NRF_DFU_APP_DATA_AREA_SIZE) 
 #define FLASH_PAGE_END (FLASH_PAGE_START + FLASH_PAGE_SIZE)
 #define FLASH_EMPTY_VALUE 0xFFFFFFFF
-#define FLASH_WORD_SIZE (sizeof(uint32_t))
+#define FLASH_WORD_SIZE ((uint32_t)sizeof(uint32_t))
+
+// FDS (bonds) takes the last pages below the bootloader, the RGB page sits below them
+_Static_assert(FDS_VIRTUAL_PAGES * FDS_VIRTUAL_PAGE_SIZE * FLASH_WORD_SIZE <= FLASH_BOOTLOADER_START_ADDR - FLASH_PAGE_END,
+               "FDS pages overlap the RGB storage page");
+
+// Program slots, one page each below the RGB page. They are outside the application data area
+// the bootloader keeps, so a firmware update may erase them.
+#define FLASH_PROGRAM_START (FLASH_PAGE_START - FLASH_STORAGE_PROGRAM_COUNT * FLASH_PAGE_SIZE)
+#define FLASH_PROGRAM_PAGE(slot) (FLASH_PROGRAM_START + (slot) * FLASH_PAGE_SIZE)
+// First word of a slot: magic in the low half, program length in the high half. It is written
+// after the program, an erased or partly written slot has none.
+#define FLASH_PROGRAM_MAGIC 0xA71E
+#define FLASH_PROGRAM_HEADER(len) (((uint32_t)(len) << 16) | FLASH_PROGRAM_MAGIC)
+// An append writes the bytes carried over from the last one and the new ones, padded to words
+#define FLASH_PROGRAM_STAGE_WORDS ((FLASH_STORAGE_PROGRAM_CHUNK_MAX + 2 * (FLASH_WORD_SIZE - 1)) / FLASH_WORD_SIZE)
+
+_Static_assert(FLASH_STORAGE_PROGRAM_SIZE_MAX + FLASH_WORD_SIZE <= FLASH_PAGE_SIZE,
+               "A program does not fit its slot");
 
 // Macros for working with bits in the gs_rgb_data variable
 #define RGB_STATE_MASK 0x000000FF   // Mask for RGB state (lowest byte)
@@ -43,106 +67,81 @@
 // Structure for storing flash context
 typedef struct {
     bool erase_needed;
-    uint32_t *current_address;
+    uint32_t current_address;
 } flash_context_t;
 
 static uint32_t gs_rgb_data = 0;
 
 static flash_context_t flash_context = {
     .erase_needed = false,
-    .current_address = NULL
+    .current_address = 0
 };
 
-// Declaration of fstorage event handler
-static void fstorage_evt_handler(nrf_fstorage_evt_t *p_evt);
-
-// Initialization of fstorage instance
-NRF_FSTORAGE_DEF(nrf_fstorage_t fstorage) = {
-    /* Set a handler for fstorage events. */
-    .evt_handler = fstorage_evt_handler,
-
-    /* These below are the boundaries of the flash space assigned to this instance of fstorage.
-     * You must set these manually, even at runtime, before nrf_fstorage_init() is called.
-     * The function nrf5_flash_end_addr_get() can be used to retrieve the last address on the
-     * last page of flash available to write data. */
-    .start_addr = FLASH_PAGE_START,
-    .end_addr = FLASH_PAGE_END - 1,
-};
-
-static void fstorage_evt_handler(nrf_fstorage_evt_t *p_evt)
-{
-    if (p_evt->result != NRF_SUCCESS)
-    {
-        NRF_LOG_INFO("--> Event received: ERROR while executing an fstorage operation.");
-        return;
-    }
-
-    switch (p_evt->id)
-    {
-    case NRF_FSTORAGE_EVT_WRITE_RESULT:
-    {
-        NRF_LOG_INFO("--> Event received: wrote %d bytes at address 0x%x.",
-                     p_evt->len, p_evt->addr);
-    }
-    break;
-
-    case NRF_FSTORAGE_EVT_ERASE_RESULT:
-    {
-        NRF_LOG_INFO("--> Event received: erased %d page from address 0x%x.",
-                     p_evt->len, p_evt->addr);
-    }
-    break;
-
-    default:
-        break;
-    }
-}
+// Program being stored, owned by the SoftDevice event context
+typedef struct {
+    bool writing;
+    bool failed;
+    bool waiting;         // An append was refused, the handler is called on the next completion
+    uint8_t slot;
+    uint16_t len;
+    uint16_t received;
+    uint32_t next_address;
+    uint32_t stage_address; // Address of the staged write in flight, 0 if none
+    uint8_t carry[FLASH_WORD_SIZE];
+    uint8_t carry_len;
+} flash_program_t;
+
+static flash_program_t m_program;
+// Source buffers of the queued writes, they stay untouched until the write finished
+static uint32_t m_program_stage[FLASH_PROGRAM_STAGE_WORDS];
+static uint32_t m_program_header;
+static flash_storage_program_handler_t m_program_handler;
+
+static void flash_done_handler(uint32_t addr, bool success);
 
 /**
  * @brief Search for the address of the last written block
+ * @details Blocks are written in order from the start of the page, so the written blocks form
+ *          a prefix of the page and the first empty word is found with a binary search.
  * @param result Pointer to save the found address
- * @return true if a block is found, false if the page is empty or full
+ * @return true if a block is found, false if the page is empty
  */
-static bool flash_find_last_address(uint32_t **result)
+static bool flash_find_last_address(uint32_t *result)
 {
-    uint32_t *addr = (uint32_t *)FLASH_PAGE_START;
-    uint32_t *last_valid_addr = NULL;
-    uint32_t *page_end = (uint32_t *)FLASH_PAGE_END;
+    uint32_t low = 0;
+    uint32_t high = FLASH_PAGE_SIZE / FLASH_WORD_SIZE;
     uint32_t data;
 
-    while (addr < page_end)
+    while (low < high)
     {
-        // Read data at the current address
-        int ret = nrf_fstorage_read(&fstorage, (uint32_t)addr, &data, FLASH_WORD_SIZE);
+        uint32_t mid = low + (high - low) / 2;
+        uint32_t addr = FLASH_PAGE_START + mid * FLASH_WORD_SIZE;
+
+        int ret = hal_flash_read(addr, &data, FLASH_WORD_SIZE);
         if (ret != NRF_SUCCESS)
         {
-            NRF_LOG_INFO("FLASH STORAGE: Error reading data at address 0x%x", (uint32_t)addr);
+            NRF_LOG_INFO("FLASH STORAGE: Error reading data at address 0x%x", addr);
             return false;
         }
 
-        // If an empty cell is found, the previous one was the last
         if (data == FLASH_EMPTY_VALUE)
         {
-            if (last_valid_addr != NULL)
-            {
-                *result = last_valid_addr;
-                return true;
-            }
-            else
-            {
-                // The page is empty
-                flash_context.current_address = addr;
-                return false;
-            }
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
         }
+    }
 
-        last_valid_addr = addr;
-        addr += 1;  // Go to the next word
+    // low is the index of the first empty word
+    if (low == 0)
+    {
+        return false;
     }
 
-    // If we get here, the page is full
-    flash_context.erase_needed = true;
-    return false;
+    *result = FLASH_PAGE_START + (low - 1) * FLASH_WORD_SIZE;
+    return true;
 }
 
 /**
@@ -150,49 +149,34 @@ static bool flash_find_last_address(uint32_t **result)
  */
 void flash_storage_init(void)
 {
-    int ret = nrf_fstorage_init(&fstorage, &nrf_fstorage_sd, NULL);
+    int ret = hal_flash_init(FLASH_PROGRAM_START, FLASH_PAGE_END - 1, flash_done_handler);
     APP_ERROR_CHECK(ret);
 
     NRF_LOG_INFO("FLASH STORAGE: Initialized at address 0x%x, size: 0x%x", 
                  FLASH_PAGE_START, FLASH_PAGE_SIZE);
 
-    uint32_t *last_addr = NULL;
+    uint32_t last_addr = 0;
     bool found = flash_find_last_address(&last_addr);
 
     if (!found)
     {
-        if (flash_context.erase_needed)
-        {
-            NRF_LOG_INFO("FLASH STORAGE: Page is full, erasing");
-            ret = nrf_fstorage_erase(&fstorage, FLASH_PAGE_START, 1, NULL);
-            APP_ERROR_CHECK(ret);
-            flash_context.erase_needed = false;
-            flash_context.current_address = (uint32_t *)FLASH_PAGE_START;
-            gs_rgb_data = 0;
-        }
-        else
-        {
-            NRF_LOG_INFO("FLASH STORAGE: No data found, initializing to defaults");
-            gs_rgb_data = 0;
-            flash_context.current_address = (uint32_t *)FLASH_PAGE_START;
-        }
+        NRF_LOG_INFO("FLASH STORAGE: No data found, initializing to defaults");
+        gs_rgb_data = 0;
+        flash_context.current_address = FLASH_PAGE_START;
     }
     else
     {
         // Read the last saved value
-        ret = nrf_fstorage_read(&fstorage, (uint32_t)last_addr, &gs_rgb_data, FLASH_WORD_SIZE);
+        ret = hal_flash_read(last_addr, &gs_rgb_data, FLASH_WORD_SIZE);
         APP_ERROR_CHECK(ret);
         
         // Set the current address to the next cell
-        flash_context.current_address = last_addr + 1;
-        
-        // Check if there is space for the next write
-        if ((uint32_t)flash_context.current_address >= FLASH_PAGE_END)
-        {
-            flash_context.erase_needed = true;
-        }
+        flash_context.current_address = last_addr + FLASH_WORD_SIZE;
     }
 
+    // A full page keeps its last value and is erased before the next write
+    flash_context.erase_needed = flash_context.current_address >= FLASH_PAGE_END;
+
     uint8_t rgb_state = GET_RGB_STATE(gs_rgb_data);
     uint8_t red_value = GET_RED_VALUE(gs_rgb_data);
     uint8_t green_value = GET_GREEN_VALUE(gs_rgb_data);
@@ -218,56 +202,86 @@ void flash_storage_init(void)
 }
 
 /**
- * @brief Update the RGB state (on/off)
+ * @brief Update the values of the RGB state and color with a single flash write
+ * @param update_state True if the state should be updated, false if not
  * @param new_state The new state value
+ * @param update_rgb True if the RGB color should be updated, false if not
+ * @param r The new red value
+ * @param g The new green value
+ * @param b The new blue value
  */
-void flash_storage_update_state(uint8_t new_state)
+void flash_storage_update_values(bool update_state, uint32_t new_state,
+                                 bool update_rgb, uint8_t r, uint8_t g, uint8_t b)
 {
     int rc;
-    
-    // Get the current state
-    uint8_t current_state = GET_RGB_STATE(gs_rgb_data);
-    
+
+    ESTC_PERF_START(start);
+
+    // Get the current values
+    uint8_t state = GET_RGB_STATE(gs_rgb_data);
+    uint8_t red = GET_RED_VALUE(gs_rgb_data);
+    uint8_t green = GET_GREEN_VALUE(gs_rgb_data);
+    uint8_t blue = GET_BLUE_VALUE(gs_rgb_data);
+
+    if (update_state)
+    {
+        state = (uint8_t)new_state;
+    }
+    if (update_rgb)
+    {
+        red = r;
+        green = g;
+        blue = b;
+    }
+
+    uint32_t new_data = SET_RGB_VALUES(gs_rgb_data, state, red, green, blue);
+
     // Check if there are changes
-    if (current_state == new_state)
+    if (new_data == gs_rgb_data)
     {
-        NRF_LOG_INFO("FLASH STORAGE: No changes in RGB state, skipping flash update.");
+        ESTC_LOG(ESTC_LOG_FLASH_UNCHANGED);
+        ESTC_PERF_SPAN_CANCEL(ESTC_PERF_WRITE_TO_FLASH);
+        ESTC_PERF_STOP(ESTC_PERF_FLASH_UPDATE, start);
         return;
     }
-    
-    // Current RGB values
-    uint8_t current_r = GET_RED_VALUE(gs_rgb_data);
-    uint8_t current_g = GET_GREEN_VALUE(gs_rgb_data);
-    uint8_t current_b = GET_BLUE_VALUE(gs_rgb_data);
-    
+
     // Update data in memory
-    gs_rgb_data = SET_RGB_VALUES(gs_rgb_data, new_state, current_r, current_g, current_b);
-    
+    gs_rgb_data = new_data;
+
     // If you need to erase the page or we have reached the end of the page
-    if (flash_context.erase_needed || 
-        (uint32_t)flash_context.current_address >= FLASH_PAGE_END)
+    if (flash_context.erase_needed ||
+        flash_context.current_address >= FLASH_PAGE_END)
     {
-        NRF_LOG_INFO("FLASH STORAGE: Need to erase page before writing");
-        rc = nrf_fstorage_erase(&fstorage, FLASH_PAGE_START, 1, NULL);
+        ESTC_LOG(ESTC_LOG_FLASH_ERASE);
+        rc = hal_flash_erase(FLASH_PAGE_START, 1);
         APP_ERROR_CHECK(rc);
-        
+        ESTC_PERF_COUNT(ESTC_PERF_CNT_FLASH_ERASES);
+
         flash_context.erase_needed = false;
-        flash_context.current_address = (uint32_t *)FLASH_PAGE_START;
+        flash_context.current_address = FLASH_PAGE_START;
     }
-    
+
     // Write new data
-    NRF_LOG_INFO("FLASH STORAGE: Writing RGB state 0x%x to address 0x%x", 
-                 new_state, (uint32_t)flash_context.current_address);
-                 
-    rc = nrf_fstorage_write(&fstorage, 
-                           (uint32_t)flash_context.current_address, 
-                           &gs_rgb_data, 
-                           FLASH_WORD_SIZE, 
-                           NULL);
+    ESTC_LOG(ESTC_LOG_FLASH_WRITE, state, red, green, blue, flash_context.current_address);
+
+    rc = hal_flash_write(flash_context.current_address, &gs_rgb_data, FLASH_WORD_SIZE);
     APP_ERROR_CHECK(rc);
-    
+    ESTC_PERF_COUNT(ESTC_PERF_CNT_FLASH_WRITES);
+
     // Increase the address for the next write
-    flash_context.current_address += 1;
+    flash_context.current_address += FLASH_WORD_SIZE;
+
+    ESTC_PERF_SPAN_END(ESTC_PERF_WRITE_TO_FLASH);
+    ESTC_PERF_STOP(ESTC_PERF_FLASH_UPDATE, start);
+}
+
+/**
+ * @brief Update the RGB state (on/off)
+ * @param new_state The new state value
+ */
+void flash_storage_update_state(uint8_t new_state)
+{
+    flash_storage_update_values(true, new_state, false, 0, 0, 0);
 }
 
 /**
@@ -278,47 +292,218 @@ void flash_storage_update_state(uint8_t new_state)
  */
 void flash_storage_update_rgb(uint8_t r, uint8_t g, uint8_t b)
 {
-    int rc;
-    
-    // Get the current values
-    uint8_t current_state = GET_RGB_STATE(gs_rgb_data);
-    uint8_t current_r = GET_RED_VALUE(gs_rgb_data);
-    uint8_t current_g = GET_GREEN_VALUE(gs_rgb_data);
-    uint8_t current_b = GET_BLUE_VALUE(gs_rgb_data);
-    
-    // Check if there are changes
-    if (current_r == r && current_g == g && current_b == b)
+    flash_storage_update_values(false, 0, true, r, g, b);
+}
+
+/**
+ * @brief Log how much of the storage page is in use
+ */
+void flash_storage_stats_log(void)
+{
+    uint32_t used = (flash_context.current_address - FLASH_PAGE_START) / FLASH_WORD_SIZE;
+
+    NRF_LOG_INFO("FLASH STORAGE: %u of %u words used, erase %s",
+                 used, FLASH_PAGE_SIZE / FLASH_WORD_SIZE, flash_context.erase_needed ? "pending" : "not needed");
+
+    for (uint8_t slot = 0; slot < FLASH_STORAGE_PROGRAM_COUNT; slot++)
     {
-        NRF_LOG_INFO("FLASH STORAGE: No changes in RGB values, skipping flash update.");
+        uint8_t const *p_program;
+        uint16_t len;
+
+        if (flash_storage_program_get(slot, &p_program, &len))
+        {
+            NRF_LOG_INFO("FLASH STORAGE: Program %u, %u bytes at 0x%x", slot, len,
+                         FLASH_PROGRAM_PAGE(slot) + FLASH_WORD_SIZE);
+        }
+    }
+}
+
+/**
+ * @brief Map a refused fstorage operation, a full queue frees up like a write in flight
+ */
+static ret_code_t flash_program_error(ret_code_t rc)
+{
+    if (rc == NRF_ERROR_NO_MEM)
+    {
+        m_program.waiting = true;
+        return NRF_ERROR_BUSY;
+    }
+    return rc;
+}
+
+/**
+ * @brief Drop the program being stored after a flash operation failed, report it once
+ */
+static void flash_program_fail(void)
+{
+    bool reported = m_program.failed;
+
+    m_program.writing = false;
+    m_program.failed = true;
+    m_program.waiting = false;
+
+    if (!reported)
+    {
+        NRF_LOG_WARNING("FLASH STORAGE: Program %u failed to write", m_program.slot);
+        if (m_program_handler != NULL)
+        {
+            m_program_handler(NRF_ERROR_INTERNAL);
+        }
+    }
+}
+
+/**
+ * @brief Validate the program by writing its header once all of it is in flash
+ */
+static void flash_program_finish(void)
+{
+    m_program.writing = false;
+
+    m_program_header = FLASH_PROGRAM_HEADER(m_program.len);
+    ret_code_t rc = hal_flash_write(FLASH_PROGRAM_PAGE(m_program.slot), &m_program_header, FLASH_WORD_SIZE);
+    if (rc != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("FLASH STORAGE: Program %u header not written, error %u", m_program.slot, rc);
+        flash_program_fail();
         return;
     }
-    
-    // Update data in memory
-    gs_rgb_data = SET_RGB_VALUES(gs_rgb_data, current_state, r, g, b);
-    
-    // If you need to erase the page or we have reached the end of the page
-    if (flash_context.erase_needed || 
-        (uint32_t)flash_context.current_address >= FLASH_PAGE_END)
+
+    NRF_LOG_INFO("FLASH STORAGE: Program %u stored, %u bytes", m_program.slot, m_program.len);
+}
+
+/**
+ * @brief Track the writes of the program being stored, runs in the SoftDevice event context
+ */
+static void flash_done_handler(uint32_t addr, bool success)
+{
+    if (addr >= FLASH_PROGRAM_START && addr < FLASH_PAGE_START)
     {
-        NRF_LOG_INFO("FLASH STORAGE: Need to erase page before writing");
-        rc = nrf_fstorage_erase(&fstorage, FLASH_PAGE_START, 1, NULL);
-        APP_ERROR_CHECK(rc);
-        
-        flash_context.erase_needed = false;
-        flash_context.current_address = (uint32_t *)FLASH_PAGE_START;
+        // The erase, a chunk or the header
+        if (!success)
+        {
+            flash_program_fail();
+        }
+
+        if (addr == m_program.stage_address)
+        {
+            m_program.stage_address = 0;
+
+            if (m_program.writing && m_program.received == m_program.len)
+            {
+                flash_program_finish();
+            }
+        }
     }
-    
-    // Write new data
-    NRF_LOG_INFO("FLASH STORAGE: Writing RGB values (%u,%u,%u) to address 0x%x", 
-                 r, g, b, (uint32_t)flash_context.current_address);
-                 
-    rc = nrf_fstorage_write(&fstorage, 
-                           (uint32_t)flash_context.current_address, 
-                           &gs_rgb_data, 
-                           FLASH_WORD_SIZE, 
-                           NULL);
-    APP_ERROR_CHECK(rc);
-    
-    // Increase the address for the next write
-    flash_context.current_address += 1;
-}
\ No newline at end of file
+
+    if (m_program.waiting && m_program.stage_address == 0)
+    {
+        m_program.waiting = false;
+        if (m_program_handler != NULL)
+        {
+            m_program_handler(NRF_SUCCESS);
+        }
+    }
+}
+
+ret_code_t flash_storage_program_begin(uint8_t slot, uint16_t len)
+{
+    if (slot >= FLASH_STORAGE_PROGRAM_COUNT)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (len == 0 || len > FLASH_STORAGE_PROGRAM_SIZE_MAX)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (m_program.stage_address != 0)
+    {
+        m_program.waiting = true;
+        return NRF_ERROR_BUSY;
+    }
+
+    // A program played from the slot reads the erased bytes as its end
+    ret_code_t rc = hal_flash_erase(FLASH_PROGRAM_PAGE(slot), 1);
+    if (rc != NRF_SUCCESS)
+    {
+        return flash_program_error(rc);
+    }
+
+    memset(&m_program, 0, sizeof(m_program));
+    m_program.writing = true;
+    m_program.slot = slot;
+    m_program.len = len;
+    m_program.next_address = FLASH_PROGRAM_PAGE(slot) + FLASH_WORD_SIZE;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t flash_storage_program_append(uint8_t const *p_data, uint16_t len)
+{
+    uint8_t *p_stage = (uint8_t *)m_program_stage;
+
+    if (!m_program.writing)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (len > FLASH_STORAGE_PROGRAM_CHUNK_MAX || len > m_program.len - m_program.received)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (m_program.stage_address != 0)
+    {
+        m_program.waiting = true;
+        return NRF_ERROR_BUSY;
+    }
+
+    uint16_t staged = m_program.carry_len + len;
+    bool last = m_program.received + len == m_program.len;
+    // Only whole words are written, the last append is padded with the erased value
+    uint16_t write_len = last ? ALIGN_NUM(FLASH_WORD_SIZE, staged) : staged - staged % FLASH_WORD_SIZE;
+
+    memcpy(p_stage, m_program.carry, m_program.carry_len);
+    memcpy(&p_stage[m_program.carry_len], p_data, len);
+    memset(&p_stage[staged], 0xFF, write_len > staged ? write_len - staged : 0);
+
+    if (write_len != 0)
+    {
+        ret_code_t rc = hal_flash_write(m_program.next_address, p_stage, write_len);
+        if (rc != NRF_SUCCESS)
+        {
+            return flash_program_error(rc);
+        }
+
+        m_program.stage_address = m_program.next_address;
+        m_program.next_address += write_len;
+    }
+
+    m_program.carry_len = last ? 0 : staged - write_len;
+    memcpy(m_program.carry, &p_stage[write_len], m_program.carry_len);
+    m_program.received += len;
+
+    return NRF_SUCCESS;
+}
+
+void flash_storage_program_handler_set(flash_storage_program_handler_t handler)
+{
+    m_program_handler = handler;
+}
+
+bool flash_storage_program_get(uint8_t slot, uint8_t const **pp_program, uint16_t *p_len)
+{
+    if (slot >= FLASH_STORAGE_PROGRAM_COUNT)
+    {
+        return false;
+    }
+
+    uint32_t const *p_page = hal_flash_ptr(FLASH_PROGRAM_PAGE(slot));
+    uint16_t len = (uint16_t)(p_page[0] >> 16);
+
+    if ((p_page[0] & 0xFFFF) != FLASH_PROGRAM_MAGIC || len == 0 || len > FLASH_STORAGE_PROGRAM_SIZE_MAX)
+    {
+        return false;
+    }
+
+    *pp_program = (uint8_t const *)&p_page[1];
+    *p_len = len;
+    return true;
+}
@@ -3,8 +3,19 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "nrf_fstorage.h"
-#include "nrf_fstorage_sd.h"
+#include "sdk_errors.h"
+
+// Animation programs (estc_anim.h byte code) are kept in one flash page per slot, below the
+// RGB page. They are played straight from flash, a slot is valid once its last byte was written.
+#define FLASH_STORAGE_PROGRAM_COUNT 4
+#define FLASH_STORAGE_PROGRAM_SIZE_MAX (0x1000 - 4)
+// Largest append, one BLE write
+#define FLASH_STORAGE_PROGRAM_CHUNK_MAX 244
+
+// Called from the SoftDevice event context with NRF_SUCCESS once the next chunk of a program can be
+// appended, or once with NRF_ERROR_INTERNAL when erasing or writing the program failed. The program
+// is then dropped and has to be stored again from the start.
+typedef void (*flash_storage_program_handler_t)(ret_code_t result);
 
 /**
  * @brief Initialize flash storage
@@ -26,7 +37,7 @@ void flash_storage_update_state(uint8_t new_state);
 void flash_storage_update_rgb(uint8_t r, uint8_t g, uint8_t b);
 
 /**
- * @brief Update the values of the RGB state and color (legacy function)
+ * @brief Update the values of the RGB state and color with a single flash write
  * @param update_state True if the state should be updated, false if not
  * @param new_state The new state value
  * @param update_rgb True if the RGB color should be updated, false if not
@@ -37,4 +48,43 @@ void flash_storage_update_rgb(uint8_t r, uint8_t g, uint8_t b);
 void flash_storage_update_values(bool update_state, uint32_t new_state,
                                  bool update_rgb, uint8_t r, uint8_t g, uint8_t b);
 
+/**
+ * @brief Log how much of the storage page is in use and the stored programs
+ */
+void flash_storage_stats_log(void);
+
+/**
+ * @brief Start storing a program, erases its slot
+ * @param slot Program slot
+ * @param len Length of the program
+ * @return NRF_SUCCESS, NRF_ERROR_BUSY while the previous chunk is written,
+ *         NRF_ERROR_INVALID_PARAM or NRF_ERROR_INVALID_LENGTH
+ */
+ret_code_t flash_storage_program_begin(uint8_t slot, uint16_t len);
+
+/**
+ * @brief Append the next bytes of the program being stored
+ * @details The bytes are copied, the handler is called once the write finished.
+ * @param p_data Bytes, up to FLASH_STORAGE_PROGRAM_CHUNK_MAX
+ * @param len Number of bytes
+ * @return NRF_SUCCESS, NRF_ERROR_BUSY while the previous chunk is written,
+ *         NRF_ERROR_INVALID_STATE without a program being stored, NRF_ERROR_INVALID_LENGTH
+ *         past the length given to flash_storage_program_begin()
+ */
+ret_code_t flash_storage_program_append(uint8_t const *p_data, uint16_t len);
+
+/**
+ * @brief Set the handler called when appending can go on or the program failed to store
+ */
+void flash_storage_program_handler_set(flash_storage_program_handler_t handler);
+
+/**
+ * @brief Get a stored program, it is read in place through the memory mapped flash
+ * @param slot Program slot
+ * @param pp_program Set to the first byte of the program
+ * @param p_len Set to the length of the program
+ * @return false if the slot holds no complete program
+ */
+bool flash_storage_program_get(uint8_t slot, uint8_t const **pp_program, uint16_t *p_len);
+
 #endif // FLASH_STORAGE_H__
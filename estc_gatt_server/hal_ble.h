@@ -0,0 +1,73 @@
+#ifndef HAL_BLE_H__
+#define HAL_BLE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+#include "ble.h"
+#include "ble_srv_common.h"
+
+/**
+ * @brief GATT server calls used by the ESTC service
+ */
+
+/**
+ * @brief Register a vendor specific base UUID and add a primary service with it
+ * @param p_base_uuid 128-bit base UUID
+ * @param uuid 16-bit service UUID within the base
+ * @param p_uuid_type Returns the UUID type assigned to the base
+ * @param p_service_handle Returns the service handle
+ */
+ret_code_t hal_ble_service_add(ble_uuid128_t const *p_base_uuid, uint16_t uuid,
+                               uint8_t *p_uuid_type, uint16_t *p_service_handle);
+
+/**
+ * @brief Add a characteristic to a service
+ * @param service_handle Handle of the service
+ * @param p_params Characteristic parameters
+ * @param p_handles Returns the attribute handles
+ */
+ret_code_t hal_ble_characteristic_add(uint16_t service_handle, ble_add_char_params_t *p_params,
+                                      ble_gatts_char_handles_t *p_handles);
+
+/**
+ * @brief Set the value of an attribute, shared by all connections
+ * @param value_handle Attribute handle
+ * @param p_data New value
+ * @param len Length of the new value
+ */
+ret_code_t hal_ble_value_set(uint16_t value_handle, uint8_t const *p_data, uint16_t len);
+
+/**
+ * @brief Queue a notification of an attribute value
+ * @param conn_handle Connection to notify
+ * @param value_handle Attribute handle
+ * @param p_data Value to send, copied by the call
+ * @param len Length of the value
+ * @return NRF_ERROR_RESOURCES while the notification queue of the link is full
+ */
+ret_code_t hal_ble_notify(uint16_t conn_handle, uint16_t value_handle, uint8_t const *p_data, uint16_t len);
+
+/**
+ * @brief Tell whether a client enabled notifications in a CCCD
+ * @param conn_handle Connection of the client
+ * @param cccd_handle Handle of the CCCD
+ * @return false if the CCCD cannot be read
+ */
+bool hal_ble_notification_enabled(uint16_t conn_handle, uint16_t cccd_handle);
+
+/**
+ * @brief Let connection events run past the configured event length while both sides have data
+ * @param enable Applies to all links, takes effect from the next connection event
+ */
+ret_code_t hal_ble_conn_evt_ext_set(bool enable);
+
+/**
+ * @brief Request new connection parameters for a link
+ * @param conn_handle Connection to update
+ * @param p_params Requested parameters
+ * @return NRF_ERROR_BUSY or NRF_ERROR_INVALID_STATE while a procedure is pending on the link
+ */
+ret_code_t hal_ble_conn_params_update(uint16_t conn_handle, ble_gap_conn_params_t const *p_params);
+
+#endif // HAL_BLE_H__
@@ -0,0 +1,75 @@
+#include "hal_ble.h"
+
+#include <string.h>
+#include "ble_gatts.h"
+
+ret_code_t hal_ble_service_add(ble_uuid128_t const *p_base_uuid, uint16_t uuid,
+                               uint8_t *p_uuid_type, uint16_t *p_service_handle)
+{
+    ret_code_t err_code = sd_ble_uuid_vs_add(p_base_uuid, p_uuid_type);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    ble_uuid_t service_uuid = {uuid, *p_uuid_type};
+
+    return sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &service_uuid, p_service_handle);
+}
+
+ret_code_t hal_ble_characteristic_add(uint16_t service_handle, ble_add_char_params_t *p_params,
+                                      ble_gatts_char_handles_t *p_handles)
+{
+    return characteristic_add(service_handle, p_params, p_handles);
+}
+
+ret_code_t hal_ble_value_set(uint16_t value_handle, uint8_t const *p_data, uint16_t len)
+{
+    ble_gatts_value_t value = {
+        .len = len,
+        .offset = 0,
+        .p_value = (uint8_t *)p_data,
+    };
+
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, value_handle, &value);
+}
+
+ret_code_t hal_ble_notify(uint16_t conn_handle, uint16_t value_handle, uint8_t const *p_data, uint16_t len)
+{
+    ble_gatts_hvx_params_t hvx_params = {
+        .handle = value_handle,
+        .type = BLE_GATT_HVX_NOTIFICATION,
+        .offset = 0,
+        .p_len = &len,
+        .p_data = p_data,
+    };
+
+    return sd_ble_gatts_hvx(conn_handle, &hvx_params);
+}
+
+bool hal_ble_notification_enabled(uint16_t conn_handle, uint16_t cccd_handle)
+{
+    uint8_t cccd_value[BLE_CCCD_VALUE_LEN] = {0};
+    ble_gatts_value_t cccd = {
+        .len = sizeof(cccd_value),
+        .offset = 0,
+        .p_value = cccd_value,
+    };
+
+    return sd_ble_gatts_value_get(conn_handle, cccd_handle, &cccd) == NRF_SUCCESS &&
+           ble_srv_is_notification_enabled(cccd_value);
+}
+
+ret_code_t hal_ble_conn_evt_ext_set(bool enable)
+{
+    ble_opt_t opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.common_opt.conn_evt_ext.enable = enable ? 1 : 0;
+
+    return sd_ble_opt_set(BLE_COMMON_OPT_CONN_EVT_EXT, &opt);
+}
+
+ret_code_t hal_ble_conn_params_update(uint16_t conn_handle, ble_gap_conn_params_t const *p_params)
+{
+    return sd_ble_gap_conn_param_update(conn_handle, p_params);
+}
@@ -0,0 +1,59 @@
+#ifndef HAL_FLASH_H__
+#define HAL_FLASH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+
+/**
+ * @brief Flash region used by flash_storage
+ *
+ * @details Write and erase are asynchronous: they are queued and complete later, the source
+ *          buffer of a write must stay valid until then. Reads are synchronous.
+ */
+
+/**
+ * @brief Called from the SoftDevice event context when a queued write or erase finished
+ * @param addr Address the write or erase started at
+ * @param success false if the operation failed
+ */
+typedef void (*hal_flash_done_handler_t)(uint32_t addr, bool success);
+
+/**
+ * @brief Initialize access to a flash region
+ * @param start_addr First address of the region, page aligned
+ * @param end_addr Last address of the region
+ * @param done_handler Completion handler, may be NULL
+ */
+ret_code_t hal_flash_init(uint32_t start_addr, uint32_t end_addr, hal_flash_done_handler_t done_handler);
+
+/**
+ * @brief Read from the region
+ * @param addr Address to read from, word aligned
+ * @param p_dest Destination buffer
+ * @param len Number of bytes, a multiple of the word size
+ */
+ret_code_t hal_flash_read(uint32_t addr, void *p_dest, uint32_t len);
+
+/**
+ * @brief Queue a write to the region
+ * @param addr Address to write to, word aligned
+ * @param p_src Source data, must stay valid until the write completes
+ * @param len Number of bytes, a multiple of the word size
+ */
+ret_code_t hal_flash_write(uint32_t addr, void const *p_src, uint32_t len);
+
+/**
+ * @brief Queue an erase of whole pages
+ * @param page_addr Address of the first page
+ * @param pages Number of pages
+ */
+ret_code_t hal_flash_erase(uint32_t page_addr, uint32_t pages);
+
+/**
+ * @brief Get a pointer to read the region in place through the memory mapped flash
+ * @param addr Address in the region
+ */
+void const *hal_flash_ptr(uint32_t addr);
+
+#endif // HAL_FLASH_H__
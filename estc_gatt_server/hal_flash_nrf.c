@@ -0,0 +1,82 @@
+#include "hal_flash.h"
+
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_sd.h"
+#include "nrf_log.h"
+
+// Declaration of fstorage event handler
+static void fstorage_evt_handler(nrf_fstorage_evt_t *p_evt);
+
+static hal_flash_done_handler_t m_done_handler;
+
+// Initialization of fstorage instance, the region boundaries are set by hal_flash_init()
+NRF_FSTORAGE_DEF(nrf_fstorage_t fstorage) = {
+    /* Set a handler for fstorage events. */
+    .evt_handler = fstorage_evt_handler,
+};
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t *p_evt)
+{
+    if (m_done_handler != NULL && p_evt->id != NRF_FSTORAGE_EVT_READ_RESULT)
+    {
+        m_done_handler(p_evt->addr, p_evt->result == NRF_SUCCESS);
+    }
+
+    if (p_evt->result != NRF_SUCCESS)
+    {
+        NRF_LOG_INFO("--> Event received: ERROR while executing an fstorage operation.");
+        return;
+    }
+
+    switch (p_evt->id)
+    {
+    case NRF_FSTORAGE_EVT_WRITE_RESULT:
+    {
+        NRF_LOG_INFO("--> Event received: wrote %d bytes at address 0x%x.",
+                     p_evt->len, p_evt->addr);
+    }
+    break;
+
+    case NRF_FSTORAGE_EVT_ERASE_RESULT:
+    {
+        NRF_LOG_INFO("--> Event received: erased %d page from address 0x%x.",
+                     p_evt->len, p_evt->addr);
+    }
+    break;
+
+    default:
+        break;
+    }
+}
+
+ret_code_t hal_flash_init(uint32_t start_addr, uint32_t end_addr, hal_flash_done_handler_t done_handler)
+{
+    m_done_handler = done_handler;
+
+    /* These are the boundaries of the flash space assigned to this instance of fstorage.
+     * They must be set before nrf_fstorage_init() is called. */
+    fstorage.start_addr = start_addr;
+    fstorage.end_addr = end_addr;
+
+    return nrf_fstorage_init(&fstorage, &nrf_fstorage_sd, NULL);
+}
+
+ret_code_t hal_flash_read(uint32_t addr, void *p_dest, uint32_t len)
+{
+    return nrf_fstorage_read(&fstorage, addr, p_dest, len);
+}
+
+ret_code_t hal_flash_write(uint32_t addr, void const *p_src, uint32_t len)
+{
+    return nrf_fstorage_write(&fstorage, addr, p_src, len, NULL);
+}
+
+ret_code_t hal_flash_erase(uint32_t page_addr, uint32_t pages)
+{
+    return nrf_fstorage_erase(&fstorage, page_addr, pages, NULL);
+}
+
+void const *hal_flash_ptr(uint32_t addr)
+{
+    return (void const *)addr;
+}
@@ -0,0 +1,100 @@
+#ifndef HAL_PWM_H__
+#define HAL_PWM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief PWM driving the RGB LED, looping a single sequence of per-channel duty cycles
+ *
+ * @details Channel 0 is not connected, channels 1 to 3 drive the red, green and blue LED.
+ *          Duty cycle changes are picked up by the running sequence without a restart.
+ *
+ *          A stream of steps can be played instead: the producer fills a ring of sequence
+ *          buffers in place and commits them, the PWM plays them back to back straight from
+ *          the buffers. Playback starts with the first committed buffer. While no committed
+ *          buffer is waiting the last step is held, after hal_pwm_stream_end() the stream
+ *          ends with the last buffer and hal_pwm_stream_stop() returns to the duty cycle
+ *          sequence. Start and stop requests made while a stream plays apply afterwards.
+ */
+
+#define HAL_PWM_CHANNEL_COUNT 4
+
+#define HAL_PWM_STREAM_BUFFER_COUNT 4  // Sequence buffers in the ring
+#define HAL_PWM_STREAM_BUFFER_STEPS 64 // Steps per sequence buffer
+#define HAL_PWM_STREAM_STEP_US 10000   // Nominal duration of a step, rounded to whole PWM periods
+
+// Duty cycles of one step, laid out as the PWM reads them
+typedef struct
+{
+    uint16_t duty[HAL_PWM_CHANNEL_COUNT];
+} hal_pwm_step_t;
+
+typedef enum
+{
+    HAL_PWM_STREAM_EVT_BUFFER_DONE, // A buffer was played and can be filled again
+    HAL_PWM_STREAM_EVT_UNDERRUN,    // No committed buffer was waiting, the last step is held
+    HAL_PWM_STREAM_EVT_END,         // The last buffer was played, call hal_pwm_stream_stop()
+} hal_pwm_stream_evt_t;
+
+// Stream event handler, called from the PWM interrupt
+typedef void (*hal_pwm_stream_handler_t)(hal_pwm_stream_evt_t evt);
+
+/**
+ * @brief Initialize the PWM instance, all duty cycles start at 0
+ * @param top_value Counter top value, a duty cycle equal to it means fully on
+ * @param stream_handler Handler of stream events
+ */
+void hal_pwm_init(uint16_t top_value, hal_pwm_stream_handler_t stream_handler);
+
+/**
+ * @brief Start looping the duty cycle sequence, no effect if it is running
+ */
+void hal_pwm_start(void);
+
+/**
+ * @brief Stop the sequence and leave the outputs at their idle (off) level, no effect if stopped
+ */
+void hal_pwm_stop(void);
+
+/**
+ * @brief Set the duty cycle of a channel
+ * @param channel Channel index, below HAL_PWM_CHANNEL_COUNT
+ * @param value Duty cycle, up to the top value
+ */
+void hal_pwm_duty_set(uint8_t channel, uint16_t value);
+
+/**
+ * @brief Get the buffer to fill next, producer side
+ * @return Buffer of HAL_PWM_STREAM_BUFFER_STEPS steps, NULL if every buffer is queued or playing
+ */
+hal_pwm_step_t *hal_pwm_stream_buffer_get(void);
+
+/**
+ * @brief Number of buffers that can be filled, including a partly filled one, producer side
+ */
+uint32_t hal_pwm_stream_buffers_free(void);
+
+/**
+ * @brief Queue the buffer returned by hal_pwm_stream_buffer_get(), producer side
+ * @param steps Number of steps filled, 1 to HAL_PWM_STREAM_BUFFER_STEPS
+ */
+void hal_pwm_stream_buffer_commit(uint16_t steps);
+
+/**
+ * @brief Tell whether the stream holds its last step for lack of data, producer side
+ */
+bool hal_pwm_stream_starving(void);
+
+/**
+ * @brief End the stream after the buffers committed so far, producer side
+ */
+void hal_pwm_stream_end(void);
+
+/**
+ * @brief Stop an ended stream and resume the duty cycle sequence if it was started,
+ *        restarts the stream instead if buffers were committed in the meantime
+ */
+void hal_pwm_stream_stop(void);
+
+#endif // HAL_PWM_H__
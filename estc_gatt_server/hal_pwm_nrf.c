@@ -0,0 +1,272 @@
+#include "hal_pwm.h"
+
+#include "nrfx_pwm.h"
+#include "nrfx_gpiote.h"
+#include "app_util_platform.h"
+#include <stdbool.h>
+
+#define LED_R_PIN NRF_GPIO_PIN_MAP(0, 8)
+#define LED_G_PIN NRF_GPIO_PIN_MAP(1, 9)
+#define LED_B_PIN NRF_GPIO_PIN_MAP(0, 12)
+
+static nrfx_pwm_t rgb_instance = NRFX_PWM_INSTANCE(0);
+
+static nrf_pwm_values_individual_t pwm_duty_cycles;
+static nrf_pwm_sequence_t const pwm_sequence =
+    {
+        .values.p_individual = &pwm_duty_cycles,
+        .length = NRF_PWM_VALUES_LENGTH(pwm_duty_cycles),
+        .repeats = 0,
+        .end_delay = 0};
+
+static bool m_running = false;
+
+_Static_assert(sizeof(hal_pwm_step_t) == sizeof(nrf_pwm_values_individual_t), "Steps are read by the PWM");
+
+typedef enum
+{
+    STREAM_IDLE,
+    STREAM_PLAYING,
+    STREAM_ENDING, // The last step is held until hal_pwm_stream_stop()
+} stream_state_t;
+
+static hal_pwm_step_t m_stream_buffers[HAL_PWM_STREAM_BUFFER_COUNT][HAL_PWM_STREAM_BUFFER_STEPS];
+static uint16_t m_stream_steps[HAL_PWM_STREAM_BUFFER_COUNT];
+
+// Buffer counters, running freely: buffers in [tail, loaded) are in the PWM sequence slots,
+// buffers in [loaded, head) wait for a slot. head is only written by the producer, loaded and
+// tail only by the PWM interrupt or while the stream is stopped.
+static uint32_t m_stream_head;
+static uint32_t m_stream_loaded;
+static uint32_t m_stream_tail;
+// Value of head at hal_pwm_stream_end(), stale values lie behind loaded
+static uint32_t m_stream_end_head;
+
+static volatile stream_state_t m_stream_state = STREAM_IDLE;
+
+// The two sequence slots of the PWM play alternately, each holds a buffer or a held step
+static bool m_slot_is_buffer[2];
+static hal_pwm_step_t m_hold_steps[2];
+
+static uint16_t m_stream_repeats;
+static hal_pwm_stream_handler_t m_stream_handler;
+
+/**
+ * @brief Prepare what a sequence slot plays after the other one: the next buffer if one was
+ *        committed, the last step of the other slot otherwise
+ */
+static void stream_slot_fill(uint8_t slot, nrf_pwm_sequence_t *p_seq)
+{
+    uint32_t head = __atomic_load_n(&m_stream_head, __ATOMIC_ACQUIRE);
+
+    p_seq->repeats = m_stream_repeats;
+    p_seq->end_delay = 0;
+
+    if (m_stream_loaded != head)
+    {
+        uint8_t index = m_stream_loaded % HAL_PWM_STREAM_BUFFER_COUNT;
+
+        p_seq->values.p_individual = (nrf_pwm_values_individual_t const *)m_stream_buffers[index];
+        p_seq->length = m_stream_steps[index] * HAL_PWM_CHANNEL_COUNT;
+        m_slot_is_buffer[slot] = true;
+        __atomic_store_n(&m_stream_loaded, m_stream_loaded + 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    // The other slot was loaded last, with the last loaded buffer or a held step
+    if (m_slot_is_buffer[1 - slot])
+    {
+        uint8_t index = (m_stream_loaded - 1) % HAL_PWM_STREAM_BUFFER_COUNT;
+        m_hold_steps[slot] = m_stream_buffers[index][m_stream_steps[index] - 1];
+    }
+    else
+    {
+        m_hold_steps[slot] = m_hold_steps[1 - slot];
+    }
+
+    p_seq->values.p_individual = (nrf_pwm_values_individual_t const *)&m_hold_steps[slot];
+    p_seq->length = HAL_PWM_CHANNEL_COUNT;
+    m_slot_is_buffer[slot] = false;
+}
+
+/**
+ * @brief Start playing the committed buffers, called with at least one buffer waiting
+ */
+static void stream_start(void)
+{
+    nrf_pwm_sequence_t seq[2];
+
+    nrfx_pwm_stop(&rgb_instance, true);
+
+    m_slot_is_buffer[1] = false;
+    stream_slot_fill(0, &seq[0]);
+    stream_slot_fill(1, &seq[1]);
+
+    m_stream_state = STREAM_PLAYING;
+    nrfx_pwm_complex_playback(&rgb_instance, &seq[0], &seq[1], 1,
+                              NRFX_PWM_FLAG_LOOP | NRFX_PWM_FLAG_SIGNAL_END_SEQ0 |
+                                  NRFX_PWM_FLAG_SIGNAL_END_SEQ1 | NRFX_PWM_FLAG_NO_EVT_FINISHED);
+}
+
+static void pwm_event_handler(nrfx_pwm_evt_type_t event_type)
+{
+    if ((event_type != NRFX_PWM_EVT_END_SEQ0 && event_type != NRFX_PWM_EVT_END_SEQ1) ||
+        m_stream_state != STREAM_PLAYING)
+    {
+        return;
+    }
+
+    // The other slot plays now, this one is refilled with what follows it
+    uint8_t slot = (event_type == NRFX_PWM_EVT_END_SEQ0) ? 0 : 1;
+    uint32_t head = __atomic_load_n(&m_stream_head, __ATOMIC_ACQUIRE);
+    uint32_t end_head = __atomic_load_n(&m_stream_end_head, __ATOMIC_ACQUIRE);
+
+    if (m_slot_is_buffer[slot])
+    {
+        __atomic_store_n(&m_stream_tail, m_stream_tail + 1, __ATOMIC_RELEASE);
+        m_stream_handler(HAL_PWM_STREAM_EVT_BUFFER_DONE);
+    }
+
+    bool ended = m_stream_loaded == head && m_stream_loaded == end_head && !m_slot_is_buffer[1 - slot];
+
+    nrf_pwm_sequence_t seq;
+    stream_slot_fill(slot, &seq);
+    nrfx_pwm_sequence_update(&rgb_instance, slot, &seq);
+
+    if (ended)
+    {
+        m_stream_state = STREAM_ENDING;
+        m_stream_handler(HAL_PWM_STREAM_EVT_END);
+    }
+    else if (!m_slot_is_buffer[slot] && m_slot_is_buffer[1 - slot] && m_stream_loaded != end_head)
+    {
+        m_stream_handler(HAL_PWM_STREAM_EVT_UNDERRUN);
+    }
+}
+
+void hal_pwm_init(uint16_t top_value, hal_pwm_stream_handler_t stream_handler)
+{
+    nrfx_pwm_config_t pwm_config = NRFX_PWM_DEFAULT_CONFIG;
+    pwm_config.output_pins[0] = NRFX_PWM_PIN_NOT_USED;
+    pwm_config.output_pins[1] = LED_R_PIN | NRFX_PWM_PIN_INVERTED;
+    pwm_config.output_pins[2] = LED_G_PIN | NRFX_PWM_PIN_INVERTED;
+    pwm_config.output_pins[3] = LED_B_PIN | NRFX_PWM_PIN_INVERTED;
+    pwm_config.load_mode = NRF_PWM_LOAD_INDIVIDUAL;
+    pwm_config.top_value = top_value;
+
+    // One PWM period takes top value microseconds at the 1 MHz base clock
+    m_stream_repeats = (HAL_PWM_STREAM_STEP_US + top_value / 2) / top_value - 1;
+    m_stream_handler = stream_handler;
+
+    nrfx_pwm_init(&rgb_instance, &pwm_config, pwm_event_handler);
+}
+
+void hal_pwm_start(void)
+{
+    CRITICAL_REGION_ENTER();
+    if (!m_running)
+    {
+        m_running = true;
+        if (m_stream_state == STREAM_IDLE)
+        {
+            nrfx_pwm_simple_playback(&rgb_instance, &pwm_sequence, 1, NRFX_PWM_FLAG_LOOP | NRFX_PWM_FLAG_NO_EVT_FINISHED);
+        }
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+void hal_pwm_stop(void)
+{
+    CRITICAL_REGION_ENTER();
+    if (m_running)
+    {
+        m_running = false;
+        if (m_stream_state == STREAM_IDLE)
+        {
+            // Waits for the end of the current PWM period, at most top value / 1 MHz
+            nrfx_pwm_stop(&rgb_instance, true);
+        }
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+void hal_pwm_duty_set(uint8_t channel, uint16_t value)
+{
+    switch (channel)
+    {
+    case 0:
+        pwm_duty_cycles.channel_0 = value;
+        break;
+    case 1:
+        pwm_duty_cycles.channel_1 = value;
+        break;
+    case 2:
+        pwm_duty_cycles.channel_2 = value;
+        break;
+    case 3:
+        pwm_duty_cycles.channel_3 = value;
+        break;
+    }
+}
+
+hal_pwm_step_t *hal_pwm_stream_buffer_get(void)
+{
+    if (hal_pwm_stream_buffers_free() == 0)
+    {
+        return NULL;
+    }
+    return m_stream_buffers[m_stream_head % HAL_PWM_STREAM_BUFFER_COUNT];
+}
+
+uint32_t hal_pwm_stream_buffers_free(void)
+{
+    return HAL_PWM_STREAM_BUFFER_COUNT - (m_stream_head - __atomic_load_n(&m_stream_tail, __ATOMIC_ACQUIRE));
+}
+
+void hal_pwm_stream_buffer_commit(uint16_t steps)
+{
+    m_stream_steps[m_stream_head % HAL_PWM_STREAM_BUFFER_COUNT] = steps;
+    __atomic_store_n(&m_stream_head, m_stream_head + 1, __ATOMIC_RELEASE);
+
+    // While the stream is ending hal_pwm_stream_stop() restarts it
+    CRITICAL_REGION_ENTER();
+    if (m_stream_state == STREAM_IDLE)
+    {
+        stream_start();
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+bool hal_pwm_stream_starving(void)
+{
+    return m_stream_state == STREAM_PLAYING &&
+           __atomic_load_n(&m_stream_loaded, __ATOMIC_ACQUIRE) == m_stream_head;
+}
+
+void hal_pwm_stream_end(void)
+{
+    __atomic_store_n(&m_stream_end_head, m_stream_head, __ATOMIC_RELEASE);
+}
+
+void hal_pwm_stream_stop(void)
+{
+    CRITICAL_REGION_ENTER();
+    if (m_stream_state == STREAM_ENDING)
+    {
+        if (__atomic_load_n(&m_stream_head, __ATOMIC_ACQUIRE) != m_stream_loaded)
+        {
+            stream_start();
+        }
+        else
+        {
+            nrfx_pwm_stop(&rgb_instance, true);
+            m_stream_state = STREAM_IDLE;
+
+            if (m_running)
+            {
+                nrfx_pwm_simple_playback(&rgb_instance, &pwm_sequence, 1, NRFX_PWM_FLAG_LOOP | NRFX_PWM_FLAG_NO_EVT_FINISHED);
+            }
+        }
+    }
+    CRITICAL_REGION_EXIT();
+}
@@ -0,0 +1,69 @@
+#ifndef HAL_TIMER_H__
+#define HAL_TIMER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+
+/**
+ * @brief Application timers and timestamps
+ *
+ * @details Timers are taken from a fixed pool at creation. Handlers run in the timer interrupt
+ *          context, in creation order when several expire at the same time.
+ */
+
+#define HAL_TIMER_COUNT 4 // Size of the timer pool
+
+// Elapsed time is only valid up to this age of a timestamp
+#define HAL_TIMER_ELAPSED_MAX_MS 500000
+
+typedef uint8_t hal_timer_id_t;
+
+typedef void (*hal_timer_handler_t)(void *p_context);
+
+/**
+ * @brief Initialize the timer module
+ */
+ret_code_t hal_timer_init(void);
+
+/**
+ * @brief Create a timer
+ * @param p_id Returns the timer id
+ * @param repeated True for a periodic timer, false for a single shot
+ * @param handler Function called on expiry
+ * @return NRF_ERROR_NO_MEM if the pool is exhausted
+ */
+ret_code_t hal_timer_create(hal_timer_id_t *p_id, bool repeated, hal_timer_handler_t handler);
+
+/**
+ * @brief Start a timer, restarting it if it is running
+ * @param id Timer id
+ * @param timeout_ms Timeout, also the period of a repeated timer
+ * @param p_context Passed to the handler
+ */
+ret_code_t hal_timer_start(hal_timer_id_t id, uint32_t timeout_ms, void *p_context);
+
+/**
+ * @brief Stop a timer, no effect if it is not running
+ */
+ret_code_t hal_timer_stop(hal_timer_id_t id);
+
+/**
+ * @brief Take a timestamp
+ */
+uint32_t hal_timer_stamp_get(void);
+
+/**
+ * @brief Time elapsed since a timestamp
+ * @param stamp Timestamp taken with hal_timer_stamp_get(), at most HAL_TIMER_ELAPSED_MAX_MS old
+ */
+uint32_t hal_timer_elapsed_ms(uint32_t stamp);
+
+/**
+ * @brief Time between two timestamps
+ * @param later Later timestamp
+ * @param earlier Earlier timestamp, at most HAL_TIMER_ELAPSED_MAX_MS before later
+ */
+uint32_t hal_timer_stamp_diff_us(uint32_t later, uint32_t earlier);
+
+#endif // HAL_TIMER_H__
@@ -0,0 +1,68 @@
+#include "hal_timer.h"
+
+#include "app_timer.h"
+#include "app_util.h"
+
+// RTC counter frequency, APP_TIMER_CLOCK_FREQ divided by the prescaler of sdk_config.h
+#define RTC_TICK_FREQ (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+
+// The RTC counter is 24 bits wide, 1024 s at the 16384 Hz of the configured prescaler
+STATIC_ASSERT(HAL_TIMER_ELAPSED_MAX_MS < (uint64_t)(APP_TIMER_MAX_CNT_VAL + 1) * 1000 / RTC_TICK_FREQ);
+
+static app_timer_t m_timer_data[HAL_TIMER_COUNT];
+static app_timer_id_t m_timer_ids[HAL_TIMER_COUNT];
+static uint8_t m_timer_count;
+
+ret_code_t hal_timer_init(void)
+{
+    return app_timer_init();
+}
+
+ret_code_t hal_timer_create(hal_timer_id_t *p_id, bool repeated, hal_timer_handler_t handler)
+{
+    if (m_timer_count >= HAL_TIMER_COUNT)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    m_timer_ids[m_timer_count] = &m_timer_data[m_timer_count];
+
+    ret_code_t err_code = app_timer_create(&m_timer_ids[m_timer_count],
+                                           repeated ? APP_TIMER_MODE_REPEATED : APP_TIMER_MODE_SINGLE_SHOT,
+                                           handler);
+    if (err_code == NRF_SUCCESS)
+    {
+        *p_id = m_timer_count++;
+    }
+
+    return err_code;
+}
+
+ret_code_t hal_timer_start(hal_timer_id_t id, uint32_t timeout_ms, void *p_context)
+{
+    return app_timer_start(m_timer_ids[id], APP_TIMER_TICKS(timeout_ms), p_context);
+}
+
+ret_code_t hal_timer_stop(hal_timer_id_t id)
+{
+    return app_timer_stop(m_timer_ids[id]);
+}
+
+uint32_t hal_timer_stamp_get(void)
+{
+    return app_timer_cnt_get();
+}
+
+uint32_t hal_timer_elapsed_ms(uint32_t stamp)
+{
+    uint32_t ticks = app_timer_cnt_diff_compute(app_timer_cnt_get(), stamp);
+
+    return (uint32_t)(((uint64_t)ticks * 1000) / RTC_TICK_FREQ);
+}
+
+uint32_t hal_timer_stamp_diff_us(uint32_t later, uint32_t earlier)
+{
+    uint32_t ticks = app_timer_cnt_diff_compute(later, earlier);
+
+    return (uint32_t)(((uint64_t)ticks * 1000000) / RTC_TICK_FREQ);
+}
@@ -0,0 +1,216 @@
+/**
+ * @brief Reconnect latency of the advertising tiers, simulated on the host
+ *
+ * @details Models the link layer timing from the disconnect of a central to its CONNECT_IND being
+ *          answered. The light advertises with the tiers of adv_tiers.h; the central keeps
+ *          initiating through the disconnect, as with auto connect, and listens on one advertising
+ *          channel per scan window, rotating through 37, 38 and 39. The phase of its scan windows
+ *          and the advDelay of undirected advertising are random.
+ *
+ *          Each central scan profile is run with the tiered policy (high duty directed advertising
+ *          to the central that disconnected, then fast undirected) and with fast undirected
+ *          advertising alone, the policy before the tiers. Figures are printed as
+ *          "name: value" lines in milliseconds.
+ *
+ *          Usage: reconnect_latency [trials]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "adv_tiers.h"
+
+// Advertising tiers of the firmware: directed high duty, then fast undirected
+#define DIRECTED_DURATION_US (ADV_DIRECTED_DURATION_MS * 1000)
+#define DIRECTED_PERIOD_US ADV_DIRECTED_PERIOD_US
+#define FAST_INTERVAL_US (APP_ADV_INTERVAL * 625)
+#define ADV_DELAY_MAX_US 10000      // advDelay added to every undirected advertising event
+#define ADV_CHANNEL_SPACING_US 400  // ADV_IND and the scan for a reply on one channel
+#define ADV_CHANNEL_COUNT 3
+
+// CONNECT_IND, transmit window offset and the first connection event
+#define CONNECT_SETUP_US 2500
+// A central that never hears the light gives up here
+#define TIMEOUT_US 30000000
+
+#define TRIALS_DEFAULT 20000
+
+typedef struct
+{
+    char const *name;
+    uint32_t interval_us;
+    uint32_t window_us;
+} scan_profile_t;
+
+static scan_profile_t const m_profiles[] = {
+    {"continuous", 100000, 100000},
+    {"nrf_ble_scan_default", 100000, 50000},
+    {"balanced", 500000, 100000},
+    {"low_duty", 1280000, 11250},
+};
+
+typedef struct
+{
+    uint32_t interval_us;
+    uint32_t window_us;
+    uint32_t phase_us;
+    uint8_t first_channel;
+} central_t;
+
+static uint32_t m_rand = 0x9E3779B9;
+
+static uint32_t rand_next(void)
+{
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return m_rand;
+}
+
+// Tell whether the central hears a PDU sent at time_us on an advertising channel
+static bool central_hears(central_t const *p_central, uint32_t time_us, uint8_t channel)
+{
+    // Windows open at phase_us + k * interval_us, also before the disconnect
+    uint32_t since_us = time_us + p_central->interval_us - p_central->phase_us;
+    uint32_t window = since_us / p_central->interval_us;
+
+    return since_us % p_central->interval_us < p_central->window_us &&
+           (p_central->first_channel + window) % ADV_CHANNEL_COUNT == channel;
+}
+
+// Time of the first advertising PDU the central hears, at or after start_us and before end_us
+static bool advertising_heard(central_t const *p_central, bool directed, uint32_t start_us, uint32_t end_us,
+                              uint32_t *p_time_us)
+{
+    uint32_t event_us = start_us;
+
+    while (event_us < end_us)
+    {
+        // High duty directed advertising cycles the channels back to back
+        uint32_t spacing_us = directed ? DIRECTED_PERIOD_US / ADV_CHANNEL_COUNT : ADV_CHANNEL_SPACING_US;
+
+        for (uint8_t channel = 0; channel < ADV_CHANNEL_COUNT; channel++)
+        {
+            uint32_t time_us = event_us + channel * spacing_us;
+            if (time_us < end_us && central_hears(p_central, time_us, channel))
+            {
+                *p_time_us = time_us;
+                return true;
+            }
+        }
+
+        event_us += directed ? DIRECTED_PERIOD_US : FAST_INTERVAL_US + rand_next() % (ADV_DELAY_MAX_US + 1);
+    }
+
+    return false;
+}
+
+static uint32_t reconnect_latency_us(central_t const *p_central, bool tiered)
+{
+    uint32_t time_us;
+    uint32_t fast_start_us = 0;
+
+    if (tiered)
+    {
+        if (advertising_heard(p_central, true, 0, DIRECTED_DURATION_US, &time_us))
+        {
+            return time_us + CONNECT_SETUP_US;
+        }
+        fast_start_us = DIRECTED_DURATION_US;
+    }
+
+    if (advertising_heard(p_central, false, fast_start_us, TIMEOUT_US, &time_us))
+    {
+        return time_us + CONNECT_SETUP_US;
+    }
+    return TIMEOUT_US;
+}
+
+static int compare_u32(void const *p_a, void const *p_b)
+{
+    uint32_t a = *(uint32_t const *)p_a;
+    uint32_t b = *(uint32_t const *)p_b;
+
+    return (a > b) - (a < b);
+}
+
+typedef struct
+{
+    uint32_t mean_us;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t max_us;
+} latency_stats_t;
+
+static latency_stats_t latency_run(scan_profile_t const *p_profile, bool tiered, uint32_t *p_samples, uint32_t trials)
+{
+    uint64_t sum_us = 0;
+    latency_stats_t stats;
+
+    for (uint32_t i = 0; i < trials; i++)
+    {
+        central_t central = {
+            .interval_us = p_profile->interval_us,
+            .window_us = p_profile->window_us,
+            .phase_us = rand_next() % p_profile->interval_us,
+            .first_channel = rand_next() % ADV_CHANNEL_COUNT,
+        };
+
+        p_samples[i] = reconnect_latency_us(&central, tiered);
+        sum_us += p_samples[i];
+    }
+
+    qsort(p_samples, trials, sizeof(p_samples[0]), compare_u32);
+    stats.mean_us = (uint32_t)(sum_us / trials);
+    stats.p50_us = p_samples[trials / 2];
+    stats.p95_us = p_samples[(uint64_t)trials * 95 / 100];
+    stats.max_us = p_samples[trials - 1];
+    return stats;
+}
+
+static void stats_print(char const *p_profile, char const *p_policy, latency_stats_t const *p_stats)
+{
+    printf("%s.%s.mean_ms: %.1f\n", p_profile, p_policy, p_stats->mean_us / 1000.0);
+    printf("%s.%s.p50_ms: %.1f\n", p_profile, p_policy, p_stats->p50_us / 1000.0);
+    printf("%s.%s.p95_ms: %.1f\n", p_profile, p_policy, p_stats->p95_us / 1000.0);
+    printf("%s.%s.max_ms: %.1f\n", p_profile, p_policy, p_stats->max_us / 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t trials = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : TRIALS_DEFAULT;
+    uint32_t *p_samples = malloc(trials * sizeof(*p_samples));
+    int result = EXIT_SUCCESS;
+
+    if (trials == 0 || p_samples == NULL)
+    {
+        fprintf(stderr, "usage: %s [trials]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(m_profiles) / sizeof(m_profiles[0]); i++)
+    {
+        scan_profile_t const *p_profile = &m_profiles[i];
+        latency_stats_t tiered = latency_run(p_profile, true, p_samples, trials);
+        latency_stats_t fast = latency_run(p_profile, false, p_samples, trials);
+
+        printf("%s.scan: %u/%u ms\n", p_profile->name, p_profile->window_us / 1000, p_profile->interval_us / 1000);
+        stats_print(p_profile->name, "tiered", &tiered);
+        stats_print(p_profile->name, "fast_only", &fast);
+
+        // The directed tier is heard in the first scan window that opens while it runs. A central
+        // that scans all the time hears either tier at once, the tiers differ by channel timing only.
+        bool bounded = p_profile->interval_us >= DIRECTED_DURATION_US ||
+                       tiered.max_us <= p_profile->interval_us - p_profile->window_us + 2 * DIRECTED_PERIOD_US + CONNECT_SETUP_US;
+        if (tiered.max_us > fast.max_us || tiered.mean_us > fast.mean_us + DIRECTED_PERIOD_US || !bounded)
+        {
+            fprintf(stderr, "%s: tiered advertising does not reconnect faster\n", p_profile->name);
+            result = EXIT_FAILURE;
+        }
+    }
+
+    free(p_samples);
+    return result;
+}
@@ -0,0 +1,85 @@
+#include "app_scheduler.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+// Host replacement of the SDK app_scheduler, event data is copied into a fixed queue
+
+#define SCHED_EVENT_DATA_MAX 32
+#define SCHED_QUEUE_MAX 32
+
+typedef struct
+{
+    app_sched_event_handler_t handler;
+    uint16_t size;
+    _Alignas(max_align_t) uint8_t data[SCHED_EVENT_DATA_MAX]; // Aligned like the SDK queue buffers
+} sched_event_t;
+
+static sched_event_t m_queue[SCHED_QUEUE_MAX];
+static uint16_t m_event_size;
+static uint16_t m_queue_size;
+static uint32_t m_head;
+static uint32_t m_tail;
+static uint16_t m_utilization_max;
+
+void app_sched_init(uint16_t event_size, uint16_t queue_size)
+{
+    assert(event_size <= SCHED_EVENT_DATA_MAX);
+    assert(queue_size <= SCHED_QUEUE_MAX);
+
+    m_event_size = event_size;
+    m_queue_size = queue_size;
+    m_head = 0;
+    m_tail = 0;
+    m_utilization_max = 0;
+}
+
+ret_code_t app_sched_event_put(void const *p_event_data, uint16_t event_size, app_sched_event_handler_t handler)
+{
+    if (event_size > m_event_size)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (m_head - m_tail == m_queue_size)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    sched_event_t *p_event = &m_queue[m_head % m_queue_size];
+    p_event->handler = handler;
+    p_event->size = event_size;
+    if (p_event_data != NULL && event_size != 0)
+    {
+        memcpy(p_event->data, p_event_data, event_size);
+    }
+    m_head++;
+
+    if (m_head - m_tail > m_utilization_max)
+    {
+        m_utilization_max = (uint16_t)(m_head - m_tail);
+    }
+
+    return NRF_SUCCESS;
+}
+
+void app_sched_execute(void)
+{
+    while (m_tail != m_head)
+    {
+        sched_event_t event = m_queue[m_tail % m_queue_size];
+        m_tail++;
+
+        event.handler(event.size != 0 ? event.data : NULL, event.size);
+    }
+}
+
+uint16_t app_sched_queue_space_get(void)
+{
+    return (uint16_t)(m_queue_size - (m_head - m_tail));
+}
+
+uint16_t app_sched_queue_utilization_get(void)
+{
+    return m_utilization_max;
+}
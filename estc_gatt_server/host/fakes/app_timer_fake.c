@@ -0,0 +1,164 @@
+#include "app_timer.h"
+#include "fake_timer.h"
+
+#include <stddef.h>
+
+static app_timer_t *m_timers[FAKE_TIMER_COUNT_MAX];
+static uint32_t m_expiries[FAKE_TIMER_COUNT_MAX];
+static uint8_t m_timer_count;
+
+static uint64_t m_now;
+static uint64_t m_ms_remainder; // Fraction of a tick left over by fake_timer_advance(), in 1/1000 ticks
+static fake_timer_hook_t m_hook;
+
+ret_code_t app_timer_init(void)
+{
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id, app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler)
+{
+    if (p_timer_id == NULL || *p_timer_id == NULL || timeout_handler == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (m_timer_count >= FAKE_TIMER_COUNT_MAX)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    app_timer_t *p_timer = *p_timer_id;
+    p_timer->handler = timeout_handler;
+    p_timer->mode = mode;
+    p_timer->running = false;
+    m_timers[m_timer_count++] = p_timer;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context)
+{
+    if (timer_id == NULL || timer_id->handler == NULL || timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS ||
+        timeout_ticks > APP_TIMER_MAX_CNT_VAL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    // A running timer is restarted
+    timer_id->running = true;
+    timer_id->end = m_now + timeout_ticks;
+    timer_id->period = timeout_ticks;
+    timer_id->p_context = p_context;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+    if (timer_id == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    timer_id->running = false;
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(void)
+{
+    return (uint32_t)(m_now & APP_TIMER_MAX_CNT_VAL);
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from)
+{
+    return (ticks_to - ticks_from) & APP_TIMER_MAX_CNT_VAL;
+}
+
+/**
+ * @brief Find the timer expiring first, not later than limit
+ * @return Index of the timer, m_timer_count if none expires
+ */
+static uint8_t next_expiry_find(uint64_t limit)
+{
+    uint8_t next = m_timer_count;
+
+    for (uint8_t i = 0; i < m_timer_count; i++)
+    {
+        app_timer_t const *p_timer = m_timers[i];
+
+        // Strictly earlier, so timers expiring together run in creation order
+        if (p_timer->running && p_timer->end <= limit && (next == m_timer_count || p_timer->end < m_timers[next]->end))
+        {
+            next = i;
+        }
+    }
+
+    return next;
+}
+
+void fake_timer_advance_ticks(uint64_t ticks)
+{
+    uint64_t target = m_now + ticks;
+    uint8_t index;
+
+    while ((index = next_expiry_find(target)) != m_timer_count)
+    {
+        app_timer_t *p_timer = m_timers[index];
+
+        m_now = p_timer->end;
+        if (p_timer->mode == APP_TIMER_MODE_REPEATED)
+        {
+            p_timer->end += p_timer->period;
+        }
+        else
+        {
+            p_timer->running = false;
+        }
+
+        m_expiries[index]++;
+        // The handler may stop or restart any timer, itself included
+        p_timer->handler(p_timer->p_context);
+
+        if (m_hook != NULL)
+        {
+            m_hook();
+        }
+    }
+
+    m_now = target;
+}
+
+void fake_timer_advance(uint32_t ms)
+{
+    uint64_t scaled = (uint64_t)ms * FAKE_TIMER_TICK_FREQ + m_ms_remainder;
+
+    m_ms_remainder = scaled % 1000;
+    fake_timer_advance_ticks(scaled / 1000);
+}
+
+uint64_t fake_timer_ticks(void)
+{
+    return m_now;
+}
+
+uint64_t fake_timer_ms(void)
+{
+    return m_now * 1000 / FAKE_TIMER_TICK_FREQ;
+}
+
+bool fake_timer_running(hal_timer_id_t id)
+{
+    return id < m_timer_count && m_timers[id]->running;
+}
+
+uint32_t fake_timer_expiries(hal_timer_id_t id)
+{
+    return id < m_timer_count ? m_expiries[id] : 0;
+}
+
+void fake_timer_hook_set(fake_timer_hook_t hook)
+{
+    m_hook = hook;
+}
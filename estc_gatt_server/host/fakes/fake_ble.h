@@ -0,0 +1,142 @@
+#ifndef FAKE_BLE_H__
+#define FAKE_BLE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "ble_srv_common.h"
+#include "sdk_config.h"
+
+/**
+ * @brief Host fake of hal_ble.h
+ *
+ * @details Attribute handles are assigned in order like the SoftDevice does, after the GAP and
+ *          GATT services. Notifications are logged and take a slot of the per-link queue until
+ *          fake_ble_tx_complete() frees it. CCCD values are taken from the write events built
+ *          with fake_ble_write_evt() and cleared by the GAP events of the link.
+ */
+
+#define FAKE_BLE_FIRST_HANDLE 0x000C   // First handle after the GAP and GATT services
+#define FAKE_BLE_CHAR_MAX 16           // Characteristics kept for inspection
+#define FAKE_BLE_NOTIFY_LOG_SIZE 64    // Notifications kept, later ones are counted only
+#define FAKE_BLE_HVN_QUEUE_SIZE 1      // Notifications queued per link, the SoftDevice default
+#define FAKE_BLE_CONN_COUNT 4          // Connection handles 0 to FAKE_BLE_CONN_COUNT - 1
+
+typedef struct
+{
+    uint16_t uuid;
+    ble_gatt_char_props_t props;
+    uint16_t max_len;
+    bool is_var_len;
+    char desc[32];
+    ble_gatts_char_handles_t handles;
+    uint8_t value[NRF_SDH_BLE_GATT_MAX_MTU_SIZE];
+    uint16_t value_len;
+} fake_ble_char_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    uint16_t value_handle;
+    uint8_t data[NRF_SDH_BLE_GATT_MAX_MTU_SIZE];
+    uint16_t len;
+} fake_ble_notification_t;
+
+// Event buffer with room for the longest write
+typedef union
+{
+    ble_evt_t evt;
+    uint8_t raw[sizeof(ble_evt_t) + NRF_SDH_BLE_GATT_MAX_MTU_SIZE];
+} fake_ble_evt_buf_t;
+
+/**
+ * @brief Drop the attribute table, values and notifications
+ */
+void fake_ble_reset(void);
+
+/**
+ * @brief Assign extra attribute handles after each characteristic from now on
+ * @details Models a stack that adds descriptors the application did not ask for.
+ */
+void fake_ble_attr_gap_set(uint16_t extra);
+
+/**
+ * @brief Get a characteristic added with hal_ble_characteristic_add()
+ * @param uuid 16-bit characteristic UUID
+ * @return NULL if there is none
+ */
+fake_ble_char_t const *fake_ble_char_find(uint16_t uuid);
+
+/**
+ * @brief Number of attribute handles assigned so far
+ */
+uint16_t fake_ble_handle_count(void);
+
+/**
+ * @brief Get a logged notification
+ * @param index Index in send order since the last clear
+ * @return NULL past the logged notifications
+ */
+fake_ble_notification_t const *fake_ble_notification(uint32_t index);
+
+/**
+ * @brief Number of notifications sent since the last clear
+ */
+uint32_t fake_ble_notification_count(void);
+
+/**
+ * @brief Number of notifications refused with a full queue since the last clear
+ */
+uint32_t fake_ble_notification_refused(void);
+
+/**
+ * @brief Drop the logged notifications, the queues keep their state
+ */
+void fake_ble_notifications_clear(void);
+
+/**
+ * @brief Free queued notifications of a link
+ * @return Number of notifications freed, the count for BLE_GATTS_EVT_HVN_TX_COMPLETE
+ */
+uint8_t fake_ble_tx_complete(uint16_t conn_handle);
+
+/**
+ * @brief Get the connection parameters last requested for a link
+ * @return NULL if none were requested since the reset
+ */
+ble_gap_conn_params_t const *fake_ble_conn_params(uint16_t conn_handle);
+
+/**
+ * @brief Number of accepted connection parameter requests of a link since the reset
+ */
+uint32_t fake_ble_conn_params_requests(uint16_t conn_handle);
+
+/**
+ * @brief Refuse the next connection parameter requests with NRF_ERROR_BUSY
+ * @param count Number of requests to refuse
+ */
+void fake_ble_conn_params_busy_set(uint32_t count);
+
+/**
+ * @brief Build a write event
+ * @param p_buf Event buffer
+ * @param conn_handle Writing link
+ * @param handle Attribute handle written
+ * @param op BLE_GATTS_OP_WRITE_REQ or BLE_GATTS_OP_WRITE_CMD
+ * @param p_data Written value
+ * @param len Length of the value
+ */
+ble_evt_t const *fake_ble_write_evt(fake_ble_evt_buf_t *p_buf, uint16_t conn_handle, uint16_t handle,
+                                    uint8_t op, uint8_t const *p_data, uint16_t len);
+
+/**
+ * @brief Build a GAP event without parameters, connected or disconnected
+ */
+ble_evt_t const *fake_ble_gap_evt(fake_ble_evt_buf_t *p_buf, uint16_t evt_id, uint16_t conn_handle);
+
+/**
+ * @brief Build a notification transmit complete event
+ */
+ble_evt_t const *fake_ble_tx_complete_evt(fake_ble_evt_buf_t *p_buf, uint16_t conn_handle, uint8_t count);
+
+#endif // FAKE_BLE_H__
@@ -0,0 +1,57 @@
+#ifndef FAKE_FLASH_H__
+#define FAKE_FLASH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_config.h"
+
+/**
+ * @brief Host fake of hal_flash.h
+ *
+ * @details The whole nRF52840 flash is kept in RAM, erased at start. Writes and erases are
+ *          queued like with fstorage and run by fake_flash_process(), which calls the done
+ *          handler as the SoftDevice event would. Writes clear bits only, as on NOR flash.
+ */
+
+#define FAKE_FLASH_SIZE 0x100000
+#define FAKE_FLASH_PAGE_SIZE 0x1000
+#define FAKE_FLASH_QUEUE_SIZE NRF_FSTORAGE_SD_QUEUE_SIZE
+
+typedef struct
+{
+    uint32_t writes;      // Completed writes
+    uint32_t write_bytes; // Bytes written by them
+    uint32_t erases;      // Completed page erases
+    uint32_t refused;     // Operations refused with a full queue
+    uint32_t queue_max;   // Deepest queue seen
+} fake_flash_stats_t;
+
+/**
+ * @brief Erase the whole flash and drop queued operations and statistics
+ */
+void fake_flash_reset(void);
+
+/**
+ * @brief Run queued operations in order
+ * @param count Largest number of operations to run
+ * @return Number of operations run
+ */
+uint32_t fake_flash_process(uint32_t count);
+
+/**
+ * @brief Number of queued operations
+ */
+uint32_t fake_flash_pending(void);
+
+/**
+ * @brief Let the next queued operations fail, they leave the flash untouched
+ * @param count Number of operations to fail
+ */
+void fake_flash_fail_next(uint32_t count);
+
+/**
+ * @brief Get the statistics since the last reset
+ */
+fake_flash_stats_t const *fake_flash_stats(void);
+
+#endif // FAKE_FLASH_H__
@@ -0,0 +1,57 @@
+#ifndef FAKE_PWM_H__
+#define FAKE_PWM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal_pwm.h"
+
+/**
+ * @brief Host fake of hal_pwm.h
+ *
+ * @details The duty cycles are kept for inspection. Stream buffers are played by the test with
+ *          fake_pwm_stream_play(), the played steps are captured in order.
+ */
+
+// Largest number of captured stream steps, later steps are counted but not kept
+#define FAKE_PWM_CAPTURE_STEPS 8192
+
+/**
+ * @brief Tell whether the duty cycle sequence runs
+ */
+bool fake_pwm_running(void);
+
+/**
+ * @brief Get the duty cycle of a channel
+ */
+uint16_t fake_pwm_duty(uint8_t channel);
+
+/**
+ * @brief Play committed stream buffers, as the PWM interrupt would
+ * @details The end of a stream is signalled by the call after its last buffer was played.
+ * @param buffers Largest number of buffers to play
+ * @return Number of buffers played
+ */
+uint32_t fake_pwm_stream_play(uint32_t buffers);
+
+/**
+ * @brief Tell whether a stream is playing or holding its last step
+ */
+bool fake_pwm_stream_active(void);
+
+/**
+ * @brief Get the captured stream steps
+ * @param p_count Set to the number of steps played since the last clear
+ */
+hal_pwm_step_t const *fake_pwm_stream_steps(uint32_t *p_count);
+
+/**
+ * @brief Drop the captured stream steps
+ */
+void fake_pwm_stream_steps_clear(void);
+
+/**
+ * @brief Number of UNDERRUN events raised
+ */
+uint32_t fake_pwm_stream_underruns(void);
+
+#endif // FAKE_PWM_H__
@@ -0,0 +1,60 @@
+#ifndef FAKE_TIMER_H__
+#define FAKE_TIMER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_timer.h"
+#include "hal_timer.h"
+
+/**
+ * @brief Host fake of the nRF5 SDK app_timer, under the hal_timer_nrf.c of the firmware
+ *
+ * @details Time is virtual and only moves with fake_timer_advance(), which runs the handlers of
+ *          the timers expiring on the way in expiry order, timers expiring together in creation
+ *          order. The counter is the 24-bit RTC of the target, ticking at FAKE_TIMER_TICK_FREQ.
+ *          Timers are numbered in creation order, which is the hal_timer id.
+ */
+
+#define FAKE_TIMER_COUNT_MAX 16
+#define FAKE_TIMER_TICK_FREQ (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+
+typedef void (*fake_timer_hook_t)(void);
+
+/**
+ * @brief Move the clock forward, running the handlers of the timers expiring on the way
+ * @param ms Milliseconds, fractions of a tick are carried over to the next call
+ */
+void fake_timer_advance(uint32_t ms);
+
+/**
+ * @brief Move the clock forward by RTC ticks
+ */
+void fake_timer_advance_ticks(uint64_t ticks);
+
+/**
+ * @brief Ticks since the start of the clock, not wrapped
+ */
+uint64_t fake_timer_ticks(void);
+
+/**
+ * @brief Milliseconds since the start of the clock
+ */
+uint64_t fake_timer_ms(void);
+
+/**
+ * @brief Tell whether a timer runs
+ */
+bool fake_timer_running(hal_timer_id_t id);
+
+/**
+ * @brief Number of times a timer expired
+ */
+uint32_t fake_timer_expiries(hal_timer_id_t id);
+
+/**
+ * @brief Set a function called after every expiry, NULL for none
+ * @details Lets a test run the main loop between timer interrupts, as on the target.
+ */
+void fake_timer_hook_set(fake_timer_hook_t hook);
+
+#endif // FAKE_TIMER_H__
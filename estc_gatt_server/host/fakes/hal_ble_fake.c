@@ -0,0 +1,347 @@
+#include "hal_ble.h"
+#include "fake_ble.h"
+
+#include <string.h>
+#include <assert.h>
+
+static uint16_t m_next_handle = FAKE_BLE_FIRST_HANDLE;
+static uint8_t m_uuid_type_count;
+static uint16_t m_attr_gap;
+
+static fake_ble_char_t m_chars[FAKE_BLE_CHAR_MAX];
+static uint8_t m_char_count;
+
+static fake_ble_notification_t m_notifications[FAKE_BLE_NOTIFY_LOG_SIZE];
+static uint32_t m_notification_count;
+static uint32_t m_notification_refused;
+static uint8_t m_hvn_queued[FAKE_BLE_CONN_COUNT];
+// CCCD values per link, by characteristic index
+static uint16_t m_cccds[FAKE_BLE_CONN_COUNT][FAKE_BLE_CHAR_MAX];
+
+static bool m_conn_evt_ext;
+
+static ble_gap_conn_params_t m_conn_params[FAKE_BLE_CONN_COUNT];
+static uint32_t m_conn_params_requests[FAKE_BLE_CONN_COUNT];
+static uint32_t m_conn_params_busy;
+
+void fake_ble_reset(void)
+{
+    m_next_handle = FAKE_BLE_FIRST_HANDLE;
+    m_uuid_type_count = 0;
+    m_attr_gap = 0;
+    m_char_count = 0;
+    memset(m_chars, 0, sizeof(m_chars));
+    memset(m_hvn_queued, 0, sizeof(m_hvn_queued));
+    memset(m_cccds, 0, sizeof(m_cccds));
+    m_conn_evt_ext = false;
+    memset(m_conn_params_requests, 0, sizeof(m_conn_params_requests));
+    m_conn_params_busy = 0;
+    fake_ble_notifications_clear();
+}
+
+static fake_ble_char_t *ble_char_by_value_handle(uint16_t value_handle)
+{
+    for (uint8_t i = 0; i < m_char_count; i++)
+    {
+        if (m_chars[i].handles.value_handle == value_handle)
+        {
+            return &m_chars[i];
+        }
+    }
+    return NULL;
+}
+
+static int8_t ble_char_index_by_cccd_handle(uint16_t cccd_handle)
+{
+    for (uint8_t i = 0; i < m_char_count; i++)
+    {
+        if (m_chars[i].handles.cccd_handle != 0 && m_chars[i].handles.cccd_handle == cccd_handle)
+        {
+            return (int8_t)i;
+        }
+    }
+    return -1;
+}
+
+ret_code_t hal_ble_service_add(ble_uuid128_t const *p_base_uuid, uint16_t uuid,
+                               uint8_t *p_uuid_type, uint16_t *p_service_handle)
+{
+    if (p_base_uuid == NULL || p_uuid_type == NULL || p_service_handle == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    *p_uuid_type = BLE_UUID_TYPE_VENDOR_BEGIN + m_uuid_type_count++;
+    *p_service_handle = m_next_handle++;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t hal_ble_characteristic_add(uint16_t service_handle, ble_add_char_params_t *p_params,
+                                      ble_gatts_char_handles_t *p_handles)
+{
+    if (p_params == NULL || p_handles == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+    if (m_char_count == FAKE_BLE_CHAR_MAX)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+    if (p_params->max_len > NRF_SDH_BLE_GATT_MAX_MTU_SIZE || p_params->init_len > p_params->max_len)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    fake_ble_char_t *p_char = &m_chars[m_char_count++];
+
+    memset(p_handles, 0, sizeof(*p_handles));
+    m_next_handle++; // Characteristic declaration
+    p_handles->value_handle = m_next_handle++;
+    if (p_params->char_props.notify || p_params->char_props.indicate)
+    {
+        p_handles->cccd_handle = m_next_handle++;
+    }
+    if (p_params->p_user_descr != NULL)
+    {
+        p_handles->user_desc_handle = m_next_handle++;
+    }
+    m_next_handle += m_attr_gap;
+
+    p_char->uuid = p_params->uuid;
+    p_char->props = p_params->char_props;
+    p_char->max_len = p_params->max_len;
+    p_char->is_var_len = p_params->is_var_len;
+    p_char->handles = *p_handles;
+    if (p_params->p_user_descr != NULL)
+    {
+        uint16_t size = p_params->p_user_descr->size;
+        memcpy(p_char->desc, p_params->p_user_descr->p_char_user_desc,
+               size < sizeof(p_char->desc) - 1 ? size : sizeof(p_char->desc) - 1);
+    }
+    if (p_params->p_init_value != NULL)
+    {
+        memcpy(p_char->value, p_params->p_init_value, p_params->init_len);
+    }
+    p_char->value_len = p_params->init_len;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t hal_ble_value_set(uint16_t value_handle, uint8_t const *p_data, uint16_t len)
+{
+    fake_ble_char_t *p_char = ble_char_by_value_handle(value_handle);
+
+    if (p_char == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (len > p_char->max_len)
+    {
+        return NRF_ERROR_DATA_SIZE;
+    }
+
+    memcpy(p_char->value, p_data, len);
+    p_char->value_len = len;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t hal_ble_notify(uint16_t conn_handle, uint16_t value_handle, uint8_t const *p_data, uint16_t len)
+{
+    fake_ble_char_t const *p_char = ble_char_by_value_handle(value_handle);
+
+    if (conn_handle >= FAKE_BLE_CONN_COUNT)
+    {
+        return BLE_CONN_HANDLE_INVALID == conn_handle ? NRF_ERROR_INVALID_STATE : NRF_ERROR_INVALID_PARAM;
+    }
+    if (p_char == NULL || !p_char->props.notify)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (len > NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+    {
+        return NRF_ERROR_DATA_SIZE;
+    }
+    if (m_hvn_queued[conn_handle] == FAKE_BLE_HVN_QUEUE_SIZE)
+    {
+        m_notification_refused++;
+        return NRF_ERROR_RESOURCES;
+    }
+
+    m_hvn_queued[conn_handle]++;
+
+    if (m_notification_count < FAKE_BLE_NOTIFY_LOG_SIZE)
+    {
+        fake_ble_notification_t *p_notification = &m_notifications[m_notification_count];
+
+        p_notification->conn_handle = conn_handle;
+        p_notification->value_handle = value_handle;
+        memcpy(p_notification->data, p_data, len);
+        p_notification->len = len;
+    }
+    m_notification_count++;
+
+    return NRF_SUCCESS;
+}
+
+bool hal_ble_notification_enabled(uint16_t conn_handle, uint16_t cccd_handle)
+{
+    int8_t index = ble_char_index_by_cccd_handle(cccd_handle);
+
+    return conn_handle < FAKE_BLE_CONN_COUNT && index >= 0 &&
+           (m_cccds[conn_handle][index] & BLE_GATT_HVX_NOTIFICATION) != 0;
+}
+
+ret_code_t hal_ble_conn_evt_ext_set(bool enable)
+{
+    m_conn_evt_ext = enable;
+    return NRF_SUCCESS;
+}
+
+ret_code_t hal_ble_conn_params_update(uint16_t conn_handle, ble_gap_conn_params_t const *p_params)
+{
+    if (conn_handle >= FAKE_BLE_CONN_COUNT)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (m_conn_params_busy != 0)
+    {
+        m_conn_params_busy--;
+        return NRF_ERROR_BUSY;
+    }
+
+    m_conn_params[conn_handle] = *p_params;
+    m_conn_params_requests[conn_handle]++;
+
+    return NRF_SUCCESS;
+}
+
+ble_gap_conn_params_t const *fake_ble_conn_params(uint16_t conn_handle)
+{
+    return conn_handle < FAKE_BLE_CONN_COUNT && m_conn_params_requests[conn_handle] != 0 ? &m_conn_params[conn_handle]
+                                                                                          : NULL;
+}
+
+uint32_t fake_ble_conn_params_requests(uint16_t conn_handle)
+{
+    return conn_handle < FAKE_BLE_CONN_COUNT ? m_conn_params_requests[conn_handle] : 0;
+}
+
+void fake_ble_conn_params_busy_set(uint32_t count)
+{
+    m_conn_params_busy = count;
+}
+
+void fake_ble_attr_gap_set(uint16_t extra)
+{
+    m_attr_gap = extra;
+}
+
+fake_ble_char_t const *fake_ble_char_find(uint16_t uuid)
+{
+    for (uint8_t i = 0; i < m_char_count; i++)
+    {
+        if (m_chars[i].uuid == uuid)
+        {
+            return &m_chars[i];
+        }
+    }
+    return NULL;
+}
+
+uint16_t fake_ble_handle_count(void)
+{
+    return m_next_handle - FAKE_BLE_FIRST_HANDLE;
+}
+
+fake_ble_notification_t const *fake_ble_notification(uint32_t index)
+{
+    if (index >= m_notification_count || index >= FAKE_BLE_NOTIFY_LOG_SIZE)
+    {
+        return NULL;
+    }
+    return &m_notifications[index];
+}
+
+uint32_t fake_ble_notification_count(void)
+{
+    return m_notification_count;
+}
+
+uint32_t fake_ble_notification_refused(void)
+{
+    return m_notification_refused;
+}
+
+void fake_ble_notifications_clear(void)
+{
+    m_notification_count = 0;
+    m_notification_refused = 0;
+}
+
+uint8_t fake_ble_tx_complete(uint16_t conn_handle)
+{
+    assert(conn_handle < FAKE_BLE_CONN_COUNT);
+
+    uint8_t count = m_hvn_queued[conn_handle];
+    m_hvn_queued[conn_handle] = 0;
+
+    return count;
+}
+
+ble_evt_t const *fake_ble_write_evt(fake_ble_evt_buf_t *p_buf, uint16_t conn_handle, uint16_t handle,
+                                    uint8_t op, uint8_t const *p_data, uint16_t len)
+{
+    assert(len <= NRF_SDH_BLE_GATT_MAX_MTU_SIZE);
+
+    memset(p_buf, 0, sizeof(*p_buf));
+    p_buf->evt.header.evt_id = BLE_GATTS_EVT_WRITE;
+    p_buf->evt.header.evt_len = (uint16_t)(sizeof(ble_evt_t) + len);
+    p_buf->evt.evt.gatts_evt.conn_handle = conn_handle;
+
+    ble_gatts_evt_write_t *p_write = &p_buf->evt.evt.gatts_evt.params.write;
+    p_write->handle = handle;
+    p_write->op = op;
+    p_write->len = len;
+    if (len != 0)
+    {
+        memcpy(p_write->data, p_data, len);
+    }
+
+    // The SoftDevice keeps CCCD values itself
+    int8_t index = ble_char_index_by_cccd_handle(handle);
+    if (index >= 0 && conn_handle < FAKE_BLE_CONN_COUNT && len == BLE_CCCD_VALUE_LEN)
+    {
+        m_cccds[conn_handle][index] = (uint16_t)(p_data[0] | (p_data[1] << 8));
+    }
+
+    return &p_buf->evt;
+}
+
+ble_evt_t const *fake_ble_gap_evt(fake_ble_evt_buf_t *p_buf, uint16_t evt_id, uint16_t conn_handle)
+{
+    memset(p_buf, 0, sizeof(*p_buf));
+    p_buf->evt.header.evt_id = evt_id;
+    p_buf->evt.header.evt_len = sizeof(ble_evt_t);
+    p_buf->evt.evt.gap_evt.conn_handle = conn_handle;
+
+    // A new link starts with notifications disabled
+    if (conn_handle < FAKE_BLE_CONN_COUNT)
+    {
+        memset(m_cccds[conn_handle], 0, sizeof(m_cccds[conn_handle]));
+    }
+
+    return &p_buf->evt;
+}
+
+ble_evt_t const *fake_ble_tx_complete_evt(fake_ble_evt_buf_t *p_buf, uint16_t conn_handle, uint8_t count)
+{
+    memset(p_buf, 0, sizeof(*p_buf));
+    p_buf->evt.header.evt_id = BLE_GATTS_EVT_HVN_TX_COMPLETE;
+    p_buf->evt.header.evt_len = sizeof(ble_evt_t);
+    p_buf->evt.evt.gatts_evt.conn_handle = conn_handle;
+    p_buf->evt.evt.gatts_evt.params.hvn_tx_complete.count = count;
+
+    return &p_buf->evt;
+}
@@ -0,0 +1,188 @@
+#include "hal_flash.h"
+#include "fake_flash.h"
+
+#include <string.h>
+
+typedef struct
+{
+    bool erase;
+    uint32_t addr;
+    void const *p_src; // Read when the write runs, as the SoftDevice does
+    uint32_t len;      // Bytes to write or pages to erase
+} flash_op_t;
+
+static uint8_t m_flash[FAKE_FLASH_SIZE];
+static bool m_flash_erased;
+
+static uint32_t m_start_addr;
+static uint32_t m_end_addr;
+static hal_flash_done_handler_t m_done_handler;
+
+static flash_op_t m_queue[FAKE_FLASH_QUEUE_SIZE];
+static uint32_t m_queue_head;
+static uint32_t m_queue_tail;
+static uint32_t m_fail_count;
+
+static fake_flash_stats_t m_stats;
+
+void fake_flash_reset(void)
+{
+    memset(m_flash, 0xFF, sizeof(m_flash));
+    m_flash_erased = true;
+    m_queue_head = 0;
+    m_queue_tail = 0;
+    m_fail_count = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+static bool flash_range_valid(uint32_t addr, uint32_t len)
+{
+    return addr >= m_start_addr && len <= m_end_addr + 1 - addr;
+}
+
+static ret_code_t flash_op_queue(flash_op_t const *p_op)
+{
+    if (m_queue_head - m_queue_tail == FAKE_FLASH_QUEUE_SIZE)
+    {
+        m_stats.refused++;
+        return NRF_ERROR_NO_MEM;
+    }
+
+    m_queue[m_queue_head % FAKE_FLASH_QUEUE_SIZE] = *p_op;
+    m_queue_head++;
+
+    if (m_queue_head - m_queue_tail > m_stats.queue_max)
+    {
+        m_stats.queue_max = m_queue_head - m_queue_tail;
+    }
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t hal_flash_init(uint32_t start_addr, uint32_t end_addr, hal_flash_done_handler_t done_handler)
+{
+    if (!m_flash_erased)
+    {
+        fake_flash_reset();
+    }
+    if (start_addr % FAKE_FLASH_PAGE_SIZE != 0 || end_addr >= FAKE_FLASH_SIZE || end_addr < start_addr)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    m_start_addr = start_addr;
+    m_end_addr = end_addr;
+    m_done_handler = done_handler;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t hal_flash_read(uint32_t addr, void *p_dest, uint32_t len)
+{
+    if (addr % sizeof(uint32_t) != 0 || !flash_range_valid(addr, len))
+    {
+        return NRF_ERROR_INVALID_ADDR;
+    }
+    if (len == 0 || len % sizeof(uint32_t) != 0)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    memcpy(p_dest, &m_flash[addr], len);
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t hal_flash_write(uint32_t addr, void const *p_src, uint32_t len)
+{
+    if (addr % sizeof(uint32_t) != 0 || !flash_range_valid(addr, len))
+    {
+        return NRF_ERROR_INVALID_ADDR;
+    }
+    if (len == 0 || len % sizeof(uint32_t) != 0)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    flash_op_t const op = {.erase = false, .addr = addr, .p_src = p_src, .len = len};
+
+    return flash_op_queue(&op);
+}
+
+ret_code_t hal_flash_erase(uint32_t page_addr, uint32_t pages)
+{
+    if (page_addr % FAKE_FLASH_PAGE_SIZE != 0 || !flash_range_valid(page_addr, pages * FAKE_FLASH_PAGE_SIZE))
+    {
+        return NRF_ERROR_INVALID_ADDR;
+    }
+    if (pages == 0)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    flash_op_t const op = {.erase = true, .addr = page_addr, .p_src = NULL, .len = pages};
+
+    return flash_op_queue(&op);
+}
+
+void const *hal_flash_ptr(uint32_t addr)
+{
+    return &m_flash[addr];
+}
+
+uint32_t fake_flash_process(uint32_t count)
+{
+    uint32_t done = 0;
+
+    while (done < count && m_queue_tail != m_queue_head)
+    {
+        flash_op_t const op = m_queue[m_queue_tail % FAKE_FLASH_QUEUE_SIZE];
+        bool success = m_fail_count == 0;
+
+        // The operation leaves the queue before the handler runs, it may queue the next one
+        m_queue_tail++;
+        done++;
+
+        if (!success)
+        {
+            m_fail_count--;
+        }
+        else if (op.erase)
+        {
+            memset(&m_flash[op.addr], 0xFF, op.len * FAKE_FLASH_PAGE_SIZE);
+            m_stats.erases += op.len;
+        }
+        else
+        {
+            uint8_t const *p_src = op.p_src;
+            for (uint32_t i = 0; i < op.len; i++)
+            {
+                m_flash[op.addr + i] &= p_src[i];
+            }
+            m_stats.writes++;
+            m_stats.write_bytes += op.len;
+        }
+
+        if (m_done_handler != NULL)
+        {
+            m_done_handler(op.addr, success);
+        }
+    }
+
+    return done;
+}
+
+uint32_t fake_flash_pending(void)
+{
+    return m_queue_head - m_queue_tail;
+}
+
+void fake_flash_fail_next(uint32_t count)
+{
+    m_fail_count = count;
+}
+
+fake_flash_stats_t const *fake_flash_stats(void)
+{
+    return &m_stats;
+}
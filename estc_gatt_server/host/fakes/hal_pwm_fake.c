@@ -0,0 +1,180 @@
+#include "fake_pwm.h"
+
+#include <string.h>
+#include <assert.h>
+
+typedef enum
+{
+    STREAM_IDLE,    // Duty cycle sequence
+    STREAM_PLAYING, // Playing committed buffers or holding the last step
+    STREAM_ENDED,   // END was raised, waiting for hal_pwm_stream_stop()
+} stream_state_t;
+
+static uint16_t m_top_value;
+static uint16_t m_duty[HAL_PWM_CHANNEL_COUNT];
+static bool m_started;
+static hal_pwm_stream_handler_t m_stream_handler;
+
+static hal_pwm_step_t m_buffers[HAL_PWM_STREAM_BUFFER_COUNT][HAL_PWM_STREAM_BUFFER_STEPS];
+static uint16_t m_buffer_steps[HAL_PWM_STREAM_BUFFER_COUNT];
+// Free running counters, head: committed, tail: played, end_head: head when the end was requested
+static uint32_t m_head;
+static uint32_t m_tail;
+static uint32_t m_end_head;
+static bool m_end_requested;
+static stream_state_t m_stream_state;
+
+static hal_pwm_step_t m_capture[FAKE_PWM_CAPTURE_STEPS];
+static uint32_t m_capture_count;
+static uint32_t m_underruns;
+
+void hal_pwm_init(uint16_t top_value, hal_pwm_stream_handler_t stream_handler)
+{
+    m_top_value = top_value;
+    m_stream_handler = stream_handler;
+    memset(m_duty, 0, sizeof(m_duty));
+    m_started = false;
+    m_head = 0;
+    m_tail = 0;
+    m_end_requested = false;
+    m_stream_state = STREAM_IDLE;
+    m_underruns = 0;
+    fake_pwm_stream_steps_clear();
+}
+
+void hal_pwm_start(void)
+{
+    m_started = true;
+}
+
+void hal_pwm_stop(void)
+{
+    m_started = false;
+}
+
+void hal_pwm_duty_set(uint8_t channel, uint16_t value)
+{
+    assert(channel < HAL_PWM_CHANNEL_COUNT);
+    assert(value <= m_top_value);
+
+    m_duty[channel] = value;
+}
+
+hal_pwm_step_t *hal_pwm_stream_buffer_get(void)
+{
+    if (m_head - m_tail == HAL_PWM_STREAM_BUFFER_COUNT)
+    {
+        return NULL;
+    }
+
+    return m_buffers[m_head % HAL_PWM_STREAM_BUFFER_COUNT];
+}
+
+uint32_t hal_pwm_stream_buffers_free(void)
+{
+    return HAL_PWM_STREAM_BUFFER_COUNT - (m_head - m_tail);
+}
+
+void hal_pwm_stream_buffer_commit(uint16_t steps)
+{
+    assert(steps != 0 && steps <= HAL_PWM_STREAM_BUFFER_STEPS);
+    assert(m_head - m_tail < HAL_PWM_STREAM_BUFFER_COUNT);
+
+    m_buffer_steps[m_head % HAL_PWM_STREAM_BUFFER_COUNT] = steps;
+    m_head++;
+
+    if (m_stream_state == STREAM_IDLE)
+    {
+        m_stream_state = STREAM_PLAYING;
+    }
+}
+
+bool hal_pwm_stream_starving(void)
+{
+    return m_stream_state == STREAM_PLAYING && m_head == m_tail;
+}
+
+void hal_pwm_stream_end(void)
+{
+    m_end_requested = true;
+    m_end_head = m_head;
+}
+
+void hal_pwm_stream_stop(void)
+{
+    assert(m_stream_state == STREAM_ENDED);
+
+    m_end_requested = false;
+    m_stream_state = m_head != m_tail ? STREAM_PLAYING : STREAM_IDLE;
+}
+
+bool fake_pwm_running(void)
+{
+    return m_started || m_stream_state != STREAM_IDLE;
+}
+
+uint16_t fake_pwm_duty(uint8_t channel)
+{
+    return m_duty[channel];
+}
+
+uint32_t fake_pwm_stream_play(uint32_t buffers)
+{
+    uint32_t played = 0;
+
+    while (played < buffers && m_stream_state == STREAM_PLAYING)
+    {
+        if (m_end_requested && m_tail == m_end_head)
+        {
+            m_stream_state = STREAM_ENDED;
+            m_stream_handler(HAL_PWM_STREAM_EVT_END);
+            break;
+        }
+        if (m_tail == m_head)
+        {
+            break;
+        }
+
+        uint32_t index = m_tail % HAL_PWM_STREAM_BUFFER_COUNT;
+        for (uint16_t i = 0; i < m_buffer_steps[index]; i++)
+        {
+            if (m_capture_count < FAKE_PWM_CAPTURE_STEPS)
+            {
+                m_capture[m_capture_count] = m_buffers[index][i];
+            }
+            m_capture_count++;
+        }
+        m_tail++;
+        played++;
+        m_stream_handler(HAL_PWM_STREAM_EVT_BUFFER_DONE);
+
+        if (m_tail == m_head && !(m_end_requested && m_tail == m_end_head))
+        {
+            m_underruns++;
+            m_stream_handler(HAL_PWM_STREAM_EVT_UNDERRUN);
+        }
+    }
+
+    return played;
+}
+
+bool fake_pwm_stream_active(void)
+{
+    return m_stream_state != STREAM_IDLE;
+}
+
+hal_pwm_step_t const *fake_pwm_stream_steps(uint32_t *p_count)
+{
+    *p_count = m_capture_count;
+    return m_capture;
+}
+
+void fake_pwm_stream_steps_clear(void)
+{
+    m_capture_count = 0;
+}
+
+uint32_t fake_pwm_stream_underruns(void)
+{
+    return m_underruns;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "app_error.h"
+#include "nrf_assert.h"
+#include "nrf_log.h"
+#include "ble_advdata.h"
+#include "crc32.h"
+
+// Host replacements of the SDK error, assert and log back ends, the advertising data search and CRC-32
+
+void app_error_handler(ret_code_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+    fprintf(stderr, "APP_ERROR 0x%x at %s:%u\n", error_code, (char const *)p_file_name, line_num);
+    abort();
+}
+
+void assert_nrf_callback(uint16_t line_num, const uint8_t *file_name)
+{
+    fprintf(stderr, "ASSERT at %s:%u\n", (char const *)file_name, line_num);
+    abort();
+}
+
+static bool nrf_log_host_enabled(void)
+{
+    static int enabled = -1;
+
+    if (enabled < 0)
+    {
+        enabled = getenv("ESTC_HOST_LOG") != NULL;
+    }
+    return enabled != 0;
+}
+
+void nrf_log_host(char const *p_level, char const *p_fmt, ...)
+{
+    if (!nrf_log_host_enabled())
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, p_fmt);
+    fprintf(stderr, "<%s> ", p_level);
+    vfprintf(stderr, p_fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+void nrf_log_host_hexdump(uint8_t const *p_data, uint32_t len)
+{
+    if (!nrf_log_host_enabled())
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        fprintf(stderr, "%02x%c", p_data[i], (i % 16 == 15 || i + 1 == len) ? '\n' : ' ');
+    }
+}
+
+uint16_t ble_advdata_search(uint8_t const *p_encoded_data, uint16_t data_len, uint16_t *p_offset, uint8_t ad_type)
+{
+    uint32_t i = 0;
+
+    // Same walk as the SDK, an AD structure is length (1), type (1) and length - 1 bytes of data
+    while (i + 1 < data_len && (i < *p_offset || p_encoded_data[i + 1] != ad_type))
+    {
+        i += p_encoded_data[i] + 1;
+    }
+    if (i + 1 >= data_len)
+    {
+        return 0;
+    }
+
+    uint32_t offset = i + 2;
+    uint32_t len = p_encoded_data[i] ? p_encoded_data[i] - 1 : 0;
+    if (len == 0 || offset + len > data_len)
+    {
+        return 0;
+    }
+
+    *p_offset = (uint16_t)offset;
+    return (uint16_t)len;
+}
+
+uint32_t crc32_compute(uint8_t const *p_data, uint32_t size, uint32_t const *p_crc)
+{
+    uint32_t crc = (p_crc == NULL) ? 0xFFFFFFFF : ~(*p_crc);
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc ^= p_data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,20 @@
+#include <openssl/evp.h>
+
+#include "nrf_soc.h"
+#include "sdk_errors.h"
+
+// Host replacement of the SoftDevice AES ECB block encryption
+
+uint32_t sd_ecb_block_encrypt(nrf_ecb_hal_data_t *p_ecb_data)
+{
+    EVP_CIPHER_CTX *p_ctx = EVP_CIPHER_CTX_new();
+    int len = 0;
+    int ok = p_ctx != NULL &&
+             EVP_EncryptInit_ex(p_ctx, EVP_aes_128_ecb(), NULL, p_ecb_data->key, NULL) &&
+             EVP_CIPHER_CTX_set_padding(p_ctx, 0) &&
+             EVP_EncryptUpdate(p_ctx, p_ecb_data->ciphertext, &len, p_ecb_data->cleartext, SOC_ECB_CLEARTEXT_LENGTH) &&
+             len == SOC_ECB_CIPHERTEXT_LENGTH;
+
+    EVP_CIPHER_CTX_free(p_ctx);
+    return ok ? NRF_SUCCESS : NRF_ERROR_INTERNAL;
+}
@@ -0,0 +1,282 @@
+/**
+ * @brief Stand-alone driver of a libFuzzer target, for compilers without -fsanitize=fuzzer
+ *
+ * @details Runs every corpus input, then random mutations of them, and prints the execution rate.
+ *          Mutations are not coverage guided, the corpus carries the structure. The input that
+ *          crashed is saved as crash-<run> in the working directory.
+ *
+ *              fuzz_write [-runs=N] [-seed=N] [-max_len=N] <corpus file or directory>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define CORPUS_MAX 1024
+#define MAX_LEN_DEFAULT 512
+
+int LLVMFuzzerTestOneInput(uint8_t const *p_data, size_t size);
+
+// Set when linked with a sanitizer runtime
+void __sanitizer_set_death_callback(void (*callback)(void)) __attribute__((weak));
+
+typedef struct
+{
+    uint8_t *p_data;
+    size_t size;
+} fuzz_input_t;
+
+static fuzz_input_t m_corpus[CORPUS_MAX];
+static uint32_t m_corpus_count;
+
+static uint8_t const *m_current;
+static size_t m_current_size;
+static uint64_t m_run;
+
+static uint64_t m_rand_state;
+
+static uint32_t rand_next(void)
+{
+    // xorshift64*
+    m_rand_state ^= m_rand_state >> 12;
+    m_rand_state ^= m_rand_state << 25;
+    m_rand_state ^= m_rand_state >> 27;
+    return (uint32_t)((m_rand_state * 2685821657736338717ull) >> 32);
+}
+
+static void crash_save(void)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "crash-%llu", (unsigned long long)m_run);
+
+    FILE *p_file = fopen(name, "wb");
+    if (p_file != NULL)
+    {
+        fwrite(m_current, 1, m_current_size, p_file);
+        fclose(p_file);
+        fprintf(stderr, "input saved as %s\n", name);
+    }
+}
+
+static void abort_handler(int signal)
+{
+    crash_save();
+    _Exit(EXIT_FAILURE);
+}
+
+static void corpus_file_add(char const *p_path)
+{
+    FILE *p_file = fopen(p_path, "rb");
+
+    if (p_file == NULL || m_corpus_count == CORPUS_MAX)
+    {
+        fprintf(stderr, "skipped %s\n", p_path);
+        if (p_file != NULL)
+        {
+            fclose(p_file);
+        }
+        return;
+    }
+
+    fseek(p_file, 0, SEEK_END);
+    long size = ftell(p_file);
+    fseek(p_file, 0, SEEK_SET);
+
+    fuzz_input_t *p_input = &m_corpus[m_corpus_count++];
+    p_input->size = size > 0 ? (size_t)size : 0;
+    p_input->p_data = malloc(p_input->size + 1);
+    p_input->size = fread(p_input->p_data, 1, p_input->size, p_file);
+    fclose(p_file);
+}
+
+static void corpus_add(char const *p_path)
+{
+    struct stat info;
+
+    if (stat(p_path, &info) != 0 || !S_ISDIR(info.st_mode))
+    {
+        corpus_file_add(p_path);
+        return;
+    }
+
+    DIR *p_dir = opendir(p_path);
+    struct dirent *p_entry;
+
+    while (p_dir != NULL && (p_entry = readdir(p_dir)) != NULL)
+    {
+        if (p_entry->d_name[0] != '.')
+        {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", p_path, p_entry->d_name);
+            corpus_file_add(path);
+        }
+    }
+    if (p_dir != NULL)
+    {
+        closedir(p_dir);
+    }
+}
+
+static void run_one(uint8_t const *p_data, size_t size)
+{
+    // A copy of exactly the input size, so reads past the end are reported
+    uint8_t *p_copy = malloc(size != 0 ? size : 1);
+
+    memcpy(p_copy, p_data, size);
+    m_current = p_copy;
+    m_current_size = size;
+
+    LLVMFuzzerTestOneInput(p_copy, size);
+
+    free(p_copy);
+    m_run++;
+}
+
+static size_t mutate(uint8_t *p_buf, size_t size, size_t max_len)
+{
+    static const uint8_t interesting[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+                                          0x10, 0x20, 0x40, 0x7F, 0x80, 0xFE, 0xFF};
+    uint32_t mutations = 1 + rand_next() % 4;
+
+    for (uint32_t i = 0; i < mutations; i++)
+    {
+        uint32_t pos = size != 0 ? rand_next() % size : 0;
+
+        switch (rand_next() % 6)
+        {
+        case 0:
+            if (size != 0)
+            {
+                p_buf[pos] ^= (uint8_t)(1u << (rand_next() % 8));
+            }
+            break;
+        case 1:
+            if (size != 0)
+            {
+                p_buf[pos] = interesting[rand_next() % sizeof(interesting)];
+            }
+            break;
+        case 2:
+            if (size < max_len)
+            {
+                memmove(&p_buf[pos + 1], &p_buf[pos], size - pos);
+                p_buf[pos] = (uint8_t)rand_next();
+                size++;
+            }
+            break;
+        case 3:
+            if (size != 0)
+            {
+                memmove(&p_buf[pos], &p_buf[pos + 1], size - pos - 1);
+                size--;
+            }
+            break;
+        case 4:
+        {
+            // Splice in a piece of another input
+            fuzz_input_t const *p_other = &m_corpus[rand_next() % m_corpus_count];
+            if (p_other->size != 0)
+            {
+                size_t from = rand_next() % p_other->size;
+                size_t len = 1 + rand_next() % (p_other->size - from);
+                if (len > max_len - pos)
+                {
+                    len = max_len - pos;
+                }
+                memcpy(&p_buf[pos], &p_other->p_data[from], len);
+                if (pos + len > size)
+                {
+                    size = pos + len;
+                }
+            }
+            break;
+        }
+        default:
+            if (size != 0)
+            {
+                p_buf[pos] = (uint8_t)rand_next();
+            }
+            break;
+        }
+    }
+
+    return size;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t runs = 100000;
+    uint64_t seed = 1;
+    size_t max_len = MAX_LEN_DEFAULT;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "-runs=", 6) == 0)
+        {
+            runs = strtoull(argv[i] + 6, NULL, 0);
+        }
+        else if (strncmp(argv[i], "-seed=", 6) == 0)
+        {
+            seed = strtoull(argv[i] + 6, NULL, 0);
+        }
+        else if (strncmp(argv[i], "-max_len=", 9) == 0)
+        {
+            max_len = strtoull(argv[i] + 9, NULL, 0);
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            corpus_add(argv[i]);
+        }
+    }
+
+    if (m_corpus_count == 0)
+    {
+        fprintf(stderr, "usage: %s [-runs=N] [-seed=N] [-max_len=N] <corpus>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    m_rand_state = seed != 0 ? seed : 1;
+    signal(SIGABRT, abort_handler);
+    if (__sanitizer_set_death_callback != NULL)
+    {
+        __sanitizer_set_death_callback(crash_save);
+    }
+
+    for (uint32_t i = 0; i < m_corpus_count; i++)
+    {
+        run_one(m_corpus[i].p_data, m_corpus[i].size);
+    }
+    printf("corpus: %u inputs\n", m_corpus_count);
+
+    uint8_t *p_buf = malloc(max_len);
+    struct timespec start;
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t i = 0; i < runs; i++)
+    {
+        fuzz_input_t const *p_input = &m_corpus[rand_next() % m_corpus_count];
+        size_t size = p_input->size < max_len ? p_input->size : max_len;
+
+        memcpy(p_buf, p_input->p_data, size);
+        size = mutate(p_buf, size, max_len);
+        run_one(p_buf, size);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("runs: %llu\n", (unsigned long long)runs);
+    printf("execs per second: %.0f\n", seconds > 0 ? runs / seconds : 0.0);
+
+    free(p_buf);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/**
+ * @brief Fuzz target of the GATT write path
+ *
+ * @details The input is a sequence of records, each starting with a selector byte:
+ *
+ *              bits 0-3  target: a characteristic id for its value, ESTC_CHAR_COUNT to 14 for the
+ *                        CCCD of characteristic (target - ESTC_CHAR_COUNT), 15 for the raw handle
+ *                        service handle + next byte
+ *              bit 4     write without response instead of write request
+ *              bits 5-6  0: write, then a length byte and the value, cut at the end of the input
+ *                        1: notification transmit complete
+ *                        2: one main loop pass with a flash operation and a played stream buffer
+ *                        3: disconnect and reconnect
+ *              bit 7     connection handle
+ *
+ *          After the records the main loop runs until the queued work is done, so state carried
+ *          into the next input is what a real session would carry between writes.
+ *          Built with clang -fsanitize=fuzzer this is a libFuzzer target, otherwise fuzz_main.c
+ *          drives it.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "estc_service.h"
+#include "estc_command.h"
+#include "pwm_control.h"
+#include "flash_storage.h"
+#include "app_scheduler.h"
+#include "fake_ble.h"
+#include "fake_flash.h"
+#include "fake_pwm.h"
+
+#define SCHED_QUEUE_SIZE 8 // As in main.c
+
+#define FUZZ_TARGET_RAW 15
+#define FUZZ_KIND_WRITE 0
+#define FUZZ_KIND_TX_COMPLETE 1
+#define FUZZ_KIND_MAIN_LOOP 2
+#define FUZZ_KIND_RECONNECT 3
+#define FUZZ_DRAIN_PASSES 256
+
+static ble_estc_service_t m_service;
+static bool m_initialized;
+
+static void batch_write_handler(uint16_t conn_handle, ble_estc_service_t *p_lbs, estc_cmd_batch_t const *p_batch)
+{
+    // Persist like the application does, so the flash path is part of the target
+    flash_storage_update_values(p_batch->flags & ESTC_CMD_FLAG_STATE, p_batch->state,
+                                p_batch->flags & ESTC_CMD_FLAG_COLOR,
+                                p_batch->color.red, p_batch->color.green, p_batch->color.blue);
+}
+
+static void fuzz_init(void)
+{
+    APP_SCHED_INIT(ESTC_SCHED_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+    pwm_controller_init();
+    pwm_start_playback();
+    fake_flash_reset();
+    flash_storage_init();
+
+    ble_lbs_init_t init = {.batch_write_handler = batch_write_handler};
+    if (estc_ble_service_init(&m_service, &init) != NRF_SUCCESS)
+    {
+        abort();
+    }
+    fake_flash_process(UINT32_MAX);
+}
+
+static void tx_complete(uint16_t conn_handle)
+{
+    uint8_t count = fake_ble_tx_complete(conn_handle);
+
+    if (count != 0)
+    {
+        fake_ble_evt_buf_t buf;
+        ble_lbs_on_ble_evt(fake_ble_tx_complete_evt(&buf, conn_handle, count), &m_service);
+    }
+}
+
+static void main_loop_run(void)
+{
+    pwm_process();
+    app_sched_execute();
+    fake_flash_process(1);
+    fake_pwm_stream_play(1);
+}
+
+static uint16_t write_handle(uint8_t target, uint8_t const **pp_data, size_t *p_size)
+{
+    if (target < ESTC_CHAR_COUNT)
+    {
+        return m_service.char_handles[target].value_handle;
+    }
+    if (target != FUZZ_TARGET_RAW)
+    {
+        return m_service.char_handles[(target - ESTC_CHAR_COUNT) % ESTC_CHAR_COUNT].cccd_handle;
+    }
+    if (*p_size == 0)
+    {
+        return m_service.service_handle;
+    }
+
+    uint16_t handle = m_service.service_handle + **pp_data;
+    (*pp_data)++;
+    (*p_size)--;
+
+    return handle;
+}
+
+int LLVMFuzzerTestOneInput(uint8_t const *p_data, size_t size)
+{
+    fake_ble_evt_buf_t buf;
+
+    if (!m_initialized)
+    {
+        fuzz_init();
+        m_initialized = true;
+    }
+
+    while (size != 0)
+    {
+        uint8_t selector = *p_data++;
+        size--;
+
+        uint16_t conn_handle = selector >> 7;
+
+        switch ((selector >> 5) & 0x03)
+        {
+        case FUZZ_KIND_WRITE:
+        {
+            uint16_t handle = write_handle(selector & 0x0F, &p_data, &size);
+            uint8_t op = selector & 0x10 ? BLE_GATTS_OP_WRITE_CMD : BLE_GATTS_OP_WRITE_REQ;
+            size_t len = size != 0 ? *p_data++ : 0;
+
+            size -= size != 0;
+            if (len > size)
+            {
+                len = size;
+            }
+            // The fake event holds at most an MTU of value, as the SoftDevice does
+            if (len > NRF_SDH_BLE_GATT_MAX_MTU_SIZE)
+            {
+                len = NRF_SDH_BLE_GATT_MAX_MTU_SIZE;
+            }
+
+            ble_lbs_on_ble_evt(fake_ble_write_evt(&buf, conn_handle, handle, op, p_data, (uint16_t)len), &m_service);
+            p_data += len;
+            size -= len;
+            break;
+        }
+
+        case FUZZ_KIND_TX_COMPLETE:
+            tx_complete(conn_handle);
+            break;
+
+        case FUZZ_KIND_MAIN_LOOP:
+            main_loop_run();
+            break;
+
+        default:
+            fake_ble_tx_complete(conn_handle);
+            ble_lbs_on_ble_evt(fake_ble_gap_evt(&buf, BLE_GAP_EVT_DISCONNECTED, conn_handle), &m_service);
+            ble_lbs_on_ble_evt(fake_ble_gap_evt(&buf, BLE_GAP_EVT_CONNECTED, conn_handle), &m_service);
+            break;
+        }
+    }
+
+    // Finish the work the input queued, streams are cut off after a bounded number of buffers
+    for (uint32_t i = 0; i < FUZZ_DRAIN_PASSES; i++)
+    {
+        tx_complete(0);
+        tx_complete(1);
+        main_loop_run();
+        if (fake_flash_pending() == 0 && !fake_pwm_stream_active() && app_sched_queue_space_get() == SCHED_QUEUE_SIZE)
+        {
+            break;
+        }
+    }
+    fake_ble_notifications_clear();
+
+    return 0;
+}
@@ -0,0 +1,629 @@
+/**
+ * @brief SoftDevice event replay on the host
+ *
+ * @details Feeds a trace of BLE events through ble_lbs_on_ble_evt() and the main loop in virtual
+ *          time, with the HAL fakes standing in for the SoftDevice, PWM and flash. Connections and
+ *          write batches go through ble_links.c as in the firmware, which notifies the subscribed
+ *          links and persists the light state. At the end the session figures are printed as
+ *          "name: value" lines, so the reports of two firmware versions can be diffed.
+ *
+ *          Trace lines, times in milliseconds from the start of the session:
+ *
+ *              <time> connect <conn> [<connection interval>]
+ *              <time> disconnect <conn>
+ *              <time> write <conn> <characteristic>[.cccd] <req|cmd> <hex value>
+ *              <time> tx_complete <conn>
+ *              <time> repeat <count> <period> <any of the above>
+ *
+ *          Characteristics are named state, value, command, stream, anim and program. Events with
+ *          the same time arrive back to back, as in one connection event, before the main loop runs.
+ *          A link connected with an interval completes its queued notifications once per interval,
+ *          otherwise only with tx_complete lines.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "estc_service.h"
+#include "ble_links.h"
+#include "conn_activity.h"
+#include "estc_command.h"
+#include "pwm_control.h"
+#include "flash_storage.h"
+#include "app_scheduler.h"
+#include "fake_ble.h"
+#include "fake_flash.h"
+#include "fake_pwm.h"
+#include "fake_timer.h"
+
+#define SCHED_QUEUE_SIZE 8 // As in main.c
+
+// Flash operation durations of the nRF52840, a word write rounded up to the millisecond
+#define FLASH_WRITE_MS 1
+#define FLASH_ERASE_MS 85
+#define STREAM_BUFFER_MS (HAL_PWM_STREAM_BUFFER_STEPS * HAL_PWM_STREAM_STEP_US / 1000)
+
+#define LINE_LEN_MAX 1024
+
+typedef enum
+{
+    REPLAY_CONNECT,
+    REPLAY_DISCONNECT,
+    REPLAY_WRITE,
+    REPLAY_TX_COMPLETE,
+    REPLAY_EVT_TYPE_COUNT
+} replay_evt_type_t;
+
+static char const * const m_evt_type_names[REPLAY_EVT_TYPE_COUNT] = {
+    [REPLAY_CONNECT] = "connect",
+    [REPLAY_DISCONNECT] = "disconnect",
+    [REPLAY_WRITE] = "write",
+    [REPLAY_TX_COMPLETE] = "tx_complete",
+};
+
+typedef struct
+{
+    uint32_t time_ms;
+    uint32_t order; // Trace order of events with the same time
+    replay_evt_type_t type;
+    uint16_t conn_handle;
+    uint32_t interval_ms;
+    estc_char_id_t char_id;
+    bool cccd;
+    uint8_t op;
+    uint8_t *p_data;
+    uint16_t len;
+} replay_evt_t;
+
+typedef struct
+{
+    bool connected;
+    uint32_t interval_ms;
+    uint32_t next_tx_ms;
+} replay_link_t;
+
+static const struct
+{
+    char const *name;
+    estc_char_id_t id;
+} m_char_names[] = {
+    {"state", ESTC_CHAR_RGB_STATE},
+    {"value", ESTC_CHAR_RGB_VALUE},
+    {"command", ESTC_CHAR_COMMAND},
+    {"stream", ESTC_CHAR_STREAM},
+    {"anim", ESTC_CHAR_ANIM},
+    {"program", ESTC_CHAR_PROGRAM},
+};
+
+static ble_estc_service_t m_service;
+static replay_link_t m_links[FAKE_BLE_CONN_COUNT];
+
+static replay_evt_t *m_events;
+static uint32_t m_event_count;
+static uint32_t m_event_capacity;
+
+static uint32_t m_now_ms;
+static uint32_t m_flash_ready_ms;
+static uint32_t m_stream_next_ms;
+
+static uint32_t m_evt_type_counts[REPLAY_EVT_TYPE_COUNT];
+static uint32_t m_batches;
+static uint32_t m_render_ring_max;
+static uint32_t m_stream_buffers;
+static fake_flash_stats_t m_flash_base; // Flash statistics before the session
+
+// Counts the batches and hands them to the firmware handler
+static void batch_write_handler(uint16_t conn_handle, ble_estc_service_t *p_lbs, estc_cmd_batch_t const *p_batch)
+{
+    m_batches++;
+    ble_links_batch_handler(conn_handle, p_lbs, p_batch);
+}
+
+static void trace_error(char const *p_file, uint32_t line, char const *p_msg)
+{
+    fprintf(stderr, "%s:%u: %s\n", p_file, line, p_msg);
+    exit(EXIT_FAILURE);
+}
+
+static replay_evt_t *event_add(void)
+{
+    if (m_event_count == m_event_capacity)
+    {
+        m_event_capacity = m_event_capacity != 0 ? m_event_capacity * 2 : 1024;
+        m_events = realloc(m_events, m_event_capacity * sizeof(*m_events));
+        if (m_events == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    replay_evt_t *p_evt = &m_events[m_event_count];
+    memset(p_evt, 0, sizeof(*p_evt));
+    p_evt->order = m_event_count++;
+
+    return p_evt;
+}
+
+static bool conn_parse(char const *p_token, uint16_t *p_conn_handle)
+{
+    char *p_end;
+    unsigned long value = p_token != NULL ? strtoul(p_token, &p_end, 0) : 0;
+
+    if (p_token == NULL || *p_end != '\0' || value >= FAKE_BLE_CONN_COUNT)
+    {
+        return false;
+    }
+    *p_conn_handle = (uint16_t)value;
+
+    return true;
+}
+
+static bool char_parse(char *p_token, replay_evt_t *p_evt)
+{
+    if (p_token == NULL)
+    {
+        return false;
+    }
+
+    char *p_suffix = strchr(p_token, '.');
+    if (p_suffix != NULL)
+    {
+        if (strcmp(p_suffix, ".cccd") != 0)
+        {
+            return false;
+        }
+        *p_suffix = '\0';
+        p_evt->cccd = true;
+    }
+
+    for (size_t i = 0; i < sizeof(m_char_names) / sizeof(m_char_names[0]); i++)
+    {
+        if (strcmp(p_token, m_char_names[i].name) == 0)
+        {
+            p_evt->char_id = m_char_names[i].id;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool hex_parse(char const *p_token, replay_evt_t *p_evt)
+{
+    size_t digits = p_token != NULL ? strlen(p_token) : 0;
+
+    if (digits == 0 || digits % 2 != 0 || digits / 2 > CHARACTERISTIC_STREAM_SIZE)
+    {
+        return false;
+    }
+
+    p_evt->len = (uint16_t)(digits / 2);
+    p_evt->p_data = malloc(p_evt->len);
+    for (uint16_t i = 0; i < p_evt->len; i++)
+    {
+        char byte[3] = {p_token[2 * i], p_token[2 * i + 1], '\0'};
+        char *p_end;
+
+        p_evt->p_data[i] = (uint8_t)strtoul(byte, &p_end, 16);
+        if (*p_end != '\0')
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Parse the event of a trace line
+ * @param p_type Event name token
+ * @param p_save strtok_r() state after the event name
+ * @return Error message, NULL if the event is valid
+ */
+static char const *event_parse(char *p_type, char *p_save, replay_evt_t *p_evt)
+{
+    if (p_type == NULL)
+    {
+        return "missing event";
+    }
+
+    if (strcmp(p_type, "connect") == 0)
+    {
+        p_evt->type = REPLAY_CONNECT;
+        if (!conn_parse(strtok_r(NULL, " \t", &p_save), &p_evt->conn_handle))
+        {
+            return "bad connection handle";
+        }
+        char *p_interval = strtok_r(NULL, " \t", &p_save);
+        p_evt->interval_ms = p_interval != NULL ? (uint32_t)strtoul(p_interval, NULL, 0) : 0;
+    }
+    else if (strcmp(p_type, "disconnect") == 0 || strcmp(p_type, "tx_complete") == 0)
+    {
+        p_evt->type = p_type[0] == 'd' ? REPLAY_DISCONNECT : REPLAY_TX_COMPLETE;
+        if (!conn_parse(strtok_r(NULL, " \t", &p_save), &p_evt->conn_handle))
+        {
+            return "bad connection handle";
+        }
+    }
+    else if (strcmp(p_type, "write") == 0)
+    {
+        p_evt->type = REPLAY_WRITE;
+        if (!conn_parse(strtok_r(NULL, " \t", &p_save), &p_evt->conn_handle))
+        {
+            return "bad connection handle";
+        }
+        if (!char_parse(strtok_r(NULL, " \t", &p_save), p_evt))
+        {
+            return "unknown characteristic";
+        }
+
+        char *p_op = strtok_r(NULL, " \t", &p_save);
+        if (p_op != NULL && strcmp(p_op, "req") == 0)
+        {
+            p_evt->op = BLE_GATTS_OP_WRITE_REQ;
+        }
+        else if (p_op != NULL && strcmp(p_op, "cmd") == 0)
+        {
+            p_evt->op = BLE_GATTS_OP_WRITE_CMD;
+        }
+        else
+        {
+            return "write op must be req or cmd";
+        }
+
+        if (!hex_parse(strtok_r(NULL, " \t", &p_save), p_evt))
+        {
+            return "bad hex value";
+        }
+    }
+    else
+    {
+        return "unknown event";
+    }
+
+    return NULL;
+}
+
+static void trace_load(char const *p_file)
+{
+    FILE *p_trace = fopen(p_file, "r");
+    char line[LINE_LEN_MAX];
+    uint32_t line_no = 0;
+
+    if (p_trace == NULL)
+    {
+        perror(p_file);
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(line, sizeof(line), p_trace) != NULL)
+    {
+        line_no++;
+
+        char *p_comment = strchr(line, '#');
+        if (p_comment != NULL)
+        {
+            *p_comment = '\0';
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *p_save;
+        char *p_time = strtok_r(line, " \t", &p_save);
+        if (p_time == NULL)
+        {
+            continue;
+        }
+
+        char *p_end;
+        uint32_t time_ms = (uint32_t)strtoul(p_time, &p_end, 0);
+        if (*p_end != '\0')
+        {
+            trace_error(p_file, line_no, "bad time");
+        }
+
+        uint32_t count = 1;
+        uint32_t period_ms = 0;
+        char *p_type = strtok_r(NULL, " \t", &p_save);
+        if (p_type != NULL && strcmp(p_type, "repeat") == 0)
+        {
+            char *p_count = strtok_r(NULL, " \t", &p_save);
+            char *p_period = strtok_r(NULL, " \t", &p_save);
+            if (p_count == NULL || p_period == NULL)
+            {
+                trace_error(p_file, line_no, "repeat needs a count and a period");
+            }
+            count = (uint32_t)strtoul(p_count, NULL, 0);
+            period_ms = (uint32_t)strtoul(p_period, NULL, 0);
+            p_type = strtok_r(NULL, " \t", &p_save);
+        }
+
+        replay_evt_t template = {0};
+        char const *p_error = event_parse(p_type, p_save, &template);
+        if (p_error != NULL)
+        {
+            trace_error(p_file, line_no, p_error);
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            replay_evt_t *p_evt = event_add();
+            uint32_t order = p_evt->order;
+
+            *p_evt = template;
+            p_evt->order = order;
+            p_evt->time_ms = time_ms + i * period_ms;
+            // Every event owns its value
+            if (template.len != 0)
+            {
+                p_evt->p_data = malloc(template.len);
+                memcpy(p_evt->p_data, template.p_data, template.len);
+            }
+        }
+        free(template.p_data);
+    }
+
+    fclose(p_trace);
+}
+
+static int event_compare(void const *p_a, void const *p_b)
+{
+    replay_evt_t const *p_evt_a = p_a;
+    replay_evt_t const *p_evt_b = p_b;
+
+    if (p_evt_a->time_ms != p_evt_b->time_ms)
+    {
+        return p_evt_a->time_ms < p_evt_b->time_ms ? -1 : 1;
+    }
+    return p_evt_a->order < p_evt_b->order ? -1 : (p_evt_a->order > p_evt_b->order);
+}
+
+static void sample_depths(void)
+{
+    uint32_t depth = pwm_command_pending();
+
+    if (depth > m_render_ring_max)
+    {
+        m_render_ring_max = depth;
+    }
+}
+
+// One main loop pass, as in main.c
+static void main_loop_run(void)
+{
+    pwm_process();
+    app_sched_execute();
+}
+
+static void tx_complete(uint16_t conn_handle)
+{
+    uint8_t count = fake_ble_tx_complete(conn_handle);
+
+    if (count != 0)
+    {
+        fake_ble_evt_buf_t buf;
+        ble_lbs_on_ble_evt(fake_ble_tx_complete_evt(&buf, conn_handle, count), &m_service);
+    }
+}
+
+/**
+ * @brief Run what is due at the current time: flash operations, stream buffers and connection events
+ */
+static void background_run(void)
+{
+    if (fake_flash_pending() != 0 && m_now_ms >= m_flash_ready_ms)
+    {
+        uint32_t erases = fake_flash_stats()->erases;
+
+        fake_flash_process(1);
+        m_flash_ready_ms = m_now_ms + (fake_flash_stats()->erases != erases ? FLASH_ERASE_MS : FLASH_WRITE_MS);
+    }
+
+    if (fake_pwm_stream_active() && m_now_ms >= m_stream_next_ms)
+    {
+        m_stream_buffers += fake_pwm_stream_play(1);
+        m_stream_next_ms = m_now_ms + STREAM_BUFFER_MS;
+    }
+
+    for (uint16_t conn_handle = 0; conn_handle < FAKE_BLE_CONN_COUNT; conn_handle++)
+    {
+        replay_link_t *p_link = &m_links[conn_handle];
+
+        if (p_link->connected && p_link->interval_ms != 0 && m_now_ms >= p_link->next_tx_ms)
+        {
+            tx_complete(conn_handle);
+            p_link->next_tx_ms = m_now_ms + p_link->interval_ms;
+        }
+    }
+
+    main_loop_run();
+}
+
+static uint32_t next_due_ms(uint32_t limit_ms)
+{
+    uint32_t next = limit_ms;
+
+    if (fake_flash_pending() != 0 && m_flash_ready_ms < next)
+    {
+        next = m_flash_ready_ms;
+    }
+    if (fake_pwm_stream_active() && m_stream_next_ms < next)
+    {
+        next = m_stream_next_ms;
+    }
+    for (uint16_t conn_handle = 0; conn_handle < FAKE_BLE_CONN_COUNT; conn_handle++)
+    {
+        replay_link_t const *p_link = &m_links[conn_handle];
+        if (p_link->connected && p_link->interval_ms != 0 && p_link->next_tx_ms < next)
+        {
+            next = p_link->next_tx_ms;
+        }
+    }
+
+    return next > m_now_ms ? next : m_now_ms + 1;
+}
+
+static void time_advance(uint32_t time_ms)
+{
+    while (m_now_ms < time_ms)
+    {
+        uint32_t next = next_due_ms(time_ms);
+
+        if (next > time_ms)
+        {
+            next = time_ms;
+        }
+        fake_timer_advance(next - m_now_ms);
+        m_now_ms = next;
+        background_run();
+    }
+}
+
+static void event_deliver(replay_evt_t const *p_evt)
+{
+    fake_ble_evt_buf_t buf;
+    replay_link_t *p_link = &m_links[p_evt->conn_handle];
+    // One central per connection handle
+    ble_gap_addr_t const peer_addr = {.addr = {(uint8_t)p_evt->conn_handle}};
+
+    m_evt_type_counts[p_evt->type]++;
+
+    switch (p_evt->type)
+    {
+    case REPLAY_CONNECT:
+        memset(p_link, 0, sizeof(*p_link));
+        p_link->connected = true;
+        p_link->interval_ms = p_evt->interval_ms;
+        p_link->next_tx_ms = m_now_ms + p_evt->interval_ms;
+        ble_lbs_on_ble_evt(fake_ble_gap_evt(&buf, BLE_GAP_EVT_CONNECTED, p_evt->conn_handle), &m_service);
+        ble_links_connected(p_evt->conn_handle, &peer_addr);
+        break;
+
+    case REPLAY_DISCONNECT:
+        // Queued notifications are dropped with the link
+        fake_ble_tx_complete(p_evt->conn_handle);
+        p_link->connected = false;
+        ble_lbs_on_ble_evt(fake_ble_gap_evt(&buf, BLE_GAP_EVT_DISCONNECTED, p_evt->conn_handle), &m_service);
+        ble_links_disconnected(p_evt->conn_handle);
+        break;
+
+    case REPLAY_WRITE:
+    {
+        ble_gatts_char_handles_t const *p_handles = &m_service.char_handles[p_evt->char_id];
+        uint16_t handle = p_evt->cccd ? p_handles->cccd_handle : p_handles->value_handle;
+        ble_lbs_on_ble_evt(fake_ble_write_evt(&buf, p_evt->conn_handle, handle, p_evt->op, p_evt->p_data, p_evt->len),
+                           &m_service);
+        break;
+    }
+
+    case REPLAY_TX_COMPLETE:
+        tx_complete(p_evt->conn_handle);
+        break;
+
+    default:
+        break;
+    }
+
+    sample_depths();
+}
+
+static double seconds_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void report(char const *p_trace, double wall_s)
+{
+    fake_flash_stats_t const *p_flash = fake_flash_stats();
+    uint32_t flash_writes = p_flash->writes - m_flash_base.writes;
+    uint32_t flash_write_bytes = p_flash->write_bytes - m_flash_base.write_bytes;
+    uint32_t flash_erases = p_flash->erases - m_flash_base.erases;
+
+    printf("trace: %s\n", p_trace);
+    for (uint8_t type = 0; type < REPLAY_EVT_TYPE_COUNT; type++)
+    {
+        printf("events %s: %u\n", m_evt_type_names[type], m_evt_type_counts[type]);
+    }
+    printf("events: %u\n", m_event_count);
+    printf("virtual time ms: %u\n", m_now_ms);
+    printf("events per virtual second: %.1f\n", m_now_ms != 0 ? m_event_count * 1000.0 / m_now_ms : 0.0);
+    printf("host events per second: %.0f\n", wall_s > 0 ? m_event_count / wall_s : 0.0);
+    printf("batches: %u\n", m_batches);
+    printf("max scheduler queue depth: %u\n", app_sched_queue_utilization_get());
+    printf("max render ring depth: %u\n", m_render_ring_max);
+    printf("flash writes: %u\n", flash_writes);
+    printf("flash write bytes: %u\n", flash_write_bytes);
+    printf("flash erases: %u\n", flash_erases);
+    printf("max flash queue depth: %u\n", p_flash->queue_max);
+    printf("flash operations refused: %u\n", p_flash->refused - m_flash_base.refused);
+    printf("notifications sent: %u\n", fake_ble_notification_count());
+    printf("notifications refused: %u\n", fake_ble_notification_refused());
+    printf("stream buffers played: %u\n", m_stream_buffers);
+    printf("stream underruns: %u\n", fake_pwm_stream_underruns());
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <trace>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    trace_load(argv[1]);
+    qsort(m_events, m_event_count, sizeof(*m_events), event_compare);
+
+    APP_SCHED_INIT(ESTC_SCHED_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+    pwm_controller_init();
+    pwm_start_playback();
+    fake_flash_reset();
+    flash_storage_init();
+
+    // The parameter requests only reach the fake, the session does not depend on their values
+    static ble_gap_conn_params_t const conn_params = {6, 6, 0, 400};
+    conn_activity_init(&conn_params, &conn_params);
+    ble_links_init(NULL);
+
+    ble_lbs_init_t init = {.batch_write_handler = batch_write_handler};
+    if (estc_ble_service_init(&m_service, &init) != NRF_SUCCESS)
+    {
+        fprintf(stderr, "service init failed\n");
+        return EXIT_FAILURE;
+    }
+    // The restore is not part of the session
+    fake_flash_process(UINT32_MAX);
+    m_flash_base = *fake_flash_stats();
+
+    double start = seconds_now();
+
+    for (uint32_t i = 0; i < m_event_count; i++)
+    {
+        time_advance(m_events[i].time_ms);
+        event_deliver(&m_events[i]);
+
+        // The main loop runs once the events of a connection event were delivered
+        if (i + 1 == m_event_count || m_events[i + 1].time_ms != m_events[i].time_ms)
+        {
+            main_loop_run();
+        }
+    }
+
+    // Let queued flash operations and streams finish
+    while (fake_flash_pending() != 0 || fake_pwm_stream_active())
+    {
+        time_advance(next_due_ms(UINT32_MAX));
+    }
+
+    report(argv[1], seconds_now() - start);
+
+    for (uint32_t i = 0; i < m_event_count; i++)
+    {
+        free(m_events[i].p_data);
+    }
+    free(m_events);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,34 @@
+#ifndef APP_ERROR_H__
+#define APP_ERROR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+
+// Host stand-in for the nRF5 SDK app_error.h, app_error_handler() aborts the test
+
+void app_error_handler(ret_code_t error_code, uint32_t line_num, const uint8_t *p_file_name);
+
+#define APP_ERROR_HANDLER(ERR_CODE) app_error_handler((ERR_CODE), __LINE__, (uint8_t const *)__FILE__)
+
+#define APP_ERROR_CHECK(ERR_CODE)                     \
+    do                                                \
+    {                                                 \
+        const uint32_t LOCAL_ERR_CODE = (ERR_CODE);   \
+        if (LOCAL_ERR_CODE != NRF_SUCCESS)            \
+        {                                             \
+            APP_ERROR_HANDLER(LOCAL_ERR_CODE);        \
+        }                                             \
+    } while (0)
+
+#define APP_ERROR_CHECK_BOOL(BOOLEAN_VALUE)           \
+    do                                                \
+    {                                                 \
+        const uint32_t LOCAL_BOOLEAN_VALUE = (BOOLEAN_VALUE); \
+        if (!LOCAL_BOOLEAN_VALUE)                     \
+        {                                             \
+            APP_ERROR_HANDLER(0);                     \
+        }                                             \
+    } while (0)
+
+#endif // APP_ERROR_H__
@@ -0,0 +1,26 @@
+#ifndef APP_SCHEDULER_H__
+#define APP_SCHEDULER_H__
+
+#include <stdint.h>
+#include "sdk_errors.h"
+
+// Host stand-in for the nRF5 SDK app_scheduler.h, a FIFO of the same capacity as on target
+
+typedef void (*app_sched_event_handler_t)(void *p_event_data, uint16_t event_size);
+
+#define APP_SCHED_INIT(EVENT_SIZE, QUEUE_SIZE) app_sched_init((EVENT_SIZE), (QUEUE_SIZE))
+
+/**
+ * @brief Initialize the queue, drops any queued event
+ */
+void app_sched_init(uint16_t event_size, uint16_t queue_size);
+
+ret_code_t app_sched_event_put(void const *p_event_data, uint16_t event_size, app_sched_event_handler_t handler);
+
+void app_sched_execute(void);
+
+uint16_t app_sched_queue_space_get(void);
+
+uint16_t app_sched_queue_utilization_get(void);
+
+#endif // APP_SCHEDULER_H__
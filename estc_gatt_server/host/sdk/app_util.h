@@ -0,0 +1,46 @@
+#ifndef APP_UTIL_H__
+#define APP_UTIL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "nordic_common.h"
+
+// Host stand-in for the nRF5 SDK app_util.h, the helpers the application uses
+
+#define STATIC_ASSERT(EXPR, ...) _Static_assert(EXPR, #EXPR)
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+#define ROUNDED_DIV(A, B) (((A) + ((B) / 2)) / (B))
+#define CEIL_DIV(A, B) (((A) + (B) - 1) / (B))
+
+#define ALIGN_NUM(alignment, number) (((number) - 1) + (alignment) - (((number) - 1) % (alignment)))
+
+static inline uint8_t uint16_encode(uint16_t value, uint8_t *p_encoded_data)
+{
+    p_encoded_data[0] = (uint8_t)(value & 0x00FF);
+    p_encoded_data[1] = (uint8_t)((value & 0xFF00) >> 8);
+    return sizeof(uint16_t);
+}
+
+static inline uint8_t uint32_encode(uint32_t value, uint8_t *p_encoded_data)
+{
+    p_encoded_data[0] = (uint8_t)(value & 0x000000FF);
+    p_encoded_data[1] = (uint8_t)((value & 0x0000FF00) >> 8);
+    p_encoded_data[2] = (uint8_t)((value & 0x00FF0000) >> 16);
+    p_encoded_data[3] = (uint8_t)((value & 0xFF000000) >> 24);
+    return sizeof(uint32_t);
+}
+
+static inline uint16_t uint16_decode(uint8_t const *p_encoded_data)
+{
+    return (uint16_t)(p_encoded_data[0] | ((uint16_t)p_encoded_data[1] << 8));
+}
+
+static inline uint32_t uint32_decode(uint8_t const *p_encoded_data)
+{
+    return (uint32_t)p_encoded_data[0] | ((uint32_t)p_encoded_data[1] << 8) |
+           ((uint32_t)p_encoded_data[2] << 16) | ((uint32_t)p_encoded_data[3] << 24);
+}
+
+#endif // APP_UTIL_H__
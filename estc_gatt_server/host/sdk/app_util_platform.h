@@ -0,0 +1,12 @@
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+#include "app_util.h"
+
+// Host stand-in for the nRF5 SDK app_util_platform.h. The host runs the BLE event context and
+// the main loop on one thread, so a critical region only has to keep its block structure.
+
+#define CRITICAL_REGION_ENTER() {
+#define CRITICAL_REGION_EXIT() }
+
+#endif // APP_UTIL_PLATFORM_H__
@@ -0,0 +1,149 @@
+#ifndef BLE_H__
+#define BLE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Host stand-in for the S140 ble.h, the events and types the ESTC service handles.
+// Event ids and write operations have the SoftDevice values.
+
+#define BLE_CONN_HANDLE_INVALID 0xFFFF
+#define BLE_UUID_TYPE_VENDOR_BEGIN 0x02
+
+enum
+{
+    BLE_GAP_EVT_CONNECTED = 0x10,
+    BLE_GAP_EVT_DISCONNECTED = 0x11,
+};
+
+enum
+{
+    BLE_GATTS_EVT_WRITE = 0x50,
+    BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST = 0x51,
+    BLE_GATTS_EVT_HVN_TX_COMPLETE = 0x57,
+};
+
+#define BLE_GAP_ADDR_LEN 6
+#define BLE_GAP_PHY_1MBPS 0x01
+#define BLE_GAP_PHY_2MBPS 0x02
+
+#define BLE_GATTS_OP_INVALID 0x00
+#define BLE_GATTS_OP_WRITE_REQ 0x01
+#define BLE_GATTS_OP_WRITE_CMD 0x02
+#define BLE_GATTS_OP_SIGN_WRITE_CMD 0x03
+#define BLE_GATTS_OP_PREP_WRITE_REQ 0x04
+#define BLE_GATTS_OP_EXEC_WRITE_REQ_CANCEL 0x05
+#define BLE_GATTS_OP_EXEC_WRITE_REQ_NOW 0x06
+
+#define BLE_GATTS_AUTHORIZE_TYPE_READ 0x01
+#define BLE_GATTS_AUTHORIZE_TYPE_WRITE 0x02
+
+typedef struct
+{
+    uint16_t uuid;
+    uint8_t type;
+} ble_uuid_t;
+
+typedef struct
+{
+    uint8_t uuid128[16];
+} ble_uuid128_t;
+
+typedef struct
+{
+    uint16_t value_handle;
+    uint16_t user_desc_handle;
+    uint16_t cccd_handle;
+    uint16_t sccd_handle;
+} ble_gatts_char_handles_t;
+
+typedef struct
+{
+    uint8_t addr_id_peer : 1;
+    uint8_t addr_type : 7;
+    uint8_t addr[BLE_GAP_ADDR_LEN];
+} ble_gap_addr_t;
+
+typedef struct
+{
+    uint16_t min_conn_interval;
+    uint16_t max_conn_interval;
+    uint16_t slave_latency;
+    uint16_t conn_sup_timeout;
+} ble_gap_conn_params_t;
+
+typedef struct
+{
+    uint8_t reason;
+} ble_gap_evt_disconnected_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    union
+    {
+        ble_gap_evt_disconnected_t disconnected;
+    } params;
+} ble_gap_evt_t;
+
+typedef struct
+{
+    uint16_t handle;
+    ble_uuid_t uuid;
+    uint8_t op;
+    uint8_t auth_required;
+    uint16_t offset;
+    uint16_t len;
+    uint8_t data[1]; // Variable length, the event buffer holds len bytes
+} ble_gatts_evt_write_t;
+
+typedef struct
+{
+    uint16_t handle;
+    ble_uuid_t uuid;
+    uint16_t offset;
+} ble_gatts_evt_read_t;
+
+typedef struct
+{
+    uint8_t type;
+    union
+    {
+        ble_gatts_evt_read_t read;
+        ble_gatts_evt_write_t write;
+    } request;
+} ble_gatts_evt_rw_authorize_request_t;
+
+typedef struct
+{
+    uint8_t count;
+} ble_gatts_evt_hvn_tx_complete_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    union
+    {
+        ble_gatts_evt_write_t write;
+        ble_gatts_evt_rw_authorize_request_t authorize_request;
+        ble_gatts_evt_hvn_tx_complete_t hvn_tx_complete;
+    } params;
+} ble_gatts_evt_t;
+
+typedef struct
+{
+    uint16_t evt_id;
+    uint16_t evt_len;
+} ble_evt_hdr_t;
+
+typedef struct
+{
+    ble_evt_hdr_t header;
+    union
+    {
+        ble_gap_evt_t gap_evt;
+        ble_gatts_evt_t gatts_evt;
+    } evt;
+} ble_evt_t;
+
+#endif // BLE_H__
@@ -0,0 +1,18 @@
+#ifndef BLE_ADVDATA_H__
+#define BLE_ADVDATA_H__
+
+#include <stdint.h>
+
+// Host stand-in for the SDK ble_advdata.h, the AD structure search of received advertising data
+
+#define BLE_GAP_AD_TYPE_FLAGS 0x01
+#define BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME 0x09
+#define BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA 0xFF
+
+/**
+ * @brief Find an AD structure of a type, at or after *p_offset
+ * @return Length of its data, *p_offset is set to the data. 0 if there is none or it is truncated.
+ */
+uint16_t ble_advdata_search(uint8_t const *p_encoded_data, uint16_t data_len, uint16_t *p_offset, uint8_t ad_type);
+
+#endif // BLE_ADVDATA_H__
@@ -0,0 +1,73 @@
+#ifndef BLE_SRV_COMMON_H__
+#define BLE_SRV_COMMON_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+// Host stand-in for the nRF5 SDK ble_srv_common.h, the characteristic_add() parameters
+
+typedef enum
+{
+    SEC_NO_ACCESS = 0,
+    SEC_OPEN = 1,
+    SEC_JUST_WORKS = 2,
+    SEC_MITM = 3,
+    SEC_SIGNED = 4,
+    SEC_SIGNED_MITM = 5,
+} security_req_t;
+
+typedef struct
+{
+    uint8_t broadcast : 1;
+    uint8_t read : 1;
+    uint8_t write_wo_resp : 1;
+    uint8_t write : 1;
+    uint8_t notify : 1;
+    uint8_t indicate : 1;
+    uint8_t auth_signed_wr : 1;
+} ble_gatt_char_props_t;
+
+typedef struct
+{
+    uint16_t max_size;
+    uint16_t size;
+    uint8_t *p_char_user_desc;
+    bool is_var_len;
+    ble_gatt_char_props_t char_props;
+    bool is_defered_read;
+    bool is_defered_write;
+    security_req_t read_access;
+    security_req_t write_access;
+    bool is_value_user;
+} ble_add_char_user_desc_t;
+
+typedef struct
+{
+    uint16_t uuid;
+    uint8_t uuid_type;
+    uint16_t max_len;
+    uint16_t init_len;
+    uint8_t *p_init_value;
+    bool is_var_len;
+    ble_gatt_char_props_t char_props;
+    uint8_t char_ext_props;
+    bool is_defered_read;
+    bool is_defered_write;
+    security_req_t read_access;
+    security_req_t write_access;
+    security_req_t cccd_write_access;
+    bool is_value_user;
+    ble_add_char_user_desc_t *p_user_descr;
+    void *p_presentation_format;
+} ble_add_char_params_t;
+
+#define BLE_GATT_HVX_NOTIFICATION 0x01
+#define BLE_CCCD_VALUE_LEN 2
+
+static inline bool ble_srv_is_notification_enabled(uint8_t const *p_encoded_data)
+{
+    return (p_encoded_data[0] & BLE_GATT_HVX_NOTIFICATION) != 0;
+}
+
+#endif // BLE_SRV_COMMON_H__
@@ -0,0 +1,13 @@
+#ifndef CRC32_H__
+#define CRC32_H__
+
+#include <stdint.h>
+
+// Host stand-in for the SDK crc32.h
+
+/**
+ * @brief CRC-32 (IEEE 802.3) of a buffer, continued from *p_crc unless p_crc is NULL
+ */
+uint32_t crc32_compute(uint8_t const *p_data, uint32_t size, uint32_t const *p_crc);
+
+#endif // CRC32_H__
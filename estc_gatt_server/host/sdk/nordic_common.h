@@ -0,0 +1,28 @@
+#ifndef NORDIC_COMMON_H__
+#define NORDIC_COMMON_H__
+
+// Host stand-in for the nRF5 SDK nordic_common.h
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+
+#define CONCAT_2(p1, p2) CONCAT_2_(p1, p2)
+#define CONCAT_2_(p1, p2) p1##p2
+
+#define NUM_VA_ARGS_LESS_1(...) NUM_VA_ARGS_LESS_1_IMPL(__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0, ~)
+#define NUM_VA_ARGS_LESS_1_IMPL(_ignored, _0, _1, _2, _3, _4, _5, N, ...) N
+
+#define UNUSED_VARIABLE(X) ((void)(X))
+#define UNUSED_PARAMETER(X) UNUSED_VARIABLE(X)
+#define UNUSED_RETURN_VALUE(X) UNUSED_VARIABLE(X)
+
+#define MSEC_TO_UNITS(TIME, RESOLUTION) (((TIME) * 1000) / (RESOLUTION))
+
+enum
+{
+    UNIT_0_625_MS = 625,
+    UNIT_1_25_MS = 1250,
+    UNIT_10_MS = 10000,
+};
+
+#endif // NORDIC_COMMON_H__
@@ -0,0 +1,7 @@
+#ifndef NRF_H
+#define NRF_H
+
+// Host stand-in for the nRF5 MDK nrf.h. The host has no DWT cycle counter, so the host build
+// leaves ESTC_PERF_ENABLED cleared.
+
+#endif // NRF_H
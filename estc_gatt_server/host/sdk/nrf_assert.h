@@ -0,0 +1,23 @@
+#ifndef NRF_ASSERT_H_
+#define NRF_ASSERT_H_
+
+#include <stdint.h>
+
+// Host stand-in for the nRF5 SDK nrf_assert.h, asserts are checked with DEBUG_NRF like on target
+
+void assert_nrf_callback(uint16_t line_num, const uint8_t *file_name);
+
+#if defined(DEBUG_NRF)
+#define ASSERT(expr)                                                   \
+    if (expr)                                                          \
+    {                                                                  \
+    }                                                                  \
+    else                                                               \
+    {                                                                  \
+        assert_nrf_callback((uint16_t)__LINE__, (uint8_t *)__FILE__); \
+    }
+#else
+#define ASSERT(expr)
+#endif
+
+#endif // NRF_ASSERT_H_
@@ -0,0 +1,6 @@
+#ifndef NRF_BOOTLOADER_INFO_H__
+#define NRF_BOOTLOADER_INFO_H__
+
+// Host stand-in for the nRF5 SDK nrf_bootloader_info.h
+
+#endif // NRF_BOOTLOADER_INFO_H__
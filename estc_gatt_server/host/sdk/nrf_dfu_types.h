@@ -0,0 +1,12 @@
+#ifndef NRF_DFU_TYPES_H__
+#define NRF_DFU_TYPES_H__
+
+// Host stand-in for the nRF5 SDK nrf_dfu_types.h
+
+#define CODE_PAGE_SIZE 0x1000
+
+#ifndef NRF_DFU_APP_DATA_AREA_SIZE
+#define NRF_DFU_APP_DATA_AREA_SIZE (CODE_PAGE_SIZE * 3)
+#endif
+
+#endif // NRF_DFU_TYPES_H__
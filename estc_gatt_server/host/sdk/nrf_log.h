@@ -0,0 +1,26 @@
+#ifndef NRF_LOG_H_
+#define NRF_LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nordic_common.h"
+#include "sdk_config.h"
+
+// Host stand-in for the nRF5 SDK nrf_log.h. Messages go to stderr when ESTC_HOST_LOG is set
+// in the environment, the format strings are checked by the compiler either way.
+
+void nrf_log_host(char const *p_level, char const *p_fmt, ...) __attribute__((format(printf, 2, 3)));
+void nrf_log_host_hexdump(uint8_t const *p_data, uint32_t len);
+
+#define NRF_LOG_ERROR(...) nrf_log_host("error", __VA_ARGS__)
+#define NRF_LOG_WARNING(...) nrf_log_host("warning", __VA_ARGS__)
+#define NRF_LOG_INFO(...) nrf_log_host("info", __VA_ARGS__)
+#define NRF_LOG_DEBUG(...) nrf_log_host("debug", __VA_ARGS__)
+
+#define NRF_LOG_HEXDUMP_INFO(p_data, len) nrf_log_host_hexdump((uint8_t const *)(p_data), (len))
+#define NRF_LOG_RAW_HEXDUMP_INFO(p_data, len) nrf_log_host_hexdump((uint8_t const *)(p_data), (len))
+
+#define NRF_LOG_PROCESS() false
+#define NRF_LOG_FLUSH() do {} while (0)
+
+#endif // NRF_LOG_H_
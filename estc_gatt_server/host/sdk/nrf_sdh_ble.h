@@ -0,0 +1,15 @@
+#ifndef NRF_SDH_BLE_H__
+#define NRF_SDH_BLE_H__
+
+#include "sdk_config.h"
+#include "ble.h"
+
+// Host stand-in for the nRF5 SDK nrf_sdh_ble.h. There is no SoftDevice to dispatch events,
+// the tests call the observer handlers directly.
+
+typedef void (*nrf_sdh_ble_evt_handler_t)(ble_evt_t const *p_ble_evt, void *p_context);
+
+#define NRF_SDH_BLE_OBSERVER(_name, _prio, _handler, _context) \
+    static nrf_sdh_ble_evt_handler_t const _name __attribute__((unused)) = (_handler)
+
+#endif // NRF_SDH_BLE_H__
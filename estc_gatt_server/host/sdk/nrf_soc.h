@@ -0,0 +1,21 @@
+#ifndef NRF_SOC_H__
+#define NRF_SOC_H__
+
+#include <stdint.h>
+
+// Host stand-in for the S140 nrf_soc.h, the AES ECB block encryption
+
+#define SOC_ECB_KEY_LENGTH 16
+#define SOC_ECB_CLEARTEXT_LENGTH 16
+#define SOC_ECB_CIPHERTEXT_LENGTH 16
+
+typedef struct
+{
+    uint8_t key[SOC_ECB_KEY_LENGTH];
+    uint8_t cleartext[SOC_ECB_CLEARTEXT_LENGTH];
+    uint8_t ciphertext[SOC_ECB_CIPHERTEXT_LENGTH];
+} nrf_ecb_hal_data_t;
+
+uint32_t sd_ecb_block_encrypt(nrf_ecb_hal_data_t *p_ecb_data);
+
+#endif // NRF_SOC_H__
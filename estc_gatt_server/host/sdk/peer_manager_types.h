@@ -0,0 +1,12 @@
+#ifndef PEER_MANAGER_TYPES_H__
+#define PEER_MANAGER_TYPES_H__
+
+#include <stdint.h>
+
+// Host stand-in for the nRF5 SDK peer_manager_types.h, the peer id of a bond
+
+typedef uint16_t pm_peer_id_t;
+
+#define PM_PEER_ID_INVALID 0xFFFF
+
+#endif // PEER_MANAGER_TYPES_H__
@@ -0,0 +1,97 @@
+// Generated by tools/estc_anim.py vectors, do not edit
+#ifndef ANIM_VECTORS_H__
+#define ANIM_VECTORS_H__
+
+#include <stdint.h>
+
+typedef struct
+{
+    char const *p_name;
+    uint8_t const *p_data;
+    uint16_t len;
+    uint32_t steps;
+    uint32_t crc; // CRC-32 of the r, g, b bytes of the steps
+} anim_vector_t;
+
+static uint8_t const m_anim_breathe[] = {
+    0x30, 0x00, 0x50, 0xff, 0x96, 0x01, 0x31, 0x00, 0x00, 0x00, 0x96, 0x01,
+    0x41, 0x28, 0x20, 0x96, 0x01, 0x21, 0x96, 0x01, 0x50, 0x08, 0x1c, 0x41,
+    0x28, 0xff,
+};
+
+static uint8_t const m_anim_police[] = {
+    0x10, 0xff, 0x00, 0x00, 0x05, 0x11, 0x00, 0x00, 0x00, 0x05, 0x00, 0x05,
+    0x01, 0x05, 0x00, 0x05, 0x01, 0x0f, 0x12, 0x00, 0x00, 0xff, 0x05, 0x01,
+    0x05, 0x02, 0x05, 0x01, 0x05, 0x02, 0x05, 0x01, 0x0f, 0x00, 0x05, 0x01,
+    0x05, 0x00, 0x05, 0x01, 0x05, 0x00, 0x05, 0x01, 0x0f, 0x02, 0x05, 0x50,
+    0x18, 0x26, 0x01, 0x05, 0x02, 0x05, 0x50, 0x04, 0x01, 0x01, 0x0f, 0xff,
+};
+
+static uint8_t const m_anim_rainbow[] = {
+    0x10, 0xff, 0x03, 0x00, 0x01, 0x40, 0x00, 0x11, 0x00, 0x07, 0x40, 0x00,
+    0x0b, 0x00, 0x04, 0x50, 0x0a, 0x01, 0x40, 0x00, 0x0c, 0x00, 0x05, 0x40,
+    0x00, 0x0b, 0x00, 0x04, 0x40, 0x00, 0x11, 0x00, 0x07, 0x40, 0x00, 0x0b,
+    0x00, 0x04, 0x50, 0x14, 0x02, 0x40, 0x00, 0x0c, 0x00, 0x05, 0x40, 0x00,
+    0x0b, 0x00, 0x04, 0x40, 0x00, 0x11, 0x00, 0x07, 0x11, 0xff, 0xff, 0x00,
+    0x01, 0x32, 0x00, 0xff, 0x00, 0x64, 0x33, 0x00, 0xff, 0xff, 0x64, 0x34,
+    0x00, 0x00, 0xff, 0x64, 0x35, 0xff, 0x00, 0xff, 0x64, 0x36, 0xff, 0x00,
+    0x00, 0x64, 0x21, 0x64, 0x22, 0x64, 0x23, 0x64, 0x24, 0x64, 0x25, 0x64,
+    0x26, 0x64, 0x50, 0x0c, 0x08, 0xff,
+};
+
+static uint8_t const m_anim_window[] = {
+    0x10, 0x63, 0xdb, 0xbe, 0x10, 0x11, 0x1a, 0x0b, 0x15, 0x10, 0x12, 0x08,
+    0x8b, 0xbc, 0x10, 0x13, 0x0d, 0x24, 0xe0, 0x10, 0x14, 0xf1, 0x39, 0xa1,
+    0x10, 0x15, 0x7c, 0x9c, 0x5d, 0x10, 0x16, 0x81, 0xd2, 0x60, 0x10, 0x17,
+    0x5a, 0x36, 0x78, 0x10, 0x18, 0x41, 0x21, 0x47, 0x10, 0x19, 0x37, 0x20,
+    0x8e, 0x10, 0x1a, 0x29, 0x1f, 0xe7, 0x10, 0x1b, 0x27, 0x7a, 0x5c, 0x10,
+    0x1c, 0x0a, 0x4d, 0x65, 0x10, 0x1d, 0xba, 0x28, 0x7c, 0x10, 0x1e, 0x06,
+    0x48, 0x01, 0x10, 0x1f, 0x4f, 0xfd, 0x04, 0x10, 0x10, 0xf1, 0x0b, 0x18,
+    0x10, 0x11, 0xe1, 0xdc, 0x31, 0x10, 0x12, 0x16, 0x05, 0x18, 0x10, 0x13,
+    0x79, 0xda, 0xd0, 0x10, 0x14, 0xb7, 0x5a, 0xe1, 0x10, 0x15, 0x3e, 0xb6,
+    0x90, 0x10, 0x16, 0xae, 0x18, 0x6a, 0x10, 0x17, 0x7b, 0x5f, 0xa9, 0x10,
+    0x18, 0x97, 0x2a, 0x35, 0x10, 0x19, 0x6b, 0xf7, 0x2b, 0x10, 0x1a, 0x0b,
+    0xe3, 0x0a, 0x10, 0x1b, 0xe8, 0x96, 0x14, 0x10, 0x1c, 0x5b, 0x99, 0x10,
+    0x10, 0x1d, 0x32, 0x8a, 0xcf, 0x10, 0x1e, 0x60, 0xbf, 0x2b, 0x10, 0x1f,
+    0x52, 0xc5, 0x05, 0x10, 0x10, 0x4e, 0xe1, 0x68, 0x10, 0x11, 0xde, 0x01,
+    0x43, 0x10, 0x12, 0x61, 0x57, 0xf1, 0x10, 0x13, 0x5a, 0x24, 0xc0, 0x10,
+    0x14, 0x98, 0x52, 0x60, 0x10, 0x15, 0x10, 0x01, 0x83, 0x10, 0x16, 0x61,
+    0x80, 0x2f, 0x10, 0x17, 0xf1, 0x89, 0x45, 0x10, 0x18, 0x36, 0x1e, 0x8b,
+    0x10, 0x19, 0x9f, 0x47, 0x3c, 0x10, 0x1a, 0x47, 0x47, 0xde, 0x10, 0x1b,
+    0x4f, 0x9f, 0x3f, 0x10, 0x1c, 0x41, 0x81, 0x54, 0x10, 0x1d, 0x3d, 0x51,
+    0x72, 0x10, 0x1e, 0x4e, 0xd0, 0x01, 0x10, 0x1f, 0xf4, 0xc7, 0xcd, 0x10,
+    0x10, 0x4f, 0xf1, 0xc8, 0x10, 0x11, 0xe2, 0x91, 0xd8, 0x10, 0x12, 0xc4,
+    0xc0, 0x75, 0x10, 0x13, 0x71, 0xe2, 0x95, 0x10, 0x14, 0x68, 0xea, 0xfe,
+    0x10, 0x15, 0xf2, 0x52, 0x6c, 0x10, 0x16, 0x5d, 0x6a, 0xe4, 0x10, 0x17,
+    0x73, 0xe0, 0x6c, 0x10, 0x18, 0x71, 0x26, 0xb8, 0x10, 0x19, 0xc7, 0x48,
+    0x31, 0x10, 0x1a, 0x57, 0xdb, 0x33, 0x10, 0x1b, 0x37, 0xe9, 0xa9, 0x10,
+    0x1c, 0xfb, 0xfc, 0x81, 0x10, 0x1d, 0xe7, 0x0c, 0x88, 0x10, 0x1e, 0x0e,
+    0x8c, 0xb0, 0x10, 0x1f, 0x68, 0x7f, 0xa6, 0x10, 0x10, 0x27, 0xca, 0xf7,
+    0x10, 0x11, 0xd8, 0xa8, 0x68, 0x10, 0x12, 0x01, 0xa8, 0x8c, 0x10, 0x13,
+    0x4f, 0xae, 0x6d, 0x10, 0x14, 0x1c, 0x3d, 0x67, 0x10, 0x15, 0x85, 0x26,
+    0x6c, 0x10, 0x16, 0x7b, 0x9b, 0x8b, 0x10, 0x17, 0x3b, 0x79, 0x97, 0x10,
+    0x18, 0x56, 0x5a, 0x0a, 0x10, 0x19, 0xde, 0x7a, 0x70, 0x10, 0x1a, 0xf7,
+    0xd4, 0x38, 0x10, 0x1b, 0x98, 0xd8, 0x75, 0x10, 0x1c, 0x71, 0xd5, 0xa1,
+    0x10, 0x1d, 0x3b, 0xb7, 0x1d, 0x10, 0x1e, 0x6a, 0x2c, 0x0e, 0x10, 0x1f,
+    0x65, 0x4b, 0x8e, 0x10, 0x10, 0xe5, 0x19, 0xb3, 0x10, 0x11, 0xcf, 0x5d,
+    0x5e, 0x10, 0x12, 0xbe, 0xa3, 0x69, 0x10, 0x13, 0x43, 0x4b, 0x5d, 0x10,
+    0x14, 0x11, 0x44, 0x3d, 0x10, 0x15, 0x4f, 0x06, 0xc9, 0x10, 0x16, 0x46,
+    0x47, 0x82, 0x10, 0x17, 0x27, 0x0e, 0x78, 0x10, 0x18, 0xfc, 0xbe, 0x37,
+    0x10, 0x19, 0x03, 0x1e, 0x76, 0x10, 0x1a, 0x0e, 0x45, 0xeb, 0x10, 0x1b,
+    0xa7, 0x28, 0x57, 0x10, 0x1c, 0x9f, 0xb5, 0xaf, 0x10, 0x1d, 0x51, 0x61,
+    0x2b, 0x10, 0x1e, 0x1c, 0xb5, 0xb0, 0x10, 0x1f, 0xc7, 0xd0, 0x55, 0x10,
+    0x10, 0x1e, 0x49, 0x54, 0x10, 0x11, 0x0d, 0x02, 0x00, 0x01, 0x32, 0xff,
+    0x28, 0x00, 0x13, 0x41, 0x07, 0x33, 0x00, 0x5a, 0xff, 0x0f, 0x14, 0x00,
+    0x00, 0x00, 0x03, 0x03, 0x03, 0x24, 0x0a, 0x41, 0x0c, 0x22, 0x14, 0x41,
+    0x07, 0x23, 0x0f, 0x04, 0x03, 0x50, 0x0e, 0x04, 0x03, 0x03, 0x24, 0x0a,
+    0x41, 0x0c, 0xff,
+};
+
+static anim_vector_t const m_anim_vectors[] = {
+    {"breathe", m_anim_breathe, sizeof(m_anim_breathe), 10200, 0x0e629d21},
+    {"police", m_anim_police, sizeof(m_anim_police), 3200, 0x20ab6690},
+    {"rainbow", m_anim_rainbow, sizeof(m_anim_rainbow), 6000, 0xe7109b68},
+    {"window", m_anim_window, sizeof(m_anim_window), 1972, 0x40434b25},
+};
+
+#endif // ANIM_VECTORS_H__
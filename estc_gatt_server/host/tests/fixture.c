@@ -0,0 +1,76 @@
+#include "fixture.h"
+
+#include "test.h"
+#include "ble_links.h"
+#include "conn_activity.h"
+#include "pwm_control.h"
+#include "flash_storage.h"
+#include "app_scheduler.h"
+#include "fake_ble.h"
+#include "fake_flash.h"
+
+static ble_estc_service_t *m_p_service;
+
+static uint32_t m_batches;
+static uint16_t m_batch_conn_handle;
+static estc_cmd_batch_t m_batch;
+
+void fixture_init(ble_estc_service_t *p_service)
+{
+    APP_SCHED_INIT(ESTC_SCHED_EVENT_DATA_SIZE, 8);
+    pwm_controller_init();
+    pwm_start_playback();
+    fake_flash_reset();
+    flash_storage_init();
+    fake_ble_reset();
+
+    // Parameter requests only reach the fake
+    static ble_gap_conn_params_t const conn_params = {6, 6, 0, 400};
+    TEST_ASSERT_EQ(NRF_SUCCESS, conn_activity_init(&conn_params, &conn_params));
+    ble_links_init(NULL);
+
+    ble_lbs_init_t init = {.batch_write_handler = fixture_batch_handler};
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_ble_service_init(p_service, &init));
+    m_p_service = p_service;
+}
+
+void fixture_batch_handler(uint16_t conn_handle, ble_estc_service_t *p_lbs, estc_cmd_batch_t const *p_batch)
+{
+    m_batches++;
+    m_batch_conn_handle = conn_handle;
+    m_batch = *p_batch;
+    ble_links_batch_handler(conn_handle, p_lbs, p_batch);
+}
+
+uint16_t fixture_value_handle(estc_char_id_t id)
+{
+    return m_p_service->char_handles[id].value_handle;
+}
+
+void fixture_main_loop_run(void)
+{
+    pwm_process();
+    app_sched_execute();
+    // The SoftDevice completes the queued flash operations while the main loop sleeps
+    fake_flash_process(UINT32_MAX);
+}
+
+uint32_t fixture_batch_count(void)
+{
+    return m_batches;
+}
+
+estc_cmd_batch_t const *fixture_batch(void)
+{
+    return &m_batch;
+}
+
+uint16_t fixture_batch_conn_handle(void)
+{
+    return m_batch_conn_handle;
+}
+
+void fixture_batches_clear(void)
+{
+    m_batches = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef FIXTURE_H__
+#define FIXTURE_H__
+
+#include <stdint.h>
+#include "estc_service.h"
+#include "estc_command.h"
+
+/**
+ * @brief Light under test of the service level tests
+ *
+ * @details Sets the ESTC service up on the fakes as services_init() in ble_module.c does, its
+ *          batches go to ble_links_batch_handler() after they are recorded here.
+ */
+
+/**
+ * @brief Initialize the scheduler, PWM, flash storage, link tracking and the service
+ * @param p_service Service under test, kept for fixture_value_handle()
+ */
+void fixture_init(ble_estc_service_t *p_service);
+
+/**
+ * @brief Batch write handler of the service, records the batch and applies it as the firmware does
+ */
+void fixture_batch_handler(uint16_t conn_handle, ble_estc_service_t *p_lbs, estc_cmd_batch_t const *p_batch);
+
+/**
+ * @brief Value handle of a characteristic of the service under test
+ */
+uint16_t fixture_value_handle(estc_char_id_t id);
+
+/**
+ * @brief One pass of the main loop: PWM, scheduled events and the queued flash operations
+ */
+void fixture_main_loop_run(void);
+
+/**
+ * @brief Number of batches handled since the last fixture_batches_clear()
+ */
+uint32_t fixture_batch_count(void);
+
+/**
+ * @brief Last batch handled
+ */
+estc_cmd_batch_t const *fixture_batch(void);
+
+/**
+ * @brief Link of the last batch, BLE_CONN_HANDLE_INVALID for a group command
+ */
+uint16_t fixture_batch_conn_handle(void);
+
+void fixture_batches_clear(void);
+
+#endif // FIXTURE_H__
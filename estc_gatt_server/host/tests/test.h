@@ -0,0 +1,45 @@
+#ifndef TEST_H__
+#define TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Minimal test harness of the host tests
+ *
+ * @details A failed check prints its location and aborts the test executable, ctest reports it.
+ */
+
+#define TEST_ASSERT(expr)                                                      \
+    do                                                                         \
+    {                                                                          \
+        if (!(expr))                                                           \
+        {                                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+            abort();                                                           \
+        }                                                                      \
+    } while (0)
+
+#define TEST_ASSERT_EQ(expected, actual)                                       \
+    do                                                                         \
+    {                                                                          \
+        long long test_expected_ = (long long)(expected);                      \
+        long long test_actual_ = (long long)(actual);                          \
+        if (test_expected_ != test_actual_)                                    \
+        {                                                                      \
+            fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n", __FILE__, __LINE__, \
+                    #expected, #actual, test_expected_, test_actual_);         \
+            abort();                                                           \
+        }                                                                      \
+    } while (0)
+
+#define TEST_RUN(test)                      \
+    do                                      \
+    {                                       \
+        printf("%s\n", #test);              \
+        test();                             \
+    } while (0)
+
+#endif // TEST_H__
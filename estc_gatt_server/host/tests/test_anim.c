@@ -0,0 +1,238 @@
+#include "test.h"
+
+#include "estc_anim.h"
+#include "pwm_control.h"
+#include "app_util.h"
+#include "crc32.h"
+#include "fake_pwm.h"
+#include "anim_vectors.h"
+
+// Stream buffers played while a chunk waits for window space, the decoder frees it in fewer
+#define FEED_RETRIES_MAX (HAL_PWM_STREAM_BUFFER_COUNT * 4)
+// Longest playback of the tests, in stream buffers
+#define PLAYBACK_BUFFERS_MAX 1000
+
+// Steps played since the last upload
+static uint32_t m_steps;
+static uint32_t m_crc;
+// Chunks answered with NO_SPACE during the last upload
+static uint32_t m_no_space;
+
+static void playback_reset(void)
+{
+    m_steps = 0;
+    m_crc = 0;
+    m_no_space = 0;
+}
+
+// Add the captured steps to the step count and CRC, as r, g, b bytes
+static void steps_collect(void)
+{
+    uint32_t count;
+    hal_pwm_step_t const *p_steps = fake_pwm_stream_steps(&count);
+
+    TEST_ASSERT(count <= FAKE_PWM_CAPTURE_STEPS);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        // Channels 1 to 3 drive the LED, at full brightness the duty cycle is the color
+        uint8_t const rgb[3] = {p_steps[i].duty[1], p_steps[i].duty[2], p_steps[i].duty[3]};
+        m_crc = crc32_compute(rgb, sizeof(rgb), &m_crc);
+    }
+    m_steps += count;
+    fake_pwm_stream_steps_clear();
+}
+
+// Play one stream buffer as the PWM would, then let the main loop decode into the freed space
+static void buffer_play(void)
+{
+    fake_pwm_stream_play(1);
+    pwm_process();
+    estc_anim_decode();
+    steps_collect();
+}
+
+static void playback_finish(void)
+{
+    for (uint32_t i = 0; fake_pwm_stream_active(); i++)
+    {
+        TEST_ASSERT(i < PLAYBACK_BUFFERS_MAX);
+        buffer_play();
+    }
+    steps_collect();
+}
+
+// Feed an animation in chunks as the ANIMATION characteristic does and play it to the end
+static void anim_upload(uint8_t const *p_data, uint16_t len, uint16_t chunk)
+{
+    playback_reset();
+
+    for (uint16_t offset = 0; offset < len; offset += chunk)
+    {
+        uint16_t size = MIN(chunk, len - offset);
+        uint32_t retries = 0;
+
+        // The client waits for READY, sent once stream buffers were played
+        while (estc_anim_feed(&p_data[offset], size, offset == 0) == PWM_STREAM_NO_SPACE)
+        {
+            TEST_ASSERT(++retries <= FEED_RETRIES_MAX);
+            m_no_space++;
+            buffer_play();
+        }
+        estc_anim_decode();
+    }
+
+    playback_finish();
+}
+
+static uint32_t color_crc(uint8_t r, uint8_t g, uint8_t b, uint32_t steps)
+{
+    uint8_t const rgb[3] = {r, g, b};
+    uint32_t crc = 0;
+
+    for (uint32_t i = 0; i < steps; i++)
+    {
+        crc = crc32_compute(rgb, sizeof(rgb), &crc);
+    }
+    return crc;
+}
+
+static void test_vectors(void)
+{
+    // Byte by byte splits every instruction, the largest chunks fill the window at once
+    static uint16_t const chunks[] = {1, 20, 242, ESTC_ANIM_CHUNK_MAX};
+
+    for (size_t i = 0; i < ARRAY_SIZE(m_anim_vectors); i++)
+    {
+        anim_vector_t const *p_vector = &m_anim_vectors[i];
+
+        for (size_t j = 0; j < ARRAY_SIZE(chunks); j++)
+        {
+            anim_upload(p_vector->p_data, p_vector->len, chunks[j]);
+
+            printf("%s: %u bytes in chunks of %u, %u steps, %u times no space\n", p_vector->p_name,
+                   p_vector->len, chunks[j], m_steps, m_no_space);
+            TEST_ASSERT_EQ(p_vector->steps, m_steps);
+            TEST_ASSERT_EQ(p_vector->crc, m_crc);
+        }
+    }
+}
+
+static void test_window_loop(void)
+{
+    // The loop body of the window vector straddles the end of the window, it is replayed from the
+    // bytes kept while the following chunks were written
+    anim_vector_t const *p_vector = &m_anim_vectors[ARRAY_SIZE(m_anim_vectors) - 1];
+    TEST_ASSERT(strcmp(p_vector->p_name, "window") == 0);
+    TEST_ASSERT(p_vector->len > ESTC_ANIM_WINDOW_SIZE);
+
+    anim_upload(p_vector->p_data, p_vector->len, 20);
+    TEST_ASSERT(m_no_space > 0);
+    TEST_ASSERT_EQ(p_vector->crc, m_crc);
+
+    // In place from a stored program
+    playback_reset();
+    estc_anim_play(p_vector->p_data, p_vector->len);
+    estc_anim_decode();
+    playback_finish();
+    TEST_ASSERT_EQ(p_vector->steps, m_steps);
+    TEST_ASSERT_EQ(p_vector->crc, m_crc);
+}
+
+static void test_chunk_max(void)
+{
+    uint8_t data[ESTC_ANIM_CHUNK_MAX + 1];
+
+    memset(data, ESTC_ANIM_OP_END, sizeof(data));
+    TEST_ASSERT_EQ(PWM_STREAM_INVALID, estc_anim_feed(data, sizeof(data), true));
+
+    // The decoder waits for the rest of a split instruction with a full loop body behind it. The
+    // largest chunk must still fit, the decoder cannot free anything before it got the bytes.
+    uint16_t const holds = ESTC_ANIM_LOOP_BODY_MAX / 2 + 1;
+    uint16_t len = 0;
+    for (uint16_t i = 0; i < holds; i++)
+    {
+        data[len++] = ESTC_ANIM_OP_HOLD;
+        data[len++] = 1;
+    }
+    uint8_t const split[] = {ESTC_ANIM_OP_HOLD_RGB, 10, 20, 30, 0x81, 0x80};
+    memcpy(&data[len], split, sizeof(split));
+    len += sizeof(split);
+
+    playback_reset();
+    TEST_ASSERT_EQ(PWM_STREAM_OK, estc_anim_feed(data, len, true));
+    estc_anim_decode();
+
+    // The varint ends with its third byte: 1 step
+    memset(data, ESTC_ANIM_OP_END, ESTC_ANIM_CHUNK_MAX);
+    data[0] = 0x00;
+    TEST_ASSERT_EQ(PWM_STREAM_OK, estc_anim_feed(data, ESTC_ANIM_CHUNK_MAX, false));
+    estc_anim_decode();
+    playback_finish();
+
+    uint8_t const rgb[3] = {10, 20, 30};
+    uint32_t crc = color_crc(0, 0, 0, holds);
+    TEST_ASSERT_EQ(holds + 1, m_steps);
+    TEST_ASSERT_EQ(crc32_compute(rgb, sizeof(rgb), &crc), m_crc);
+}
+
+static void test_malformed(void)
+{
+    // Hold 1, 2, 3 for 5 steps, then a malformed instruction and steps that must not play
+    static uint8_t const prefix[] = {ESTC_ANIM_OP_HOLD_RGB | 1, 1, 2, 3, 5};
+    static uint8_t const suffix[] = {ESTC_ANIM_OP_HOLD_RGB | 2, 9, 9, 9, 5, ESTC_ANIM_OP_END};
+    static struct
+    {
+        char const *p_name;
+        uint8_t insn[8];
+        uint8_t len;
+        uint32_t steps; // Of 1, 2, 3 played before the instruction
+    } const cases[] = {
+        {"overlong steps", {ESTC_ANIM_OP_HOLD, 0x81, 0x80, 0x80, 0x00}, 5, 5},
+        {"zero steps", {ESTC_ANIM_OP_HOLD, 0x00}, 2, 5},
+        {"too many steps", {ESTC_ANIM_OP_HOLD, 0x80, 0x80, 0x04}, 4, 5},
+        {"overlong loop body", {ESTC_ANIM_OP_LOOP, 0x85, 0x80, 0x80, 0x00, 0x01}, 6, 5},
+        {"overlong loop count", {ESTC_ANIM_OP_LOOP, 0x05, 0x81, 0x80, 0x80, 0x00}, 6, 5},
+        {"loop before the start", {ESTC_ANIM_OP_LOOP, 0x06, 0x01}, 3, 5},
+        {"zero loop count", {ESTC_ANIM_OP_LOOP, 0x05, 0x00}, 3, 5},
+        // The outer body replays the hold, then meets the inner loop
+        {"nested loop", {ESTC_ANIM_OP_LOOP, 0x05, 0x01, ESTC_ANIM_OP_LOOP, 0x08, 0x01}, 6, 15},
+        {"unknown opcode", {0x60, 0x01}, 2, 5},
+    };
+    uint8_t data[sizeof(prefix) + sizeof(cases[0].insn) + sizeof(suffix)];
+
+    for (size_t i = 0; i < ARRAY_SIZE(cases); i++)
+    {
+        uint16_t len = 0;
+
+        memcpy(&data[len], prefix, sizeof(prefix));
+        len += sizeof(prefix);
+        memcpy(&data[len], cases[i].insn, cases[i].len);
+        len += cases[i].len;
+        memcpy(&data[len], suffix, sizeof(suffix));
+        len += sizeof(suffix);
+
+        // Whole and split at every byte, the decoder must not take a varint cut short for a bad one
+        for (uint16_t chunk = 1; chunk <= len; chunk += len - 1)
+        {
+            anim_upload(data, len, chunk);
+
+            printf("%s in chunks of %u: %u steps\n", cases[i].p_name, chunk, m_steps);
+            TEST_ASSERT_EQ(cases[i].steps, m_steps);
+            TEST_ASSERT_EQ(color_crc(1, 2, 3, cases[i].steps), m_crc);
+        }
+    }
+}
+
+int main(void)
+{
+    pwm_controller_init();
+    pwm_start_playback();
+    TEST_ASSERT_EQ(UINT8_MAX, pwm_get_brightness());
+
+    TEST_RUN(test_vectors);
+    TEST_RUN(test_window_loop);
+    TEST_RUN(test_chunk_max);
+    TEST_RUN(test_malformed);
+
+    return 0;
+}
@@ -0,0 +1,348 @@
+#include "test.h"
+
+#include <time.h>
+#include "estc_command.h"
+
+#define STREAM_LEN_MAX 244 // One write at the largest MTU
+#define FUZZ_ITERATIONS 200000
+#define THROUGHPUT_SECONDS 0.2
+
+// Reference model of the command stream, kept in step with the parser's scenes
+typedef struct
+{
+    uint8_t state;
+    rgb_color_t color;
+    uint8_t brightness;
+} model_scene_t;
+
+static model_scene_t m_model_scenes[ESTC_CMD_SCENE_COUNT];
+
+static uint32_t m_rand_state = 0x2545F491;
+
+static uint32_t rand_next(void)
+{
+    // xorshift32, fixed seed so failures reproduce
+    m_rand_state ^= m_rand_state << 13;
+    m_rand_state ^= m_rand_state >> 17;
+    m_rand_state ^= m_rand_state << 5;
+    return m_rand_state;
+}
+
+static int model_operand_len(uint8_t opcode)
+{
+    static const int8_t lens[] = {-1, 3, 1, 5, 1, 1, 0, 1, 1};
+    return opcode < sizeof(lens) ? lens[opcode] : -1;
+}
+
+/**
+ * @brief Apply a stream to a batch the straightforward way, returns false for a stream the parser must reject
+ */
+static bool model_apply(uint8_t const *p_data, uint16_t len, estc_cmd_batch_t *p_batch)
+{
+    estc_cmd_batch_t batch = *p_batch;
+    model_scene_t scenes[ESTC_CMD_SCENE_COUNT];
+    uint16_t pos = 0;
+
+    memcpy(scenes, m_model_scenes, sizeof(scenes));
+
+    while (pos < len)
+    {
+        uint8_t opcode = p_data[pos];
+        int operand_len = model_operand_len(opcode);
+        if (operand_len < 0 || pos + 1 + operand_len > len)
+        {
+            return false;
+        }
+
+        uint8_t const *p_op = &p_data[pos + 1];
+        switch (opcode)
+        {
+        case ESTC_CMD_OP_SET_COLOR:
+            batch.color = (rgb_color_t){p_op[0], p_op[1], p_op[2]};
+            batch.flags = (batch.flags | ESTC_CMD_FLAG_COLOR) & ~ESTC_CMD_FLAG_FADE;
+            break;
+        case ESTC_CMD_OP_SET_STATE:
+            batch.state = p_op[0] != 0;
+            batch.flags |= ESTC_CMD_FLAG_STATE;
+            break;
+        case ESTC_CMD_OP_FADE_TO:
+            batch.color = (rgb_color_t){p_op[0], p_op[1], p_op[2]};
+            batch.fade_ms = (uint16_t)(p_op[3] | p_op[4] << 8);
+            batch.flags |= ESTC_CMD_FLAG_COLOR | ESTC_CMD_FLAG_FADE;
+            break;
+        case ESTC_CMD_OP_RECALL_SCENE:
+            if (p_op[0] >= ESTC_CMD_SCENE_COUNT)
+            {
+                return false;
+            }
+            batch.state = scenes[p_op[0]].state;
+            batch.color = scenes[p_op[0]].color;
+            batch.brightness = scenes[p_op[0]].brightness;
+            batch.flags = (batch.flags | ESTC_CMD_FLAG_STATE | ESTC_CMD_FLAG_COLOR | ESTC_CMD_FLAG_BRIGHTNESS) &
+                          ~ESTC_CMD_FLAG_FADE;
+            break;
+        case ESTC_CMD_OP_SET_BRIGHTNESS:
+            batch.brightness = p_op[0];
+            batch.flags |= ESTC_CMD_FLAG_BRIGHTNESS;
+            break;
+        case ESTC_CMD_OP_QUERY:
+            batch.flags |= ESTC_CMD_FLAG_QUERY;
+            break;
+        case ESTC_CMD_OP_STORE_SCENE:
+            if (p_op[0] >= ESTC_CMD_SCENE_COUNT)
+            {
+                return false;
+            }
+            scenes[p_op[0]] = (model_scene_t){batch.state, batch.color, batch.brightness};
+            break;
+        case ESTC_CMD_OP_PLAY_PROGRAM:
+            if (p_op[0] >= ESTC_CMD_PROGRAM_COUNT)
+            {
+                return false;
+            }
+            batch.program = p_op[0];
+            batch.flags |= ESTC_CMD_FLAG_PROGRAM;
+            break;
+        }
+        pos += 1 + operand_len;
+    }
+
+    *p_batch = batch;
+    memcpy(m_model_scenes, scenes, sizeof(scenes));
+    return true;
+}
+
+static void batch_check(estc_cmd_batch_t const *p_expected, estc_cmd_batch_t const *p_actual)
+{
+    TEST_ASSERT_EQ(p_expected->flags, p_actual->flags);
+    TEST_ASSERT_EQ(p_expected->state, p_actual->state);
+    TEST_ASSERT_EQ(p_expected->color.red, p_actual->color.red);
+    TEST_ASSERT_EQ(p_expected->color.green, p_actual->color.green);
+    TEST_ASSERT_EQ(p_expected->color.blue, p_actual->color.blue);
+    TEST_ASSERT_EQ(p_expected->brightness, p_actual->brightness);
+    TEST_ASSERT_EQ(p_expected->fade_ms, p_actual->fade_ms);
+    TEST_ASSERT_EQ(p_expected->program, p_actual->program);
+}
+
+/**
+ * @brief Parse a stream and compare the outcome with the model
+ */
+static ret_code_t parse_check(uint8_t const *p_data, uint16_t len, estc_cmd_batch_t *p_batch)
+{
+    estc_cmd_batch_t expected = *p_batch;
+    bool valid = model_apply(p_data, len, &expected);
+
+    ret_code_t err_code = estc_cmd_parse(p_data, len, p_batch);
+
+    TEST_ASSERT_EQ(valid, err_code == NRF_SUCCESS);
+    // A rejected stream leaves the batch untouched
+    batch_check(&expected, p_batch);
+
+    return err_code;
+}
+
+static void test_operations(void)
+{
+    estc_cmd_batch_t batch = {.brightness = ESTC_CMD_BRIGHTNESS_MAX};
+    uint8_t const stream[] = {
+        ESTC_CMD_OP_SET_STATE, 1,
+        ESTC_CMD_OP_SET_COLOR, 1, 2, 3,
+        ESTC_CMD_OP_SET_BRIGHTNESS, 100,
+        ESTC_CMD_OP_FADE_TO, 4, 5, 6, 0xE8, 0x03,
+        ESTC_CMD_OP_QUERY,
+        ESTC_CMD_OP_PLAY_PROGRAM, 3,
+    };
+
+    TEST_ASSERT_EQ(NRF_SUCCESS, parse_check(stream, sizeof(stream), &batch));
+    TEST_ASSERT_EQ(1000, batch.fade_ms);
+    TEST_ASSERT_EQ(ESTC_CMD_FLAG_STATE | ESTC_CMD_FLAG_COLOR | ESTC_CMD_FLAG_BRIGHTNESS | ESTC_CMD_FLAG_FADE |
+                       ESTC_CMD_FLAG_QUERY | ESTC_CMD_FLAG_PROGRAM,
+                   batch.flags);
+
+    // A later color in the same write cancels the fade
+    TEST_ASSERT_EQ(NRF_SUCCESS, parse_check((uint8_t[]){ESTC_CMD_OP_SET_COLOR, 7, 8, 9}, 4, &batch));
+    TEST_ASSERT_EQ(0, batch.flags & ESTC_CMD_FLAG_FADE);
+
+    uint8_t response[ESTC_CMD_QUERY_RESPONSE_SIZE];
+    TEST_ASSERT_EQ(ESTC_CMD_QUERY_RESPONSE_SIZE, estc_cmd_query_response_encode(&batch, response));
+    TEST_ASSERT_EQ(0, memcmp(response, (uint8_t[]){ESTC_CMD_OP_QUERY, 1, 7, 8, 9, 100}, sizeof(response)));
+}
+
+static void test_scenes(void)
+{
+    estc_cmd_batch_t batch = {.brightness = ESTC_CMD_BRIGHTNESS_MAX};
+    uint8_t const store[] = {
+        ESTC_CMD_OP_SET_STATE, 1,
+        ESTC_CMD_OP_SET_COLOR, 10, 20, 30,
+        ESTC_CMD_OP_STORE_SCENE, 2,
+        ESTC_CMD_OP_SET_COLOR, 0, 0, 0,
+        ESTC_CMD_OP_RECALL_SCENE, 2,
+    };
+
+    TEST_ASSERT_EQ(NRF_SUCCESS, parse_check(store, sizeof(store), &batch));
+    TEST_ASSERT_EQ(20, batch.color.green);
+
+    // A never stored scene recalls as off and black
+    TEST_ASSERT_EQ(NRF_SUCCESS, parse_check((uint8_t[]){ESTC_CMD_OP_RECALL_SCENE, 7}, 2, &batch));
+    TEST_ASSERT_EQ(0, batch.state);
+    TEST_ASSERT_EQ(0, batch.brightness);
+
+    // The scene stored before a rejected command in the same write is not kept
+    uint8_t const rejected[] = {
+        ESTC_CMD_OP_SET_COLOR, 99, 99, 99,
+        ESTC_CMD_OP_STORE_SCENE, 2,
+        ESTC_CMD_OP_RECALL_SCENE, ESTC_CMD_SCENE_COUNT,
+    };
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_PARAM, parse_check(rejected, sizeof(rejected), &batch));
+    TEST_ASSERT_EQ(NRF_SUCCESS, parse_check((uint8_t[]){ESTC_CMD_OP_RECALL_SCENE, 2}, 2, &batch));
+    TEST_ASSERT_EQ(30, batch.color.blue);
+}
+
+static void test_malformed(void)
+{
+    estc_cmd_batch_t batch = {.brightness = ESTC_CMD_BRIGHTNESS_MAX};
+
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_PARAM, parse_check((uint8_t[]){0x00}, 1, &batch));
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_PARAM, parse_check((uint8_t[]){ESTC_CMD_OP_SET_STATE, 1, 0xFF}, 3, &batch));
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_LENGTH, parse_check((uint8_t[]){ESTC_CMD_OP_SET_COLOR, 1, 2}, 3, &batch));
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_LENGTH, parse_check((uint8_t[]){ESTC_CMD_OP_FADE_TO, 1, 2, 3, 4}, 5, &batch));
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_PARAM,
+                   parse_check((uint8_t[]){ESTC_CMD_OP_PLAY_PROGRAM, ESTC_CMD_PROGRAM_COUNT}, 2, &batch));
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_PARAM,
+                   parse_check((uint8_t[]){ESTC_CMD_OP_STORE_SCENE, ESTC_CMD_SCENE_COUNT}, 2, &batch));
+    TEST_ASSERT_EQ(0, batch.flags);
+}
+
+/**
+ * @brief Build a stream of valid commands with random operands, then mutate it at random
+ */
+static uint16_t fuzz_stream_build(uint8_t *p_buf)
+{
+    uint16_t len = 0;
+    // Mostly short writes, so that most of them survive the mutation below
+    uint16_t target = rand_next() % 8 == 0 ? STREAM_LEN_MAX : rand_next() % 32;
+
+    while (len < target)
+    {
+        uint8_t opcode = 1 + rand_next() % ESTC_CMD_OP_PLAY_PROGRAM;
+        int operand_len = model_operand_len(opcode);
+
+        if (len + 1 + operand_len > STREAM_LEN_MAX)
+        {
+            break;
+        }
+        p_buf[len++] = opcode;
+        for (int i = 0; i < operand_len; i++)
+        {
+            // Mostly small operands, so indexes are valid most of the time
+            p_buf[len++] = (uint8_t)(rand_next() % 32 == 0 ? rand_next() : rand_next() % ESTC_CMD_PROGRAM_COUNT);
+        }
+    }
+
+    switch (rand_next() % 4)
+    {
+    case 0:
+        // Flip a byte
+        if (len != 0)
+        {
+            p_buf[rand_next() % len] = (uint8_t)rand_next();
+        }
+        break;
+    case 1:
+        // Truncate
+        len = len != 0 ? rand_next() % len : 0;
+        break;
+    case 2:
+        // Random bytes
+        len = rand_next() % (STREAM_LEN_MAX + 1);
+        for (uint16_t i = 0; i < len; i++)
+        {
+            p_buf[i] = (uint8_t)rand_next();
+        }
+        break;
+    default:
+        break;
+    }
+
+    return len;
+}
+
+static void test_fuzz(void)
+{
+    estc_cmd_batch_t batch = {.brightness = ESTC_CMD_BRIGHTNESS_MAX};
+    uint32_t accepted = 0;
+
+    for (uint32_t i = 0; i < FUZZ_ITERATIONS; i++)
+    {
+        // Exactly sized buffer, ASan catches reads past the stream
+        uint8_t stream[STREAM_LEN_MAX];
+        uint16_t len = fuzz_stream_build(stream);
+        uint8_t *p_copy = malloc(len != 0 ? len : 1);
+
+        memcpy(p_copy, stream, len);
+        if (parse_check(p_copy, len, &batch) == NRF_SUCCESS)
+        {
+            accepted++;
+        }
+        free(p_copy);
+
+        batch.flags = 0;
+    }
+
+    printf("  %u streams, %u accepted\n", FUZZ_ITERATIONS, accepted);
+    // Both outcomes must have been exercised
+    TEST_ASSERT(accepted > FUZZ_ITERATIONS / 10 && accepted < FUZZ_ITERATIONS - FUZZ_ITERATIONS / 10);
+}
+
+static double seconds_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void test_throughput(void)
+{
+    uint8_t stream[STREAM_LEN_MAX];
+    uint16_t len = 0;
+    uint32_t commands = 0;
+
+    // A full write of the most common commands
+    while (len + 6 <= sizeof(stream))
+    {
+        uint8_t const commands_pattern[] = {ESTC_CMD_OP_SET_COLOR, 1, 2, 3, ESTC_CMD_OP_SET_STATE, 1};
+        memcpy(&stream[len], commands_pattern, sizeof(commands_pattern));
+        len += sizeof(commands_pattern);
+        commands += 2;
+    }
+
+    estc_cmd_batch_t batch = {.brightness = ESTC_CMD_BRIGHTNESS_MAX};
+    uint32_t writes = 0;
+    double start = seconds_now();
+    double elapsed;
+
+    do
+    {
+        for (uint32_t i = 0; i < 1000; i++)
+        {
+            TEST_ASSERT_EQ(NRF_SUCCESS, estc_cmd_parse(stream, len, &batch));
+        }
+        writes += 1000;
+        elapsed = seconds_now() - start;
+    } while (elapsed < THROUGHPUT_SECONDS);
+
+    // Host figures, only comparable between runs of the same build
+    printf("  %u-byte writes: %.0f writes/s, %.1f MB/s, %.1f ns per command\n", len, writes / elapsed,
+           writes * (double)len / elapsed / 1e6, elapsed * 1e9 / ((double)writes * commands));
+}
+
+int main(void)
+{
+    TEST_RUN(test_operations);
+    TEST_RUN(test_scenes);
+    TEST_RUN(test_malformed);
+    TEST_RUN(test_fuzz);
+    TEST_RUN(test_throughput);
+
+    return 0;
+}
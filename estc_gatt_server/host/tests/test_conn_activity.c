@@ -0,0 +1,150 @@
+#include "test.h"
+
+#include "conn_activity.h"
+#include "hal_timer.h"
+#include "fake_ble.h"
+#include "fake_timer.h"
+
+// The inactivity check is the only timer conn_activity creates
+#define IDLE_TIMER_ID 0
+#define CONN_A 0
+#define CONN_B 1
+
+static ble_gap_conn_params_t const m_fast = {6, 12, 0, 400};
+static ble_gap_conn_params_t const m_idle = {80, 160, 6, 400};
+
+static bool params_are(uint16_t conn_handle, ble_gap_conn_params_t const *p_expected)
+{
+    ble_gap_conn_params_t const *p_params = fake_ble_conn_params(conn_handle);
+
+    return p_params != NULL && memcmp(p_params, p_expected, sizeof(*p_params)) == 0;
+}
+
+/**
+ * @brief Advance in steps of 1 ms until the link asks for the idle parameters
+ * @return Milliseconds advanced
+ */
+static uint32_t advance_until_idle(uint16_t conn_handle, uint32_t limit_ms)
+{
+    uint32_t elapsed = 0;
+
+    while (conn_activity_is_fast(conn_handle) && elapsed < limit_ms)
+    {
+        fake_timer_advance(1);
+        elapsed++;
+    }
+
+    return elapsed;
+}
+
+static void test_write_requests_fast_params(void)
+{
+    conn_activity_connected(CONN_A);
+    TEST_ASSERT(!conn_activity_is_fast(CONN_A));
+    TEST_ASSERT_EQ(0, fake_ble_conn_params_requests(CONN_A));
+
+    conn_activity_write(CONN_A);
+    TEST_ASSERT(conn_activity_is_fast(CONN_A));
+    TEST_ASSERT(params_are(CONN_A, &m_fast));
+    TEST_ASSERT(fake_timer_running(IDLE_TIMER_ID));
+
+    // Further writes do not repeat the request
+    conn_activity_write(CONN_A);
+    TEST_ASSERT_EQ(1, fake_ble_conn_params_requests(CONN_A));
+
+    // The first check after the timeout returns the link to the idle parameters
+    TEST_ASSERT_EQ(CONN_ACTIVITY_IDLE_TIMEOUT_MS, advance_until_idle(CONN_A, 60000));
+    TEST_ASSERT(params_are(CONN_A, &m_idle));
+    TEST_ASSERT(!fake_timer_running(IDLE_TIMER_ID));
+    TEST_ASSERT_EQ(CONN_ACTIVITY_IDLE_TIMEOUT_MS / CONN_ACTIVITY_CHECK_INTERVAL_MS, fake_timer_expiries(IDLE_TIMER_ID));
+
+    conn_activity_disconnected(CONN_A);
+}
+
+static void test_steady_writes_stay_fast(void)
+{
+    conn_activity_connected(CONN_A);
+    conn_activity_write(CONN_A);
+    uint32_t requests = fake_ble_conn_params_requests(CONN_A);
+
+    // Two hours of a write every 4.5 s
+    for (uint32_t i = 0; i < 1601; i++)
+    {
+        fake_timer_advance(4500);
+        TEST_ASSERT(conn_activity_is_fast(CONN_A));
+        conn_activity_write(CONN_A);
+    }
+    TEST_ASSERT_EQ(requests, fake_ble_conn_params_requests(CONN_A));
+
+    // The checks run on the grid of the first write, 500 ms after the last write here
+    TEST_ASSERT_EQ(CONN_ACTIVITY_IDLE_TIMEOUT_MS + 500, advance_until_idle(CONN_A, 60000));
+    TEST_ASSERT_EQ(requests + 1, fake_ble_conn_params_requests(CONN_A));
+
+    conn_activity_disconnected(CONN_A);
+}
+
+static void test_busy_request_retried(void)
+{
+    conn_activity_connected(CONN_A);
+
+    // A pending procedure refuses the request, the next write tries again
+    fake_ble_conn_params_busy_set(1);
+    conn_activity_write(CONN_A);
+    TEST_ASSERT(!conn_activity_is_fast(CONN_A));
+    TEST_ASSERT(!fake_timer_running(IDLE_TIMER_ID));
+
+    conn_activity_write(CONN_A);
+    TEST_ASSERT(conn_activity_is_fast(CONN_A));
+
+    // A refused idle request is retried by the next check
+    fake_timer_advance(CONN_ACTIVITY_IDLE_TIMEOUT_MS - 1);
+    fake_ble_conn_params_busy_set(1);
+    TEST_ASSERT_EQ(1 + CONN_ACTIVITY_CHECK_INTERVAL_MS, advance_until_idle(CONN_A, 60000));
+    TEST_ASSERT(params_are(CONN_A, &m_idle));
+
+    conn_activity_disconnected(CONN_A);
+}
+
+static void test_links_independent(void)
+{
+    conn_activity_connected(CONN_A);
+    conn_activity_connected(CONN_B);
+
+    conn_activity_write(CONN_A);
+    conn_activity_write(CONN_B);
+
+    // Link B keeps writing, link A goes idle on its own
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        fake_timer_advance(1000);
+        conn_activity_write(CONN_B);
+    }
+    TEST_ASSERT(!conn_activity_is_fast(CONN_A));
+    TEST_ASSERT(conn_activity_is_fast(CONN_B));
+    TEST_ASSERT(fake_timer_running(IDLE_TIMER_ID));
+
+    // A link that disconnects while fast lets the timer stop at the next check
+    conn_activity_disconnected(CONN_B);
+    fake_timer_advance(CONN_ACTIVITY_CHECK_INTERVAL_MS);
+    TEST_ASSERT(!fake_timer_running(IDLE_TIMER_ID));
+
+    // Writes of links that are not tracked are ignored
+    uint32_t requests = fake_ble_conn_params_requests(CONN_B);
+    conn_activity_write(CONN_B);
+    TEST_ASSERT_EQ(requests, fake_ble_conn_params_requests(CONN_B));
+
+    conn_activity_disconnected(CONN_A);
+}
+
+int main(void)
+{
+    TEST_ASSERT_EQ(NRF_SUCCESS, hal_timer_init());
+    TEST_ASSERT_EQ(NRF_SUCCESS, conn_activity_init(&m_fast, &m_idle));
+
+    TEST_RUN(test_write_requests_fast_params);
+    TEST_RUN(test_steady_writes_stay_fast);
+    TEST_RUN(test_busy_request_retried);
+    TEST_RUN(test_links_independent);
+
+    return 0;
+}
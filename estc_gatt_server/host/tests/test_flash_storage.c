@@ -0,0 +1,145 @@
+#include "test.h"
+
+#include "flash_storage.h"
+#include "pwm_control.h"
+#include "app_scheduler.h"
+#include "estc_service.h"
+#include "fake_flash.h"
+#include "fake_pwm.h"
+#include "fake_ble.h"
+
+// One RGB record per word, a page holds this many before it is erased
+#define RECORDS_PER_PAGE (0x1000 / 4)
+
+static void reboot(void)
+{
+    fake_flash_process(UINT32_MAX);
+    flash_storage_init();
+}
+
+static void light_check(bool on, uint8_t r, uint8_t g, uint8_t b)
+{
+    rgb_color_t color = pwm_get_rgb_color();
+
+    TEST_ASSERT_EQ(on, pwm_is_rgb_on());
+    TEST_ASSERT_EQ(r, color.red);
+    TEST_ASSERT_EQ(g, color.green);
+    TEST_ASSERT_EQ(b, color.blue);
+    TEST_ASSERT_EQ(on ? r : 0, fake_pwm_duty(1));
+    TEST_ASSERT_EQ(on ? g : 0, fake_pwm_duty(2));
+    TEST_ASSERT_EQ(on ? b : 0, fake_pwm_duty(3));
+}
+
+static void test_empty_flash(void)
+{
+    fake_flash_reset();
+    flash_storage_init();
+
+    light_check(false, 0, 0, 0);
+    TEST_ASSERT_EQ(0, fake_flash_pending());
+}
+
+static void test_persist_restore(void)
+{
+    fake_flash_reset();
+    flash_storage_init();
+
+    flash_storage_update_values(true, 1, true, 10, 20, 30);
+    TEST_ASSERT_EQ(1, fake_flash_pending());
+
+    reboot();
+    light_check(true, 10, 20, 30);
+    TEST_ASSERT_EQ(1, fake_flash_stats()->writes);
+
+    // State and color are updated separately, the other half is kept
+    flash_storage_update_state(0);
+    reboot();
+    light_check(false, 10, 20, 30);
+
+    flash_storage_update_rgb(1, 2, 3);
+    reboot();
+    light_check(false, 1, 2, 3);
+    TEST_ASSERT_EQ(3, fake_flash_stats()->writes);
+}
+
+static void test_unchanged_not_written(void)
+{
+    fake_flash_reset();
+    flash_storage_init();
+
+    flash_storage_update_values(true, 1, true, 5, 6, 7);
+    fake_flash_process(UINT32_MAX);
+
+    flash_storage_update_values(true, 1, true, 5, 6, 7);
+    flash_storage_update_state(1);
+    flash_storage_update_rgb(5, 6, 7);
+    TEST_ASSERT_EQ(0, fake_flash_pending());
+    TEST_ASSERT_EQ(1, fake_flash_stats()->writes);
+}
+
+static void test_page_wraps(void)
+{
+    fake_flash_reset();
+    flash_storage_init();
+
+    for (uint32_t i = 0; i < RECORDS_PER_PAGE; i++)
+    {
+        flash_storage_update_rgb((uint8_t)i, (uint8_t)(i >> 8), 1);
+        fake_flash_process(UINT32_MAX);
+    }
+    TEST_ASSERT_EQ(0, fake_flash_stats()->erases);
+
+    // The full page keeps the last record across a reboot
+    reboot();
+    light_check(false, (uint8_t)(RECORDS_PER_PAGE - 1), (uint8_t)((RECORDS_PER_PAGE - 1) >> 8), 1);
+
+    flash_storage_update_values(true, 1, true, 200, 100, 50);
+    TEST_ASSERT_EQ(2, fake_flash_pending());
+    reboot();
+    TEST_ASSERT_EQ(1, fake_flash_stats()->erases);
+    light_check(true, 200, 100, 50);
+
+    // Writing goes on from the start of the erased page
+    flash_storage_update_rgb(9, 9, 9);
+    reboot();
+    TEST_ASSERT_EQ(1, fake_flash_stats()->erases);
+    light_check(true, 9, 9, 9);
+}
+
+static void test_characteristic_values_restored(void)
+{
+    fake_flash_reset();
+    flash_storage_init();
+
+    flash_storage_update_values(true, 1, true, 11, 22, 33);
+    reboot();
+
+    // The restored state is what the service reports before the first write
+    static ble_estc_service_t service;
+    ble_lbs_init_t init = {0};
+    fake_ble_reset();
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_ble_service_init(&service, &init));
+
+    fake_ble_char_t const *p_state = fake_ble_char_find(RANDOM_CHARACTERISTIC_UUID_RGB_STATE);
+    fake_ble_char_t const *p_value = fake_ble_char_find(RANDOM_CHARACTERISTIC_UUID_RGB_VALUE);
+    TEST_ASSERT(p_state != NULL && p_value != NULL);
+    TEST_ASSERT_EQ(1, p_state->value_len);
+    TEST_ASSERT_EQ(1, p_state->value[0]);
+    TEST_ASSERT_EQ(3, p_value->value_len);
+    TEST_ASSERT_EQ(0, memcmp(p_value->value, (uint8_t[]){11, 22, 33}, 3));
+}
+
+int main(void)
+{
+    APP_SCHED_INIT(ESTC_SCHED_EVENT_DATA_SIZE, 8);
+    pwm_controller_init();
+    pwm_start_playback();
+
+    TEST_RUN(test_empty_flash);
+    TEST_RUN(test_persist_restore);
+    TEST_RUN(test_unchanged_not_written);
+    TEST_RUN(test_page_wraps);
+    TEST_RUN(test_characteristic_values_restored);
+
+    return 0;
+}
@@ -0,0 +1,339 @@
+#include "test.h"
+#include "fixture.h"
+
+#include "estc_group.h"
+#include "estc_service.h"
+#include "estc_command.h"
+#include "ble_links.h"
+#include "conn_activity.h"
+#include "nrf_soc.h"
+#include "fake_ble.h"
+#include "fake_pwm.h"
+#include "fake_timer.h"
+
+// Scan timing of ble_module.c, SCAN_INTERVAL and SCAN_WINDOW
+#define SCAN_INTERVAL_MS 500
+#define SCAN_WINDOW_MS 25
+// A controller advertises every 20 ms plus the advDelay of 0 to 10 ms, for 2 s per command
+#define CTRL_ADV_INTERVAL_MS 20
+#define CTRL_ADV_DELAY_MAX_MS 10
+#define CTRL_ADV_DURATION_MS 2000
+// Other advertisers in range, one report every few ms
+#define NOISE_INTERVAL_MS 3
+
+static ble_estc_service_t m_service;
+
+// Sequence numbers handed to the store handler
+static uint32_t m_stores;
+static uint32_t m_stored_seq;
+
+// Packets of tools/estc_group_packet.py, AD structure of the manufacturer specific data
+static uint8_t const m_red[] = {0x11, 0xff, 0x59, 0x00, 0xec, 0x01, 0x01, 0x00, 0x00, 0x00,
+                                0x01, 0xff, 0x00, 0x00, 0xcc, 0x35, 0x28, 0xbf};
+static uint8_t const m_green[] = {0x11, 0xff, 0x59, 0x00, 0xec, 0x01, 0x02, 0x00, 0x00, 0x00,
+                                  0x01, 0x00, 0xff, 0x00, 0x6a, 0x44, 0xb6, 0x56};
+// Group 0xff: blue, on, brightness 128
+static uint8_t const m_all_blue[] = {0x15, 0xff, 0x59, 0x00, 0xec, 0xff, 0x03, 0x00, 0x00, 0x00,
+                                     0x01, 0x00, 0x00, 0xff, 0x02, 0x01, 0x05, 0x80,
+                                     0x79, 0x06, 0x45, 0x37};
+// Group 2
+static uint8_t const m_other_group[] = {0x11, 0xff, 0x59, 0x00, 0xec, 0x02, 0x04, 0x00, 0x00, 0x00,
+                                        0x01, 0xff, 0xff, 0xff, 0x0d, 0xa8, 0x7d, 0x99};
+// Off, sequence number 6
+static uint8_t const m_off[] = {0x0f, 0xff, 0x59, 0x00, 0xec, 0x01, 0x06, 0x00, 0x00, 0x00,
+                                0x02, 0x00, 0xf1, 0x20, 0x8f, 0xab};
+
+static void seq_store_handler(uint32_t seq)
+{
+    m_stores++;
+    m_stored_seq = seq;
+}
+
+// Flags and a name in front of the manufacturer specific data, as a controller would send it
+static uint16_t adv_data_build(uint8_t const *p_manuf, uint16_t manuf_len, uint8_t *p_buf)
+{
+    static uint8_t const prefix[] = {0x02, 0x01, 0x06, 0x04, 0x09, 'c', 't', 'l'};
+
+    memcpy(p_buf, prefix, sizeof(prefix));
+    memcpy(&p_buf[sizeof(prefix)], p_manuf, manuf_len);
+    return sizeof(prefix) + manuf_len;
+}
+
+// CBC-MAC of estc_group.h, written from its description
+static uint16_t packet_build(uint8_t group, uint32_t seq, uint8_t const *p_cmd, uint8_t cmd_len, uint8_t *p_buf)
+{
+    static uint8_t const key[SOC_ECB_KEY_LENGTH] = ESTC_GROUP_KEY;
+    uint8_t message[32] = {cmd_len, group, (uint8_t)seq, (uint8_t)(seq >> 8), (uint8_t)(seq >> 16), (uint8_t)(seq >> 24)};
+    nrf_ecb_hal_data_t ecb = {0};
+
+    memcpy(&message[6], p_cmd, cmd_len);
+    memcpy(ecb.key, key, sizeof(key));
+    for (uint16_t offset = 0; offset < 6u + cmd_len; offset += 16)
+    {
+        for (uint8_t i = 0; i < 16; i++)
+        {
+            ecb.cleartext[i] = message[offset + i] ^ ecb.ciphertext[i];
+        }
+        TEST_ASSERT_EQ(NRF_SUCCESS, sd_ecb_block_encrypt(&ecb));
+    }
+
+    uint16_t len = 0;
+    p_buf[len++] = (uint8_t)(3 + ESTC_GROUP_HEADER_SIZE + cmd_len + ESTC_GROUP_MAC_SIZE);
+    p_buf[len++] = 0xff;
+    p_buf[len++] = 0x59;
+    p_buf[len++] = 0x00;
+    p_buf[len++] = ESTC_GROUP_MAGIC;
+    memcpy(&p_buf[len], &message[1], 5);
+    len += 5;
+    memcpy(&p_buf[len], p_cmd, cmd_len);
+    len += cmd_len;
+    memcpy(&p_buf[len], ecb.ciphertext, ESTC_GROUP_MAC_SIZE);
+    return len + ESTC_GROUP_MAC_SIZE;
+}
+
+// After a reboot nothing is applied until the stored sequence number is back
+static void test_refused_until_restored(void)
+{
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_STATE, estc_group_adv_report(&m_service, m_red, sizeof(m_red)));
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(0, fixture_batch_count());
+    TEST_ASSERT_EQ(0, m_stores);
+
+    // A light that never stored one accepts the next command heard
+    estc_group_seq_restore(NULL);
+}
+
+static void test_packet_build(void)
+{
+    uint8_t buf[32];
+
+    TEST_ASSERT_EQ(sizeof(m_red), packet_build(1, 1, &m_red[10], 4, buf));
+    TEST_ASSERT(memcmp(buf, m_red, sizeof(m_red)) == 0);
+    TEST_ASSERT_EQ(sizeof(m_all_blue), packet_build(ESTC_GROUP_ALL, 3, &m_all_blue[10], 8, buf));
+    TEST_ASSERT(memcmp(buf, m_all_blue, sizeof(m_all_blue)) == 0);
+}
+
+static void test_commands_applied_once(void)
+{
+    uint8_t buf[64];
+
+    fixture_batches_clear();
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_adv_report(&m_service, buf, adv_data_build(m_red, sizeof(m_red), buf)));
+    // The controller repeats the packet, the light applies it once
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_STATE, estc_group_adv_report(&m_service, buf, adv_data_build(m_red, sizeof(m_red), buf)));
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(1, fixture_batch_count());
+    // Applied through the COMMAND characteristic path, outside of any connection
+    TEST_ASSERT_EQ(BLE_CONN_HANDLE_INVALID, fixture_batch_conn_handle());
+    TEST_ASSERT_EQ(ESTC_CMD_FLAG_COLOR, fixture_batch()->flags);
+    TEST_ASSERT_EQ(255, fixture_batch()->color.red);
+
+    // The bare payload, without other AD structures in front, and a group wide command
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_adv_report(&m_service, m_green, sizeof(m_green)));
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(255, fixture_batch()->color.green);
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_adv_report(&m_service, m_all_blue, sizeof(m_all_blue)));
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(3, fixture_batch_count());
+    TEST_ASSERT_EQ(1, fixture_batch()->state);
+    TEST_ASSERT_EQ(255, fixture_batch()->color.blue);
+    TEST_ASSERT_EQ(128, fixture_batch()->brightness);
+    TEST_ASSERT_EQ(128, fake_pwm_duty(3));
+}
+
+static void test_foreign_and_forged_reports(void)
+{
+    uint8_t buf[64];
+    uint8_t forged[sizeof(m_off)];
+    uint8_t const other_company[] = {0x06, 0xff, 0x4c, 0x00, 0xec, 0x01, 0x07};
+    uint8_t const truncated[] = {0x02, 0x01, 0x06, 0x11, 0xff, 0x59, 0x00, 0xec, 0x01};
+
+    fixture_batches_clear();
+    TEST_ASSERT_EQ(NRF_ERROR_NOT_FOUND, estc_group_adv_report(&m_service, buf, adv_data_build(m_other_group, sizeof(m_other_group), buf)));
+    TEST_ASSERT_EQ(NRF_ERROR_NOT_FOUND, estc_group_adv_report(&m_service, buf, adv_data_build(other_company, sizeof(other_company), buf)));
+    TEST_ASSERT_EQ(NRF_ERROR_NOT_FOUND, estc_group_adv_report(&m_service, truncated, sizeof(truncated)));
+    TEST_ASSERT_EQ(NRF_ERROR_NOT_FOUND, estc_group_adv_report(&m_service, buf, 0));
+
+    memcpy(forged, m_off, sizeof(m_off));
+    forged[11] = 0x01;
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_DATA, estc_group_adv_report(&m_service, forged, sizeof(forged)));
+    // A forged packet does not burn its sequence number
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_adv_report(&m_service, m_off, sizeof(m_off)));
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(1, fixture_batch_count());
+    TEST_ASSERT_EQ(0, fixture_batch()->state);
+}
+
+static uint32_t m_rand = 0x2545F491;
+
+static uint32_t rand_next(void)
+{
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return m_rand;
+}
+
+// Millisecond timeline of the reports in range: the controller repeating one command and other
+// advertisers. The light hears the reports inside its scan windows, the window opens at phase_ms.
+static void test_simulated_feed(void)
+{
+    uint32_t seq = 100;
+    uint32_t latency_max = 0;
+    uint32_t latency_sum = 0;
+    uint32_t runs = 0;
+    uint8_t const noise[] = {0x02, 0x01, 0x06, 0x0b, 0xff, 0x4c, 0x00, 0x10, 0x06, 0x1d, 0x1e, 0x5a, 0x39, 0x7b, 0x48};
+
+    for (uint32_t phase_ms = 0; phase_ms < SCAN_INTERVAL_MS; phase_ms += 7)
+    {
+        uint8_t cmd[] = {ESTC_CMD_OP_SET_COLOR, (uint8_t)phase_ms, 0x40, 0x80};
+        uint8_t packet[32];
+        uint16_t packet_len = packet_build(ESTC_GROUP_ID, seq++, cmd, sizeof(cmd), packet);
+        uint32_t next_ctrl_ms = rand_next() % CTRL_ADV_INTERVAL_MS;
+        uint32_t applied_ms = UINT32_MAX;
+        uint32_t repeats = 0;
+
+        fixture_batches_clear();
+        for (uint32_t now_ms = 0; now_ms < CTRL_ADV_DURATION_MS; now_ms++)
+        {
+            bool in_window = (now_ms + SCAN_INTERVAL_MS - phase_ms) % SCAN_INTERVAL_MS < SCAN_WINDOW_MS;
+
+            if (in_window && now_ms % NOISE_INTERVAL_MS == 0)
+            {
+                TEST_ASSERT_EQ(NRF_ERROR_NOT_FOUND, estc_group_adv_report(&m_service, noise, sizeof(noise)));
+            }
+            if (now_ms == next_ctrl_ms)
+            {
+                next_ctrl_ms += CTRL_ADV_INTERVAL_MS + rand_next() % (CTRL_ADV_DELAY_MAX_MS + 1);
+                if (in_window)
+                {
+                    ret_code_t err_code = estc_group_adv_report(&m_service, packet, packet_len);
+                    if (err_code == NRF_SUCCESS)
+                    {
+                        applied_ms = now_ms;
+                    }
+                    else
+                    {
+                        TEST_ASSERT_EQ(NRF_ERROR_INVALID_STATE, err_code);
+                        repeats++;
+                    }
+                }
+            }
+            fixture_main_loop_run();
+        }
+
+        // Applied once within the first two scan intervals, the repeats are dropped early
+        TEST_ASSERT_EQ(1, fixture_batch_count());
+        TEST_ASSERT_EQ((uint8_t)phase_ms, fixture_batch()->color.red);
+        TEST_ASSERT(applied_ms < 2 * SCAN_INTERVAL_MS);
+        TEST_ASSERT(repeats > 0);
+        latency_max = applied_ms > latency_max ? applied_ms : latency_max;
+        latency_sum += applied_ms;
+        runs++;
+    }
+
+    printf("group command latency: mean %u ms, max %u ms over %u scan phases\n",
+           latency_sum / runs, latency_max, runs);
+}
+
+// A group command is no write of any link: it must not match a free link context
+static void test_links(void)
+{
+    ble_gap_addr_t const peer_addr = {.addr = {1}};
+    uint8_t const cccd[] = {BLE_GATT_HVX_NOTIFICATION, 0};
+    uint8_t cmd[] = {ESTC_CMD_OP_SET_COLOR, 0x10, 0x20, 0x30};
+    uint8_t packet[32];
+    fake_ble_evt_buf_t evt;
+
+    // No link connected
+    fixture_batches_clear();
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_adv_report(&m_service, packet, packet_build(ESTC_GROUP_ID, 1000, cmd, sizeof(cmd), packet)));
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(1, fixture_batch_count());
+    TEST_ASSERT_EQ(BLE_CONN_HANDLE_INVALID, fixture_batch_conn_handle());
+    for (uint16_t conn_handle = 0; conn_handle < FAKE_BLE_CONN_COUNT; conn_handle++)
+    {
+        TEST_ASSERT_EQ(0, fake_ble_conn_params_requests(conn_handle));
+    }
+
+    // One link subscribed to the color, it is notified but keeps its parameters
+    ble_lbs_on_ble_evt(fake_ble_gap_evt(&evt, BLE_GAP_EVT_CONNECTED, 0), &m_service);
+    TEST_ASSERT(ble_links_connected(0, &peer_addr) != NULL);
+    ble_lbs_on_ble_evt(fake_ble_write_evt(&evt, 0, m_service.char_handles[ESTC_CHAR_RGB_VALUE].cccd_handle,
+                                          BLE_GATTS_OP_WRITE_REQ, cccd, sizeof(cccd)),
+                       &m_service);
+    fake_ble_notifications_clear();
+
+    cmd[1] = 0x40;
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_adv_report(&m_service, packet, packet_build(ESTC_GROUP_ID, 1001, cmd, sizeof(cmd), packet)));
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(2, fixture_batch_count());
+    TEST_ASSERT_EQ(0, fake_ble_conn_params_requests(0));
+    TEST_ASSERT(!conn_activity_is_fast(0));
+    TEST_ASSERT(ble_links_get(0)->first_write_pending);
+    TEST_ASSERT(ble_links_get(BLE_CONN_HANDLE_INVALID) == NULL);
+    TEST_ASSERT_EQ(1, fake_ble_notification_count());
+    TEST_ASSERT_EQ(m_service.char_handles[ESTC_CHAR_RGB_VALUE].value_handle, fake_ble_notification(0)->value_handle);
+    TEST_ASSERT_EQ(0x40, fake_ble_notification(0)->data[0]);
+
+    fake_ble_tx_complete(0);
+    ble_lbs_on_ble_evt(fake_ble_gap_evt(&evt, BLE_GAP_EVT_DISCONNECTED, 0), &m_service);
+    ble_links_disconnected(0);
+}
+
+// Stores are spaced by the interval, a reboot keeps the last stored sequence number
+static void test_seq_store(void)
+{
+    uint8_t cmd[] = {ESTC_CMD_OP_SET_COLOR, 0x50, 0x60, 0x70};
+    uint8_t packet[32];
+    uint16_t len;
+
+    // The last command of the earlier tests is stored, then the store is free
+    fake_timer_advance(ESTC_GROUP_SEQ_STORE_INTERVAL_MS);
+    TEST_ASSERT_EQ(1001, m_stored_seq);
+    fake_timer_advance(ESTC_GROUP_SEQ_STORE_INTERVAL_MS);
+    m_stores = 0;
+
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_adv_report(&m_service, packet, packet_build(ESTC_GROUP_ID, 2000, cmd, sizeof(cmd), packet)));
+    TEST_ASSERT_EQ(1, m_stores);
+    TEST_ASSERT_EQ(2000, m_stored_seq);
+
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_adv_report(&m_service, packet, packet_build(ESTC_GROUP_ID, 2001, cmd, sizeof(cmd), packet)));
+    len = packet_build(ESTC_GROUP_ID, 2002, cmd, sizeof(cmd), packet);
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_adv_report(&m_service, packet, len));
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(1, m_stores);
+
+    // The last one is stored once the interval is over, then nothing is left to store
+    fake_timer_advance(ESTC_GROUP_SEQ_STORE_INTERVAL_MS - 1);
+    TEST_ASSERT_EQ(1, m_stores);
+    fake_timer_advance(1);
+    TEST_ASSERT_EQ(2, m_stores);
+    TEST_ASSERT_EQ(2002, m_stored_seq);
+    fake_timer_advance(ESTC_GROUP_SEQ_STORE_INTERVAL_MS);
+    TEST_ASSERT_EQ(2, m_stores);
+
+    // Reboot: a recorded packet is not applied again
+    uint32_t stored_seq = m_stored_seq;
+    estc_group_seq_restore(&stored_seq);
+    TEST_ASSERT_EQ(NRF_ERROR_INVALID_STATE, estc_group_adv_report(&m_service, packet, len));
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_adv_report(&m_service, packet, packet_build(ESTC_GROUP_ID, 2003, cmd, sizeof(cmd), packet)));
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(0x50, fixture_batch()->color.red);
+}
+
+int main(void)
+{
+    fixture_init(&m_service);
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_group_init(seq_store_handler));
+
+    TEST_RUN(test_refused_until_restored);
+    TEST_RUN(test_packet_build);
+    TEST_RUN(test_commands_applied_once);
+    TEST_RUN(test_foreign_and_forged_reports);
+    TEST_RUN(test_simulated_feed);
+    TEST_RUN(test_links);
+    TEST_RUN(test_seq_store);
+
+    return 0;
+}
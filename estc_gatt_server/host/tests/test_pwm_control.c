@@ -0,0 +1,255 @@
+#include "test.h"
+
+#include "pwm_control.h"
+#include "fake_pwm.h"
+#include "fake_timer.h"
+
+// The fade timer is the only timer pwm_control creates
+#define FADE_TIMER_ID 0
+#define FADE_STEP_MS 20
+#define FADE_STEP_TICKS APP_TIMER_TICKS(FADE_STEP_MS)
+
+static void duty_check(uint16_t r, uint16_t g, uint16_t b)
+{
+    TEST_ASSERT_EQ(r, fake_pwm_duty(1));
+    TEST_ASSERT_EQ(g, fake_pwm_duty(2));
+    TEST_ASSERT_EQ(b, fake_pwm_duty(3));
+}
+
+static void light_reset(void)
+{
+    pwm_apply_light(false, (rgb_color_t){0, 0, 0}, 255, 0);
+    pwm_process();
+}
+
+static void test_starts_dark(void)
+{
+    duty_check(0, 0, 0);
+    TEST_ASSERT(!fake_pwm_running());
+    TEST_ASSERT(!pwm_is_rgb_on());
+    TEST_ASSERT_EQ(255, pwm_get_brightness());
+}
+
+static void test_color(void)
+{
+    pwm_set_rgb_color(10, 20, 30);
+    // The color is kept while the light is off
+    duty_check(0, 0, 0);
+    TEST_ASSERT(!fake_pwm_running());
+
+    pwm_on_rgb();
+    duty_check(10, 20, 30);
+    TEST_ASSERT(fake_pwm_running());
+
+    pwm_set_rgb_color(255, 0, 128);
+    duty_check(255, 0, 128);
+
+    rgb_color_t color = pwm_get_rgb_color();
+    TEST_ASSERT_EQ(255, color.red);
+    TEST_ASSERT_EQ(0, color.green);
+    TEST_ASSERT_EQ(128, color.blue);
+
+    pwm_off_rgb();
+    duty_check(0, 0, 0);
+    TEST_ASSERT(!fake_pwm_running());
+
+    // Black is dark even when switched on, the PWM stays stopped
+    pwm_set_rgb_color(0, 0, 0);
+    pwm_on_rgb();
+    TEST_ASSERT(!fake_pwm_running());
+
+    light_reset();
+}
+
+static void test_brightness(void)
+{
+    pwm_set_rgb_color(255, 128, 1);
+    pwm_on_rgb();
+
+    pwm_set_brightness(128);
+    duty_check(128, 64, 0);
+    TEST_ASSERT_EQ(128, pwm_get_brightness());
+    TEST_ASSERT(fake_pwm_running());
+
+    // A color dimmed to nothing does not need the PWM
+    pwm_set_brightness(0);
+    duty_check(0, 0, 0);
+    TEST_ASSERT(!fake_pwm_running());
+
+    pwm_set_brightness(255);
+    duty_check(255, 128, 1);
+    TEST_ASSERT(fake_pwm_running());
+
+    light_reset();
+}
+
+static void test_command_latest_wins(void)
+{
+    pwm_command_t command = {.state = 1, .color = {1, 2, 3}, .brightness = 255};
+
+    TEST_ASSERT(pwm_command_push(&command));
+    command.color = (rgb_color_t){40, 50, 60};
+    command.brightness = 51;
+    TEST_ASSERT(pwm_command_push(&command));
+    // Nothing is rendered before the main loop runs
+    duty_check(0, 0, 0);
+
+    pwm_process();
+    duty_check(8, 10, 12);
+    TEST_ASSERT(pwm_is_rgb_on());
+
+    light_reset();
+}
+
+static void test_command_ring_full(void)
+{
+    pwm_command_t command = {.state = 1, .color = {9, 9, 9}, .brightness = 255};
+    uint32_t pushed = 0;
+
+    while (pwm_command_push(&command))
+    {
+        pushed++;
+        TEST_ASSERT(pushed <= 64);
+    }
+    TEST_ASSERT(pushed > 0);
+
+    pwm_process();
+    duty_check(9, 9, 9);
+    TEST_ASSERT(pwm_command_push(&command));
+    pwm_process();
+
+    light_reset();
+}
+
+static void test_fade(void)
+{
+    pwm_apply_light(true, (rgb_color_t){0, 0, 0}, 255, 0);
+    pwm_apply_light(true, (rgb_color_t){100, 200, 40}, 255, 5 * FADE_STEP_MS);
+
+    // The target is reported while fading
+    rgb_color_t color = pwm_get_rgb_color();
+    TEST_ASSERT_EQ(100, color.red);
+    TEST_ASSERT(fake_timer_running(FADE_TIMER_ID));
+    uint32_t expiries = fake_timer_expiries(FADE_TIMER_ID);
+
+    // Nothing happens before the first step is due
+    fake_timer_advance_ticks(FADE_STEP_TICKS - 1);
+    pwm_process();
+    duty_check(0, 0, 0);
+
+    fake_timer_advance_ticks(1);
+    pwm_process();
+    duty_check(20, 40, 8);
+
+    // Ticks missed by the main loop are caught up in one go
+    fake_timer_advance_ticks(2 * FADE_STEP_TICKS);
+    pwm_process();
+    duty_check(60, 120, 24);
+
+    // The main loop stops the timer with the last step
+    fake_timer_advance_ticks(2 * FADE_STEP_TICKS);
+    pwm_process();
+    duty_check(100, 200, 40);
+    TEST_ASSERT(!fake_timer_running(FADE_TIMER_ID));
+    TEST_ASSERT_EQ(5, fake_timer_expiries(FADE_TIMER_ID) - expiries);
+
+    light_reset();
+}
+
+static void test_color_stops_fade(void)
+{
+    pwm_apply_light(true, (rgb_color_t){0, 0, 0}, 255, 0);
+    pwm_fade_to_rgb_color(200, 200, 200, 10 * FADE_STEP_MS);
+    fake_timer_advance_ticks(FADE_STEP_TICKS);
+    pwm_process();
+
+    pwm_set_rgb_color(7, 8, 9);
+    TEST_ASSERT(!fake_timer_running(FADE_TIMER_ID));
+    duty_check(7, 8, 9);
+
+    // A fade shorter than a step is a plain color change
+    pwm_fade_to_rgb_color(1, 2, 3, FADE_STEP_MS - 1);
+    TEST_ASSERT(!fake_timer_running(FADE_TIMER_ID));
+    duty_check(1, 2, 3);
+
+    light_reset();
+}
+
+// The main loop runs after every timer interrupt, as on the target when it is not busy
+static uint32_t m_main_loop_passes;
+static uint16_t m_red_last;
+
+static void main_loop_hook(void)
+{
+    pwm_process();
+    m_main_loop_passes++;
+
+    // A fade up never steps back
+    TEST_ASSERT(fake_pwm_duty(1) >= m_red_last);
+    m_red_last = fake_pwm_duty(1);
+}
+
+static void test_long_fade(void)
+{
+    uint16_t const duration_ms = 65000;
+    uint32_t const steps = duration_ms / FADE_STEP_MS;
+
+    pwm_apply_light(true, (rgb_color_t){0, 0, 0}, 255, 0);
+    pwm_fade_to_rgb_color(255, 128, 1, duration_ms);
+
+    m_main_loop_passes = 0;
+    m_red_last = 0;
+    uint32_t expiries = fake_timer_expiries(FADE_TIMER_ID);
+    uint64_t start_ms = fake_timer_ms();
+
+    fake_timer_hook_set(main_loop_hook);
+    // An hour of virtual time, the fade ends after a minute and its timer stops
+    for (uint32_t minute = 0; minute < 60; minute++)
+    {
+        fake_timer_advance(60 * 1000);
+    }
+    fake_timer_hook_set(NULL);
+
+    TEST_ASSERT_EQ(60 * 60 * 1000, fake_timer_ms() - start_ms);
+    TEST_ASSERT_EQ(steps, fake_timer_expiries(FADE_TIMER_ID) - expiries);
+    TEST_ASSERT_EQ(steps, m_main_loop_passes);
+    TEST_ASSERT(!fake_timer_running(FADE_TIMER_ID));
+    duty_check(255, 128, 1);
+
+    light_reset();
+}
+
+static void test_timestamps(void)
+{
+    uint32_t stamp = hal_timer_stamp_get();
+
+    fake_timer_advance(1500);
+    TEST_ASSERT_EQ(1500, hal_timer_elapsed_ms(stamp));
+    TEST_ASSERT_EQ(1500000, hal_timer_stamp_diff_us(hal_timer_stamp_get(), stamp));
+
+    // Across the wrap of the 24-bit RTC counter
+    uint64_t to_wrap = APP_TIMER_MAX_CNT_VAL + 1 - fake_timer_ticks() % (APP_TIMER_MAX_CNT_VAL + 1);
+    fake_timer_advance_ticks(to_wrap - FAKE_TIMER_TICK_FREQ);
+    stamp = hal_timer_stamp_get();
+    fake_timer_advance(HAL_TIMER_ELAPSED_MAX_MS);
+    TEST_ASSERT(hal_timer_stamp_get() < stamp);
+    TEST_ASSERT_EQ(HAL_TIMER_ELAPSED_MAX_MS, hal_timer_elapsed_ms(stamp));
+}
+
+int main(void)
+{
+    pwm_controller_init();
+    pwm_start_playback();
+
+    TEST_RUN(test_starts_dark);
+    TEST_RUN(test_color);
+    TEST_RUN(test_brightness);
+    TEST_RUN(test_command_latest_wins);
+    TEST_RUN(test_command_ring_full);
+    TEST_RUN(test_fade);
+    TEST_RUN(test_color_stops_fade);
+    TEST_RUN(test_long_fade);
+    TEST_RUN(test_timestamps);
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include "test.h"
+#include "fixture.h"
+
+#include "estc_service.h"
+#include "estc_command.h"
+#include "crc32.h"
+#include "fake_ble.h"
+#include "fake_pwm.h"
+
+#define CONN 0
+
+static ble_estc_service_t m_service;
+
+static void write(uint16_t handle, uint8_t op, uint8_t const *p_data, uint16_t len)
+{
+    fake_ble_evt_buf_t buf;
+    ble_lbs_on_ble_evt(fake_ble_write_evt(&buf, CONN, handle, op, p_data, len), &m_service);
+}
+
+static void duty_check(uint16_t r, uint16_t g, uint16_t b)
+{
+    TEST_ASSERT_EQ(r, fake_pwm_duty(1));
+    TEST_ASSERT_EQ(g, fake_pwm_duty(2));
+    TEST_ASSERT_EQ(b, fake_pwm_duty(3));
+}
+
+static void test_attribute_table(void)
+{
+    for (uint8_t id = 0; id < ESTC_CHAR_COUNT; id++)
+    {
+        ble_gatts_char_handles_t const *p_handles = &m_service.char_handles[id];
+
+        TEST_ASSERT(p_handles->value_handle > m_service.service_handle);
+        TEST_ASSERT(p_handles->value_handle - m_service.service_handle < ESTC_HANDLE_MAP_SIZE);
+        TEST_ASSERT(p_handles->user_desc_handle != 0);
+    }
+    TEST_ASSERT(fake_ble_char_find(RANDOM_CHARACTERISTIC_UUID_RGB_STATE) != NULL);
+    TEST_ASSERT(fake_ble_char_find(RANDOM_CHARACTERISTIC_UUID_PROGRAM) != NULL);
+}
+
+static void test_color_and_state_writes(void)
+{
+    fixture_batches_clear();
+
+    write(fixture_value_handle(ESTC_CHAR_RGB_VALUE), BLE_GATTS_OP_WRITE_REQ, (uint8_t[]){30, 60, 90}, 3);
+    write(fixture_value_handle(ESTC_CHAR_RGB_STATE), BLE_GATTS_OP_WRITE_REQ, (uint8_t[]){1}, 1);
+    // The writes are folded into one batch for the main loop
+    TEST_ASSERT_EQ(0, fixture_batch_count());
+    fixture_main_loop_run();
+
+    TEST_ASSERT_EQ(1, fixture_batch_count());
+    TEST_ASSERT_EQ(CONN, fixture_batch_conn_handle());
+    TEST_ASSERT_EQ(ESTC_CMD_FLAG_STATE | ESTC_CMD_FLAG_COLOR, fixture_batch()->flags);
+    TEST_ASSERT_EQ(1, fixture_batch()->state);
+    TEST_ASSERT_EQ(60, fixture_batch()->color.green);
+    duty_check(30, 60, 90);
+
+    write(fixture_value_handle(ESTC_CHAR_RGB_STATE), BLE_GATTS_OP_WRITE_CMD, (uint8_t[]){0}, 1);
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(2, fixture_batch_count());
+    TEST_ASSERT_EQ(ESTC_CMD_FLAG_STATE, fixture_batch()->flags);
+    // The color is kept with the light off
+    TEST_ASSERT_EQ(90, fixture_batch()->color.blue);
+    duty_check(0, 0, 0);
+}
+
+static void test_brightness_command(void)
+{
+    uint8_t const commands[] = {
+        ESTC_CMD_OP_SET_COLOR, 255, 255, 255,
+        ESTC_CMD_OP_SET_BRIGHTNESS, 51,
+        ESTC_CMD_OP_SET_STATE, 1,
+    };
+
+    fixture_batches_clear();
+    write(fixture_value_handle(ESTC_CHAR_COMMAND), BLE_GATTS_OP_WRITE_CMD, commands, sizeof(commands));
+    fixture_main_loop_run();
+
+    TEST_ASSERT_EQ(1, fixture_batch_count());
+    TEST_ASSERT_EQ(ESTC_CMD_FLAG_STATE | ESTC_CMD_FLAG_COLOR | ESTC_CMD_FLAG_BRIGHTNESS, fixture_batch()->flags);
+    TEST_ASSERT_EQ(51, fixture_batch()->brightness);
+    duty_check(51, 51, 51);
+
+    // A later color write keeps the brightness
+    write(fixture_value_handle(ESTC_CHAR_RGB_VALUE), BLE_GATTS_OP_WRITE_REQ, (uint8_t[]){255, 0, 0}, 3);
+    fixture_main_loop_run();
+    TEST_ASSERT_EQ(51, fixture_batch()->brightness);
+    duty_check(51, 0, 0);
+}
+
+static void test_light_state_leads_output(void)
+{
+    estc_cmd_batch_t state;
+    uint8_t const commands[] = {ESTC_CMD_OP_FADE_TO, 0, 200, 0, 0xE8, 0x03};
+
+    write(fixture_value_handle(ESTC_CHAR_COMMAND), BLE_GATTS_OP_WRITE_CMD, commands, sizeof(commands));
+    fixture_main_loop_run();
+
+    // The fade target is the light state from the write on, the output only starts to move
+    estc_service_light_state_get(&state);
+    TEST_ASSERT_EQ(1, state.state);
+    TEST_ASSERT_EQ(0, state.color.red);
+    TEST_ASSERT_EQ(200, state.color.green);
+    TEST_ASSERT_EQ(51, state.brightness);
+    TEST_ASSERT_EQ(0, state.flags);
+    TEST_ASSERT(fake_pwm_duty(2) < 40);
+}
+
+static void test_invalid_writes_dropped(void)
+{
+    fixture_batches_clear();
+
+    // Wrong length, prepared write, unknown handle and a malformed command stream
+    write(fixture_value_handle(ESTC_CHAR_RGB_VALUE), BLE_GATTS_OP_WRITE_REQ, (uint8_t[]){1, 2}, 2);
+    write(fixture_value_handle(ESTC_CHAR_RGB_STATE), BLE_GATTS_OP_PREP_WRITE_REQ, (uint8_t[]){1}, 1);
+    write(m_service.char_handles[ESTC_CHAR_RGB_VALUE].user_desc_handle, BLE_GATTS_OP_WRITE_REQ, (uint8_t[]){1, 2, 3}, 3);
+    write(m_service.service_handle - 1, BLE_GATTS_OP_WRITE_REQ, (uint8_t[]){1}, 1);
+    write(fixture_value_handle(ESTC_CHAR_COMMAND), BLE_GATTS_OP_WRITE_CMD, (uint8_t[]){ESTC_CMD_OP_SET_COLOR, 1}, 2);
+    fixture_main_loop_run();
+
+    TEST_ASSERT_EQ(0, fixture_batch_count());
+    duty_check(51, 0, 0);
+}
+
+static void test_db_hash(void)
+{
+    static ble_estc_service_t service;
+    ble_lbs_init_t init = {.batch_write_handler = fixture_batch_handler};
+    uint32_t hash = estc_service_db_hash(&m_service);
+
+    // The CRC-32 check value
+    TEST_ASSERT_EQ(0xCBF43926, crc32_compute((uint8_t const *)"123456789", 9, NULL));
+
+    // The same table on the next boot keeps the hash
+    fake_ble_reset();
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_ble_service_init(&service, &init));
+    TEST_ASSERT_EQ(hash, estc_service_db_hash(&service));
+
+    // Any moved attribute changes it, the value handles alone do not cover the table
+    service.char_handles[ESTC_CHAR_PROGRAM].cccd_handle++;
+    TEST_ASSERT(estc_service_db_hash(&service) != hash);
+    service.char_handles[ESTC_CHAR_PROGRAM].cccd_handle--;
+    service.char_handles[ESTC_CHAR_RGB_STATE].user_desc_handle++;
+    TEST_ASSERT(estc_service_db_hash(&service) != hash);
+    service.char_handles[ESTC_CHAR_RGB_STATE].user_desc_handle--;
+    service.service_handle++;
+    TEST_ASSERT(estc_service_db_hash(&service) != hash);
+}
+
+static void test_handle_map_overflow(void)
+{
+    static ble_estc_service_t service;
+    ble_lbs_init_t init = {.batch_write_handler = fixture_batch_handler};
+
+    // One descriptor more per characteristic than the map allows for
+    fake_ble_reset();
+    fake_ble_attr_gap_set(1);
+    TEST_ASSERT_EQ(NRF_ERROR_NO_MEM, estc_ble_service_init(&service, &init));
+
+    fake_ble_reset();
+    TEST_ASSERT_EQ(NRF_SUCCESS, estc_ble_service_init(&service, &init));
+}
+
+int main(void)
+{
+    fixture_init(&m_service);
+
+    TEST_RUN(test_attribute_table);
+    TEST_RUN(test_color_and_state_writes);
+    TEST_RUN(test_brightness_command);
+    TEST_RUN(test_invalid_writes_dropped);
+    TEST_RUN(test_light_state_leads_output);
+    TEST_RUN(test_db_hash);
+    TEST_RUN(test_handle_map_overflow);
+
+    return 0;
+}
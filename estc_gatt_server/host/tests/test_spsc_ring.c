@@ -0,0 +1,159 @@
+#include "test.h"
+
+#include <pthread.h>
+#include "spsc_ring.h"
+
+#define STRESS_RECORDS 2000000
+#define STRESS_CAPACITY 8
+// Start both indexes close to the 32-bit wrap so the stress run crosses it
+#define INDEX_START (UINT32_MAX - STRESS_RECORDS / 2)
+
+// Larger than a word so a torn copy shows up as a mismatch between the fields
+typedef struct
+{
+    uint32_t seq;
+    uint32_t check;
+    uint8_t fill[24];
+} record_t;
+
+static void record_make(record_t *p_record, uint32_t seq)
+{
+    p_record->seq = seq;
+    p_record->check = ~seq * 2654435761u;
+    memset(p_record->fill, (uint8_t)seq, sizeof(p_record->fill));
+}
+
+static void record_verify(record_t const *p_record, uint32_t seq)
+{
+    record_t expected;
+    record_make(&expected, seq);
+    TEST_ASSERT_EQ(seq, p_record->seq);
+    TEST_ASSERT(memcmp(&expected, p_record, sizeof(expected)) == 0);
+}
+
+static void test_fill_and_drain(void)
+{
+    static record_t buffer[4];
+    spsc_ring_t ring = {.p_buffer = (uint8_t *)buffer, .record_size = sizeof(record_t), .capacity = 4,
+                        .head = UINT32_MAX - 2, .tail = UINT32_MAX - 2};
+    record_t record;
+    uint32_t pushed = 0;
+    uint32_t popped = 0;
+
+    TEST_ASSERT(!spsc_ring_pop(&ring, &record));
+
+    // Several rounds through the buffer, across the index wrap, always filled to capacity
+    for (uint32_t round = 0; round < 5; round++)
+    {
+        for (;;)
+        {
+            record_make(&record, pushed);
+            if (!spsc_ring_push(&ring, &record))
+            {
+                break;
+            }
+            pushed++;
+        }
+        TEST_ASSERT_EQ(4, spsc_ring_count(&ring));
+
+        // Drain a different amount each round so the slots shift
+        for (uint32_t i = 0; i <= round % 4; i++)
+        {
+            TEST_ASSERT(spsc_ring_pop(&ring, &record));
+            record_verify(&record, popped++);
+        }
+    }
+
+    while (spsc_ring_pop(&ring, &record))
+    {
+        record_verify(&record, popped++);
+    }
+    TEST_ASSERT_EQ(pushed, popped);
+    TEST_ASSERT_EQ(0, spsc_ring_count(&ring));
+}
+
+typedef struct
+{
+    spsc_ring_t *p_ring;
+    uint32_t full_spins;
+    uint32_t empty_spins;
+    uint32_t max_count;
+} stress_ctx_t;
+
+static void *producer_thread(void *p_arg)
+{
+    stress_ctx_t *p_ctx = p_arg;
+    record_t record;
+
+    for (uint32_t seq = 0; seq < STRESS_RECORDS; seq++)
+    {
+        record_make(&record, seq);
+        while (!spsc_ring_push(p_ctx->p_ring, &record))
+        {
+            p_ctx->full_spins++;
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void *consumer_thread(void *p_arg)
+{
+    stress_ctx_t *p_ctx = p_arg;
+    record_t record;
+
+    for (uint32_t seq = 0; seq < STRESS_RECORDS; seq++)
+    {
+        uint32_t count = spsc_ring_count(p_ctx->p_ring);
+        TEST_ASSERT(count <= STRESS_CAPACITY);
+        if (count > p_ctx->max_count)
+        {
+            p_ctx->max_count = count;
+        }
+
+        while (!spsc_ring_pop(p_ctx->p_ring, &record))
+        {
+            p_ctx->empty_spins++;
+            sched_yield();
+        }
+        // Every record arrives once, complete and in order
+        record_verify(&record, seq);
+    }
+
+    return NULL;
+}
+
+static void test_threads(void)
+{
+    static record_t buffer[STRESS_CAPACITY];
+    spsc_ring_t ring = {.p_buffer = (uint8_t *)buffer, .record_size = sizeof(record_t),
+                        .capacity = STRESS_CAPACITY, .head = INDEX_START, .tail = INDEX_START};
+    stress_ctx_t producer = {.p_ring = &ring};
+    stress_ctx_t consumer = {.p_ring = &ring};
+    pthread_t producer_id;
+    pthread_t consumer_id;
+
+    TEST_ASSERT_EQ(0, pthread_create(&consumer_id, NULL, consumer_thread, &consumer));
+    TEST_ASSERT_EQ(0, pthread_create(&producer_id, NULL, producer_thread, &producer));
+    TEST_ASSERT_EQ(0, pthread_join(producer_id, NULL));
+    TEST_ASSERT_EQ(0, pthread_join(consumer_id, NULL));
+
+    record_t record;
+    TEST_ASSERT(!spsc_ring_pop(&ring, &record));
+    TEST_ASSERT_EQ((uint32_t)(INDEX_START + STRESS_RECORDS), ring.head);
+    TEST_ASSERT_EQ(ring.head, ring.tail);
+    // The run must have crossed the index wrap
+    TEST_ASSERT(ring.head < INDEX_START);
+
+    printf("  %u records, ring full %u times, empty %u times, max depth %u\n", STRESS_RECORDS,
+           producer.full_spins, consumer.empty_spins, consumer.max_count);
+}
+
+int main(void)
+{
+    TEST_RUN(test_fill_and_drain);
+    TEST_RUN(test_threads);
+
+    return 0;
+}
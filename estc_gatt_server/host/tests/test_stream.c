@@ -0,0 +1,254 @@
+#include "test.h"
+#include "fixture.h"
+
+#include "estc_service.h"
+#include "estc_command.h"
+#include "estc_anim.h"
+#include "flash_storage.h"
+#include "app_util.h"
+#include "fake_ble.h"
+#include "fake_flash.h"
+#include "fake_pwm.h"
+#include "fake_timer.h"
+
+static ble_estc_service_t m_service;
+
+// A chunk of one 100 ms frame
+static void chunk_write(uint16_t conn_handle, estc_char_id_t id, uint16_t seq)
+{
+    uint8_t chunk[ESTC_STREAM_HEADER_SIZE + PWM_STREAM_FRAME_SIZE] = {0, 0, 100, 0, 10, 20, 30};
+    fake_ble_evt_buf_t buf;
+
+    uint16_encode(seq, chunk);
+    ble_lbs_on_ble_evt(fake_ble_write_evt(&buf, conn_handle, fixture_value_handle(id), BLE_GATTS_OP_WRITE_CMD,
+                                          chunk, sizeof(chunk)),
+                       &m_service);
+}
+
+// A PROGRAM upload in one chunk: slot, length and a hold of color for steps
+static void program_write(uint16_t conn_handle, uint8_t slot, uint8_t color, uint16_t steps)
+{
+    uint8_t chunk[] = {0, 0, slot, 8, 0, ESTC_ANIM_OP_HOLD_RGB, color, color, color,
+                       0x80 | (steps & 0x7F), 0x80 | ((steps >> 7) & 0x7F), steps >> 14, ESTC_ANIM_OP_END};
+    fake_ble_evt_buf_t buf;
+
+    ble_lbs_on_ble_evt(fake_ble_write_evt(&buf, conn_handle, fixture_value_handle(ESTC_CHAR_PROGRAM),
+                                          BLE_GATTS_OP_WRITE_CMD, chunk, sizeof(chunk)),
+                       &m_service);
+}
+
+static void program_play(uint16_t conn_handle, uint8_t slot)
+{
+    uint8_t const command[] = {ESTC_CMD_OP_PLAY_PROGRAM, slot};
+    fake_ble_evt_buf_t buf;
+
+    ble_lbs_on_ble_evt(fake_ble_write_evt(&buf, conn_handle, fixture_value_handle(ESTC_CHAR_COMMAND),
+                                          BLE_GATTS_OP_WRITE_CMD, command, sizeof(command)),
+                       &m_service);
+    fixture_main_loop_run();
+}
+
+static bool program_stored(uint8_t slot)
+{
+    uint8_t const *p_program;
+    uint16_t len;
+
+    return flash_storage_program_get(slot, &p_program, &len);
+}
+
+// Play stream buffers until the stream ends, false if it still plays after count buffers
+static bool stream_end_wait(uint32_t count)
+{
+    for (; count != 0 && fake_pwm_stream_active(); count--)
+    {
+        fake_pwm_stream_play(1);
+        fixture_main_loop_run();
+    }
+    return !fake_pwm_stream_active();
+}
+
+static void disconnect(uint16_t conn_handle)
+{
+    fake_ble_evt_buf_t buf;
+
+    ble_lbs_on_ble_evt(fake_ble_gap_evt(&buf, BLE_GAP_EVT_DISCONNECTED, conn_handle), &m_service);
+}
+
+// Check the only notification since the last call, then let the link send again
+static void status_check(uint16_t conn_handle, estc_char_id_t id, estc_stream_status_t status, uint16_t expected_seq)
+{
+    fake_ble_notification_t const *p_notification = fake_ble_notification(0);
+
+    TEST_ASSERT_EQ(1, fake_ble_notification_count());
+    TEST_ASSERT_EQ(conn_handle, p_notification->conn_handle);
+    TEST_ASSERT_EQ(fixture_value_handle(id), p_notification->value_handle);
+    TEST_ASSERT_EQ(ESTC_STREAM_STATUS_SIZE, p_notification->len);
+    TEST_ASSERT_EQ(status, p_notification->data[0]);
+    TEST_ASSERT_EQ(expected_seq, uint16_decode(&p_notification->data[1]));
+
+    fake_ble_tx_complete(conn_handle);
+    fake_ble_notifications_clear();
+}
+
+static void no_status_check(void)
+{
+    TEST_ASSERT_EQ(0, fake_ble_notification_count());
+}
+
+static void test_sequence(void)
+{
+    chunk_write(0, ESTC_CHAR_STREAM, 0);
+    chunk_write(0, ESTC_CHAR_STREAM, 1);
+    no_status_check();
+
+    // One status for the gap, the chunks in flight behind it get none
+    chunk_write(0, ESTC_CHAR_STREAM, 3);
+    chunk_write(0, ESTC_CHAR_STREAM, 4);
+    status_check(0, ESTC_CHAR_STREAM, ESTC_STREAM_STATUS_OUT_OF_ORDER, 2);
+
+    chunk_write(0, ESTC_CHAR_STREAM, 2);
+    no_status_check();
+}
+
+static void test_second_link_busy(void)
+{
+    // Another link can neither start nor continue an upload while the first one owns the stream
+    chunk_write(1, ESTC_CHAR_STREAM, 0);
+    status_check(1, ESTC_CHAR_STREAM, ESTC_STREAM_STATUS_BUSY, 0);
+    chunk_write(1, ESTC_CHAR_STREAM, 3);
+    status_check(1, ESTC_CHAR_STREAM, ESTC_STREAM_STATUS_BUSY, 0);
+    chunk_write(1, ESTC_CHAR_ANIM, 0);
+    status_check(1, ESTC_CHAR_ANIM, ESTC_STREAM_STATUS_BUSY, 0);
+
+    // The owner carries on where it was
+    chunk_write(0, ESTC_CHAR_STREAM, 3);
+    no_status_check();
+}
+
+static void test_release_on_disconnect(void)
+{
+    // The owner may switch characteristics by starting over, its old upload is then gone
+    chunk_write(0, ESTC_CHAR_ANIM, 0);
+    no_status_check();
+    chunk_write(0, ESTC_CHAR_STREAM, 4);
+    status_check(0, ESTC_CHAR_STREAM, ESTC_STREAM_STATUS_BUSY, 0);
+
+    disconnect(1);
+    chunk_write(2, ESTC_CHAR_STREAM, 0);
+    status_check(2, ESTC_CHAR_STREAM, ESTC_STREAM_STATUS_BUSY, 0);
+
+    disconnect(0);
+    chunk_write(2, ESTC_CHAR_STREAM, 0);
+    no_status_check();
+    fixture_main_loop_run();
+}
+
+static void test_idle_takeover(void)
+{
+    // Link 2 owns the stream from the last test
+    fake_timer_advance(ESTC_STREAM_IDLE_TIMEOUT_MS - 1);
+    chunk_write(3, ESTC_CHAR_STREAM, 0);
+    status_check(3, ESTC_CHAR_STREAM, ESTC_STREAM_STATUS_BUSY, 0);
+
+    fake_timer_advance(1);
+    chunk_write(3, ESTC_CHAR_STREAM, 0);
+    no_status_check();
+
+    // The idle owner finds the stream taken
+    chunk_write(2, ESTC_CHAR_STREAM, 1);
+    status_check(2, ESTC_CHAR_STREAM, ESTC_STREAM_STATUS_BUSY, 0);
+    chunk_write(3, ESTC_CHAR_STREAM, 1);
+    no_status_check();
+}
+
+static void test_program_write_failed(void)
+{
+    // The erase fails, the upload has to start over
+    fake_flash_fail_next(1);
+    program_write(3, 0, 10, 100);
+    no_status_check();
+    fake_flash_process(UINT32_MAX);
+    status_check(3, ESTC_CHAR_PROGRAM, ESTC_STREAM_STATUS_WRITE_FAILED, 0);
+    TEST_ASSERT(!program_stored(0));
+
+    program_write(3, 0, 10, 100);
+    fake_flash_process(UINT32_MAX);
+    no_status_check();
+    TEST_ASSERT(program_stored(0));
+
+    // All chunks were accepted, the header validating the program fails
+    program_write(3, 1, 20, 100);
+    fake_flash_process(2);
+    fake_flash_fail_next(1);
+    fake_flash_process(UINT32_MAX);
+    status_check(3, ESTC_CHAR_PROGRAM, ESTC_STREAM_STATUS_WRITE_FAILED, 0);
+    TEST_ASSERT(!program_stored(1));
+    fixture_main_loop_run();
+}
+
+static void test_program_erase(void)
+{
+    program_write(3, 1, 20, ESTC_ANIM_STEPS_MAX);
+    fake_flash_process(UINT32_MAX);
+    TEST_ASSERT(program_stored(1));
+
+    program_play(3, 1);
+    TEST_ASSERT(fake_pwm_stream_active());
+
+    // Storing another program leaves the playing one alone
+    program_write(3, 0, 30, 100);
+    fake_flash_process(UINT32_MAX);
+    TEST_ASSERT(!stream_end_wait(2 * HAL_PWM_STREAM_BUFFER_COUNT));
+
+    // Erasing the playing program ends it after the buffers decoded before
+    program_write(3, 1, 40, 100);
+    fixture_main_loop_run();
+    TEST_ASSERT(stream_end_wait(HAL_PWM_STREAM_BUFFER_COUNT + 1));
+    fake_flash_process(UINT32_MAX);
+    no_status_check();
+    TEST_ASSERT(program_stored(1));
+}
+
+static void test_program_takes_stream(void)
+{
+    disconnect(3);
+    chunk_write(2, ESTC_CHAR_STREAM, 0);
+    chunk_write(2, ESTC_CHAR_STREAM, 1);
+    no_status_check();
+
+    // A program played by another link takes the stream from the frame upload
+    program_play(3, 1);
+    status_check(2, ESTC_CHAR_STREAM, ESTC_STREAM_STATUS_BUSY, 0);
+    TEST_ASSERT(fake_pwm_stream_active());
+
+    // The chunks in flight are refused, the upload may start over
+    chunk_write(2, ESTC_CHAR_STREAM, 2);
+    status_check(2, ESTC_CHAR_STREAM, ESTC_STREAM_STATUS_BUSY, 0);
+    chunk_write(2, ESTC_CHAR_STREAM, 0);
+    no_status_check();
+    disconnect(2);
+
+    // A PROGRAM upload only writes flash, it keeps the stream
+    program_write(3, 0, 50, 100);
+    program_play(2, 1);
+    no_status_check();
+    fake_flash_process(UINT32_MAX);
+    fixture_main_loop_run();
+    no_status_check();
+    TEST_ASSERT(program_stored(0));
+}
+
+int main(void)
+{
+    fixture_init(&m_service);
+
+    TEST_RUN(test_sequence);
+    TEST_RUN(test_second_link_busy);
+    TEST_RUN(test_release_on_disconnect);
+    TEST_RUN(test_idle_takeover);
+    TEST_RUN(test_program_write_failed);
+    TEST_RUN(test_program_erase);
+    TEST_RUN(test_program_takes_stream);
+
+    return 0;
+}
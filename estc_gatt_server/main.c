@@ -5,7 +5,8 @@
 #include "nordic_common.h"
 #include "nrf.h"
 #include "app_error.h"
-#include "app_timer.h"
+#include "hal_timer.h"
+#include "app_scheduler.h"
 #include "nrf_pwr_mgmt.h"
 #include "nrf_log.h"
 #include "nrf_log_ctrl.h"
@@ -15,9 +16,21 @@
 #include "pwm_control.h"
 #include "ble_module.h"
 #include "flash_storage.h"
+#include "estc_log.h"
+#include "estc_perf.h"
 
 #define DEAD_BEEF 0xDEADBEEF /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
+#define SCHED_MAX_EVENT_DATA_SIZE ESTC_SCHED_EVENT_DATA_SIZE /**< Maximum size of scheduler events. */
+#define SCHED_QUEUE_SIZE 8                                   /**< Maximum number of events in the scheduler queue. */
+
+/**@brief Boot phase, an initialization step timestamped by the boot sequencer. */
+typedef struct
+{
+    const char *name;
+    void (*init)(void);
+} boot_phase_t;
+
 /**@brief Function for the Timer initialization.
  *
  * @details Initializes the timer module. This creates and starts application timers.
@@ -25,7 +38,7 @@
 static void timers_init(void)
 {
     // Initialize timer module.
-    uint32_t err_code = app_timer_init();
+    uint32_t err_code = hal_timer_init();
     APP_ERROR_CHECK(err_code);
 }
 
@@ -35,13 +48,29 @@ static void application_timers_start(void)
 {
 }
 
+/**@brief Function for initializing the event scheduler.
+ *
+ * @details Work triggered by BLE writes is deferred from the SoftDevice event context to the main loop.
+ */
+static void scheduler_init(void)
+{
+    APP_SCHED_INIT(SCHED_MAX_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+}
+
 /**@brief Function for initializing the nrf log module.
+ *
+ * @details Messages are buffered until the backends are brought up by log_backends_init().
  */
 static void log_init(void)
 {
     uint32_t err_code = NRF_LOG_INIT(NULL);
     APP_ERROR_CHECK(err_code);
+}
 
+/**@brief Function for initializing the log backends, including the USB stack.
+ */
+static void log_backends_init(void)
+{
     NRF_LOG_DEFAULT_BACKENDS_INIT();
 }
 
@@ -56,40 +85,91 @@ static void power_management_init(void)
 
 /**@brief Function for handling the idle state (main loop).
  *
- * @details If there is no pending log operation, then sleep until next the next event occurs.
+ * @details Binary log records are handed to nrf_log first. If there is no pending log operation,
+ *          then sleep until next the next event occurs.
  */
 static void idle_state_handle(void)
 {
-    if (NRF_LOG_PROCESS() == false)
+    bool binary_log_pending = estc_log_flush();
+
+    if (NRF_LOG_PROCESS() == false && !binary_log_pending)
     {
         nrf_pwr_mgmt_run();
     }
     LOG_BACKEND_USB_PROCESS();
 }
 
-/**@brief Application main function.
+/**@brief Boot phases, run in order by boot_run().
+ *
+ * @details Everything up to advertising_start() is needed to accept a connection: the SoftDevice
+ *          (it also starts the LFCLK and with it the RTC used for the timestamps), the restored
+ *          light state for the characteristic values and the BSP for the advertising indication.
+ *          SoftDevice events may arrive as soon as advertising runs, so the deferred phases must
+ *          not be needed to handle them.
  */
-int main(void)
+static const boot_phase_t m_boot_phases[] =
+    {
+        {"timers", timers_init},
+        {"softdevice", ble_stack_init},
+        {"scheduler", scheduler_init},
+        {"pwm", pwm_controller_init},
+        {"pwm playback", pwm_start_playback},
+        {"flash restore", flash_storage_init},
+        {"bsp", buttons_leds_init},
+        {"gap", gap_params_init},
+        {"gatt", gatt_init},
+        {"services", services_init},
+        {"peer manager", peer_manager_init},
+        {"advertising init", advertising_init},
+        {"conn params", conn_params_init},
+        {"advertising start", advertising_start},
+        {"observer start", observer_start},
+        // Deferred until the device is advertising
+        {"log backends", log_backends_init},
+        {"power management", power_management_init},
+        {"flash stats", flash_storage_stats_log},
+};
+
+static uint32_t m_boot_stamps[ARRAY_SIZE(m_boot_phases)]; /**< RTC timestamps taken when each phase completed. */
+
+/**@brief Function for running the boot phases and timestamping them.
+ */
+static void boot_run(void)
 {
-    log_init();
-    timers_init();
-
-    pwm_controller_init();
-    pwm_start_playback();
+    for (uint8_t i = 0; i < ARRAY_SIZE(m_boot_phases); i++)
+    {
+        m_boot_phases[i].init();
+        m_boot_stamps[i] = hal_timer_stamp_get();
+    }
+}
 
-    flash_storage_init();
+/**@brief Function for logging the duration of each boot phase.
+ *
+ * @details The RTC only counts once the SoftDevice has started the LFCLK, earlier phases and the
+ *          clock start-up itself are accounted to the "softdevice" phase.
+ */
+static void boot_report(void)
+{
+    uint32_t previous = m_boot_stamps[0];
 
-    buttons_leds_init();
-    power_management_init();
+    for (uint8_t i = 0; i < ARRAY_SIZE(m_boot_phases); i++)
+    {
+        NRF_LOG_INFO("BOOT: %s took %d us, done at %d us", m_boot_phases[i].name,
+                     hal_timer_stamp_diff_us(m_boot_stamps[i], previous),
+                     hal_timer_stamp_diff_us(m_boot_stamps[i], m_boot_stamps[0]));
+        previous = m_boot_stamps[i];
+    }
+}
 
-    ble_stack_init();
-    gap_params_init();
-    gatt_init();
-    services_init();
-    advertising_init();
-    conn_params_init();
+/**@brief Application main function.
+ */
+int main(void)
+{
+    log_init();
+    estc_perf_init();
 
-    advertising_start();
+    boot_run();
+    boot_report();
 
     NRF_LOG_INFO("ESTC GATT server example started");
     application_timers_start();
@@ -97,6 +177,8 @@ int main(void)
     // Enter main loop.
     for (;;)
     {
+        pwm_process();
+        app_sched_execute();
         idle_state_handle();
     }
 }
\ No newline at end of file
@@ -127,4 +127,69 @@
 
 // </e>
 
+// <q> ESTC_PERF_ENABLED - DWT cycle counter instrumentation of the write path
+// <i> Adds the diagnostics characteristic. Follows the build type, on in debug builds (make DEBUG=1).
+#ifndef ESTC_PERF_ENABLED
+#ifdef DEBUG
+#define ESTC_PERF_ENABLED 1
+#else
+#define ESTC_PERF_ENABLED 0
+#endif
+#endif
+
+// <q> ESTC_BENCH_ENABLED - GATT throughput benchmark characteristics
+// <i> Adds a write sink and a notification source that log throughput per link configuration.
+#ifndef ESTC_BENCH_ENABLED
+#define ESTC_BENCH_ENABLED 0
+#endif
+
+// <o> ESTC_CONN_EVENT_LENGTH - Radio time reserved per connection event, in 1.25 ms units
+// <i> Control traffic fits 7.5 ms. Events are extended beyond it whenever the radio is free.
+#ifndef ESTC_CONN_EVENT_LENGTH
+#define ESTC_CONN_EVENT_LENGTH 6
+#endif
+
+// <o> ESTC_STREAM_CONN_EVENT_LENGTH - Radio time reserved per connection event of the streaming link, in 1.25 ms units
+// <i> One link at a time can own the stream, one link is connected with this reservation so advertising
+// <i> and scanning do not cut its bursts short. 0 connects every link with ESTC_CONN_EVENT_LENGTH.
+#ifndef ESTC_STREAM_CONN_EVENT_LENGTH
+#define ESTC_STREAM_CONN_EVENT_LENGTH 24
+#endif
+#define NRF_SDH_BLE_GAP_EVENT_LENGTH ESTC_CONN_EVENT_LENGTH
+
+// <q> ESTC_ADV_EXTENDED_ENABLED - BLE 5 extended advertising with a light state snapshot
+// <i> Alternates with legacy advertising, so scanners without BLE 5 support still find the light.
+#ifndef ESTC_ADV_EXTENDED_ENABLED
+#define ESTC_ADV_EXTENDED_ENABLED 0
+#endif
+
+// <o> ESTC_ADV_EXTENDED_PHY - PHY of the extended advertising
+// <1=> 1M
+// <4=> Coded
+#ifndef ESTC_ADV_EXTENDED_PHY
+#define ESTC_ADV_EXTENDED_PHY 1
+#endif
+
+// Attribute table of the GAP, GATT, Device Information and ESTC services. Every ESTC characteristic
+// keeps its user description (up to 60 bytes) in SoftDevice memory; with all nine, ESTC_PERF_ENABLED
+// and ESTC_BENCH_ENABLED set, some 50 attributes need an estimated 1.5 kB, over the default 1408.
+// The RAM origin in the linker script moves up by the same 640 bytes, ble_stack_init() logs the
+// exact minimum.
+#define NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE 2048
+
+// <q> ESTC_BOND_REQUEST_ENABLED - Ask every new central to bond as it connects
+// <i> Bonded centrals are always re-encrypted. Without this option only a central that starts
+// <i> pairing itself bonds, the others write without a pairing delay.
+#ifndef ESTC_BOND_REQUEST_ENABLED
+#define ESTC_BOND_REQUEST_ENABLED 0
+#endif
+
+// CRC-32 of the attribute table, see estc_service_db_hash()
+#define CRC32_ENABLED 1
+
+// The scheduler profiler feeds the "max scheduler queue depth" counter
+#if ESTC_PERF_ENABLED
+#define APP_SCHEDULER_WITH_PROFILER 1
+#endif
+
 #endif
@@ -1,57 +1,91 @@
 #include "pwm_control.h"
 
-#include "nrfx_pwm.h"
-#include "nrfx_gpiote.h"
+#include "hal_pwm.h"
 #include <stdlib.h>
 
-#include "app_timer.h"
+#include "hal_timer.h"
+#include "app_util.h"
+#include "spsc_ring.h"
+#include "estc_perf.h"
 
 #include "app_error.h"
 #include "nrf_log.h"
+#include "estc_log.h"
 
 #define PWM_TOP_VALUE 255
 
-#define LED_R_PIN NRF_GPIO_PIN_MAP(0, 8)
-#define LED_G_PIN NRF_GPIO_PIN_MAP(1, 9)
-#define LED_B_PIN NRF_GPIO_PIN_MAP(0, 12)
-
 #define RGB_CHANNEL_R 1
 #define RGB_CHANNEL_G 2
 #define RGB_CHANNEL_B 3
 
-rgb_color_t rgb_current_color = {0, 0, 0};
-bool rgb_enabled = false;
+#define PWM_FADE_STEP_MS 20
+#define PWM_COMMAND_RING_SIZE 8
+#define PWM_STREAM_STEP_MS (HAL_PWM_STREAM_STEP_US / 1000)
 
-static nrfx_pwm_t rgb_instance = NRFX_PWM_INSTANCE(0);
+// Light state, only modified from the main loop
+static rgb_color_t rgb_current_color = {0, 0, 0};
+static bool rgb_enabled = false;
+static uint8_t rgb_brightness = PWM_TOP_VALUE;
 
-static nrf_pwm_values_individual_t pwm_duty_cycles;
-static nrf_pwm_sequence_t const pwm_sequence =
-    {
-        .values.p_individual = &pwm_duty_cycles,
-        .length = NRF_PWM_VALUES_LENGTH(pwm_duty_cycles),
-        .repeats = 0,
-        .end_delay = 0};
+// Set by pwm_start_playback(), the PWM then runs whenever the light is visible
+static bool m_playback_enabled = false;
+
+// Commands from the BLE event context, consumed by pwm_process()
+SPSC_RING_DEF(m_command_ring, pwm_command_t, PWM_COMMAND_RING_SIZE);
+
+// Fade timer ticks, incremented by the timer interrupt and consumed by pwm_process()
+static uint32_t m_fade_ticks;
+static uint32_t m_fade_ticks_done;
+
+static hal_timer_id_t m_fade_timer;
+
+static rgb_color_t fade_from;
+static rgb_color_t fade_to;
+static uint16_t fade_step;
+static uint16_t fade_steps;
+
+// Stream buffer being filled, BLE event context
+static hal_pwm_step_t *mp_stream_buffer;
+static uint16_t m_stream_fill;
+
+// Stream events, set by the PWM interrupt and consumed by pwm_process()
+static uint32_t m_stream_buffers_done;
+static uint32_t m_stream_buffers_done_seen;
+static bool m_stream_ended;
+
+static pwm_stream_space_handler_t m_stream_space_handler;
+
+static void pwm_fade_timer_handler(void *p_context);
+static void pwm_stream_evt_handler(hal_pwm_stream_evt_t evt);
+static void pwm_output_update(void);
 
 void pwm_controller_init(void)
 {
-    nrfx_pwm_config_t pwm_config = NRFX_PWM_DEFAULT_CONFIG;
-    pwm_config.output_pins[0] = NRFX_PWM_PIN_NOT_USED;
-    pwm_config.output_pins[1] = LED_R_PIN | NRFX_PWM_PIN_INVERTED;
-    pwm_config.output_pins[2] = LED_G_PIN | NRFX_PWM_PIN_INVERTED;
-    pwm_config.output_pins[3] = LED_B_PIN | NRFX_PWM_PIN_INVERTED;
-    pwm_config.load_mode = NRF_PWM_LOAD_INDIVIDUAL;
-    pwm_config.top_value = PWM_TOP_VALUE;
+    ret_code_t err_code = hal_timer_create(&m_fade_timer, true, pwm_fade_timer_handler);
+    APP_ERROR_CHECK(err_code);
 
-    nrfx_pwm_init(&rgb_instance, &pwm_config, NULL);
+    hal_pwm_init(PWM_TOP_VALUE, pwm_stream_evt_handler);
 
-    pwm_duty_cycles.channel_1 = rgb_current_color.red;
-    pwm_duty_cycles.channel_2 = rgb_current_color.green;
-    pwm_duty_cycles.channel_3 = rgb_current_color.blue;
+    hal_pwm_duty_set(RGB_CHANNEL_R, rgb_current_color.red);
+    hal_pwm_duty_set(RGB_CHANNEL_G, rgb_current_color.green);
+    hal_pwm_duty_set(RGB_CHANNEL_B, rgb_current_color.blue);
 }
 
 void pwm_start_playback(void)
 {
-    nrfx_pwm_simple_playback(&rgb_instance, &pwm_sequence, 1, NRFX_PWM_FLAG_LOOP);
+    m_playback_enabled = true;
+
+    pwm_output_update();
+}
+
+static uint16_t pwm_duty(uint8_t value, uint8_t brightness)
+{
+    return (uint16_t)((uint32_t)value * brightness / PWM_TOP_VALUE);
+}
+
+static uint16_t pwm_scale(uint8_t value)
+{
+    return pwm_duty(value, rgb_brightness);
 }
 
 static void pwm_update_duty_cycle(uint8_t channel)
@@ -63,50 +97,372 @@ static void pwm_update_duty_cycle(uint8_t channel)
 
     switch (channel)
     {
-    case 1:
-        pwm_duty_cycles.channel_1 = rgb_enabled ? rgb_current_color.red : 0;
+    case RGB_CHANNEL_R:
+        hal_pwm_duty_set(channel, rgb_enabled ? pwm_scale(rgb_current_color.red) : 0);
         break;
-    case 2:
-        pwm_duty_cycles.channel_2 = rgb_enabled ? rgb_current_color.green : 0;
+    case RGB_CHANNEL_G:
+        hal_pwm_duty_set(channel, rgb_enabled ? pwm_scale(rgb_current_color.green) : 0);
         break;
-    case 3:
-        pwm_duty_cycles.channel_3 = rgb_enabled ? rgb_current_color.blue : 0;
+    case RGB_CHANNEL_B:
+        hal_pwm_duty_set(channel, rgb_enabled ? pwm_scale(rgb_current_color.blue) : 0);
         break;
     }
 }
 
-void pwm_set_rgb_color(uint8_t r, uint8_t g, uint8_t b)
+/**
+ * @brief Run the PWM only while the light is visible
+ *
+ * A stopped PWM leaves the (inverted) LED pins at their idle level and releases the
+ * high frequency clock, which dominates the current while the light is dark.
+ */
+static void pwm_output_update(void)
 {
-    NRF_LOG_INFO("PWM CONTROL: Setting RGB color: R=%d, G=%d, B=%d", r, g, b);
+    bool lit = rgb_enabled &&
+               (pwm_scale(rgb_current_color.red) | pwm_scale(rgb_current_color.green) | pwm_scale(rgb_current_color.blue)) != 0;
 
-    rgb_current_color.red = r;
-    rgb_current_color.green = g;
-    rgb_current_color.blue = b;
+    if (lit && m_playback_enabled)
+    {
+        hal_pwm_start();
+    }
+    else
+    {
+        hal_pwm_stop();
+    }
+}
 
-    if (rgb_enabled)
+static void pwm_render(void)
+{
+    if (!rgb_enabled)
+    {
+        hal_pwm_duty_set(RGB_CHANNEL_R, 0);
+        hal_pwm_duty_set(RGB_CHANNEL_G, 0);
+        hal_pwm_duty_set(RGB_CHANNEL_B, 0);
+    }
+    else
     {
         pwm_update_duty_cycle(RGB_CHANNEL_R);
         pwm_update_duty_cycle(RGB_CHANNEL_G);
         pwm_update_duty_cycle(RGB_CHANNEL_B);
     }
+
+    pwm_output_update();
+}
+
+static void pwm_fade_stop(void)
+{
+    if (fade_steps != 0)
+    {
+        hal_timer_stop(m_fade_timer);
+        fade_steps = 0;
+    }
+}
+
+static uint8_t pwm_fade_channel(uint8_t from, uint8_t to)
+{
+    return (uint8_t)(from + ((int32_t)to - from) * fade_step / fade_steps);
+}
+
+static void pwm_fade_timer_handler(void *p_context)
+{
+    // The step itself is rendered from the main loop
+    __atomic_store_n(&m_fade_ticks, m_fade_ticks + 1, __ATOMIC_RELEASE);
+}
+
+static void pwm_fade_step(void)
+{
+    fade_step++;
+
+    rgb_current_color.red = pwm_fade_channel(fade_from.red, fade_to.red);
+    rgb_current_color.green = pwm_fade_channel(fade_from.green, fade_to.green);
+    rgb_current_color.blue = pwm_fade_channel(fade_from.blue, fade_to.blue);
+
+    if (fade_step >= fade_steps)
+    {
+        pwm_fade_stop();
+    }
+
+    pwm_render();
+}
+
+void pwm_set_rgb_color(uint8_t r, uint8_t g, uint8_t b)
+{
+    ESTC_LOG(ESTC_LOG_PWM_SET_COLOR, r, g, b);
+
+    pwm_fade_stop();
+
+    rgb_current_color.red = r;
+    rgb_current_color.green = g;
+    rgb_current_color.blue = b;
+
+    pwm_render();
 }
 
 void pwm_on_rgb(void)
 {
-    NRF_LOG_INFO("PWM CONTROL: RGB ON: R=%d G=%d B=%d", rgb_current_color.red, rgb_current_color.green, rgb_current_color.blue);
+    ESTC_LOG(ESTC_LOG_PWM_ON, rgb_current_color.red, rgb_current_color.green, rgb_current_color.blue);
     rgb_enabled = true;
 
-    pwm_update_duty_cycle(RGB_CHANNEL_R);
-    pwm_update_duty_cycle(RGB_CHANNEL_G);
-    pwm_update_duty_cycle(RGB_CHANNEL_B);
+    pwm_render();
 }
 
 void pwm_off_rgb(void)
 {
-    NRF_LOG_INFO("PWM CONTROL: RGB OFF (saved: R=%d G=%d B=%d)", rgb_current_color.red, rgb_current_color.green, rgb_current_color.blue);
+    ESTC_LOG(ESTC_LOG_PWM_OFF, rgb_current_color.red, rgb_current_color.green, rgb_current_color.blue);
     rgb_enabled = false;
 
-    pwm_duty_cycles.channel_1 = 0;
-    pwm_duty_cycles.channel_2 = 0;
-    pwm_duty_cycles.channel_3 = 0;
-}
\ No newline at end of file
+    pwm_render();
+}
+
+void pwm_set_brightness(uint8_t brightness)
+{
+    ESTC_LOG(ESTC_LOG_PWM_BRIGHTNESS, brightness);
+    rgb_brightness = brightness;
+
+    pwm_render();
+}
+
+void pwm_fade_to_rgb_color(uint8_t r, uint8_t g, uint8_t b, uint16_t duration_ms)
+{
+    uint16_t steps = duration_ms / PWM_FADE_STEP_MS;
+    if (steps == 0)
+    {
+        pwm_set_rgb_color(r, g, b);
+        return;
+    }
+
+    ESTC_LOG(ESTC_LOG_PWM_FADE, r, g, b, duration_ms);
+
+    pwm_fade_stop();
+
+    fade_from = rgb_current_color;
+    fade_to.red = r;
+    fade_to.green = g;
+    fade_to.blue = b;
+    fade_step = 0;
+    fade_steps = steps;
+    m_fade_ticks_done = __atomic_load_n(&m_fade_ticks, __ATOMIC_ACQUIRE);
+
+    ret_code_t err_code = hal_timer_start(m_fade_timer, PWM_FADE_STEP_MS, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+void pwm_apply_light(bool enabled, rgb_color_t color, uint8_t brightness, uint16_t fade_ms)
+{
+    rgb_enabled = enabled;
+    rgb_brightness = brightness;
+
+    if (fade_ms != 0)
+    {
+        pwm_render();
+        pwm_fade_to_rgb_color(color.red, color.green, color.blue, fade_ms);
+        ESTC_PERF_SPAN_END(ESTC_PERF_WRITE_TO_LIGHT);
+        return;
+    }
+
+    pwm_fade_stop();
+    rgb_current_color = color;
+
+    pwm_render();
+    ESTC_PERF_SPAN_END(ESTC_PERF_WRITE_TO_LIGHT);
+}
+
+bool pwm_command_push(pwm_command_t const *p_command)
+{
+    bool pushed = spsc_ring_push(&m_command_ring, p_command);
+
+    ESTC_PERF_MAX(ESTC_PERF_MAX_RENDER_RING, spsc_ring_count(&m_command_ring));
+
+    return pushed;
+}
+
+uint32_t pwm_command_pending(void)
+{
+    return spsc_ring_count(&m_command_ring);
+}
+
+static void pwm_stream_evt_handler(hal_pwm_stream_evt_t evt)
+{
+    switch (evt)
+    {
+    case HAL_PWM_STREAM_EVT_BUFFER_DONE:
+        __atomic_store_n(&m_stream_buffers_done, m_stream_buffers_done + 1, __ATOMIC_RELEASE);
+        break;
+    case HAL_PWM_STREAM_EVT_UNDERRUN:
+        ESTC_PERF_COUNT(ESTC_PERF_CNT_STREAM_UNDERRUNS);
+        break;
+    case HAL_PWM_STREAM_EVT_END:
+        __atomic_store_n(&m_stream_ended, true, __ATOMIC_RELEASE);
+        break;
+    }
+}
+
+static uint16_t pwm_stream_steps(uint16_t duration_ms)
+{
+    uint16_t steps = (duration_ms + PWM_STREAM_STEP_MS / 2) / PWM_STREAM_STEP_MS;
+    return steps != 0 ? steps : 1;
+}
+
+static void pwm_stream_buffer_commit(void)
+{
+    hal_pwm_stream_buffer_commit(m_stream_fill);
+    mp_stream_buffer = NULL;
+    m_stream_fill = 0;
+}
+
+uint32_t pwm_stream_space_get(void)
+{
+    return hal_pwm_stream_buffers_free() * HAL_PWM_STREAM_BUFFER_STEPS - m_stream_fill;
+}
+
+pwm_stream_result_t pwm_stream_write(uint8_t const *p_frames, uint16_t len, uint8_t brightness)
+{
+    uint16_t frames_len = len;
+    uint32_t steps = 0;
+    bool end = false;
+
+    if (len == 0 || len % PWM_STREAM_FRAME_SIZE != 0)
+    {
+        return PWM_STREAM_INVALID;
+    }
+
+    for (uint16_t offset = 0; offset < len; offset += PWM_STREAM_FRAME_SIZE)
+    {
+        uint16_t duration_ms = uint16_decode(&p_frames[offset]);
+        if (duration_ms == 0)
+        {
+            // The end marker must be the last frame
+            if (offset + PWM_STREAM_FRAME_SIZE != len)
+            {
+                return PWM_STREAM_INVALID;
+            }
+            frames_len = offset;
+            end = true;
+            break;
+        }
+        steps += pwm_stream_steps(duration_ms);
+    }
+
+    if (steps > HAL_PWM_STREAM_BUFFER_COUNT * HAL_PWM_STREAM_BUFFER_STEPS)
+    {
+        return PWM_STREAM_INVALID;
+    }
+    if (steps > pwm_stream_space_get())
+    {
+        return PWM_STREAM_NO_SPACE;
+    }
+
+    for (uint16_t offset = 0; offset < frames_len; offset += PWM_STREAM_FRAME_SIZE)
+    {
+        uint8_t const *p_frame = &p_frames[offset];
+        rgb_color_t const color = {p_frame[2], p_frame[3], p_frame[4]};
+
+        pwm_stream_steps_put(color, pwm_stream_steps(uint16_decode(p_frame)), brightness);
+    }
+
+    pwm_stream_flush(end);
+
+    return PWM_STREAM_OK;
+}
+
+void pwm_stream_steps_put(rgb_color_t color, uint16_t steps, uint8_t brightness)
+{
+    hal_pwm_step_t const step = {
+        .duty = {
+            [RGB_CHANNEL_R] = pwm_duty(color.red, brightness),
+            [RGB_CHANNEL_G] = pwm_duty(color.green, brightness),
+            [RGB_CHANNEL_B] = pwm_duty(color.blue, brightness),
+        },
+    };
+
+    for (; steps != 0; steps--)
+    {
+        // A buffer is free, the caller checked the space for every step
+        if (mp_stream_buffer == NULL)
+        {
+            mp_stream_buffer = hal_pwm_stream_buffer_get();
+        }
+
+        mp_stream_buffer[m_stream_fill++] = step;
+
+        if (m_stream_fill == HAL_PWM_STREAM_BUFFER_STEPS)
+        {
+            pwm_stream_buffer_commit();
+        }
+    }
+}
+
+void pwm_stream_flush(bool end)
+{
+    if (m_stream_fill != 0 && (end || hal_pwm_stream_starving()))
+    {
+        pwm_stream_buffer_commit();
+    }
+
+    if (end)
+    {
+        hal_pwm_stream_end();
+    }
+}
+
+void pwm_stream_space_handler_set(pwm_stream_space_handler_t handler)
+{
+    m_stream_space_handler = handler;
+}
+
+void pwm_process(void)
+{
+    pwm_command_t command;
+    bool received = false;
+
+    // Every command carries a complete light state, so only the latest one is rendered
+    while (spsc_ring_pop(&m_command_ring, &command))
+    {
+        received = true;
+    }
+
+    if (received)
+    {
+        ESTC_PERF_START(start);
+        pwm_apply_light(command.state, command.color, command.brightness, command.fade_ms);
+        ESTC_PERF_STOP(ESTC_PERF_PWM_APPLY, start);
+    }
+
+    uint32_t ticks = __atomic_load_n(&m_fade_ticks, __ATOMIC_ACQUIRE);
+    while (m_fade_ticks_done != ticks && fade_steps != 0)
+    {
+        m_fade_ticks_done++;
+        pwm_fade_step();
+    }
+    m_fade_ticks_done = ticks;
+
+    // The light returns to its state once the animation was played
+    if (__atomic_exchange_n(&m_stream_ended, false, __ATOMIC_ACQUIRE))
+    {
+        hal_pwm_stream_stop();
+    }
+
+    uint32_t buffers_done = __atomic_load_n(&m_stream_buffers_done, __ATOMIC_ACQUIRE);
+    if (buffers_done != m_stream_buffers_done_seen)
+    {
+        m_stream_buffers_done_seen = buffers_done;
+        if (m_stream_space_handler != NULL)
+        {
+            m_stream_space_handler();
+        }
+    }
+}
+
+bool pwm_is_rgb_on(void)
+{
+    return rgb_enabled;
+}
+
+rgb_color_t pwm_get_rgb_color(void)
+{
+    return fade_steps != 0 ? fade_to : rgb_current_color;
+}
+
+uint8_t pwm_get_brightness(void)
+{
+    return rgb_brightness;
+}
@@ -11,6 +11,15 @@ typedef struct
     uint8_t blue;
 } rgb_color_t;
 
+// Render command, a complete light state handed from the BLE event context to the render loop
+typedef struct
+{
+    uint8_t state;
+    rgb_color_t color;
+    uint8_t brightness;
+    uint16_t fade_ms;
+} pwm_command_t;
+
 void pwm_controller_init(void);
 void pwm_timer_start(void);
 void pwm_start_playback(void);
@@ -19,4 +28,47 @@ void pwm_set_rgb_color(uint8_t r, uint8_t g, uint8_t b);
 void pwm_on_rgb(void);
 void pwm_off_rgb(void);
 
+void pwm_set_brightness(uint8_t brightness);
+void pwm_fade_to_rgb_color(uint8_t r, uint8_t g, uint8_t b, uint16_t duration_ms);
+void pwm_apply_light(bool enabled, rgb_color_t color, uint8_t brightness, uint16_t fade_ms);
+
+// Animation frame: duration in ms (2, little-endian, 0 ends the animation), red, green, blue.
+// Durations are rounded to steps of HAL_PWM_STREAM_STEP_US.
+#define PWM_STREAM_FRAME_SIZE 5
+
+typedef enum
+{
+    PWM_STREAM_OK,
+    PWM_STREAM_NO_SPACE, // The frames do not fit the free stream buffers yet
+    PWM_STREAM_INVALID,  // Malformed frames or more than the stream buffers can ever hold
+} pwm_stream_result_t;
+
+// Called from the main loop after stream buffers were played and can take new frames
+typedef void (*pwm_stream_space_handler_t)(void);
+
+// Producer side, called from the BLE event context only. Returns false if the ring is full.
+bool pwm_command_push(pwm_command_t const *p_command);
+// Number of commands waiting for pwm_process(), valid from either side
+uint32_t pwm_command_pending(void);
+
+// Stream producer side, called from one context at a time: the BLE event context, or the main
+// loop inside a critical region.
+// Decodes frames straight into the PWM sequence buffers, nothing is written unless all frames
+// fit. Playback starts once the first buffer is full, a partly filled buffer is queued when the
+// stream runs dry or at the end marker.
+pwm_stream_result_t pwm_stream_write(uint8_t const *p_frames, uint16_t len, uint8_t brightness);
+// Append steps of one color, the caller checked pwm_stream_space_get() first
+void pwm_stream_steps_put(rgb_color_t color, uint16_t steps, uint8_t brightness);
+// Queue a partly filled buffer if the stream runs dry, then end the stream if requested
+void pwm_stream_flush(bool end);
+// Free stream space in steps, producer side
+uint32_t pwm_stream_space_get(void);
+void pwm_stream_space_handler_set(pwm_stream_space_handler_t handler);
+// Consumer side, called from the main loop. Applies queued commands and fade steps.
+void pwm_process(void);
+
+bool pwm_is_rgb_on(void);
+rgb_color_t pwm_get_rgb_color(void);
+uint8_t pwm_get_brightness(void);
+
 #endif // PWM_CONTROL_H
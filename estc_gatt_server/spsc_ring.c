@@ -0,0 +1,44 @@
+#include "spsc_ring.h"
+
+#include <string.h>
+
+bool spsc_ring_push(spsc_ring_t *p_ring, void const *p_record)
+{
+    uint32_t head = p_ring->head;
+    uint32_t tail = __atomic_load_n(&p_ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= p_ring->capacity)
+    {
+        return false;
+    }
+
+    memcpy(&p_ring->p_buffer[(head & (p_ring->capacity - 1)) * p_ring->record_size], p_record, p_ring->record_size);
+
+    // Publish the record only after it is completely written
+    __atomic_store_n(&p_ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool spsc_ring_pop(spsc_ring_t *p_ring, void *p_record)
+{
+    uint32_t tail = p_ring->tail;
+    uint32_t head = __atomic_load_n(&p_ring->head, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+    {
+        return false;
+    }
+
+    memcpy(p_record, &p_ring->p_buffer[(tail & (p_ring->capacity - 1)) * p_ring->record_size], p_ring->record_size);
+
+    // Hand the slot back to the producer only after the record is copied out
+    __atomic_store_n(&p_ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+uint32_t spsc_ring_count(spsc_ring_t const *p_ring)
+{
+    return __atomic_load_n(&p_ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&p_ring->tail, __ATOMIC_ACQUIRE);
+}
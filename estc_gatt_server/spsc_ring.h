@@ -0,0 +1,59 @@
+#ifndef SPSC_RING_H__
+#define SPSC_RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Lock-free single-producer, single-consumer ring of fixed-size records
+ *
+ * @details The producer only writes head and the consumer only writes tail. Both indexes run
+ *          freely and are reduced modulo the capacity, which must be a power of two, so a full
+ *          ring holds exactly capacity records. Index updates use release stores and the
+ *          opposite index is read with acquire loads, which orders the record copy against the
+ *          index update on Cortex-M4 as well as on a multi-core host.
+ */
+typedef struct
+{
+    uint8_t *p_buffer;
+    uint16_t record_size;
+    uint16_t capacity;
+    uint32_t head; // Written by the producer only
+    uint32_t tail; // Written by the consumer only
+} spsc_ring_t;
+
+/**
+ * @brief Macro for defining a ring instance
+ * @param _name Name of the instance
+ * @param _record_type Type of the records
+ * @param _capacity Number of records, power of two
+ */
+#define SPSC_RING_DEF(_name, _record_type, _capacity)                                  \
+    _Static_assert(((_capacity) & ((_capacity) - 1)) == 0, "Capacity must be a power of two"); \
+    static _record_type _name##_buffer[_capacity];                                      \
+    static spsc_ring_t _name = {                                                        \
+        .p_buffer = (uint8_t *)_name##_buffer,                                          \
+        .record_size = sizeof(_record_type),                                            \
+        .capacity = (_capacity),                                                        \
+        .head = 0,                                                                      \
+        .tail = 0,                                                                      \
+    }
+
+/**
+ * @brief Copy a record into the ring, producer side
+ * @return false if the ring is full
+ */
+bool spsc_ring_push(spsc_ring_t *p_ring, void const *p_record);
+
+/**
+ * @brief Copy the oldest record out of the ring, consumer side
+ * @return false if the ring is empty
+ */
+bool spsc_ring_pop(spsc_ring_t *p_ring, void *p_record);
+
+/**
+ * @brief Number of records currently in the ring, valid from either side
+ */
+uint32_t spsc_ring_count(spsc_ring_t const *p_ring);
+
+#endif // SPSC_RING_H__
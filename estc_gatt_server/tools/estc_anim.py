@@ -0,0 +1,489 @@
+#!/usr/bin/env python3
+"""Encode light shows into ESTC compressed animations.
+
+A show is a JSON list of frames [duration_ms, r, g, b], the frame format of the STREAM
+characteristic (see pwm_control.h). It is played in steps of 10 ms and encoded into the byte code
+of estc_anim.h: palette holds, linear ramps, delta ramps and loops. A reference decoder mirrors
+estc_anim.c, every encoding is decoded again and compared step by step with the show.
+
+Usage:
+  estc_anim.py [-t TOLERANCE] encode [--chunk SIZE [--program SLOT]] SHOW.json
+      print the animation as hex, or as ANIMATION characteristic writes with --chunk,
+      or as PROGRAM characteristic writes storing it in a flash slot with --program
+  estc_anim.py [-t TOLERANCE] selftest [SHOW.json ...]
+      round trip the built-in sample shows and the given ones, report the compression ratio
+  estc_anim.py vectors
+      print the test vectors of host/tests/test_anim.c as a C header
+"""
+
+import argparse
+import colorsys
+import json
+import math
+import random
+import struct
+import sys
+import zlib
+
+STEP_MS = 10
+FRAME_SIZE = 5
+FRAME_DURATION_MAX = 0xFFFF
+
+# estc_anim.h
+OP_HOLD_PALETTE = 0x00
+OP_HOLD_RGB = 0x10
+OP_RAMP_PALETTE = 0x20
+OP_RAMP_RGB = 0x30
+OP_RAMP_DELTA = 0x40
+OP_HOLD = 0x41
+OP_LOOP = 0x50
+OP_END = 0xFF
+PALETTE_SIZE = 16
+STEPS_MAX = 0xFFFF
+LOOP_COUNT_MAX = 0xFFFF
+LOOP_BODY_MAX = 128
+WINDOW_SIZE = 512
+
+STREAM_HEADER_SIZE = 2
+# Opcode, r, g, b and a varint of 3 bytes, the window keeps a split instruction besides the loop body
+INSN_SIZE_MAX = 7
+CHUNK_MAX = WINDOW_SIZE - LOOP_BODY_MAX - (INSN_SIZE_MAX - 1)
+
+# flash_storage.h
+PROGRAM_COUNT = 4
+PROGRAM_SIZE_MAX = 0x1000 - 4
+
+
+def show_steps(frames):
+    """Expand frames into one color per step, rounded like pwm_stream_write()."""
+    steps = []
+    for duration_ms, r, g, b in frames:
+        steps += [(r, g, b)] * max((duration_ms + STEP_MS // 2) // STEP_MS, 1)
+    return steps
+
+
+def frames_size(steps):
+    """Size of the show as STREAM frames, equal steps merged into one frame."""
+    frames = 0
+    run = 0
+    for i, color in enumerate(steps):
+        if i == 0 or color != steps[i - 1] or (run + 1) * STEP_MS > FRAME_DURATION_MAX:
+            frames += 1
+            run = 0
+        run += 1
+    return (frames + 1) * FRAME_SIZE  # with the end marker
+
+
+def interpolate(start, end, step, steps):
+    # Rounded half up, the numerator is never negative
+    return (2 * steps * start + 2 * step * (end - start) + steps) // (2 * steps)
+
+
+def ramp_color(start, end, step, steps):
+    return tuple(interpolate(s, e, step, steps) for s, e in zip(start, end))
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        out.append(byte | (0x80 if value else 0))
+        if not value:
+            return bytes(out)
+
+
+def close(a, b, tolerance):
+    return all(abs(x - y) <= tolerance for x, y in zip(a, b))
+
+
+class Encoder:
+    def __init__(self, tolerance):
+        self.tolerance = tolerance
+        self.color = (0, 0, 0)
+        self.palette = [None] * PALETTE_SIZE
+        self.lru = list(range(PALETTE_SIZE))
+
+    def palette_use(self, color):
+        """Return (index, defined) for a color, storing it in the least recently used slot."""
+        if color in self.palette:
+            index, defined = self.palette.index(color), False
+        else:
+            index, defined = self.lru[0], True
+            self.palette[index] = color
+        self.lru.remove(index)
+        self.lru.append(index)
+        return index, defined
+
+    def ramp_fits(self, start, steps, i, n):
+        end = steps[i + n - 1]
+        # Most lengths already fail at one of the sample points
+        for k in (n // 2, n // 4, 3 * n // 4):
+            if not close(ramp_color(start, end, k + 1, n), steps[i + k], self.tolerance):
+                return False
+        return all(close(ramp_color(start, end, k + 1, n), steps[i + k], self.tolerance) for k in range(n))
+
+    def monotonic_len(self, start, steps, i):
+        """Number of steps from i every channel moves in one direction, no ramp can be longer."""
+        low = high = start
+        up = down = (True, True, True)
+        n = 0
+        while i + n < len(steps) and n < STEPS_MAX:
+            color = steps[i + n]
+            up = tuple(u and c >= h - 2 * self.tolerance for u, c, h in zip(up, color, high))
+            down = tuple(d and c <= lo + 2 * self.tolerance for d, c, lo in zip(down, color, low))
+            if not all(u or d for u, d in zip(up, down)):
+                break
+            high = tuple(map(max, high, color))
+            low = tuple(map(min, low, color))
+            n += 1
+        return n
+
+    def ramp_len(self, start, steps, i):
+        """Longest ramp from start matching steps[i:]."""
+        for n in range(self.monotonic_len(start, steps, i), 1, -1):
+            if self.ramp_fits(start, steps, i, n):
+                return n
+        return 0
+
+    def hold_len(self, steps, i):
+        n = 1
+        while i + n < len(steps) and n < STEPS_MAX and close(steps[i + n], steps[i], self.tolerance):
+            n += 1
+        return n
+
+    def hold_split(self, steps, i, hold):
+        """Find a ramp starting inside the hold at i, the first steps of a slow ramp stay within
+        the tolerance of its start color. Returns (ramp start, ramp end) or None."""
+        color = steps[i]
+        j = i + hold
+        for end in range(j + self.monotonic_len(color, steps, j), j + 1, -1):
+            delta = max(abs(a - b) for a, b in zip(steps[end - 1], color))
+            if delta <= self.tolerance:
+                continue
+            # Step k of an n step ramp leaves the tolerance once k >= n * (2 * tolerance + 1) / (2 * delta)
+            share = (2 * self.tolerance + 1) / (2 * delta)
+            estimate = round((j + 1 - share * end) / (1 - share)) if share < 1 else j
+            for start in range(max(estimate - 2, i + 1), min(estimate + 2, j) + 1):
+                if end - start <= STEPS_MAX and self.ramp_fits(color, steps, start, end - start):
+                    return start, end
+        return None
+
+    def hold(self, color, n):
+        if color == self.color:
+            return bytes([OP_HOLD]) + varint(n)
+        self.color = color
+        index, defined = self.palette_use(color)
+        if defined:
+            return bytes([OP_HOLD_RGB | index, *color]) + varint(n)
+        return bytes([OP_HOLD_PALETTE | index]) + varint(n)
+
+    def ramp(self, color, n):
+        delta = [e - s for s, e in zip(self.color, color)]
+        self.color = color
+        if color in self.palette:
+            return bytes([OP_RAMP_PALETTE | self.palette_use(color)[0]]) + varint(n)
+        if all(-128 <= d <= 127 for d in delta):
+            return bytes([OP_RAMP_DELTA]) + struct.pack('<3b', *delta) + varint(n)
+        return bytes([OP_RAMP_RGB | self.palette_use(color)[0], *color]) + varint(n)
+
+    def instructions(self, steps):
+        insns = []
+        i = 0
+        while i < len(steps):
+            hold = self.hold_len(steps, i)
+            ramp = self.ramp_len(self.color, steps, i)
+            if ramp > hold:
+                insns.append(self.ramp(steps[i + ramp - 1], ramp))
+                i += ramp
+                continue
+
+            split = self.hold_split(steps, i, hold)
+            if split is not None and split[1] > i + hold + self.ramp_len(steps[i], steps, i + hold):
+                start, end = split
+                insns.append(self.hold(steps[i], start - i))
+                insns.append(self.ramp(steps[end - 1], end - start))
+                i = end
+            else:
+                insns.append(self.hold(steps[i], hold))
+                i += hold
+        return insns
+
+
+def loop_insn(body_len, count):
+    return bytes([OP_LOOP]) + varint(body_len) + varint(count)
+
+
+def fold_loops(insns):
+    """Replace instruction sequences repeated right after each other by a loop."""
+    out = []
+    i = 0
+    while i < len(insns):
+        best = None
+        body_len = 0
+        for m in range(1, len(insns) - i + 1):
+            body_len += len(insns[i + m - 1])
+            if body_len > LOOP_BODY_MAX:
+                break
+            body = insns[i:i + m]
+            count = 0
+            while count < LOOP_COUNT_MAX and insns[i + m * (count + 1):i + m * (count + 2)] == body:
+                count += 1
+            saved = body_len * count - len(loop_insn(body_len, count))
+            if count and saved > 0 and (best is None or saved > best[0]):
+                best = (saved, m, count, body_len)
+        if best is None:
+            out.append(insns[i])
+            i += 1
+            continue
+        _, m, count, body_len = best
+        out += insns[i:i + m] + [loop_insn(body_len, count)]
+        i += m * (count + 1)
+    return out
+
+
+def encode(steps, tolerance=0):
+    return b''.join(fold_loops(Encoder(tolerance).instructions(steps))) + bytes([OP_END])
+
+
+def read_varint(data, pos):
+    value = 0
+    for i in range(3):
+        byte = data[pos + i]
+        value |= (byte & 0x7F) << (7 * i)
+        if not byte & 0x80:
+            return value, pos + i + 1
+    raise ValueError('overlong varint at byte %d' % pos)
+
+
+def decode(data):
+    """Reference decoder, mirrors estc_anim.c. Returns one color per step."""
+    color = (0, 0, 0)
+    palette = [(0, 0, 0)] * PALETTE_SIZE
+    out = []
+    pos = 0
+    loop = None  # [start, end, resume, left]
+    while True:
+        if loop and pos == loop[1]:
+            loop[3] -= 1
+            pos = loop[0] if loop[3] else loop[2]
+            if not loop[3]:
+                loop = None
+            continue
+        insn_pos = pos
+        op = data[pos]
+        pos += 1
+        group = op & 0xF0 if op < OP_RAMP_DELTA else op
+        index = op & 0x0F
+        if group == OP_END:
+            return out
+        if group == OP_LOOP:
+            body_len, pos = read_varint(data, pos)
+            count, pos = read_varint(data, pos)
+            if loop or not 1 <= body_len <= min(LOOP_BODY_MAX, insn_pos) or not 1 <= count <= LOOP_COUNT_MAX:
+                raise ValueError('bad loop at byte %d' % insn_pos)
+            loop = [insn_pos - body_len, insn_pos, pos, count]
+            pos = insn_pos - body_len
+            continue
+        if group in (OP_HOLD_RGB, OP_RAMP_RGB, OP_RAMP_DELTA):
+            rgb = tuple(data[pos:pos + 3])
+            pos += 3
+        if group == OP_HOLD_PALETTE or group == OP_RAMP_PALETTE:
+            target = palette[index]
+        elif group == OP_HOLD_RGB or group == OP_RAMP_RGB:
+            palette[index] = target = rgb
+        elif group == OP_RAMP_DELTA:
+            target = tuple(min(max(c + d, 0), 255) for c, d in zip(color, struct.unpack('<3b', bytes(rgb))))
+        elif group == OP_HOLD:
+            target = color
+        else:
+            raise ValueError('unknown opcode 0x%02x at byte %d' % (op, insn_pos))
+        steps, pos = read_varint(data, pos)
+        if not 1 <= steps <= STEPS_MAX:
+            raise ValueError('bad step count at byte %d' % insn_pos)
+        if group in (OP_RAMP_PALETTE, OP_RAMP_RGB, OP_RAMP_DELTA):
+            out += [ramp_color(color, target, k, steps) for k in range(1, steps + 1)]
+        else:
+            out += [target] * steps
+        color = target
+
+
+def chunks(data, size, header=b''):
+    """ANIMATION or PROGRAM characteristic writes: sequence number, then up to size - 2 bytes."""
+    data = header + data
+    payload = size - STREAM_HEADER_SIZE
+    return [struct.pack('<H', seq) + data[offset:offset + payload]
+            for seq, offset in enumerate(range(0, len(data), payload))]
+
+
+def ramp_frames(start, end, duration_ms):
+    """Frames of a linear ramp as a show generator would write them, rounded to the nearest."""
+    n = duration_ms // STEP_MS
+    return [[STEP_MS] + [math.floor(s + (e - s) * (k + 1) / n + 0.5) for s, e in zip(start, end)] for k in range(n)]
+
+
+def sample_shows():
+    shows = {}
+
+    frames = []
+    for _ in range(30):
+        frames += ramp_frames((0, 0, 0), (0, 80, 255), 1500) + ramp_frames((0, 80, 255), (0, 0, 0), 1500)
+        frames.append([400, 0, 0, 0])
+    shows['breathe'] = frames
+
+    frames = []
+    for _ in range(40):
+        for color in ((255, 0, 0), (0, 0, 255)):
+            frames += [[50, *color], [50, 0, 0, 0]] * 3 + [[100, 0, 0, 0]]
+    shows['police'] = frames
+
+    hues = [tuple(round(c * 255) for c in colorsys.hsv_to_rgb(h / 6, 1, 1)) for h in range(7)]
+    frames = []
+    for _ in range(10):
+        for start, end in zip(hues, hues[1:]):
+            frames += ramp_frames(start, end, 1000)
+    shows['rainbow'] = frames
+
+    frames = [[60000, 0, 0, 0]]
+    for start, end in (((0, 0, 0), (40, 0, 10)), ((40, 0, 10), (255, 90, 0)), ((255, 90, 0), (255, 220, 160))):
+        frames += ramp_frames(start, end, 120000)
+    shows['sunrise'] = frames + [[60000, 255, 220, 160]]
+
+    rnd = random.Random(1)
+    frames = []
+    for _ in range(600):
+        level = rnd.uniform(0.55, 1.0)
+        frames.append([rnd.choice((30, 40, 60, 80)), round(255 * level), round(120 * level ** 2), round(20 * level ** 3)])
+    shows['candle'] = frames
+
+    frames = []
+    for i in range(100):
+        level = round(255 * (0.5 + 0.5 * math.sin(i / 4)))
+        frames += [[100, level, level, level]]
+    shows['sine'] = frames
+
+    return shows
+
+
+def window_show():
+    """Holds of random colors, then a pattern repeated so often that it is encoded as a loop whose
+    body straddles the end of the first decoder window. The stream buffers take the steps of the
+    first few holds only, so the window fills up before the loop is decoded."""
+    pattern = ramp_frames((0, 0, 0), (255, 40, 0), 200) + [[70, 255, 40, 0]]
+    pattern += ramp_frames((255, 40, 0), (0, 90, 255), 150) + [[30, 0, 0, 0], [30, 0, 90, 255]]
+    pattern += ramp_frames((0, 90, 255), (0, 0, 0), 100) + [[120, 0, 0, 0]]
+    for count in range(WINDOW_SIZE // 5, 0, -1):
+        rnd = random.Random(count)
+        frames = [[16 * STEP_MS, rnd.randrange(256), rnd.randrange(256), rnd.randrange(256)] for _ in range(count)]
+        frames += pattern * 6
+        insns = fold_loops(Encoder(0).instructions(show_steps(frames)))
+        pos = 0
+        for insn in insns:
+            if insn[0] == OP_LOOP:
+                body_len = read_varint(insn, 1)[0]
+                if pos - body_len < WINDOW_SIZE < pos:
+                    return frames
+                break
+            pos += len(insn)
+    sys.exit('no loop straddles the window')
+
+
+def vectors_print():
+    """C header of encoded shows with the step count and CRC-32 of the r, g, b bytes of their steps."""
+    shows = sample_shows()
+    shows = {'breathe': shows['breathe'], 'police': shows['police'], 'rainbow': shows['rainbow'],
+             'window': window_show()}
+    print('// Generated by tools/estc_anim.py vectors, do not edit')
+    print('#ifndef ANIM_VECTORS_H__')
+    print('#define ANIM_VECTORS_H__')
+    print()
+    print('#include <stdint.h>')
+    print()
+    print('typedef struct')
+    print('{')
+    print('    char const *p_name;')
+    print('    uint8_t const *p_data;')
+    print('    uint16_t len;')
+    print('    uint32_t steps;')
+    print('    uint32_t crc; // CRC-32 of the r, g, b bytes of the steps')
+    print('} anim_vector_t;')
+    for name, frames in shows.items():
+        data = encode(show_steps(frames))
+        print()
+        print('static uint8_t const m_anim_%s[] = {' % name)
+        for offset in range(0, len(data), 12):
+            print('    ' + ' '.join('0x%02x,' % b for b in data[offset:offset + 12]))
+        print('};')
+    print()
+    print('static anim_vector_t const m_anim_vectors[] = {')
+    for name, frames in shows.items():
+        steps = show_steps(frames)
+        crc = zlib.crc32(bytes(c for step in steps for c in step))
+        print('    {"%s", m_anim_%s, sizeof(m_anim_%s), %d, 0x%08x},' % (name, name, name, len(steps), crc))
+    print('};')
+    print()
+    print('#endif // ANIM_VECTORS_H__')
+
+
+def round_trip(name, frames, tolerance):
+    steps = show_steps(frames)
+    data = encode(steps, tolerance)
+    decoded = decode(data)
+    if len(decoded) != len(steps) or not all(close(a, b, tolerance) for a, b in zip(decoded, steps)):
+        sys.exit('%s: round trip mismatch' % name)
+    raw = frames_size(steps)
+    print('%-12s %7d %9d %9d %8.1f' % (name, len(steps), raw, len(data), raw / len(data)))
+    return raw, len(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-t', '--tolerance', type=int, default=0,
+                        help='largest channel error a hold or ramp may make, 0 is lossless')
+    sub = parser.add_subparsers(dest='command', required=True)
+    p = sub.add_parser('encode')
+    p.add_argument('--chunk', type=int, help='split into writes of at most CHUNK bytes, ATT MTU - 3, 244 for 247')
+    p.add_argument('--program', type=int, help='store the animation in this flash program slot')
+    p.add_argument('show')
+    p = sub.add_parser('selftest')
+    p.add_argument('shows', nargs='*')
+    sub.add_parser('vectors')
+    args = parser.parse_args()
+
+    if args.command == 'vectors':
+        vectors_print()
+        return
+
+    if args.command == 'encode':
+        with open(args.show) as f:
+            data = encode(show_steps(json.load(f)), args.tolerance)
+        if args.chunk is None:
+            print(data.hex())
+            return
+        if not STREAM_HEADER_SIZE < args.chunk <= STREAM_HEADER_SIZE + CHUNK_MAX:
+            sys.exit('chunk must be %d..%d bytes' % (STREAM_HEADER_SIZE + 1, STREAM_HEADER_SIZE + CHUNK_MAX))
+        header = b''
+        if args.program is not None:
+            if not 0 <= args.program < PROGRAM_COUNT or len(data) > PROGRAM_SIZE_MAX:
+                sys.exit('program slot must be 0..%d, programs up to %d bytes' % (PROGRAM_COUNT - 1, PROGRAM_SIZE_MAX))
+            header = struct.pack('<BH', args.program, len(data))
+        for chunk in chunks(data, args.chunk, header):
+            print(chunk.hex())
+        return
+
+    shows = sample_shows()
+    for path in args.shows:
+        with open(path) as f:
+            shows[path] = json.load(f)
+
+    print('%-12s %7s %9s %9s %8s' % ('show', 'steps', 'frames B', 'anim B', 'ratio'))
+    total_raw = total_anim = 0
+    for name, frames in shows.items():
+        raw, anim = round_trip(name, frames, args.tolerance)
+        total_raw += raw
+        total_anim += anim
+    print('%-12s %7s %9d %9d %8.1f' % ('total', '', total_raw, total_anim, total_raw / total_anim))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Build ESTC group command advertisements.
+
+Prints the manufacturer specific data AD structure of a group command (see estc_group.h) as hex,
+ready for an advertiser such as nRF Connect or a bench script feeding simulated reports. The
+command stream uses the estc_command.h opcodes. The MAC is computed with the openssl command line
+tool, so no Python crypto package is needed.
+
+Usage: estc_group_packet.py [-g GROUP] [-k KEYHEX] SEQ COMMANDHEX
+Example, set every light of group 1 to red: estc_group_packet.py 1 01ff0000
+"""
+
+import argparse
+import struct
+import subprocess
+import sys
+
+COMPANY_ID = 0x0059
+MAGIC = 0xEC
+AD_TYPE_MANUFACTURER_SPECIFIC_DATA = 0xFF
+MAC_SIZE = 4
+CMD_MAX_SIZE = 17
+BLOCK_SIZE = 16
+
+# Default ESTC_GROUP_KEY of estc_group.h
+DEFAULT_KEY = '455354432d67726f75702d6b65793031'
+
+
+def cbc_mac(key, message):
+    message += bytes(-len(message) % BLOCK_SIZE)
+    out = subprocess.run(['openssl', 'enc', '-aes-128-cbc', '-nopad', '-K', key.hex(), '-iv', '00' * BLOCK_SIZE],
+                         input=message, stdout=subprocess.PIPE, check=True).stdout
+    return out[-BLOCK_SIZE:]
+
+
+def build(group, seq, commands, key):
+    header = struct.pack('<BI', group, seq)
+    mac = cbc_mac(key, bytes([len(commands)]) + header + commands)[:MAC_SIZE]
+    data = struct.pack('<HB', COMPANY_ID, MAGIC) + header + commands + mac
+    return bytes([len(data) + 1, AD_TYPE_MANUFACTURER_SPECIFIC_DATA]) + data
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-g', '--group', type=lambda v: int(v, 0), default=1, help='group, 0xff for all lights')
+    parser.add_argument('-k', '--key', default=DEFAULT_KEY, help='group key, 32 hex digits')
+    parser.add_argument('seq', type=lambda v: int(v, 0), help='sequence number, larger than any sent before; lights keep the last one across reboots')
+    parser.add_argument('commands', help='command stream as hex')
+    args = parser.parse_args()
+
+    commands = bytes.fromhex(args.commands)
+    key = bytes.fromhex(args.key)
+    if not 1 <= len(commands) <= CMD_MAX_SIZE:
+        sys.exit('command stream must be 1..%d bytes' % CMD_MAX_SIZE)
+    if len(key) != BLOCK_SIZE:
+        sys.exit('key must be %d bytes' % BLOCK_SIZE)
+
+    print(build(args.group, args.seq, commands, key).hex())
+
+
+if __name__ == '__main__':
+    main()
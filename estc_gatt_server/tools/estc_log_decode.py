@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Decode ESTC binary log records back into text.
+
+The firmware dumps binary records with NRF_LOG_RAW_HEXDUMP_INFO(); every other log line is
+passed through unchanged. The message formats are read from the ESTC_LOG_MESSAGES table in
+estc_log.h, so the header must match the flashed firmware.
+
+Usage: estc_log_decode.py [-H path/to/estc_log.h] [logfile]   (reads stdin by default)
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+MAGIC = 0xE5
+ENTRY_RE = re.compile(r'X\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+HEXDUMP_RE = re.compile(r'^\s*((?:[0-9a-fA-F]{2} +)+)\s*\|')
+SPEC_RE = re.compile(r'%[-+ #0]*\d*(?:\.\d+)?[hl]*([diuxXcs%])')
+
+
+def load_formats(header_path):
+    with open(header_path) as f:
+        text = f.read()
+    table = text[text.index('#define ESTC_LOG_MESSAGES'):]
+    table = table[:table.index('\n\n')]
+    return [fmt for _, fmt in ENTRY_RE.findall(table)]
+
+
+def render(fmt, args):
+    args = iter(args)
+
+    def substitute(match):
+        conv = match.group(1)
+        if conv == '%':
+            return '%'
+        value = next(args, 0)
+        if conv in 'di':
+            value = struct.unpack('<i', struct.pack('<I', value))[0]
+        if conv == 'c':
+            return chr(value & 0xFF)
+        if conv == 's':
+            return '<str@0x%x>' % value
+        return ('%' + conv.replace('u', 'd')) % value
+
+    return SPEC_RE.sub(substitute, fmt)
+
+
+class Decoder:
+    def __init__(self, formats):
+        self.formats = formats
+        self.pending = bytearray()
+
+    def feed(self, data):
+        self.pending += data
+        lines = []
+        while len(self.pending) >= 4:
+            header, = struct.unpack_from('<I', self.pending)
+            if header >> 24 != MAGIC:
+                del self.pending[0]  # Out of sync, e.g. a dump line was lost
+                continue
+            msg_id = header & 0xFFFF
+            nargs = (header >> 16) & 0xFF
+            size = 4 * (nargs + 1)
+            if len(self.pending) < size:
+                break
+            args = struct.unpack_from('<%dI' % nargs, self.pending, 4)
+            del self.pending[:size]
+            if msg_id < len(self.formats):
+                lines.append(render(self.formats[msg_id], args))
+            else:
+                lines.append('<unknown message %d> %s' % (msg_id, ' '.join('0x%x' % a for a in args)))
+        return lines
+
+
+def main():
+    default_header = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'estc_log.h')
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-H', '--header', default=default_header, help='path to estc_log.h')
+    parser.add_argument('logfile', nargs='?', help='captured log, stdin if omitted')
+    options = parser.parse_args()
+
+    decoder = Decoder(load_formats(options.header))
+    source = open(options.logfile, errors='replace') if options.logfile else sys.stdin
+
+    for line in source:
+        match = HEXDUMP_RE.match(line)
+        if match:
+            for text in decoder.feed(bytes.fromhex(match.group(1))):
+                print(text)
+        else:
+            sys.stdout.write(line)
+
+
+if __name__ == '__main__':
+    main()